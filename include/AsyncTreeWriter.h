@@ -0,0 +1,165 @@
+/*
+	AsyncTreeWriter
+	Template class which moves the filling (serialization and compression) of an output tree or ntuple off of the event
+	loop. The event loop hands finished events to a bounded single-producer/single-consumer ring of event slots, and a writer
+	thread takes them out in order and fills the EventSink (see EventIO). Events are swapped in and out of the slots rather than copied, so the object
+	passed to Push is left holding stale data and must be reset by the caller before reuse (the event loops already do this).
+	If ImplicitMT is enabled, ROOT compresses the baskets flushed by the writer thread in parallel as well.
+
+	With a queue size of 0 the sink is filled directly by Push, exactly like calling Fill in the loop. Finish must be called
+	before the sink is closed, and Drain before a checkpoint of the sink is saved. Queue depth and the time the event loop spent waiting on a full queue are reported by Report.
+*/
+#ifndef ASYNCTREEWRITER_H
+#define ASYNCTREEWRITER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <TROOT.h>
+#include "EventIO.h"
+#include "StageTracer.h"
+
+struct WriterStats
+{
+	long long events = 0;
+	int queue_size = 0;
+	int max_depth = 0;
+	double mean_depth = 0.0;
+	double stall_time = 0.0; //seconds the event loop waited on a full queue
+	double fill_time = 0.0; //seconds spent in Fill
+};
+
+template<typename T>
+class AsyncTreeWriter
+{
+public:
+	AsyncTreeWriter(EventSink<T>* outsink, int queue_size) :
+		sink(outsink), target(outsink->GetObject()), slots(queue_size > 0 ? queue_size : 0), head(0), tail(0), filled(0), done(false), depth_sum(0)
+	{
+		stats.queue_size = slots.size();
+		if(slots.size() > 0)
+		{
+			ROOT::EnableThreadSafety();
+			worker = std::thread(&AsyncTreeWriter<T>::Worker, this);
+		}
+	}
+
+	~AsyncTreeWriter()
+	{
+		Finish();
+	}
+
+	void Push(T& object)
+	{
+		ANASEN_TRACE_ACCUMULATE("AsyncTreeWriter/push");
+		if(slots.size() == 0)
+		{
+			std::swap(*target, object);
+			auto start = std::chrono::steady_clock::now();
+			sink->Fill();
+			stats.fill_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			stats.events++;
+			return;
+		}
+
+		size_t last = tail.load(std::memory_order_relaxed);
+		size_t depth = last - head.load(std::memory_order_acquire);
+		if(depth == slots.size())
+		{
+			auto start = std::chrono::steady_clock::now();
+			while(last - head.load(std::memory_order_acquire) == slots.size())
+				std::this_thread::yield();
+			stats.stall_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		std::swap(slots[last % slots.size()], object);
+		tail.store(last + 1, std::memory_order_release);
+
+		stats.events++;
+		depth_sum += depth + 1;
+		if((int)depth + 1 > stats.max_depth)
+			stats.max_depth = depth + 1;
+	}
+
+	//Waits for the writer thread to fill every queued event, leaving it running
+	void Drain()
+	{
+		size_t last = tail.load(std::memory_order_relaxed);
+		while(filled.load(std::memory_order_acquire) != last)
+			std::this_thread::yield();
+	}
+
+	//Waits for the writer thread to fill every queued event
+	void Finish()
+	{
+		ANASEN_TRACE_SCOPE("AsyncTreeWriter/finish");
+		done.store(true, std::memory_order_release);
+		if(worker.joinable())
+		{
+			worker.join();
+			stats.fill_time += worker_fill_time;
+		}
+	}
+
+	const WriterStats& Report()
+	{
+		if(stats.events > 0)
+			stats.mean_depth = ((double)depth_sum)/stats.events;
+		std::cout<<"Output writer for "<<sink->GetName()<<": "<<stats.events<<" events filled in "<<stats.fill_time<<" s";
+		if(stats.queue_size > 0)
+		{
+			std::cout<<", queue depth mean "<<stats.mean_depth<<" max "<<stats.max_depth<<" of "<<stats.queue_size;
+			std::cout<<", event loop stalled "<<stats.stall_time<<" s";
+		}
+		std::cout<<std::endl;
+		return stats;
+	}
+
+private:
+	void Worker()
+	{
+		int idle = 0;
+		while(true)
+		{
+			size_t first = head.load(std::memory_order_relaxed);
+			if(first == tail.load(std::memory_order_acquire))
+			{
+				//Done is set after the last Push, so the tail must be checked again before stopping
+				if(done.load(std::memory_order_acquire) && first == tail.load(std::memory_order_acquire))
+					break;
+				if(++idle < 64)
+					std::this_thread::yield();
+				else
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				continue;
+			}
+			idle = 0;
+
+			ANASEN_TRACE_ACCUMULATE("AsyncTreeWriter/fill");
+			std::swap(*target, slots[first % slots.size()]);
+			head.store(first + 1, std::memory_order_release);
+			auto start = std::chrono::steady_clock::now();
+			sink->Fill();
+			worker_fill_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			filled.store(first + 1, std::memory_order_release);
+		}
+	}
+
+	EventSink<T>* sink;
+	T* target; //object written by the sink
+	std::vector<T> slots;
+	std::atomic<size_t> head, tail;
+	std::atomic<size_t> filled; //events the writer thread has finished filling
+	std::atomic<bool> done;
+	std::thread worker;
+
+	WriterStats stats;
+	long long depth_sum;
+	double worker_fill_time = 0.0;
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+	CalibrationBundle
+	Class which packs the channel map and the results of every calibration stage into a single versioned binary file, so
+	that a set of calibrations is always used together. The bundle is memory-mapped when loaded; the maps are stored as dense
+	arrays indexed by global channel, so nothing needs to be parsed at startup, and every process reading the same bundle
+	sees the same snapshot.
+
+	File layout (native byte order, checked on load):
+		BundleHeader: magic, schema version, number of channels, number of sections, creation time, checksum of the rest of the file
+		BundleSection x nsections: stage, provenance (source file, its checksum and modification time, number of channels set), data location
+		data: ChannelData[nchannels] for the channel map, double[nchannels] for the zero offsets, and (intercept, slope)
+		pairs double[2*nchannels] for the gain-matching and energy stages. Channels which are not set are NaN (ChannelData()
+		for the channel map).
+
+	Bundles are made from the current text files with Export, and written back out to text files with Import. ChannelMap,
+	ZeroCalMap, and ParameterMap can be made from the arrays of a loaded bundle. The channel map table is used in place, so
+	the bundle must outlive the ChannelMap.
+*/
+#ifndef CALIBRATIONBUNDLE_H
+#define CALIBRATIONBUNDLE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ChannelMap.h"
+
+enum class CalibrationStage : uint32_t
+{
+	Channels,
+	ZeroOffset,
+	BackGains,
+	UpDownGains,
+	FrontBackGains,
+	Energy
+};
+
+struct BundleHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t nchannels;
+	uint32_t nsections;
+	int64_t created;
+	uint64_t checksum;
+};
+
+struct BundleSection
+{
+	char source[256];
+	uint64_t source_checksum;
+	int64_t source_time;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t stage;
+	uint32_t nentries;
+};
+
+class CalibrationBundle
+{
+public:
+	CalibrationBundle();
+	CalibrationBundle(const std::string& filename);
+	~CalibrationBundle();
+	CalibrationBundle(const CalibrationBundle&) = delete;
+	CalibrationBundle& operator=(const CalibrationBundle&) = delete;
+
+	inline const bool IsValid() const { return valid_flag; }
+	inline const int GetNChannels() const { return header == nullptr ? 0 : header->nchannels; }
+	inline const std::string& GetName() const { return name; }
+	bool HasStage(CalibrationStage stage) const;
+	const ChannelData* GetChannelTable() const;
+	const double* GetOffsets() const;
+	const double* GetParameters(CalibrationStage stage) const; //(intercept, slope) pairs
+	void Print() const;
+
+	//Writes the text files of the stages which have a non-empty file name given (in CalibrationStage order)
+	bool Import(const std::vector<std::string>& stagefiles) const;
+	//Packs the text files (in CalibrationStage order) into a bundle. Only the channel map is required.
+	static bool Export(const std::vector<std::string>& stagefiles, const std::string& bundlename);
+
+	static const char* GetStageName(CalibrationStage stage);
+	//64-bit FNV-1a of a block of memory, as ChannelMap::ComputeChecksum gives for files
+	static uint64_t ComputeChecksum(const char* data, uint64_t size);
+	static constexpr uint32_t schema_version = 1;
+	static constexpr int nstages = 6;
+
+private:
+	void Load(const std::string& filename);
+	const BundleSection* FindSection(CalibrationStage stage) const;
+
+	std::string name;
+	char* buffer; //mapped file
+	uint64_t buffer_size;
+	const BundleHeader* header;
+	const BundleSection* sections;
+	bool valid_flag;
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+	CalibrationDatabase
+	Run-indexed set of calibrations. Each entry is a CalibrationSnapshot along with the range of runs it is valid for, so that
+	a data set spanning many runs can be calibrated with the calibrations of each run interval (i.e. drift-corrected
+	calibrations, see DriftScanner) in a single pass.
+
+	A database file lists one calibration set per line as <first run> <last run> <calibration bundle>, where either run may
+	be * to leave that end of the range open. Lines starting with # are ignored. Ranges may not overlap. Every snapshot is
+	loaded (and its dense tables precomposed) when the database is read, and a bundle listed for several ranges is only loaded
+	once, so selecting the snapshot of a run is a binary search over the ranges and costs nothing in the event loop.
+
+	A single calibration set (text files or one bundle) is a database with one entry valid for every run (Add). Input files
+	whose name has no run number are given run INT_MIN (see FileProcessor::GetRunNumber), so they are only matched by a
+	range open at the low end.
+*/
+#ifndef CALIBRATIONDATABASE_H
+#define CALIBRATIONDATABASE_H
+
+#include <string>
+#include <vector>
+#include <climits>
+#include "CalibrationSnapshot.h"
+
+struct CalibrationInterval
+{
+	int first_run = INT_MIN;
+	int last_run = INT_MAX;
+	int index = -1; //of the snapshot
+};
+
+class CalibrationDatabase
+{
+public:
+	CalibrationDatabase();
+	CalibrationDatabase(const std::string& dbfile);
+	~CalibrationDatabase();
+	CalibrationDatabase(const CalibrationDatabase&) = delete;
+	CalibrationDatabase& operator=(const CalibrationDatabase&) = delete;
+
+	bool Add(int first_run, int last_run, CalibrationSnapshot* snapshot, const std::string& source); //takes ownership
+	//nullptr if no calibration set covers the run
+	const CalibrationSnapshot* Find(int run) const;
+	const std::string& GetSource(const CalibrationSnapshot* snapshot) const;
+	inline const bool IsValid() const { return valid_flag && intervals.size() > 0; }
+	void Print() const;
+
+private:
+	bool AddInterval(int first_run, int last_run, int index);
+
+	std::vector<CalibrationSnapshot*> snapshots;
+	std::vector<std::string> sources;
+	std::vector<CalibrationInterval> intervals; //sorted by first_run
+	bool valid_flag;
+};
+
+#endif
@@ -0,0 +1,34 @@
+/*
+	CalibrationKernel
+	Batch kernel which calibrates a span of hits in a single pass. Every calibration of a back, wedge, or ring is linear in the
+	ADC value once the zero offset, gain-matching, and energy parameters are folded together, so the kernel only needs two
+	dense arrays indexed by global channel (gain and offset, NaN where a channel has no calibration; see CalibrationSnapshot)
+	and computes energy = gain*adc + offset. Hits with a global channel outside of the arrays are given NaN.
+
+	The arrays are gathered and the energies computed with AVX2 or AVX-512 FMAs where the CPU supports them (detected at
+	runtime, so no special compiler flags are needed), with a scalar reference implementation for every other case. The
+	vector paths give the same results as the scalar path up to the rounding of the fused multiply-add.
+
+	Benchmark measures the hits per second of every available instruction set on a calibration table, and checks each against
+	the scalar path.
+*/
+#ifndef CALIBRATIONKERNEL_H
+#define CALIBRATIONKERNEL_H
+
+enum class KernelISA
+{
+	Scalar,
+	AVX2,
+	AVX512
+};
+
+namespace CalibrationKernel
+{
+	void Calibrate(KernelISA isa, const double* gains, const double* offsets, int size, const int* gchans, const double* adcs, int nhits, double* energies);
+	bool IsAvailable(KernelISA isa);
+	KernelISA GetBestISA();
+	const char* GetName(KernelISA isa);
+	void Benchmark(const double* gains, const double* offsets, int size, long nhits);
+}
+
+#endif
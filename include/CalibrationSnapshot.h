@@ -0,0 +1,121 @@
+/*
+	CalibrationSnapshot
+	Immutable, dense copy of every calibration needed to go from raw ADC values to calibrated energies, indexed by global
+	channel. This is the core of libanasencal: it is what apply-calibrations (DataCalibrator) uses, and it is meant to be
+	linked directly into online sort code so that the calibration math is not re-implemented elsewhere.
+
+	A snapshot is loaded either from the text file of each stage, or from a CalibrationBundle. After construction it is never
+	modified, so a single snapshot may be shared by any number of threads. Neither method allocates once warmed up:
+		CalibrateHits: calibrates a span of (global channel, ADC) hits to energies. Backs, wedges, and rings are fully
+		calibrated; SX3 fronts need their partner strip and cannot be calibrated alone, so they (and any channel missing a
+		calibration) are given NaN. The calibration of each channel is folded into a single gain and offset, and the span is
+		done in one pass by CalibrationKernel, with the fastest instruction set the CPU supports.
+		CalibrateEvent: calibrates one AnasenEvent and performs the front-back matching, filling a CalibratedEvent. The
+		energies of every back, wedge, and ring of the event are done first, in one call to CalibrateHits; only the SX3 front
+		matching is done hit by hit. The vectors of the CalibratedEvent are cleared and refilled, so reusing the same object
+		keeps their capacity, and the hit buffers are kept per thread, growing to the largest event seen.
+	MatchCounters collects the front-back matching statistics of CalibrateEvent; each thread should keep its own and Add them.
+*/
+#ifndef CALIBRATIONSNAPSHOT_H
+#define CALIBRATIONSNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "ChannelMap.h"
+#include "DataStructs.h"
+#include "CalibrationKernel.h"
+
+class CalibrationBundle;
+class ZeroCalMap;
+class ParameterMap;
+
+struct RawHit
+{
+	int gchan = -1;
+	double adc = 0;
+};
+
+struct ChannelCalibration
+{
+	enum Flags : uint8_t
+	{
+		HasOffset = 1,
+		HasBack = 2,
+		HasUpDown = 4,
+		HasFrontBack = 8,
+		HasEnergy = 16
+	};
+
+	double offset = 0;
+	CalParams back, updown, frontback, energy;
+	uint8_t flags = 0;
+
+	inline const bool Has(uint8_t mask) const { return (flags & mask) == mask; }
+};
+
+struct MatchCounters
+{
+	long fqqq_wedges[4] = {0, 0, 0, 0};
+	long fqqq_matched[4] = {0, 0, 0, 0};
+	long fqqq_no_rings[4] = {0, 0, 0, 0};
+	long fqqq_one_ring[4] = {0, 0, 0, 0};
+	long fqqq_many_rings[4] = {0, 0, 0, 0};
+	long fqqq_rings_only[4] = {0, 0, 0, 0};
+	long bqqq_wedges[4] = {0, 0, 0, 0};
+	long bqqq_matched[4] = {0, 0, 0, 0};
+
+	void Add(const MatchCounters& rhs);
+	void Print() const;
+};
+
+class CalibrationSnapshot
+{
+public:
+	CalibrationSnapshot(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch,
+						const std::string& frontbackmatch, const std::string& energyfile);
+	CalibrationSnapshot(const CalibrationBundle& bundle);
+	~CalibrationSnapshot();
+
+	inline const bool IsValid() const { return valid_flag; }
+	inline const int GetNChannels() const { return calibrations.size(); }
+	//nullptr if the channel does not exist
+	inline const ChannelCalibration* GetCalibration(int gchan) const
+	{
+		if(gchan < 0 || gchan >= (int) calibrations.size())
+			return nullptr;
+		return &calibrations[gchan];
+	}
+	inline const ChannelData* GetChannelData(int gchan) const
+	{
+		if(gchan < 0 || gchan >= (int) channels.size() || channels[gchan].detectorType == DetectorType::None)
+			return nullptr;
+		return &channels[gchan];
+	}
+
+	int CalibrateHits(const RawHit* hits, int nhits, double* energies) const; //returns the number of hits calibrated
+	int CalibrateHits(const int* gchans, const double* adcs, int nhits, double* energies) const;
+	//Folded calibration, energy = gain*adc + offset, NaN where a channel cannot be calibrated alone
+	inline const double* GetLinearGains() const { return linear_gains.data(); }
+	inline const double* GetLinearOffsets() const { return linear_offsets.data(); }
+	inline const KernelISA GetKernelISA() const { return kernel_isa; }
+	void CalibrateEvent(const AnasenEvent& event, CalibratedEvent& calevent, MatchCounters* counters = nullptr) const;
+
+private:
+	void Fill(ChannelMap& cmap, ZeroCalMap& zmap, ParameterMap& bmap, ParameterMap& udmap, ParameterMap& fbmap, ParameterMap& emap);
+	void CalibrateSX3(const SX3Data& data, int index, const double* back_energies, std::vector<CalibratedSX3Hit>& hits) const;
+	void CalibrateQQQ(const QQQData& data, int index, bool forward, const double* wedge_energies, const double* ring_energies,
+					  std::vector<CalibratedQQQHit>& hits, MatchCounters* counters) const;
+
+	std::vector<ChannelCalibration> calibrations;
+	std::vector<ChannelData> channels;
+	std::vector<double> linear_gains, linear_offsets;
+	KernelISA kernel_isa;
+	bool valid_flag;
+
+	static constexpr double match_window_low = 0.8; //front/back energy ratio accepted as a match
+	static constexpr double match_window_high = 1.2;
+	static constexpr double fqqq_wedge_threshold = 2.8; //MeV, forward QQQ wedges below this are dropped
+};
+
+#endif
@@ -7,6 +7,20 @@
 	Key method is FindChannel. This returns an iterator, which can be checked against the end of the map for validity.
 	If the iterator is equal to the end, the key does not link to a member of the map.
 
+	The strings of the map file ("BARREL1A", "A", "FRONT", "UP") are converted once when the map is loaded into small enums
+	and integers, so that stages compare channel data without any string work; the name tables (GetTypeName, etc.) are
+	only used for printing. The detector index used by the AnasenEvent arrays is stored with each channel as well.
+
+	The reverse direction (channel data -> global channel) is served by an index built when the map is loaded, keyed on the
+	packed (type, id, component, direction, channel) tuple. FindPartnerStrip and FindReferenceChannel give direct access to
+	the most common reverse lookups. All reverse lookups return -1 if no such channel exists.
+
+	When built with make, the channel map file given by CHANNELMAP is compiled into constexpr tables (CompiledChannelMap.h,
+	generated by tools/ChannelTableGenerator.cpp). If the file passed at runtime has the same checksum as the compiled one,
+	the compiled tables are used directly and the file is not parsed; otherwise the file is parsed as usual. GetChannelData
+	is a flat array lookup in either case, and is meant for hot loops. A map can also be made from a flat table owned elsewhere
+	(i.e. a CalibrationBundle), which is then used in place.
+
 	Written by Gordon McCann Nov 2021
 */
 #ifndef CHANNELMAP_H
@@ -14,24 +28,62 @@
 
 #include <string>
 #include <unordered_map>
+#include <cstdint>
+#include <vector>
+#include "DetectorGeometry.h"
+
+enum class DetectorType : uint8_t
+{
+	None,
+	FQQQ,
+	BQQQ,
+	Barrel1A,
+	Barrel1B,
+	Barrel2A,
+	Barrel2B
+};
+
+enum class DetectorComponent : uint8_t
+{
+	None,
+	Ring,
+	Wedge,
+	Front,
+	Back
+};
+
+enum class DetectorDirection : uint8_t
+{
+	None,
+	Up,
+	Down
+};
 
 struct ChannelData
 {
-	std::string detectorType="None"; //Identifier such as FQQQ, BARREL1A, etc.
-	std::string detectorID="None"; //Identifier such as 1 for FQQQ or A for BARREL1A
-	std::string detectorComponent="None"; //RING/WEDGE or FRONT/BACK
-	std::string detectorDirection="None"; //Only for SX3 Fronts -- indicates upstream or downstream
-	int channel=0; //Local channel in detector
+	DetectorType detectorType=DetectorType::None; //FQQQ, BARREL1A, etc.
+	int8_t detectorID=-1; //0-3 for QQQs, 0-5 for SX3s (A-F)
+	DetectorComponent detectorComponent=DetectorComponent::None; //RING/WEDGE or FRONT/BACK
+	DetectorDirection detectorDirection=DetectorDirection::None; //Only for SX3 Fronts -- indicates upstream or downstream
+	int8_t detectorIndex=-1; //Index of the detector in the AnasenEvent arrays
+	int16_t channel=0; //Local channel in detector
+
+	ChannelData() = default;
+	constexpr ChannelData(DetectorType type, int8_t id, DetectorComponent component, DetectorDirection direction, int8_t index, int16_t chan) :
+		detectorType(type), detectorID(id), detectorComponent(component), detectorDirection(direction), detectorIndex(index), channel(chan)
+	{
+	}
 
-	bool operator==(const ChannelData& rhs)
+	bool operator==(const ChannelData& rhs) const
 	{
-		if(this->detectorType == rhs.detectorType && this->detectorID == rhs.detectorID && this->detectorComponent == rhs.detectorComponent && this->detectorDirection == rhs.detectorDirection
-			&& this->channel == rhs.channel)
-		{
-			return true;
-		}
-		return false;
+		return detectorType == rhs.detectorType && detectorID == rhs.detectorID && detectorComponent == rhs.detectorComponent && detectorDirection == rhs.detectorDirection
+				&& channel == rhs.channel;
 	}
+
+	inline const bool IsSX3() const { return detectorType == DetectorType::Barrel1A || detectorType == DetectorType::Barrel1B || detectorType == DetectorType::Barrel2A || detectorType == DetectorType::Barrel2B; }
+	inline const bool IsQQQ() const { return detectorType == DetectorType::FQQQ || detectorType == DetectorType::BQQQ; }
+	inline const bool IsFrontLike() const { return detectorComponent == DetectorComponent::Front || detectorComponent == DetectorComponent::Ring; }
+	inline const bool IsBackLike() const { return detectorComponent == DetectorComponent::Back || detectorComponent == DetectorComponent::Wedge; }
 };
 
 class ChannelMap
@@ -40,19 +92,48 @@ public:
 	typedef std::unordered_map<int, ChannelData>::iterator Iterator;
 
 	ChannelMap(const std::string& filename);
+	ChannelMap(const ChannelData* table, int size, const std::string& source); //table is used in place, and must outlive the map
 	~ChannelMap();
 	inline const bool IsValid() const { return valid_flag; }
 	inline Iterator FindChannel(int gchan) { return cmap.find(gchan); }
 	inline Iterator End() { return cmap.end(); }
-	int InverseFindChannel(const ChannelData& data);
+	//nullptr if the channel does not exist
+	inline const ChannelData* GetChannelData(int gchan) const
+	{
+		const ChannelData* table = (compiled_table != nullptr) ? compiled_table : table_storage.data();
+		if(gchan < 0 || gchan >= table_size || table[gchan].detectorType == DetectorType::None)
+			return nullptr;
+		return &table[gchan];
+	}
+	inline const bool IsCompiled() const { return compiled_flag; }
+	int InverseFindChannel(const ChannelData& data) const;
+	int FindPartnerStrip(int gchan) const; //SX3 front upstream <-> downstream partner
+	int FindReferenceChannel(int gchan, int reference) const; //local channel reference of the same detector and component
 
-	int ConvertSX3Name2Index(const std::string& detectorType, const std::string& detectorID); //used to index the different detectors in data
-	int ConvertQQQName2Index(const std::string& detectorID);
+	static uint64_t ComputeChecksum(const std::string& filename);
+	static const char* GetTypeName(DetectorType type);
+	static std::string GetIDName(DetectorType type, int id);
+	static const char* GetComponentName(DetectorComponent component);
+	static const char* GetDirectionName(DetectorDirection direction);
 
 private:
 	void FillMap(const std::string& filename);
+	bool FillCompiledMap(const std::string& filename);
+	void UseTable(const ChannelData* table, int size);
+	void BuildTable();
+	int ConvertSX3Index(DetectorType type, int id); //used to index the different detectors in data
+	bool ParseChannel(const std::string& type, const std::string& id, const std::string& component, const std::string& direction, ChannelData& data);
+	void BuildIndex();
+	uint64_t MakeKey(const ChannelData& data) const;
+
 	std::unordered_map<int, ChannelData> cmap;
+	std::unordered_map<uint64_t, int> reverse_map;
+	std::unordered_map<int, int> partner_map;
+	std::vector<ChannelData> table_storage; //flat copy of a parsed map
+	const ChannelData* compiled_table; //points to the compiled or bundled tables when they are in use
+	int table_size;
 	bool valid_flag;
+	bool compiled_flag;
 	std::string name;
 };
 
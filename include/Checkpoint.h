@@ -0,0 +1,64 @@
+/*
+	Checkpoint
+	Saved position of a long job writing an output tree (organize-data, apply-calibrations), so that a job which dies partway
+	through can be resumed instead of started over. A checkpoint is a set of named integer values (entry position, number of
+	events written, counters; chosen by the job) and optionally the state of one ROOT object, such as a random generator.
+
+	The checkpoint is kept in the UserInfo of the output tree, and is written along with the tree header by TTree::AutoSave
+	(see EventSink::SaveCheckpoint), so the entries on disk and the checkpoint describing them always agree. A job which
+	finishes always saves a last checkpoint marked complete, even without intermediate checkpoints. Read tells a job, before it
+	opens its output, whether the output is missing (or unusable), complete, or partial and can be resumed from the checkpoint.
+	A tree without any checkpoint (i.e. flushed by ROOT's own AutoSave before the job died) is missing, and is started over.
+	Jobs keep GetInputKey of their input files in the checkpoint as "inputs", and do not resume (or skip) an output which was
+	made from other inputs.
+	RNTuple outputs have nowhere to keep a checkpoint, but are only readable once committed, so they count as complete if they
+	can be opened.
+*/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <map>
+#include <vector>
+
+class TObject;
+class TTree;
+
+enum class CheckpointStatus
+{
+	Missing,
+	Partial,
+	Complete
+};
+
+class Checkpoint
+{
+public:
+	Checkpoint();
+	~Checkpoint();
+	Checkpoint(const Checkpoint&) = delete;
+	Checkpoint& operator=(const Checkpoint&) = delete;
+
+	inline void Set(const std::string& key, long long value) { values[key] = value; }
+	long long Get(const std::string& key, long long default_value = 0) const;
+	inline const bool Has(const std::string& key) const { return values.find(key) != values.end(); }
+	inline void SetComplete() { Set("complete", 1); }
+	inline const bool IsComplete() const { return Get("complete") != 0; }
+	void SetState(const TObject* object); //copied
+	inline const TObject* GetState() const { return state; }
+	void Clear();
+
+	void Store(TTree* tree) const;
+	bool Load(TTree* tree);
+	static CheckpointStatus Read(const std::string& filename, const std::string& treename, Checkpoint& checkpoint);
+	static long long GetInputKey(const std::vector<std::string>& filenames);
+
+private:
+	std::string Encode() const;
+	void Decode(const std::string& record);
+
+	std::map<std::string, long long> values;
+	TObject* state;
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+	CompressionBenchmark
+	Class which measures how the output settings perform on our own data. A sample of AnasenEvents is read into memory from
+	the given data files, and then written to a temporary file and read back in full once per setting:
+		Run: every output profile (see OutputPolicy), in the configured data format
+		RunFormats: every data format available in this build (see EventIO), with the configured output profile
+	For each the file size (also relative to the first one), write throughput, and full-scan read throughput are reported.
+	The temporary files are written to (and removed from) the given directory, so it should be on the disk the data lives on.
+*/
+#ifndef COMPRESSIONBENCHMARK_H
+#define COMPRESSIONBENCHMARK_H
+
+#include <string>
+#include <vector>
+#include "DataStructs.h"
+#include "IOPolicy.h"
+#include "OutputPolicy.h"
+
+struct CompressionResult
+{
+	std::string label;
+	long long file_size = 0; //bytes
+	double write_time = 0.0; //seconds
+	double read_time = 0.0; //seconds
+};
+
+class CompressionBenchmark
+{
+public:
+	CompressionBenchmark();
+	~CompressionBenchmark();
+	void Run(const std::vector<std::string>& inputnames, const std::string& workdir, long nevents);
+	void RunFormats(const std::vector<std::string>& inputnames, const std::string& workdir, long nevents);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetOutputPolicy(const OutputPolicy& policy) { output_policy = policy; }
+
+private:
+	bool ReadSample(const std::vector<std::string>& inputnames, long nevents);
+	CompressionResult TestOutput(const OutputPolicy& policy, const std::string& label, const std::string& filename);
+	void PrintResults(const std::vector<CompressionResult>& results);
+
+	std::vector<AnasenEvent> sample;
+	IOPolicy io_policy;
+	OutputPolicy output_policy;
+};
+
+#endif
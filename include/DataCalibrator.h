@@ -1,8 +1,10 @@
 /*
 	DataCalibrator
 	Class which applies all of the calibration results to a data set, performs front-back hit assignment (kind of)
-	and saves to a condensed data format (CalibratedEvent) for further analysis. This essentially a single function
-	with some class-global parameter maps.
+	and saves to a condensed data format (CalibratedEvent) for further analysis. The calibration itself is done by a
+	CalibrationSnapshot (see libanasencal), which is either read from the text file of each stage, or taken from a single
+	CalibrationBundle, which guarantees that the calibrations belong together. A CalibrationDatabase instead gives each input
+	run the snapshot of its run range; consecutive runs with the same snapshot are chained together.
 
 	Written by Gordon McCann Nov 2021
 */
@@ -10,23 +12,31 @@
 #define DATACALIBRATOR_H
 
 #include <string>
-#include "ChannelMap.h"
-#include "ZeroCalMap.h"
-#include "ParameterMap.h"
+#include <vector>
+#include "CalibrationSnapshot.h"
+#include "CalibrationDatabase.h"
+#include "IOPolicy.h"
+#include "OutputPolicy.h"
 
 class DataCalibrator
 {
 public:
 	DataCalibrator(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch, 
 					const std::string& frontbackmatch, const std::string& energyfile);
+	DataCalibrator(const std::string& bundlefile);
+	DataCalibrator(CalibrationDatabase* db); //takes ownership
 	~DataCalibrator();
-	void Run(const std::string& inputname, const std::string& outputname);
+	bool Run(const std::vector<std::string>& inputnames, const std::string& outputname);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetOutputPolicy(const OutputPolicy& policy) { output_policy = policy; }
+	//Skip a complete output and continue a partial one from its last checkpoint (see Checkpoint)
+	inline void SetResume(bool resume) { resume_flag = resume; }
 
 private:
-	ChannelMap channel_map;
-	ZeroCalMap zero_map;
-	ParameterMap back_map, updown_map, frontback_map, energy_map;
-	const int updown_list[8] = {1, 0, 3, 2, 5, 4, 7, 6}; //matches index -> index of up/down pair for SX3 fronts
+	CalibrationDatabase* database;
+	IOPolicy io_policy;
+	OutputPolicy output_policy;
+	bool resume_flag;
 };
 
 #endif
\ No newline at end of file
@@ -12,6 +12,9 @@
 #include <string>
 #include "DataStructs.h"
 #include "ChannelMap.h"
+#include "IOPolicy.h"
+#include "OutputPolicy.h"
+#include "Checkpoint.h"
 #include <TRandom3.h>
 
 class DataOrganizer
@@ -20,15 +23,23 @@ public:
 	DataOrganizer(const std::string& channelfile);
 	~DataOrganizer();
 
-	void Run(const std::string& inputname, const std::string& outputname);
+	bool Run(const std::string& inputname, const std::string& outputname);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetOutputPolicy(const OutputPolicy& policy) { output_policy = policy; }
+	//Skip complete outputs and continue partial ones from their last checkpoint (see Checkpoint)
+	inline void SetResume(bool resume) { resume_flag = resume; }
 private:
 	void FillEvent(AnasenEvent& event, int gchan, int energy, int time);
 	//When switching from integers to floating point, need to smear within the bin.
 	inline double ConvertInt2Double(int value) { return value + generator->Uniform(0.0, 1.0); }
+	void RestoreGenerator(const Checkpoint& checkpoint);
 
 
 	ChannelMap cmap;
 	TRandom3* generator;
+	IOPolicy io_policy;
+	OutputPolicy output_policy;
+	bool resume_flag;
 };
 
 
@@ -32,12 +32,38 @@ struct QQQData
 	std::vector<SiliconHit> wedges;
 };
 
+/*
+	Bits of AnasenEvent::fired, set by organize-data. Each bit marks that a group of detector components has at least one
+	hit in the event, so that stages can skip the events they have no use for (see FiredIndex). SX3UpDownBack marks that a
+	single SX3 had an upstream front, a downstream front, and a back. Set is always on in a filled mask; data organized
+	before the mask was added has fired = 0.
+*/
+namespace FiredGroup
+{
+	enum : unsigned int
+	{
+		Barrel1Up = 1u<<0,
+		Barrel1Down = 1u<<1,
+		Barrel1Back = 1u<<2,
+		Barrel2Up = 1u<<3,
+		Barrel2Down = 1u<<4,
+		Barrel2Back = 1u<<5,
+		FQQQRing = 1u<<6,
+		FQQQWedge = 1u<<7,
+		BQQQRing = 1u<<8,
+		BQQQWedge = 1u<<9,
+		SX3UpDownBack = 1u<<10,
+		Set = 1u<<31
+	};
+}
+
 struct AnasenEvent
 {
 	SX3Data barrel1[12];
 	SX3Data barrel2[12];
 	QQQData fqqq[4];
 	QQQData bqqq[4];
+	unsigned int fired = 0; //FiredGroup bits
 };
 
 struct GraphData
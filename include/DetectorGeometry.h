@@ -0,0 +1,19 @@
+/*
+	DetectorGeometry
+	Fixed dimensions of the solid-target ANASEN array, shared by every stage. These must agree with the detector arrays of
+	AnasenEvent (DataStructs.h) and with the channel map; the compiled channel map (see ChannelMap) checks the latter at
+	build time.
+*/
+#ifndef DETECTORGEOMETRY_H
+#define DETECTORGEOMETRY_H
+
+namespace DetectorGeometry
+{
+	constexpr int nchannels = 544; //May need modified if ANASEN is modified
+	constexpr int nsx3_per_barrel = 12;
+	constexpr int nqqq_per_end = 4;
+	constexpr int nsx3_fronts = 8; //4 strips, each with an upstream and downstream channel
+	constexpr int updown_list[nsx3_fronts] = {1, 0, 3, 2, 5, 4, 7, 6}; //matches index -> index of up/down pair for SX3 fronts
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+	DriftScanner
+	Run-by-run gain drift monitor. One set of calibrations is applied to a whole range of runs, but the ASIC gains drift over
+	an experiment; the drift scan shows by how much, and in which channels. Each run is filled into its own compact spectra of
+	calibrated energy (one per back, wedge, and ring channel, covering only the reference peaks), using the CalibrationSnapshot
+	of the current calibrations. Runs are processed in parallel, one per thread (see FileProcessor::FillFiles), and every run
+	is reduced to its centroid shifts as soon as it is done, so memory does not grow with the number of runs. With histogram
+	banks on, the spectra of each run are kept (see HistogramBank) and a rescan only reads runs which are new or changed.
+
+	The centroid of each reference peak is found with an iterated windowed mean: the mean of the spectrum within DriftWindow of
+	the current estimate, recentred until it converges. The shift of a channel in a run is the average relative shift of its
+	peaks, centroid/reference - 1, so a perfectly calibrated channel sits at zero. A channel is flagged if its shift exceeds
+	DriftTolerance in any run.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		DriftPeaks: reference peak energies in MeV, separated by spaces or commas (default the alpha source lines)
+		DriftWindow: half width in MeV of the window used for each centroid (default 0.1)
+		DriftBinWidth: bin width in MeV of the spectra (default 0.005)
+		DriftMinCounts: counts needed within the window for a centroid (default 50)
+		DriftTolerance: relative centroid shift above which a channel is flagged (default 0.005)
+		DriftScanOutput: text file for the time series of shifts (default drift_scan.txt)
+		DriftScanPlots: ROOT file for a graph of the shifts of each channel against run number (default none)
+*/
+#ifndef DRIFTSCANNER_H
+#define DRIFTSCANNER_H
+
+#include <string>
+#include <vector>
+#include <THashTable.h>
+#include "RunOptions.h"
+#include "CalibrationSnapshot.h"
+#include "IOPolicy.h"
+#include "HistogramBank.h"
+
+class TH1;
+
+struct DriftSettings
+{
+	std::vector<double> peaks = {5.155, 5.486, 5.805};
+	double window = 0.1;
+	double bin_width = 0.005;
+	double min_counts = 50.0;
+	double tolerance = 0.005;
+	std::string outputname = "drift_scan.txt";
+	std::string plotname;
+
+	DriftSettings() {}
+	DriftSettings(const RunOptions& options);
+	void Print() const;
+};
+
+class DriftScanner
+{
+public:
+	DriftScanner(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch,
+				const std::string& frontbackmatch, const std::string& energyfile);
+	DriftScanner(const std::string& bundlefile);
+	~DriftScanner();
+	bool Run(const std::vector<std::string>& inputnames);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetNThreads(int n) { nthreads = n; }
+	inline void SetSettings(const DriftSettings& s) { settings = s; }
+	inline void SetHistogramBank(const BankSettings& s) { bank_settings = s; }
+
+private:
+	void FillSpectra(AnasenEvent* event, THashTable* table);
+	void FillHistogram(THashTable* table, int gchan, double value);
+	std::vector<double> GetShifts(THashTable* table);
+	double GetCentroid(TH1* histo, double reference);
+	bool WriteResults(const std::vector<int>& runs, const std::vector<std::vector<double>>& shifts);
+
+	CalibrationSnapshot snapshot;
+	IOPolicy io_policy;
+	DriftSettings settings;
+	BankSettings bank_settings;
+	std::string bank_key;
+	int nthreads;
+	int nbins;
+	double minx, maxx;
+};
+
+#endif
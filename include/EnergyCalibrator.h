@@ -18,29 +18,46 @@
 #include "ChannelMap.h"
 #include "ParameterMap.h"
 #include "ZeroCalMap.h"
+#include "CalibrationBundle.h"
 #include "DataStructs.h"
+#include "IOPolicy.h"
+#include "SpectrumMonitor.h"
+#include "HistogramBank.h"
 
 
 class EnergyCalibrator {
   
 public:
 	EnergyCalibrator(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch, const std::string& frontbackmatch);
+	EnergyCalibrator(const std::string& bundlefile);
 	~EnergyCalibrator();
-	void Run(const std::string& inputname, const std::string& plotname, const std::string& outputname);
+	bool Run(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetNThreads(int n) { nthreads = n; }
+	inline void SetEarlyStop(const EarlyStopSettings& settings) { early_stop = settings; }
+	inline void SetHistogramBank(const BankSettings& settings) { bank_settings = settings; }
 
 private:
 	CalParams CalibrateEnergy(THashTable* table, const std::string& name, const GraphData& data);
 	void FillHistogram(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value);
 	GraphData GetPoints(THashTable* table, int gchan, const std::string& name);
+	void FillEnergySpectra(AnasenEvent* event, THashTable* histo_table);
+	void FillEnergyTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& energymap);
 
 	TSpectrum spec;
 
+	CalibrationBundle bundle; //must be declared before the maps which use it
 	ChannelMap cmap;
 	ZeroCalMap zmap;
 	ParameterMap bmap, udmap, fbmap;
+	IOPolicy io_policy;
+	int nthreads;
+	EarlyStopSettings early_stop;
+	BankSettings bank_settings;
+	std::string bank_key;
 
 	double sigma, threshold;
-	const int nchannels = 544;
+	const int nchannels = DetectorGeometry::nchannels;
 
 	std::vector<double> energyValues = {5.155, 5.486, 5.805}; //Will need modified for each experiment.
 
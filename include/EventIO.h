@@ -0,0 +1,420 @@
+/*
+	EventIO
+	Backend abstraction for reading and writing event data (AnasenEvent, CalibratedEvent). Stages read through an EventSource
+	and write through an EventSink, so that the on-disk format can be chosen in one place:
+		ttree: a TTree with a single branch holding the event object (the standard format)
+		rntuple: ROOT's columnar RNTuple format. Only available when built with RNTuple support (make RNTUPLE=1), which
+		requires ROOT 6.34 or newer.
+
+	Sources detect the format of their files on their own, so every stage can read data written in either format. The format
+	written is set by the DataFormat setting of OutputPolicy. Both are templated on the event type, and created through
+	MakeEventSource and MakeEventSink. In either format the tree/ntuple name and the field name match the existing files
+	(EventTree or CalTree, event). GetEntries reads the number of entries of one file from its header, for loops which need the
+	total before any source is made (see FileProcessor).
+
+	GetClusters gives the storage clusters of a source, which are the units sampled in quick-look mode (see IOPolicy). RNTuple
+	pages are read on demand, so RNTuple sources are simply split into blocks of entries.
+	Sinks can save a Checkpoint with the data written so far, and a TTree sink can be reopened from its last checkpoint to
+	resume a job which died (see MakeEventSink). RNTuple outputs cannot be resumed, as an ntuple is only readable once its
+	writer has committed it.
+*/
+#ifndef EVENTIO_H
+#define EVENTIO_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <iostream>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TNamed.h>
+#include <TVirtualPerfStats.h>
+#include "IOPolicy.h"
+#include "OutputPolicy.h"
+#include "Checkpoint.h"
+
+#ifdef ANASEN_RNTUPLE
+#include <RVersion.h>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+//RNTuple left the Experimental namespace in 6.36
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+namespace RNTupleAPI = ROOT;
+#else
+namespace RNTupleAPI = ROOT::Experimental;
+#endif
+#endif
+
+namespace EventIO
+{
+	std::string DetectFormat(const std::string& filename, const std::string& name);
+	long long GetEntries(const std::string& filename, const std::string& name);
+	bool IsFormatAvailable(const std::string& format);
+	inline bool IsFormatResumable(const std::string& format) { return format == "ttree"; }
+}
+
+template<typename T>
+class EventSource
+{
+public:
+	virtual ~EventSource() {}
+	virtual bool IsValid() const = 0;
+	virtual long long GetEntries() = 0;
+	//Loads the entry and returns the event it was read into. The pointer stays valid until the next call.
+	virtual T* GetEntry(long long entry) = 0;
+	//Prints (and returns) the I/O statistics collected so far
+	virtual IOStats Report() = 0;
+	virtual std::vector<EntryRange> GetClusters()
+	{
+		std::vector<EntryRange> blocks;
+		long long nentries = GetEntries();
+		for(long long first=0; first<nentries; first+=block_entries)
+			blocks.push_back(EntryRange{first, std::min(first + block_entries, nentries)});
+		return blocks;
+	}
+
+protected:
+	static constexpr long long block_entries = 10000;
+};
+
+template<typename T>
+class EventSink
+{
+public:
+	virtual ~EventSink() {}
+	virtual bool IsValid() const = 0;
+	//The object which is written by Fill
+	virtual T* GetObject() = 0;
+	virtual void Fill() = 0;
+	//Writes everything out and closes the file. Must be called once, after the last Fill.
+	virtual void Close() = 0;
+	virtual std::string GetName() const = 0;
+	//Description stored with the data (the TTree title, or a note next to an RNTuple)
+	virtual void SetTitle(const std::string& title) {}
+	//Writes everything filled so far along with the checkpoint, which is given the number of entries written. Must be called
+	//while nothing is being filled (see AsyncTreeWriter::Drain). Returns false if the format cannot be resumed.
+	virtual bool SaveCheckpoint(Checkpoint& checkpoint) { return false; }
+};
+
+/*
+	TTree backend. The source chains its files, so a single source can cover a whole list of runs.
+*/
+template<typename T>
+class TreeEventSource : public EventSource<T>
+{
+public:
+	TreeEventSource(const std::vector<std::string>& files, const std::string& treename, const std::string& branchname, const IOPolicy& policy) :
+		chain(new TChain(treename.c_str(), treename.c_str())), object(new T()), io_policy(policy), valid(files.size() > 0)
+	{
+		for(auto& file : files)
+		{
+			//Passing zero entries forces the file to be opened, so that bad files are caught here
+			if(chain->Add(file.c_str(), 0) == 0)
+			{
+				std::cerr<<"Unable to open input file "<<file<<" at TreeEventSource::TreeEventSource()!"<<std::endl;
+				valid = false;
+			}
+		}
+		if(valid)
+		{
+			io_policy.ConfigureTree(chain);
+			chain->SetBranchAddress(branchname.c_str(), &object);
+		}
+	}
+
+	~TreeEventSource()
+	{
+		//Statistics which were never reported are dropped quietly
+		TVirtualPerfStats* perf = chain->GetPerfStats();
+		chain->SetPerfStats(nullptr);
+		delete perf;
+		delete chain;
+		delete object;
+	}
+
+	bool IsValid() const override { return valid; }
+	long long GetEntries() override { return chain->GetEntries(); }
+	T* GetEntry(long long entry) override
+	{
+		chain->GetEntry(entry);
+		return object;
+	}
+	IOStats Report() override { return io_policy.Report(chain); }
+	std::vector<EntryRange> GetClusters() override { return IOPolicy::GetClusters(chain); }
+
+private:
+	TChain* chain;
+	T* object;
+	IOPolicy io_policy;
+	bool valid;
+};
+
+template<typename T>
+class TreeEventSink : public EventSink<T>
+{
+public:
+	TreeEventSink(const std::string& filename, const std::string& treename, const std::string& branchname, const OutputPolicy& policy) :
+		file(TFile::Open(filename.c_str(), "RECREATE")), tree(nullptr), address(&object)
+	{
+		if(file == nullptr || !file->IsOpen())
+		{
+			std::cerr<<"Unable to open output file "<<filename<<" at TreeEventSink::TreeEventSink()!"<<std::endl;
+			delete file;
+			file = nullptr;
+			return;
+		}
+		policy.ConfigureFile(file);
+		tree = new TTree(treename.c_str(), treename.c_str());
+		tree->Branch(branchname.c_str(), &object);
+		policy.ConfigureTree(tree);
+	}
+
+	//Reopens the output of a job which died at its last checkpoint. Entries filled after the checkpoint are lost, and are
+	//overwritten as the job fills them again.
+	TreeEventSink(const std::string& filename, const std::string& treename, const std::string& branchname, const OutputPolicy& policy,
+					const Checkpoint& checkpoint) :
+		file(TFile::Open(filename.c_str(), "UPDATE")), tree(nullptr), address(&object)
+	{
+		if(file == nullptr || !file->IsOpen())
+		{
+			std::cerr<<"Unable to open output file "<<filename<<" at TreeEventSink::TreeEventSink()!"<<std::endl;
+			delete file;
+			file = nullptr;
+			return;
+		}
+		policy.ConfigureFile(file);
+		tree = dynamic_cast<TTree*>(file->Get(treename.c_str()));
+		if(tree == nullptr || tree->GetEntries() != checkpoint.Get("entries", -1))
+		{
+			std::cerr<<"Output file "<<filename<<" does not match its checkpoint at TreeEventSink::TreeEventSink()!"<<std::endl;
+			tree = nullptr;
+			file->Close();
+			delete file;
+			file = nullptr;
+			return;
+		}
+		tree->SetBranchAddress(branchname.c_str(), &address);
+	}
+
+	~TreeEventSink()
+	{
+		Close();
+	}
+
+	bool IsValid() const override { return file != nullptr; }
+	T* GetObject() override { return &object; }
+	void Fill() override { tree->Fill(); }
+	void Close() override
+	{
+		if(file == nullptr)
+			return;
+		file->cd();
+		tree->Write(tree->GetName(), TObject::kOverwrite);
+		file->Close();
+		delete file;
+		file = nullptr;
+	}
+	std::string GetName() const override { return tree == nullptr ? "" : tree->GetName(); }
+	void SetTitle(const std::string& title) override
+	{
+		if(tree != nullptr)
+			tree->SetTitle(title.c_str());
+	}
+	//AutoSave writes the baskets and then the tree header, so a crash at any point leaves the last complete checkpoint readable
+	bool SaveCheckpoint(Checkpoint& checkpoint) override
+	{
+		checkpoint.Set("entries", tree->GetEntries());
+		checkpoint.Store(tree);
+		tree->AutoSave("SaveSelf;FlushBaskets");
+		return true;
+	}
+
+private:
+	TFile* file;
+	TTree* tree; //owned by the file
+	T object;
+	T* address; //branch address of a reopened tree
+};
+
+#ifdef ANASEN_RNTUPLE
+/*
+	RNTuple backend. Files are opened one at a time as the entries are read.
+*/
+template<typename T>
+class NTupleEventSource : public EventSource<T>
+{
+public:
+	NTupleEventSource(const std::vector<std::string>& files, const std::string& ntuplename, const std::string& fieldname) :
+		file_list(files), ntuple_name(ntuplename), field_name(fieldname), current(-1), object(nullptr), valid(files.size() > 0)
+	{
+		long long total = 0;
+		for(auto& file : file_list)
+		{
+			offsets.push_back(total);
+			//RNTuple reports errors by throwing
+			try
+			{
+				auto probe = RNTupleAPI::RNTupleReader::Open(ntuple_name, file);
+				total += probe->GetNEntries();
+			}
+			catch(std::exception& e)
+			{
+				std::cerr<<"Unable to open input file "<<file<<" at NTupleEventSource::NTupleEventSource()! "<<e.what()<<std::endl;
+				valid = false;
+			}
+		}
+		offsets.push_back(total);
+	}
+
+	bool IsValid() const override { return valid; }
+	long long GetEntries() override { return offsets.back(); }
+	T* GetEntry(long long entry) override
+	{
+		int index = current;
+		if(index < 0 || entry < offsets[index] || entry >= offsets[index+1])
+		{
+			index = 0;
+			while(index < (int)file_list.size()-1 && entry >= offsets[index+1])
+				index++;
+			OpenFile(index);
+		}
+		reader->LoadEntry(entry - offsets[index]);
+		return object.get();
+	}
+	//TTreePerfStats has no RNTuple equivalent in every supported version, so nothing is collected
+	IOStats Report() override
+	{
+		std::cout<<"No I/O statistics available for RNTuple "<<ntuple_name<<std::endl;
+		return IOStats();
+	}
+
+private:
+	void OpenFile(int index)
+	{
+		reader = RNTupleAPI::RNTupleReader::Open(ntuple_name, file_list[index]);
+		object = reader->GetModel().GetDefaultEntry().template GetPtr<T>(field_name);
+		current = index;
+	}
+
+	std::vector<std::string> file_list;
+	std::vector<long long> offsets;
+	std::string ntuple_name, field_name;
+	int current;
+	std::unique_ptr<RNTupleAPI::RNTupleReader> reader;
+	std::shared_ptr<T> object;
+	bool valid;
+};
+
+template<typename T>
+class NTupleEventSink : public EventSink<T>
+{
+public:
+	NTupleEventSink(const std::string& filename, const std::string& ntuplename, const std::string& fieldname, const OutputPolicy& policy) :
+		file_name(filename), name(ntuplename)
+	{
+		auto model = RNTupleAPI::RNTupleModel::Create();
+		object = model->template MakeField<T>(fieldname);
+		RNTupleAPI::RNTupleWriteOptions options;
+		int settings = policy.GetCompressionSettings();
+		if(settings >= 0)
+			options.SetCompression(settings);
+		//Closest equivalent of the TTree autoflush size
+		if(policy.GetProfile().autoflush > 0)
+			options.SetApproxZippedClusterSize(policy.GetProfile().autoflush);
+		try
+		{
+			writer = RNTupleAPI::RNTupleWriter::Recreate(std::move(model), ntuplename, filename, options);
+		}
+		catch(std::exception& e)
+		{
+			std::cerr<<"Unable to open output file "<<filename<<" at NTupleEventSink::NTupleEventSink()! "<<e.what()<<std::endl;
+		}
+	}
+
+	~NTupleEventSink()
+	{
+		Close();
+	}
+
+	bool IsValid() const override { return writer != nullptr; }
+	T* GetObject() override { return object.get(); }
+	void Fill() override { writer->Fill(); }
+	//The data is committed when the writer is destroyed; the title can only be added to the file once it is
+	void Close() override
+	{
+		if(writer == nullptr)
+			return;
+		writer.reset();
+		if(title.empty())
+			return;
+		TFile* file = TFile::Open(file_name.c_str(), "UPDATE");
+		if(file == nullptr || !file->IsOpen())
+		{
+			std::cerr<<"Unable to write the title of "<<name<<" to "<<file_name<<" at NTupleEventSink::Close()!"<<std::endl;
+			delete file;
+			return;
+		}
+		TNamed note((name+"_title").c_str(), title.c_str());
+		note.Write();
+		file->Close();
+		delete file;
+	}
+	std::string GetName() const override { return name; }
+	//RNTuple has no title, so it is kept as a note named <ntuple>_title next to the ntuple
+	void SetTitle(const std::string& ntupletitle) override { title = ntupletitle; }
+
+private:
+	std::string file_name;
+	std::string name;
+	std::string title;
+	std::shared_ptr<T> object;
+	std::unique_ptr<RNTupleAPI::RNTupleWriter> writer;
+};
+#endif
+
+/*
+	Factories. The source format is taken from the first file; the sink format from the OutputPolicy. Both return nullptr if
+	the format is not available, and the caller owns the returned object. Given a checkpoint (see Checkpoint::Read), the sink
+	reopens the existing output at that checkpoint instead of recreating it.
+*/
+template<typename T>
+EventSource<T>* MakeEventSource(const std::vector<std::string>& files, const std::string& name, const std::string& fieldname, const IOPolicy& policy)
+{
+	std::string format = files.size() > 0 ? EventIO::DetectFormat(files[0], name) : "ttree";
+	if(format == "ttree")
+		return new TreeEventSource<T>(files, name, fieldname, policy);
+#ifdef ANASEN_RNTUPLE
+	else if(format == "rntuple")
+		return new NTupleEventSource<T>(files, name, fieldname);
+#endif
+	std::cerr<<"Data format "<<format<<" of "<<files[0]<<" is not supported by this build at MakeEventSource()!"<<std::endl;
+	return nullptr;
+}
+
+template<typename T>
+EventSink<T>* MakeEventSink(const std::string& filename, const std::string& name, const std::string& fieldname, const OutputPolicy& policy,
+							const Checkpoint* resume = nullptr)
+{
+	if(resume != nullptr && !EventIO::IsFormatResumable(policy.GetDataFormat()))
+	{
+		std::cerr<<"Data format "<<policy.GetDataFormat()<<" cannot be resumed at MakeEventSink()!"<<std::endl;
+		return nullptr;
+	}
+	if(policy.GetDataFormat() == "ttree" && resume != nullptr)
+		return new TreeEventSink<T>(filename, name, fieldname, policy, *resume);
+	else if(policy.GetDataFormat() == "ttree")
+		return new TreeEventSink<T>(filename, name, fieldname, policy);
+#ifdef ANASEN_RNTUPLE
+	else if(policy.GetDataFormat() == "rntuple")
+		return new NTupleEventSink<T>(filename, name, fieldname, policy);
+#endif
+	std::cerr<<"Data format "<<policy.GetDataFormat()<<" is not supported by this build at MakeEventSink()!"<<std::endl;
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+	FileProcessor
+	Class which runs the event loop over a list of AnasenEvent data files. Files are handed out to a pool of worker threads,
+	each identified by a slot number. The function passed to Process is called for every event along with the slot of the
+	thread which read it, so that each thread fills its own histograms or data; the per-slot results are then combined by the
+	caller (see MergeTables). With a single thread (or a single file) everything runs on the calling thread. Fill instead keeps
+	one table of histograms per file, so that the spectra of each run can be kept in a HistogramBank; FillFiles hands each of
+	those tables to the caller as soon as its file is done, for run-by-run results (see DriftScanner).
+
+	Inputs can be a single file, a list file (.txt or .list, one data file per line), or a run range given as runs:<start>-<stop>
+	(or simply runs, which uses StartRun and StopRun) which is expanded using the organized data directory. See ResolveInputFiles.
+
+	SetSelection restricts the loop to the events of one FiredGroup. Files with a matching fired index (see FiredIndex) only read
+	the listed entries; otherwise every entry is read and the events whose fired mask lacks the group are skipped. Events
+	without a fired mask (data organized before it existed) are never skipped.
+
+	SetStopCheck installs a function which each thread calls after every interval entries it reads; once it returns true
+	every thread stops and Process returns early (see SpectrumMonitor). SetMaxEntries stops the loop after a fixed number of
+	entries have been read, so that a later pass can be limited to what an early-stopped pass used. Progress over every file is
+	given by a ProgressReporter.
+*/
+#ifndef FILEPROCESSOR_H
+#define FILEPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <THashTable.h>
+#include "DataStructs.h"
+#include "IOPolicy.h"
+#include "HistogramBank.h"
+#include "ProgressReporter.h"
+
+class FileProcessor
+{
+public:
+	typedef std::function<void(AnasenEvent* event, int slot)> EventFunction;
+	typedef std::function<bool(int slot)> StopFunction;
+	typedef std::function<void(AnasenEvent* event, THashTable* table)> FillFunction;
+	typedef std::function<void(size_t index, THashTable* table)> TableFunction;
+
+	FileProcessor(const std::vector<std::string>& files, const std::string& treename, const IOPolicy& policy, int nthreads);
+	~FileProcessor();
+	bool Process(const EventFunction& func);
+	bool Fill(const FillFunction& func, THashTable* result, const HistogramBank& bank);
+	bool FillFiles(const FillFunction& func, const TableFunction& done, const HistogramBank& bank);
+	inline const bool IsValid() const { return file_list.size() > 0; }
+	inline const int GetNSlots() const { return nslots; }
+	inline const std::vector<std::string>& GetFiles() const { return file_list; }
+	inline void SetSelection(unsigned int group) { selection = group; } //0 for every event
+	inline void SetStopCheck(const StopFunction& func, long interval) { stop_check = func; check_interval = interval; }
+	inline void SetMaxEntries(long n) { max_entries = n; } //0 or less for no limit
+	inline const bool WasStopped() const { return stopped; }
+	inline const long GetReadEntries() const { return read_entries; }
+	inline const std::vector<std::string>& GetFilledFiles() const { return filled_files; }
+
+	static std::vector<std::string> ResolveInputFiles(const std::string& spec, const std::string& rundir, int runMin, int runMax, bool must_exist = true);
+	static int GetRunNumber(const std::string& filename, int fallback);
+	static std::vector<THashTable*> MakeTables(int n);
+	static void MergeTables(THashTable* result, std::vector<THashTable*>& tables);
+	static void MergeTables(THashTable* result, std::vector<THashTable*>& tables, int nthreads);
+
+private:
+	bool RunFiles(const std::function<bool(size_t index, int slot)>& work);
+	bool ProcessFile(const std::string& filename, const EventFunction& func, int slot, long* file_entries = nullptr);
+	static void MergeInto(THashTable* result, THashTable* table);
+	long CountEntries();
+
+	std::vector<std::string> file_list;
+	std::vector<std::string> filled_files;
+	std::string tree_name;
+	IOPolicy io_policy;
+	int nslots;
+	unsigned int selection;
+	StopFunction stop_check;
+	long check_interval;
+	long max_entries;
+
+	long total_entries;
+	ProgressReporter* progress; //of the running loop
+	std::atomic<long> read_entries;
+	std::atomic<bool> stopped;
+	std::mutex print_mutex;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/*
+	FiredIndex
+	Per-group entry lists of an organized data file. For every FiredGroup bit (see DataStructs.h) the index holds the sorted
+	list of entries whose fired mask has that bit, so that a stage which only needs one group can read just those entries
+	instead of the whole file (see FileProcessor::SetSelection).
+
+	The index is written by organize-data (when the FiredIndex setting is on) to a sidecar file next to the data file,
+	<datafile>.fired, so that it works the same for TTree and RNTuple data. File layout (native byte order):
+		FiredIndexHeader: magic, version, number of groups, total number of entries in the data file
+		per group: number of entries (int64), followed by that many entry numbers (int64)
+	An index whose total number of entries does not match the data file is stale and should not be used.
+*/
+#ifndef FIREDINDEX_H
+#define FIREDINDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "DataStructs.h"
+
+struct FiredIndexHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t ngroups;
+	int64_t nentries;
+};
+
+class FiredIndex
+{
+public:
+	FiredIndex();
+	FiredIndex(const std::string& filename);
+	~FiredIndex();
+
+	void Add(long long entry, unsigned int mask);
+	void Truncate(long long n);
+	bool Write(const std::string& filename, bool verbose = true) const;
+
+	inline const bool IsValid() const { return valid_flag; }
+	inline const long long GetNEntries() const { return nentries; }
+	//nullptr unless group is a single FiredGroup bit
+	const std::vector<long long>* GetEntries(unsigned int group) const;
+
+	static unsigned int ComputeMask(const AnasenEvent& event);
+	static std::string GetIndexName(const std::string& datafile) { return datafile + ".fired"; }
+	static const char* GetGroupName(unsigned int group);
+
+	static constexpr int ngroups = 11;
+
+private:
+	static int GetGroupIndex(unsigned int group);
+
+	std::vector<long long> entry_lists[ngroups];
+	long long nentries;
+	bool valid_flag;
+
+	static constexpr uint32_t index_version = 1;
+};
+
+#endif
@@ -14,7 +14,9 @@
 #include <THashTable.h>
 #include "ChannelMap.h"
 #include "ZeroCalMap.h"
+#include "ParameterMap.h"
 #include "DataStructs.h"
+#include "IOPolicy.h"
 #include "TSpectrum.h"
 
 class GainMatcher
@@ -22,9 +24,11 @@ class GainMatcher
 public:
 	GainMatcher(const std::string& channelfile, const std::string& zerofile);
 	~GainMatcher();
-	void MatchBacks(const std::string& inputname, const std::string& plotname, const std::string& outputname, int sx3match, int qqqmatch);
-	void MatchSX3UpDown(const std::string& inputname, const std::string& plotname, const std::string& outputname, const std::string& backmatchname);
-	void MatchFrontBack(const std::string& inputname, const std::string& graphname, const std::string& outputname, const std::string& backmatchname, const std::string& updownmatchname);
+	bool MatchBacks(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname, int sx3match, int qqqmatch);
+	bool MatchSX3UpDown(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname, const std::string& backmatchname);
+	bool MatchFrontBack(const std::vector<std::string>& inputnames, const std::string& graphname, const std::string& outputname, const std::string& backmatchname, const std::string& updownmatchname);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetNThreads(int n) { nthreads = n; }
 
 private:
 	void MyFill(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value);
@@ -32,14 +36,21 @@ private:
 																						int binsy, double miny, double maxy, double valuey);
 	GraphData GetPoints(THashTable* table, const std::string& name);
 	CalParams MakeGraph(THashTable* table, int gchan, const GraphData& data);
+	void FillBackSpectra(AnasenEvent* event, THashTable* histo_table);
+	void FillBackTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap);
+	void FillUpDownData(AnasenEvent* event, std::vector<GraphData>& gain_data, ParameterMap& backmap);
+	void FillUpDownTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap, ParameterMap& updownmap);
+	void FillFrontBackData(AnasenEvent* event, std::vector<GraphData>& gain_data, ParameterMap& backmap, ParameterMap& updownmap);
+	void FillFrontBackTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap, ParameterMap& updownmap, ParameterMap& frontbackmap);
+	void MergeGainData(std::vector<GraphData>& gain_data, std::vector<std::vector<GraphData>>& slot_data);
 	
 	ChannelMap cmap;
 	ZeroCalMap zmap;
 	TSpectrum spec;
-	const int max_chan=544; //May need modified if ANASEN is modified
+	IOPolicy io_policy;
+	int nthreads;
+	const int max_chan=DetectorGeometry::nchannels;
 	const double sigma = 1.0, threshold=0.4; //May need modified for each experiment
-
-	const int updown_list[8] = {1, 0, 3, 2, 5, 4, 7, 6}; //matches index -> index of up/down pair for SX3 fronts
 };
 
 #endif
\ No newline at end of file
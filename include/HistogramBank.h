@@ -0,0 +1,60 @@
+/*
+	HistogramBank
+	Persisted spectra of a calibration stage, one bank per input run, so that a calibration can be redone as new runs arrive
+	without refilling the runs which were already seen. Each bank is a ROOT file holding the histograms the stage filled from
+	that run, along with the stage key (which changes whenever the inputs to the spectra, such as the maps they are made with,
+	change) and a stamp of the run file (size and modification time). A bank is only used if both still match.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		HistogramBankDirectory: directory the banks are kept in, one subdirectory per stage (default none disables the banks)
+		RefitThreshold: relative change in the counts of a channel's spectrum which triggers a refit (default 0.1)
+
+	FileProcessor::Fill loads the bank of every run which has one and only fills (and saves) the rest. The bank also keeps
+	the counts of each channel at its last fit, so that stages can keep the previous result of a channel whose statistics
+	have not changed meaningfully (NeedsRefit) and save the updated counts once done (SaveFitCounts).
+*/
+#ifndef HISTOGRAMBANK_H
+#define HISTOGRAMBANK_H
+
+#include <string>
+#include <vector>
+#include <THashTable.h>
+#include "RunOptions.h"
+
+struct BankSettings
+{
+	std::string directory;
+	double refit_threshold = 0.1;
+
+	BankSettings() {}
+	BankSettings(const RunOptions& options);
+	inline const bool IsEnabled() const { return !directory.empty(); }
+	void Print() const;
+};
+
+class HistogramBank
+{
+public:
+	HistogramBank(const BankSettings& settings, const std::string& stage, const std::string& key, int nchannels);
+	~HistogramBank();
+
+	inline const bool IsEnabled() const { return settings.IsEnabled(); }
+	//nullptr if the run has no bank, or it is out of date
+	THashTable* Load(const std::string& inputfile, long& nentries) const;
+	bool Save(const std::string& inputfile, THashTable* table, long nentries) const;
+
+	bool NeedsRefit(int gchan, double counts);
+	bool SaveFitCounts() const;
+
+	static double GetCounts(THashTable* table, const std::string& name);
+
+private:
+	std::string GetBankName(const std::string& inputfile) const;
+	static std::string GetStamp(const std::string& inputfile);
+
+	BankSettings settings;
+	std::string stage_name, stage_key, bank_dir;
+	std::vector<double> fit_counts;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+	IOPolicy
+	Class which holds the settings used when reading ROOT trees, so that every stage reads its input the same way. Settings
+	are taken from the optional entries of the input file (see RunOptions):
+		TreeCacheSize: size of the TTreeCache in MB (0 disables the cache)
+		TreeCacheBranches: all (cache every branch up front) or learn (learn the used branches from the first entries)
+		TreeCacheLearnEntries: number of entries used to learn the branches when TreeCacheBranches is learn
+		AsyncPrefetch: 1 to enable asynchronous prefetching of the cache blocks
+		ImplicitMTThreads: number of threads ROOT may use to decompress baskets (0 disables, -1 uses all cores)
+		QuickLookFraction: fraction of every input read by each stage, for quick-look calibrations (default 1 reads everything)
+	Unlike the other settings, the defaults do not read the way the stages used to: a 64 MB TTreeCache over every branch is
+	on by default. TreeCacheSize: 0 turns it off and reads the trees without a cache, as before.
+
+	Key methods are ConfigureTree, which should be called on every input tree before the event loop, and Report, which
+	should be called when the loop is finished (before closing the file). EnableGlobal must be called once before any
+	files are opened.
+
+	Quick-look mode samples whole storage clusters (GetClusters), so that the data which is skipped is never read from disk.
+	SelectClusters takes evenly spaced clusters over each input, which spreads the sample over every run and over the length of
+	each run, and always gives the same entries for the same files. The sample cannot be finer than a cluster, and at least
+	one cluster of every input is read. Everything produced from a sample should be marked with WriteQuickLookNote.
+*/
+#ifndef IOPOLICY_H
+#define IOPOLICY_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "RunOptions.h"
+
+class TTree;
+class TDirectory;
+
+struct IOStats
+{
+	long long bytes_read = 0;
+	long long read_calls = 0;
+	double unzip_time = 0.0; //seconds
+};
+
+//Entries [first, last) of one storage cluster
+struct EntryRange
+{
+	long long first;
+	long long last;
+};
+
+class IOPolicy
+{
+public:
+	IOPolicy();
+	IOPolicy(const RunOptions& options);
+	~IOPolicy();
+	void EnableGlobal() const;
+	void ConfigureTree(TTree* tree) const;
+	IOStats Report(TTree* tree) const;
+	void Print() const;
+
+	inline const long GetCacheSize() const { return cache_size; }
+	inline const int GetImplicitMTThreads() const { return imt_threads; }
+
+	inline const bool IsQuickLook() const { return quicklook_fraction < 1.0; }
+	inline const double GetQuickLookFraction() const { return quicklook_fraction; }
+	std::vector<EntryRange> SelectClusters(const std::vector<EntryRange>& clusters) const;
+	std::string GetQuickLookNote() const;
+	void WriteQuickLookNote(std::ostream& output) const;
+	void WriteQuickLookNote(TDirectory* directory) const;
+
+	static std::vector<EntryRange> GetClusters(TTree* tree);
+	static long long CountEntries(const std::vector<EntryRange>& ranges);
+
+private:
+	long cache_size; //bytes
+	bool learn_branches;
+	int learn_entries;
+	bool async_prefetch;
+	int imt_threads;
+	double quicklook_fraction;
+};
+
+#endif
@@ -16,14 +16,14 @@ class MapChecker
 public:
 	MapChecker(const std::string& channelfile);
 	~MapChecker();
-	void CheckZOffset(const std::string& filename);
-	void CheckBackGainMatch(const std::string& filename);
-	void CheckUpDownGainMatch(const std::string& filename);
-	void CheckFrontBackGainMatch(const std::string& filename);
+	bool CheckZOffset(const std::string& filename);
+	bool CheckBackGainMatch(const std::string& filename);
+	bool CheckUpDownGainMatch(const std::string& filename);
+	bool CheckFrontBackGainMatch(const std::string& filename);
 
 private:
 	ChannelMap cmap;
-	const int nchannels = 544;
+	const int nchannels = DetectorGeometry::nchannels;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+/*
+	OutputPolicy
+	Class which holds the settings used when writing ROOT trees, so that every stage which produces a data file writes it
+	the same way. Settings are taken from the optional entries of the input file (see RunOptions):
+		DataFormat: format of the output data files (ttree or rntuple, see EventIO)
+		OutputProfile: named set of compression and basket settings (default, fast, zstd, archival, analysis; see GetProfiles)
+		CompressionAlgorithm: overrides the profile algorithm (none, zlib, lzma, lz4, zstd)
+		CompressionLevel: overrides the profile compression level (1-9; with the default profile and no algorithm, ROOT's
+		default algorithm is used at this level)
+		BasketSizeKB: overrides the profile basket size of every branch
+		AutoFlushMB: overrides the profile amount of data buffered before the baskets are flushed to the file
+		AsyncWriteQueue: number of events which may be queued for the output writer thread (0 fills the tree in the event loop)
+		FiredIndex: if 1, organize-data also writes the per-group entry lists of each run next to the data file (see FiredIndex)
+		CheckpointEntries: number of entries between checkpoints of organize-data and apply-calibrations outputs, which let an
+		interrupted job be resumed (see Checkpoint; 0 only saves the final one, which marks the output complete)
+
+	Key methods are ConfigureFile, which should be called right after the output file is opened, and ConfigureTree, which
+	should be called once all of the branches of the output tree exist (both are handled by the EventIO sinks). The queue size is handed to an AsyncTreeWriter
+	through GetWriteQueueSize.
+*/
+#ifndef OUTPUTPOLICY_H
+#define OUTPUTPOLICY_H
+
+#include <string>
+#include <vector>
+#include "RunOptions.h"
+
+class TFile;
+class TTree;
+
+//Negative values (and an autoflush of 0) leave the ROOT default in place
+struct OutputProfile
+{
+	std::string name;
+	int algorithm; //ROOT::RCompressionSetting::EAlgorithm value, 0 for uncompressed
+	int level;
+	int basket_size; //bytes
+	long long autoflush; //bytes
+};
+
+class OutputPolicy
+{
+public:
+	OutputPolicy();
+	OutputPolicy(const RunOptions& options);
+	~OutputPolicy();
+	void ConfigureFile(TFile* file) const;
+	void ConfigureTree(TTree* tree) const;
+	void Print() const;
+
+	int GetCompressionSettings() const;
+
+	inline void SetProfile(const OutputProfile& prof) { profile = prof; }
+	inline void SetDataFormat(const std::string& format) { data_format = format; }
+	inline const std::string& GetDataFormat() const { return data_format; }
+	inline const OutputProfile& GetProfile() const { return profile; }
+	inline const int GetWriteQueueSize() const { return write_queue; }
+	inline const bool GetWriteFiredIndex() const { return fired_index; }
+	inline const long long GetCheckpointEntries() const { return checkpoint_entries; }
+
+	static const std::vector<OutputProfile>& GetProfiles();
+	static bool FindProfile(const std::string& name, OutputProfile& prof);
+
+private:
+	static int ConvertAlgorithmName(const std::string& name);
+	static std::string ConvertAlgorithm2Name(int algorithm);
+
+	OutputProfile profile;
+	std::string data_format;
+	int write_queue;
+	bool fired_index;
+	long long checkpoint_entries;
+};
+
+#endif
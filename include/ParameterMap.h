@@ -20,6 +20,7 @@ class ParameterMap
 public:
 	typedef std::unordered_map<int, CalParams>::iterator Iter; 
 	ParameterMap(const std::string& filename);
+	ParameterMap(const double* params, int size); //dense (intercept, slope) pairs by global channel, NaN where not set
 	~ParameterMap();
 	inline Iter FindParameters(int gchan) { return map.find(gchan); }
 	inline Iter End() { return map.end(); }
@@ -0,0 +1,123 @@
+/*
+	PerfCounters
+	Hardware performance counters (Linux perf_event_open) around the hot loops, to see what the per-event and per-hit work
+	costs at the instruction level: instructions, cycles, cache misses and branch misses. Regions are placed by macros:
+		ANASEN_PERF_REGION(name): counts from here to the end of the scope as one event of the region. Regions are placed
+		around the work done for a single event (building an AnasenEvent, filling the spectra of an event, calibrating an
+		event), so that the counts divide into a cost per event.
+		ANASEN_PERF_HIT(): counts one hit in the innermost region open on the thread (i.e. one FillEvent or histogram fill).
+		ANASEN_PERF_HITS(n): counts n hits in the innermost region open on the thread.
+	Names are string literals of the form Stage/region.
+
+	The macros expand to nothing unless built with counters (make PERF=1, which defines ANASEN_PERF). With counters, each
+	thread opens its own group of the four counters the first time it enters a region, counting user space only, and every
+	region reads the group at entry and exit (two system calls per event, so counts include a small fixed overhead, and wall
+	times are slower than a normal build). If the counters cannot be opened (i.e. perf_event_paranoid is too strict, or in a
+	container without access to the PMU), a warning is printed once and the regions only count events and hits. If the
+	kernel had to multiplex the counters, the counts are partial and the summary says so.
+
+	WriteSummary writes one line per region, summed over threads, as tab-separated columns (see the header line of the
+	file); PrintSummary gives the same per event and per hit. Both must only be called once every counted thread has finished.
+*/
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+#ifdef ANASEN_PERF
+#define ANASEN_PERF_CONCAT_IMPL(a, b) a##b
+#define ANASEN_PERF_CONCAT(a, b) ANASEN_PERF_CONCAT_IMPL(a, b)
+#define ANASEN_PERF_REGION(name) PerfCounters::Region ANASEN_PERF_CONCAT(perf_region_, __LINE__)(name)
+#define ANASEN_PERF_HIT() PerfCounters::AddHits(1)
+#define ANASEN_PERF_HITS(n) PerfCounters::AddHits(n)
+#else
+#define ANASEN_PERF_REGION(name)
+#define ANASEN_PERF_HIT()
+#define ANASEN_PERF_HITS(n)
+#endif
+
+class PerfCounters
+{
+public:
+	static constexpr int ncounters = 4; //instructions, cycles, cache misses, branch misses
+
+	struct Counts
+	{
+		uint64_t values[ncounters] = {0, 0, 0, 0};
+	};
+
+	struct RegionTotal
+	{
+		const char* name;
+		long long events = 0;
+		long long hits = 0;
+		Counts counts;
+	};
+
+private:
+	struct ThreadCounters;
+
+public:
+	class Region
+	{
+	public:
+		Region(const char* name);
+		~Region();
+	private:
+		ThreadCounters* thread;
+		RegionTotal* total;
+		Region* outer;
+		long long hits;
+		Counts start;
+		bool counting;
+
+		friend class PerfCounters;
+	};
+
+	static PerfCounters& Get();
+#ifdef ANASEN_PERF
+	static constexpr bool IsEnabled() { return true; }
+#else
+	static constexpr bool IsEnabled() { return false; }
+#endif
+	static void AddHits(long long n);
+
+	bool WriteSummary(const std::string& filename) const;
+	void PrintSummary() const;
+
+	static const char* GetCounterName(int index);
+
+private:
+	struct ThreadCounters
+	{
+		int fds[ncounters] = {-1, -1, -1, -1};
+		bool opened = false;
+		bool available = false;
+		bool multiplexed = false;
+		Region* current = nullptr;
+		std::deque<RegionTotal> totals; //a handful of regions per thread, searched by pointer; a deque keeps them in place
+
+		~ThreadCounters();
+		bool Open();
+		void Close();
+		bool Read(Counts& counts);
+		RegionTotal* Find(const char* name);
+	};
+
+	PerfCounters();
+	ThreadCounters& GetThread();
+	void Warn();
+	std::map<std::string, RegionTotal> Merge(bool& multiplexed) const;
+
+	std::vector<std::shared_ptr<ThreadCounters>> threads; //kept after their thread exits, for the summary
+	std::mutex thread_mutex;
+	bool warned;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+	Pipeline
+	Runs a set of stages as a DAG, skipping the stages whose outputs are current. Each stage lists the files it reads, the files
+	it writes, and a string of the parameters it depends on (see RunOptions::GetSettings). The edges of the graph are found by
+	matching the inputs of each stage to the outputs of the others, so a stage only waits on the stages which write what it reads.
+
+	When a stage is ready (every stage it depends on has finished), its key is computed from its name, its parameters, and its
+	inputs: text files are hashed by content (so a rerun of an upstream stage which gives the same result does not invalidate
+	anything downstream), and ROOT data files by name, size and modification time. If the key matches the key recorded in the
+	state file from the last successful run, and every output exists, the stage is current and is not run. Otherwise it is run,
+	and it succeeds if its function returns true and every output was written. Stages downstream of a failure are not run.
+
+	Up to njobs stages run at once; independent branches (the organize shards of each run, the check stages) can run side by
+	side. Stages running at the same time must not share state, and each may use threads of its own. The state file is rewritten
+	after every stage which succeeds, so an interrupted pipeline resumes where it stopped.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+class Pipeline
+{
+public:
+	typedef std::function<bool()> StageFunction;
+
+	Pipeline(const std::string& statefile);
+	~Pipeline();
+
+	void AddStage(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs,
+					const std::string& parameters, const StageFunction& func);
+	bool Run(int njobs);
+	inline const bool IsOutput(const std::string& filename) const { return producers.find(filename) != producers.end(); }
+
+private:
+	enum class StageStatus
+	{
+		Pending,
+		Running,
+		Current,
+		Done,
+		Failed
+	};
+
+	struct Stage
+	{
+		std::string name;
+		std::vector<std::string> inputs, outputs;
+		std::string parameters;
+		StageFunction func;
+		std::vector<int> dependencies;
+		StageStatus status = StageStatus::Pending;
+		uint64_t key = 0;
+	};
+
+	bool Build();
+	uint64_t ComputeKey(const Stage& stage) const;
+	static std::string GetFileStamp(const std::string& filename);
+	bool IsCurrent(const Stage& stage) const;
+	void RunStage(int index);
+	void LoadState();
+	void SaveState();
+
+	std::string state_name;
+	std::vector<Stage> stages;
+	std::unordered_map<std::string, int> producers; //output file -> stage
+	std::unordered_map<std::string, uint64_t> state; //stage name -> key of the last successful run
+	std::mutex state_mutex;
+	std::condition_variable stage_finished;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+	ProgressReporter
+	Progress and throughput of an event loop, shared by every stage so that they all report the same way: the fraction of the
+	entries done, the event rate, the rate data is read from ROOT files, and the time left. Settings are taken from the optional
+	entries of the input file (see RunOptions):
+		ProgressMode: terminal (default; one line, rewritten in place), log (one line of key=value pairs per report, for batch
+		logs), or off
+		ProgressInterval: seconds between reports (default 1 in terminal mode, 30 in log mode)
+	The settings are shared by every reporter, and must be given once through Configure before any loop starts.
+
+	Add is called from the event loop, on any number of threads, with the number of entries handled since the last call. It is
+	a relaxed atomic add and a compare, and only every few hundred entries (see stride) does it read the clock; the thread which
+	finds a report due prints it, while the others carry on. Threads which share a reporter may still batch their updates to
+	avoid contending on it (see FileProcessor). Skip counts entries which were accounted for without being read (i.e. loaded
+	from a histogram bank), which count towards the progress but not towards the event rate. Finish prints the final totals.
+
+	The read rate is taken from the bytes read by every ROOT file of the process (TFile::GetFileBytesRead), so stages which run
+	side by side (see Pipeline) each report the combined rate, and RNTuple inputs are not counted. Log lines start with
+	"progress" and always give the same keys:
+		progress stage=<label> state=<running|done> entries=<n> total=<n> percent=<p> elapsed_s=<t> events_per_s=<r>
+			mb_per_s=<r> eta_s=<t>
+*/
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include "RunOptions.h"
+
+enum class ProgressMode
+{
+	Terminal,
+	Log,
+	Off
+};
+
+struct ProgressSettings
+{
+	ProgressMode mode = ProgressMode::Terminal;
+	double interval = 1.0; //seconds
+
+	ProgressSettings() {}
+	ProgressSettings(const RunOptions& options);
+	void Print() const;
+};
+
+class ProgressReporter
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	ProgressReporter(const std::string& label, long long total, long long done = 0, std::mutex* print_lock = nullptr);
+	~ProgressReporter();
+
+	inline void Add(long long n)
+	{
+		long long now = done.fetch_add(n, std::memory_order_relaxed) + n;
+		if(now >= next_check.load(std::memory_order_relaxed))
+			Check(now);
+	}
+	inline void Skip(long long n) { skipped.fetch_add(n, std::memory_order_relaxed); Add(n); }
+	void Finish();
+	inline const long long GetDone() const { return done.load(std::memory_order_relaxed); }
+
+	static void Configure(const ProgressSettings& progress_settings);
+
+private:
+	void Check(long long now);
+	void Print(long long now, bool final);
+	static std::string FormatTime(double seconds);
+
+	std::string stage_label;
+	long long total_entries;
+	long long start_done;
+	long long start_bytes;
+	long long stride; //entries between clock reads
+	Clock::time_point start_time;
+	std::atomic<long long> done;
+	std::atomic<long long> skipped;
+	std::atomic<long long> next_check; //entry count
+	std::atomic<long long> next_report; //ns since start
+	std::mutex own_lock;
+	std::mutex* print_lock; //shared with other output of the loop, so that lines are not mixed
+	bool finished;
+
+	static ProgressSettings settings;
+};
+
+#endif
@@ -0,0 +1,39 @@
+/*
+	RunOptions
+	Wrapper around std::unordered_map which gives access to the optional settings of a run. Optional settings are given
+	in the input file after all of the required entries, one per line, using the same "Key: value" format as the rest of
+	the file (i.e. TreeCacheSize: 100). Lines starting with # are ignored.
+
+	Key methods are the Get functions. If a setting was not given in the input file, the passed default is returned, so
+	every optional setting must have a sensible default, which reproduces the standard behavior wherever it can (the read
+	cache of IOPolicy is on by default).
+*/
+#ifndef RUNOPTIONS_H
+#define RUNOPTIONS_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <unordered_map>
+
+class RunOptions
+{
+public:
+	RunOptions();
+	~RunOptions();
+	void FillMap(std::istream& input);
+	inline const bool HasOption(const std::string& key) const { return map.find(key) != map.end(); }
+	inline void SetOption(const std::string& key, const std::string& value) { map[key] = value; }
+
+	std::string GetString(const std::string& key, const std::string& default_value) const;
+	long GetLong(const std::string& key, long default_value) const;
+	int GetInt(const std::string& key, int default_value) const;
+	double GetDouble(const std::string& key, double default_value) const;
+	bool GetBool(const std::string& key, bool default_value) const;
+	std::string GetSettings(const std::vector<std::string>& keys) const;
+
+private:
+	std::unordered_map<std::string, std::string> map;
+};
+
+#endif
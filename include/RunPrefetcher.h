@@ -0,0 +1,59 @@
+/*
+	RunPrefetcher
+	Class which warms the upcoming raw run files into the OS page cache while the current run is being converted, so that
+	the organize-data loop does not alternate between cold disk reads and computation. A background thread hints the kernel
+	(posix_fadvise) and then reads each of the next few files through once. Settings are taken from the optional entries of
+	the input file (see RunOptions):
+		PrefetchRuns: number of runs ahead of the current run to warm (0 disables prefetching)
+		PrefetchMemoryMB: maximum amount of data warmed ahead of the current run at any time
+
+	Key methods are Start, which is given the full list of files before the loop, and BeginRun, which should be called just
+	before each file is processed. BeginRun moves the prefetch window and reports how much of the file was warmed and how
+	much of it is resident in the page cache.
+*/
+#ifndef RUNPREFETCHER_H
+#define RUNPREFETCHER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "RunOptions.h"
+
+class RunPrefetcher
+{
+public:
+	RunPrefetcher();
+	RunPrefetcher(const RunOptions& options);
+	~RunPrefetcher();
+	void Start(const std::vector<std::string>& files);
+	void BeginRun(int index);
+	void Stop();
+	void Print() const;
+
+	inline const bool IsEnabled() const { return depth > 0; }
+
+	static double GetResidentFraction(const std::string& filename);
+
+private:
+	void Worker();
+	long long WarmFile(int index);
+
+	int depth;
+	long long memory_cap; //bytes
+	std::vector<std::string> file_list;
+	std::vector<long long> file_sizes;
+	std::vector<long long> warmed_bytes;
+	std::vector<bool> attempted;
+	int current;
+	bool stop_flag;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	static constexpr long long chunk_size = 4*1024*1024;
+};
+
+#endif
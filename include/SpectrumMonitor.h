@@ -0,0 +1,61 @@
+/*
+	SpectrumMonitor
+	Statistics-driven early termination of a calibration pass. Each channel which is calibrated is given the number of peaks
+	its spectrum should contain; once every live channel has at least EarlyStopCounts counts per expected peak, there is
+	nothing more to gain from reading data and the pass can stop. A channel is live if it has at least EarlyStopLiveFraction
+	of the median counts of the channels with data, so that dead or nearly dead channels do not hold up the pass.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		EarlyStopCounts: counts needed per expected peak (default 0 disables early termination)
+		EarlyStopInterval: number of entries each thread reads between checks (default 100000)
+		EarlyStopLiveFraction: fraction of the median channel counts below which a channel is not waited on (default 0.05)
+
+	Update is the stop check of a FileProcessor (see SetStopCheck; Attach installs it): it is called on the thread of a slot, reads the
+	channel_<gchan> spectra of that slot's own table, and merges the counts of every slot. Once the pass is over, Finish takes
+	the final counts of every slot and reports the channels which did not reach their target.
+*/
+#ifndef SPECTRUMMONITOR_H
+#define SPECTRUMMONITOR_H
+
+#include <vector>
+#include <mutex>
+#include <THashTable.h>
+#include "RunOptions.h"
+#include "FileProcessor.h"
+
+struct EarlyStopSettings
+{
+	double counts_per_peak = 0.0;
+	long check_interval = 100000;
+	double live_fraction = 0.05;
+
+	EarlyStopSettings() {}
+	EarlyStopSettings(const RunOptions& options);
+	inline const bool IsEnabled() const { return counts_per_peak > 0.0; }
+	void Print() const;
+};
+
+class SpectrumMonitor
+{
+public:
+	SpectrumMonitor(const EarlyStopSettings& settings, int nslots, int nchannels);
+	~SpectrumMonitor();
+
+	void SetPeaks(int gchan, int npeaks); //channels with no peaks are not monitored
+	bool Update(int slot, THashTable* table);
+	void Attach(FileProcessor& processor, const std::vector<THashTable*>& slot_tables);
+	void Finish(const std::vector<THashTable*>& slot_tables);
+	void Report() const;
+
+private:
+	double GetLiveThreshold() const;
+
+	EarlyStopSettings settings;
+	std::vector<std::vector<double>> slot_counts;
+	std::vector<double> totals;
+	std::vector<double> targets;
+	bool done_flag;
+	mutable std::mutex mutex;
+};
+
+#endif
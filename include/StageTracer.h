@@ -0,0 +1,104 @@
+/*
+	StageTracer
+	Scoped timers for finding where the time of a stage goes. Two kinds of timer are placed in the code through macros:
+		ANASEN_TRACE_SCOPE(name): records a span (start and duration on its thread) for each pass through the scope. Used
+		for the phases of a stage (filling, peak finding, fitting, writing), which run a few thousand times at most.
+		ANASEN_TRACE_ACCUMULATE(name): only adds the time and the number of calls to a per-thread total. Used inside the event
+		loop (reading an entry, filling a histogram), where recording every pass would cost more than the work measured.
+	Names are string literals of the form Stage/phase, and the summary is grouped by the stage part.
+
+	The macros expand to nothing unless built with tracing (make TRACE=1, which defines ANASEN_TRACE), so a normal build pays
+	nothing. With tracing, each thread records into its own buffer (no locking outside of the first record of a thread), and
+	at the end of the program the spans are written as a Chrome trace-event JSON file (open in Perfetto or chrome://tracing)
+	by WriteTrace, and the spans and totals of every name are summed over threads by PrintSummary. Both must only be called
+	once every traced thread has finished.
+*/
+#ifndef STAGETRACER_H
+#define STAGETRACER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+#ifdef ANASEN_TRACE
+#define ANASEN_TRACE_CONCAT_IMPL(a, b) a##b
+#define ANASEN_TRACE_CONCAT(a, b) ANASEN_TRACE_CONCAT_IMPL(a, b)
+#define ANASEN_TRACE_SCOPE(name) StageTracer::Scope ANASEN_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define ANASEN_TRACE_ACCUMULATE(name) StageTracer::Accumulator ANASEN_TRACE_CONCAT(trace_accumulate_, __LINE__)(name)
+#else
+#define ANASEN_TRACE_SCOPE(name)
+#define ANASEN_TRACE_ACCUMULATE(name)
+#endif
+
+class StageTracer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Span
+	{
+		const char* name;
+		long long start; //ns since the tracer was created
+		long long duration; //ns
+	};
+
+	struct Total
+	{
+		const char* name;
+		long long calls;
+		long long duration; //ns
+	};
+
+	//Records one span from construction to destruction
+	class Scope
+	{
+	public:
+		Scope(const char* name) : span_name(name), start(Clock::now()) {}
+		~Scope() { Get().AddSpan(span_name, start, Clock::now()); }
+	private:
+		const char* span_name;
+		Clock::time_point start;
+	};
+
+	//Adds the time from construction to destruction to the total of its name
+	class Accumulator
+	{
+	public:
+		Accumulator(const char* name) : total_name(name), start(Clock::now()) {}
+		~Accumulator() { Get().AddTotal(total_name, start, Clock::now()); }
+	private:
+		const char* total_name;
+		Clock::time_point start;
+	};
+
+	static StageTracer& Get();
+#ifdef ANASEN_TRACE
+	static constexpr bool IsEnabled() { return true; }
+#else
+	static constexpr bool IsEnabled() { return false; }
+#endif
+
+	void AddSpan(const char* name, const Clock::time_point& start, const Clock::time_point& stop);
+	void AddTotal(const char* name, const Clock::time_point& start, const Clock::time_point& stop);
+	bool WriteTrace(const std::string& filename) const;
+	void PrintSummary() const;
+
+private:
+	struct ThreadBuffer
+	{
+		int thread;
+		std::vector<Span> spans;
+		std::vector<Total> totals; //a handful of names per thread, searched by pointer
+	};
+
+	StageTracer();
+	ThreadBuffer& GetBuffer();
+
+	Clock::time_point origin;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::mutex buffer_mutex;
+};
+
+#endif
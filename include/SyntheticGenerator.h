@@ -0,0 +1,106 @@
+/*
+	SyntheticGenerator
+	Writes synthetic raw ANASEN data with a known calibration, so that every stage can be run, benchmarked, and checked without
+	the experiment files. Each channel of the channel map is given a true zero offset (ADC) and a true gain (ADC per MeV), and
+	hits are turned into raw ADC values by adc = offset + gain*charge plus gaussian noise. Two kinds of run are made, in the raw
+	DataTree format of evt2root (mb1/mb2 energy and time arrays, -1 for a channel without a hit):
+		Pulser: every channel fires in every event, with the pulser amplitude stepping through the front (SX3 fronts, QQQ rings)
+		and back (SX3 backs, QQQ wedges) pulser values. The amplitudes are scaled to ADC by FrontPulserADC and BackPulserADC.
+		Alpha: each event has a Poisson number of particles (Multiplicity), each with one of the alpha energies, smeared by the
+		resolution, in a random detector. A QQQ particle fires one wedge and one ring; an SX3 particle fires one back and both
+		ends of one front strip, with the charge shared between the upstream and downstream ends by a random position. Noise hits
+		(a Poisson number per event, NoiseHits) add small signals on random channels.
+	Runs are organized with DataOrganizer like any other raw data, so the organized EventTree follows the same channel map.
+
+	Settings are taken from the optional entries of the input file (see RunOptions), all starting with Synthetic (see the
+	README). The truth is drawn from the seed, so the same settings always give the same calibration.
+
+	WriteTruth writes the true calibration in the format of each stage's output file. For the gain-matching files it needs the
+	reference back and wedge channels used by MatchBacks. Validate compares the outputs of the stages with the truth. It gives
+	the zero offsets, and the energy of each alpha line as calibrated by the full chain of files (see CalibrationSnapshot), for
+	every back, wedge and ring. SX3 fronts have no calibration of their own, so they are not checked.
+*/
+#ifndef SYNTHETICGENERATOR_H
+#define SYNTHETICGENERATOR_H
+
+#include <string>
+#include <vector>
+#include <TRandom3.h>
+#include "ChannelMap.h"
+#include "RunOptions.h"
+
+enum class SyntheticRunType
+{
+	Pulser,
+	Alpha
+};
+
+struct SyntheticSettings
+{
+	long events = 100000; //per run
+	int pulser_runs = 1; //the first runs of the range are pulser runs, the rest are alpha runs
+	unsigned int seed = 1;
+	double offset_min = 200.0; //ADC
+	double offset_max = 400.0;
+	double gain = 900.0; //ADC per MeV
+	double gain_spread = 0.1; //fractional, uniform
+	double front_pulser_adc = 1400.0; //ADC per pulser unit at the nominal gain
+	double back_pulser_adc = 10000.0;
+	std::vector<double> front_pulses = {1.0, 2.0, 3.0, 4.0, 5.0, 8.0, 10.0}; //as in ZeroCalibrator
+	std::vector<double> back_pulses = {0.25, 0.5, 0.75, 1.0, 1.25};
+	std::vector<double> alpha_energies = {5.155, 5.486, 5.805}; //MeV, as in EnergyCalibrator
+	double multiplicity = 1.0; //mean particles per alpha event
+	double resolution = 0.02; //MeV, sigma
+	double noise = 5.0; //ADC, sigma
+	double noise_hits = 0.1; //mean per alpha event
+	std::string truth_prefix = "results/synthetic_";
+
+	SyntheticSettings() {}
+	SyntheticSettings(const RunOptions& options);
+	void Print() const;
+};
+
+class SyntheticGenerator
+{
+public:
+	SyntheticGenerator(const std::string& channelfile, const SyntheticSettings& settings);
+	~SyntheticGenerator();
+
+	inline const bool IsValid() const { return cmap.IsValid(); }
+	bool WriteRun(const std::string& filename, SyntheticRunType type);
+	std::vector<std::string> GetTruthFiles() const; //CalibrationStage order, starting with the channel map
+	bool WriteTruth(int sx3reference, int qqqreference);
+	bool Validate(const std::vector<std::string>& stagefiles);
+
+private:
+	struct Strip
+	{
+		int up;
+		int down;
+	};
+
+	struct Detector
+	{
+		bool sx3 = false;
+		std::vector<int> backs; //SX3 backs or QQQ wedges
+		std::vector<int> fronts; //QQQ rings
+		std::vector<Strip> strips; //SX3 fronts
+	};
+
+	void MakeTruth();
+	void AddParticle(std::vector<double>& charges);
+	int ToADC(int gchan, double charge);
+	double GetReferenceGain(int gchan, int sx3reference, int qqqreference);
+
+	ChannelMap cmap;
+	std::string channel_name;
+	SyntheticSettings settings;
+	TRandom3 generator;
+	std::vector<double> offsets; //ADC, per global channel
+	std::vector<double> gains; //ADC per MeV, 0 for channels not in the map
+	std::vector<Detector> detectors;
+	std::vector<int> channel_detectors; //index in detectors, per global channel, -1 if none
+	std::vector<int> channels; //every channel in the map
+};
+
+#endif
@@ -21,6 +21,7 @@ public:
 	typedef std::unordered_map<int, double>::iterator Iter;
 	
 	ZeroCalMap(const std::string& filename);
+	ZeroCalMap(const double* offsets, int size); //dense array by global channel, NaN where not set
 	~ZeroCalMap();
 	inline Iter FindOffset(int gchan) { return zmap.find(gchan); }
 	inline Iter End() { return zmap.end(); }
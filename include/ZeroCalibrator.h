@@ -14,7 +14,11 @@
 #include <THashTable.h>
 #include <TSpectrum.h>
 #include "ChannelMap.h"
+#include "ZeroCalMap.h"
 #include "DataStructs.h"
+#include "IOPolicy.h"
+#include "SpectrumMonitor.h"
+#include "HistogramBank.h"
 
 class ZeroCalibrator
 {
@@ -22,8 +26,12 @@ class ZeroCalibrator
 public:
 	ZeroCalibrator(const std::string& channelfile);
 	~ZeroCalibrator();
-	void Run(const std::string& inputname, const std::string& plotname, const std::string& outputname);
-	void RecoverOffsets(const std::string& inputname, const std::string& plotname, const std::string& outputname);
+	bool Run(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname);
+	bool RecoverOffsets(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname);
+	inline void SetIOPolicy(const IOPolicy& policy) { io_policy = policy; }
+	inline void SetNThreads(int n) { nthreads = n; }
+	inline void SetEarlyStop(const EarlyStopSettings& settings) { early_stop = settings; }
+	inline void SetHistogramBank(const BankSettings& settings) { bank_settings = settings; }
 
 private:
 	void FillHistogram(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value);
@@ -32,12 +40,20 @@ private:
 	GraphData GetPoints(THashTable* table, int gchan, const std::string& histoname);
 	GraphData GetPointsAlphas(THashTable* table, int gchan, const std::string& histoname);
 	double MakeGraph(THashTable* table, const std::string& name, const GraphData& data);
+	void FillOffsetSpectra(AnasenEvent* event, THashTable* table);
+	void FillOffsetTestPlot(THashTable* table, ZeroCalMap& zmap, const SiliconHit& hit);
+	void FillOffsetTestPlots(AnasenEvent* event, THashTable* table, ZeroCalMap& zmap);
 
 	TSpectrum spec;
 
 	double sigma, threshold;
 
 	ChannelMap cmap;
+	IOPolicy io_policy;
+	int nthreads;
+	EarlyStopSettings early_stop;
+	BankSettings bank_settings;
+	const int nchannels = DetectorGeometry::nchannels;
 
 	/****Experiment parameters****/
 	std::vector<double> frontPulseValues = {1.0, 2.0, 3.0, 4.0, 5.0, 8.0, 10.0}; //Values from experiment, should be adjusted each data set
@@ -0,0 +1,423 @@
+/*
+	CalibrationBundle
+	Class which packs the channel map and the results of every calibration stage into a single versioned binary file, so
+	that a set of calibrations is always used together. The bundle is memory-mapped when loaded; the maps are stored as dense
+	arrays indexed by global channel, so nothing needs to be parsed at startup, and every process reading the same bundle
+	sees the same snapshot.
+
+	File layout (native byte order, checked on load):
+		BundleHeader: magic, schema version, number of channels, number of sections, creation time, checksum of the rest of the file
+		BundleSection x nsections: stage, provenance (source file, its checksum and modification time, number of channels set), data location
+		data: ChannelData[nchannels] for the channel map, double[nchannels] for the zero offsets, and (intercept, slope)
+		pairs double[2*nchannels] for the gain-matching and energy stages. Channels which are not set are NaN (ChannelData()
+		for the channel map).
+
+	Bundles are made from the current text files with Export, and written back out to text files with Import. ChannelMap,
+	ZeroCalMap, and ParameterMap can be made from the arrays of a loaded bundle. The channel map table is used in place, so
+	the bundle must outlive the ChannelMap.
+*/
+#include "CalibrationBundle.h"
+#include "ZeroCalMap.h"
+#include "ParameterMap.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(std::is_trivially_copyable<ChannelData>::value, "ChannelData must be trivially copyable to be stored in a CalibrationBundle");
+
+static const char bundle_magic[8] = {'A', 'N', 'C', 'A', 'L', 'B', 'N', 'D'};
+static const uint32_t bundle_byte_order = 0x01020304;
+
+CalibrationBundle::CalibrationBundle() :
+	buffer(nullptr), buffer_size(0), header(nullptr), sections(nullptr), valid_flag(false)
+{
+}
+
+CalibrationBundle::CalibrationBundle(const std::string& filename) :
+	CalibrationBundle()
+{
+	Load(filename);
+}
+
+CalibrationBundle::~CalibrationBundle()
+{
+	if(buffer != nullptr)
+		munmap(buffer, buffer_size);
+}
+
+void CalibrationBundle::Load(const std::string& filename)
+{
+	name = filename;
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		std::cerr<<"Unable to open calibration bundle "<<filename<<" at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(BundleHeader))
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" is too small at CalibrationBundle::Load()!"<<std::endl;
+		close(fd);
+		return;
+	}
+
+	void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED)
+	{
+		std::cerr<<"Unable to map calibration bundle "<<filename<<" at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+	buffer = (char*) addr;
+	buffer_size = info.st_size;
+	header = (const BundleHeader*) buffer;
+
+	if(std::memcmp(header->magic, bundle_magic, sizeof(bundle_magic)) != 0)
+	{
+		std::cerr<<filename<<" is not a calibration bundle at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+	else if(header->byte_order != bundle_byte_order)
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" was written on a machine with a different byte order at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+	else if(header->version != schema_version)
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" has schema version "<<header->version<<", expected "<<schema_version<<" at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+	//The maps are indexed up to the channel count of this build, so a bundle of another geometry would be read past its sections
+	else if(header->nchannels != (uint32_t) DetectorGeometry::nchannels)
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" has "<<header->nchannels<<" channels, expected "<<DetectorGeometry::nchannels<<" at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+
+	uint64_t data_start = sizeof(BundleHeader) + ((uint64_t) header->nsections)*sizeof(BundleSection);
+	if(data_start > buffer_size)
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" is truncated at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+	if(ComputeChecksum(buffer + sizeof(BundleHeader), buffer_size - sizeof(BundleHeader)) != header->checksum)
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" failed its checksum at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+
+	sections = (const BundleSection*) (buffer + sizeof(BundleHeader));
+	for(uint32_t i=0; i<header->nsections; i++)
+	{
+		//Written so that offset + size cannot overflow
+		if(sections[i].offset < data_start || sections[i].offset > buffer_size || sections[i].size > buffer_size - sections[i].offset ||
+			sections[i].offset % 8 != 0)
+		{
+			std::cerr<<"Bad section "<<i<<" in calibration bundle "<<filename<<" at CalibrationBundle::Load()!"<<std::endl;
+			return;
+		}
+	}
+
+	if(!HasStage(CalibrationStage::Channels))
+	{
+		std::cerr<<"Calibration bundle "<<filename<<" has no channel map at CalibrationBundle::Load()!"<<std::endl;
+		return;
+	}
+
+	valid_flag = true;
+}
+
+const BundleSection* CalibrationBundle::FindSection(CalibrationStage stage) const
+{
+	if(sections == nullptr)
+		return nullptr;
+
+	for(uint32_t i=0; i<header->nsections; i++)
+	{
+		if(sections[i].stage == (uint32_t) stage)
+			return &sections[i];
+	}
+	return nullptr;
+}
+
+bool CalibrationBundle::HasStage(CalibrationStage stage) const
+{
+	const BundleSection* section = FindSection(stage);
+	if(section == nullptr || section->nentries == 0)
+		return false;
+
+	uint64_t expected = header->nchannels;
+	if(stage == CalibrationStage::Channels)
+		expected *= sizeof(ChannelData);
+	else if(stage == CalibrationStage::ZeroOffset)
+		expected *= sizeof(double);
+	else
+		expected *= 2*sizeof(double);
+	return section->size == expected;
+}
+
+const ChannelData* CalibrationBundle::GetChannelTable() const
+{
+	if(!HasStage(CalibrationStage::Channels))
+		return nullptr;
+	return (const ChannelData*) (buffer + FindSection(CalibrationStage::Channels)->offset);
+}
+
+const double* CalibrationBundle::GetOffsets() const
+{
+	if(!HasStage(CalibrationStage::ZeroOffset))
+		return nullptr;
+	return (const double*) (buffer + FindSection(CalibrationStage::ZeroOffset)->offset);
+}
+
+const double* CalibrationBundle::GetParameters(CalibrationStage stage) const
+{
+	if(stage == CalibrationStage::Channels || stage == CalibrationStage::ZeroOffset || !HasStage(stage))
+		return nullptr;
+	return (const double*) (buffer + FindSection(stage)->offset);
+}
+
+void CalibrationBundle::Print() const
+{
+	if(!valid_flag)
+	{
+		std::cout<<"Calibration bundle "<<name<<": invalid"<<std::endl;
+		return;
+	}
+
+	char date[64];
+	time_t created = header->created;
+	std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&created));
+	std::cout<<"Calibration bundle "<<name<<" (schema version "<<header->version<<", created "<<date<<")"<<std::endl;
+	for(uint32_t i=0; i<header->nsections; i++)
+	{
+		const BundleSection& section = sections[i];
+		std::cout<<"\t"<<GetStageName((CalibrationStage) section.stage)<<": ";
+		if(section.nentries == 0)
+		{
+			std::cout<<"not set"<<std::endl;
+			continue;
+		}
+		time_t modified = section.source_time;
+		std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&modified));
+		std::cout<<section.nentries<<" channels from "<<section.source<<" (modified "<<date<<", checksum "<<std::hex<<section.source_checksum<<std::dec<<")"<<std::endl;
+	}
+}
+
+/*
+	Writes the stages back out in the same text formats the calibration stages produce.
+*/
+bool CalibrationBundle::Import(const std::vector<std::string>& stagefiles) const
+{
+	if(!valid_flag)
+	{
+		std::cerr<<"Invalid calibration bundle at CalibrationBundle::Import()! Exiting."<<std::endl;
+		return false;
+	}
+
+	for(int i=0; i<nstages && i<(int)stagefiles.size(); i++)
+	{
+		CalibrationStage stage = (CalibrationStage) i;
+		if(stagefiles[i] == "" || !HasStage(stage))
+			continue;
+
+		std::ofstream output(stagefiles[i]);
+		if(!output.is_open())
+		{
+			std::cerr<<"Unable to open "<<stagefiles[i]<<" at CalibrationBundle::Import()! Exiting."<<std::endl;
+			return false;
+		}
+
+		if(stage == CalibrationStage::Channels)
+		{
+			const ChannelData* table = GetChannelTable();
+			for(int gchan=0; gchan<GetNChannels(); gchan++)
+			{
+				const ChannelData& data = table[gchan];
+				if(data.detectorType == DetectorType::None)
+					continue;
+				output<<gchan<<" "<<ChannelMap::GetTypeName(data.detectorType)<<" "<<ChannelMap::GetIDName(data.detectorType, data.detectorID)<<" ";
+				output<<ChannelMap::GetComponentName(data.detectorComponent)<<" "<<ChannelMap::GetDirectionName(data.detectorDirection)<<" "<<data.channel<<std::endl;
+			}
+		}
+		else if(stage == CalibrationStage::ZeroOffset)
+		{
+			const double* offsets = GetOffsets();
+			for(int gchan=0; gchan<GetNChannels(); gchan++)
+				if(!std::isnan(offsets[gchan]))
+					output<<gchan<<"\t"<<offsets[gchan]<<std::endl;
+		}
+		else
+		{
+			const double* params = GetParameters(stage);
+			for(int gchan=0; gchan<GetNChannels(); gchan++)
+				if(!std::isnan(params[2*gchan]))
+					output<<gchan<<"\t"<<params[2*gchan]<<"\t"<<params[2*gchan+1]<<std::endl;
+		}
+		output.close();
+		std::cout<<"Wrote "<<GetStageName(stage)<<" to "<<stagefiles[i]<<std::endl;
+	}
+	return true;
+}
+
+bool CalibrationBundle::Export(const std::vector<std::string>& stagefiles, const std::string& bundlename)
+{
+	const int nchannels = DetectorGeometry::nchannels;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	if(stagefiles.size() == 0 || stagefiles[0] == "")
+	{
+		std::cerr<<"No channel map given at CalibrationBundle::Export()! Exiting."<<std::endl;
+		return false;
+	}
+
+	std::vector<BundleSection> section_list(nstages);
+	std::vector<std::vector<char>> data_list(nstages);
+	uint64_t offset = sizeof(BundleHeader) + nstages*sizeof(BundleSection);
+	for(int i=0; i<nstages; i++)
+	{
+		CalibrationStage stage = (CalibrationStage) i;
+		BundleSection& section = section_list[i];
+		std::memset(&section, 0, sizeof(section));
+		section.stage = i;
+		std::string filename = i < (int)stagefiles.size() ? stagefiles[i] : "";
+
+		if(stage == CalibrationStage::Channels)
+		{
+			ChannelMap cmap(filename);
+			if(!cmap.IsValid())
+			{
+				std::cerr<<"Bad channel map "<<filename<<" at CalibrationBundle::Export()! Exiting."<<std::endl;
+				return false;
+			}
+			std::vector<ChannelData> table(nchannels);
+			for(int gchan=0; gchan<nchannels; gchan++)
+			{
+				const ChannelData* data = cmap.GetChannelData(gchan);
+				if(data == nullptr)
+					continue;
+				table[gchan] = *data;
+				section.nentries++;
+			}
+			data_list[i].resize(nchannels*sizeof(ChannelData));
+			std::memcpy(data_list[i].data(), table.data(), data_list[i].size());
+		}
+		else if(stage == CalibrationStage::ZeroOffset)
+		{
+			std::vector<double> offsets(nchannels, nan);
+			ZeroCalMap zmap(filename);
+			if(filename != "" && zmap.IsValid())
+			{
+				for(int gchan=0; gchan<nchannels; gchan++)
+				{
+					auto iter = zmap.FindOffset(gchan);
+					if(iter == zmap.End())
+						continue;
+					offsets[gchan] = iter->second;
+					section.nentries++;
+				}
+			}
+			data_list[i].resize(nchannels*sizeof(double));
+			std::memcpy(data_list[i].data(), offsets.data(), data_list[i].size());
+		}
+		else
+		{
+			std::vector<double> params(2*nchannels, nan);
+			ParameterMap pmap(filename);
+			if(filename != "" && pmap.IsValid())
+			{
+				for(int gchan=0; gchan<nchannels; gchan++)
+				{
+					auto iter = pmap.FindParameters(gchan);
+					if(iter == pmap.End())
+						continue;
+					params[2*gchan] = iter->second.intercept;
+					params[2*gchan+1] = iter->second.slope;
+					section.nentries++;
+				}
+			}
+			data_list[i].resize(2*nchannels*sizeof(double));
+			std::memcpy(data_list[i].data(), params.data(), data_list[i].size());
+		}
+
+		if(section.nentries == 0 && filename == "")
+			std::cout<<"No "<<GetStageName(stage)<<" given, it will not be set in the bundle."<<std::endl;
+		else if(section.nentries == 0)
+			std::cout<<"The "<<GetStageName(stage)<<" file "<<filename<<" is missing or empty, it will not be set in the bundle."<<std::endl;
+		else
+		{
+			std::strncpy(section.source, filename.c_str(), sizeof(section.source)-1);
+			section.source_checksum = ChannelMap::ComputeChecksum(filename);
+			struct stat info;
+			if(stat(filename.c_str(), &info) == 0)
+				section.source_time = info.st_mtime;
+		}
+		section.offset = offset;
+		section.size = data_list[i].size();
+		offset += section.size;
+	}
+
+	std::vector<char> body;
+	body.reserve(offset - sizeof(BundleHeader));
+	body.insert(body.end(), (const char*) section_list.data(), (const char*) (section_list.data() + nstages));
+	for(auto& data : data_list)
+		body.insert(body.end(), data.begin(), data.end());
+
+	BundleHeader new_header;
+	std::memset(&new_header, 0, sizeof(new_header));
+	std::memcpy(new_header.magic, bundle_magic, sizeof(bundle_magic));
+	new_header.version = schema_version;
+	new_header.byte_order = bundle_byte_order;
+	new_header.nchannels = nchannels;
+	new_header.nsections = nstages;
+	new_header.created = std::time(nullptr);
+	new_header.checksum = ComputeChecksum(body.data(), body.size());
+
+	std::ofstream output(bundlename, std::ios::binary);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open "<<bundlename<<" at CalibrationBundle::Export()! Exiting."<<std::endl;
+		return false;
+	}
+	output.write((const char*) &new_header, sizeof(new_header));
+	output.write(body.data(), body.size());
+	output.close();
+
+	std::cout<<"Wrote calibration bundle "<<bundlename<<std::endl;
+	return true;
+}
+
+const char* CalibrationBundle::GetStageName(CalibrationStage stage)
+{
+	switch(stage)
+	{
+		case CalibrationStage::Channels: return "channel map";
+		case CalibrationStage::ZeroOffset: return "zero offsets";
+		case CalibrationStage::BackGains: return "back gain-matching";
+		case CalibrationStage::UpDownGains: return "SX3 up-down gain-matching";
+		case CalibrationStage::FrontBackGains: return "front-back gain-matching";
+		case CalibrationStage::Energy: return "energy calibration";
+	}
+	return "unknown stage";
+}
+
+//64-bit FNV-1a, as used by ChannelMap::ComputeChecksum for files
+uint64_t CalibrationBundle::ComputeChecksum(const char* data, uint64_t size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(uint64_t i=0; i<size; i++)
+	{
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,164 @@
+/*
+	CalibrationDatabase
+	Run-indexed set of calibrations. Each entry is a CalibrationSnapshot along with the range of runs it is valid for, so that
+	a data set spanning many runs can be calibrated with the calibrations of each run interval (i.e. drift-corrected
+	calibrations, see DriftScanner) in a single pass.
+
+	A database file lists one calibration set per line as <first run> <last run> <calibration bundle>, where either run may
+	be * to leave that end of the range open. Lines starting with # are ignored. Ranges may not overlap. Every snapshot is
+	loaded (and its dense tables precomposed) when the database is read, and a bundle listed for several ranges is only loaded
+	once, so selecting the snapshot of a run is a binary search over the ranges and costs nothing in the event loop.
+
+	A single calibration set (text files or one bundle) is a database with one entry valid for every run (Add). Input files
+	whose name has no run number are given run INT_MIN (see FileProcessor::GetRunNumber), so they are only matched by a
+	range open at the low end.
+*/
+#include "CalibrationDatabase.h"
+#include "CalibrationBundle.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+CalibrationDatabase::CalibrationDatabase() :
+	valid_flag(true)
+{
+}
+
+CalibrationDatabase::CalibrationDatabase(const std::string& dbfile) :
+	valid_flag(false)
+{
+	std::ifstream input(dbfile);
+	if(!input.is_open())
+	{
+		std::cerr<<"Unable to open calibration database "<<dbfile<<" at CalibrationDatabase::CalibrationDatabase()! Exiting."<<std::endl;
+		return;
+	}
+
+	std::string line, first, last, bundlefile;
+	int first_run, last_run, index;
+	while(std::getline(input, line))
+	{
+		std::stringstream linestream(line);
+		if(!(linestream>>first) || first[0] == '#')
+			continue;
+		if(!(linestream>>last>>bundlefile))
+		{
+			std::cerr<<"Bad line \""<<line<<"\" in calibration database "<<dbfile<<" at CalibrationDatabase::CalibrationDatabase()! Exiting."<<std::endl;
+			return;
+		}
+
+		try
+		{
+			first_run = first == "*" ? INT_MIN : std::stoi(first);
+			last_run = last == "*" ? INT_MAX : std::stoi(last);
+		}
+		catch(std::exception& e)
+		{
+			std::cerr<<"Bad run range "<<first<<" "<<last<<" in calibration database "<<dbfile<<" at CalibrationDatabase::CalibrationDatabase()! Exiting."<<std::endl;
+			return;
+		}
+
+		index = std::find(sources.begin(), sources.end(), bundlefile) - sources.begin();
+		if(index == (int) sources.size())
+		{
+			CalibrationSnapshot* snapshot = new CalibrationSnapshot(CalibrationBundle(bundlefile));
+			if(!snapshot->IsValid())
+			{
+				std::cerr<<"Unable to load calibration bundle "<<bundlefile<<" at CalibrationDatabase::CalibrationDatabase()! Exiting."<<std::endl;
+				delete snapshot;
+				return;
+			}
+			snapshots.push_back(snapshot);
+			sources.push_back(bundlefile);
+		}
+		if(!AddInterval(first_run, last_run, index))
+			return;
+	}
+	valid_flag = true;
+}
+
+CalibrationDatabase::~CalibrationDatabase()
+{
+	for(auto& snapshot : snapshots)
+		delete snapshot;
+}
+
+bool CalibrationDatabase::Add(int first_run, int last_run, CalibrationSnapshot* snapshot, const std::string& source)
+{
+	snapshots.push_back(snapshot);
+	sources.push_back(source);
+	if(!snapshot->IsValid())
+	{
+		valid_flag = false;
+		return false;
+	}
+	return AddInterval(first_run, last_run, snapshots.size()-1);
+}
+
+bool CalibrationDatabase::AddInterval(int first_run, int last_run, int index)
+{
+	if(last_run < first_run)
+	{
+		std::cerr<<"Empty run range "<<first_run<<"-"<<last_run<<" at CalibrationDatabase::AddInterval()! Exiting."<<std::endl;
+		valid_flag = false;
+		return false;
+	}
+
+	CalibrationInterval interval;
+	interval.first_run = first_run;
+	interval.last_run = last_run;
+	interval.index = index;
+	auto iter = std::upper_bound(intervals.begin(), intervals.end(), interval, [](const CalibrationInterval& a, const CalibrationInterval& b)
+	{
+		return a.first_run < b.first_run;
+	});
+	if((iter != intervals.end() && iter->first_run <= last_run) || (iter != intervals.begin() && (iter-1)->last_run >= first_run))
+	{
+		std::cerr<<"Run range "<<first_run<<"-"<<last_run<<" overlaps another calibration set at CalibrationDatabase::AddInterval()! Exiting."<<std::endl;
+		valid_flag = false;
+		return false;
+	}
+	intervals.insert(iter, interval);
+	return true;
+}
+
+//Last range starting at or before the run, if it reaches the run
+const CalibrationSnapshot* CalibrationDatabase::Find(int run) const
+{
+	auto iter = std::upper_bound(intervals.begin(), intervals.end(), run, [](int value, const CalibrationInterval& interval)
+	{
+		return value < interval.first_run;
+	});
+	if(iter == intervals.begin() || (iter-1)->last_run < run)
+		return nullptr;
+	return snapshots[(iter-1)->index];
+}
+
+const std::string& CalibrationDatabase::GetSource(const CalibrationSnapshot* snapshot) const
+{
+	static const std::string unknown = "unknown";
+	for(size_t i=0; i<snapshots.size(); i++)
+		if(snapshots[i] == snapshot)
+			return sources[i];
+	return unknown;
+}
+
+void CalibrationDatabase::Print() const
+{
+	std::cout<<"Calibration database: "<<snapshots.size()<<" calibration set(s) over "<<intervals.size()<<" run range(s)"<<std::endl;
+	for(auto& interval : intervals)
+	{
+		std::cout<<"\tRuns ";
+		if(interval.first_run == INT_MIN)
+			std::cout<<"*";
+		else
+			std::cout<<interval.first_run;
+		std::cout<<"-";
+		if(interval.last_run == INT_MAX)
+			std::cout<<"*";
+		else
+			std::cout<<interval.last_run;
+		std::cout<<": "<<sources[interval.index]<<std::endl;
+	}
+}
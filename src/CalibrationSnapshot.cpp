@@ -0,0 +1,365 @@
+/*
+	CalibrationSnapshot
+	Immutable, dense copy of every calibration needed to go from raw ADC values to calibrated energies, indexed by global
+	channel. This is the core of libanasencal: it is what apply-calibrations (DataCalibrator) uses, and it is meant to be
+	linked directly into online sort code so that the calibration math is not re-implemented elsewhere.
+
+	A snapshot is loaded either from the text file of each stage, or from a CalibrationBundle. After construction it is never
+	modified, so a single snapshot may be shared by any number of threads. Neither method allocates once warmed up:
+		CalibrateHits: calibrates a span of (global channel, ADC) hits to energies. Backs, wedges, and rings are fully
+		calibrated; SX3 fronts need their partner strip and cannot be calibrated alone, so they (and any channel missing a
+		calibration) are given NaN. The calibration of each channel is folded into a single gain and offset, and the span is
+		done in one pass by CalibrationKernel, with the fastest instruction set the CPU supports.
+		CalibrateEvent: calibrates one AnasenEvent and performs the front-back matching, filling a CalibratedEvent. The
+		energies of every back, wedge, and ring of the event are done first, in one call to CalibrateHits; only the SX3 front
+		matching is done hit by hit. The vectors of the CalibratedEvent are cleared and refilled, so reusing the same object
+		keeps their capacity, and the hit buffers are kept per thread, growing to the largest event seen.
+	MatchCounters collects the front-back matching statistics of CalibrateEvent; each thread should keep its own and Add them.
+*/
+#include "CalibrationSnapshot.h"
+#include "CalibrationBundle.h"
+#include "ZeroCalMap.h"
+#include "ParameterMap.h"
+#include <iostream>
+#include <limits>
+#include <cmath>
+
+static const uint8_t back_mask = ChannelCalibration::HasOffset | ChannelCalibration::HasBack | ChannelCalibration::HasEnergy;
+static const uint8_t ring_mask = ChannelCalibration::HasOffset | ChannelCalibration::HasFrontBack | ChannelCalibration::HasEnergy;
+
+//Raw hits of an event, gathered for CalibrateHits
+struct EventHits
+{
+	std::vector<int> gchans;
+	std::vector<double> adcs;
+	std::vector<double> energies;
+
+	void Clear()
+	{
+		gchans.clear();
+		adcs.clear();
+	}
+	void Add(const std::vector<SiliconHit>& hits)
+	{
+		for(auto& hit : hits)
+		{
+			gchans.push_back(hit.global_chan);
+			adcs.push_back(hit.energy);
+		}
+	}
+};
+
+void MatchCounters::Add(const MatchCounters& rhs)
+{
+	for(int i=0; i<4; i++)
+	{
+		fqqq_wedges[i] += rhs.fqqq_wedges[i];
+		fqqq_matched[i] += rhs.fqqq_matched[i];
+		fqqq_no_rings[i] += rhs.fqqq_no_rings[i];
+		fqqq_one_ring[i] += rhs.fqqq_one_ring[i];
+		fqqq_many_rings[i] += rhs.fqqq_many_rings[i];
+		fqqq_rings_only[i] += rhs.fqqq_rings_only[i];
+		bqqq_wedges[i] += rhs.bqqq_wedges[i];
+		bqqq_matched[i] += rhs.bqqq_matched[i];
+	}
+}
+
+void MatchCounters::Print() const
+{
+	long nbqqq_ws=0, nbqqq_ws_matched=0, nfqqq_ws=0, nfqqq_ws_matched=0;
+	for(int i=0; i<4; i++)
+	{
+		nbqqq_ws += bqqq_wedges[i];
+		nbqqq_ws_matched += bqqq_matched[i];
+		nfqqq_ws += fqqq_wedges[i];
+		nfqqq_ws_matched += fqqq_matched[i];
+	}
+
+	std::cout<<"nbqqq_ws: "<<nbqqq_ws<<" matched: "<<nbqqq_ws_matched<<std::endl;
+	for(int i=0; i<4; i++)
+		std::cout<<"nbqqq"<<i<<"_ws: "<<bqqq_wedges[i]<<" matched: "<<bqqq_matched[i]<<std::endl;
+	std::cout<<"nfqqq_ws: "<<nfqqq_ws<<" matched: "<<nfqqq_ws_matched<<std::endl;
+	for(int i=0; i<4; i++)
+	{
+		std::cout<<"nfqqq"<<i<<"_ws: "<<fqqq_wedges[i]<<" matched: "<<fqqq_matched[i]<<" no rings present: "<<fqqq_no_rings[i];
+		std::cout<<" many rings present: "<<fqqq_many_rings[i]<<" one ring present: "<<fqqq_one_ring[i]<<std::endl;
+	}
+	for(int i=0; i<4; i++)
+		std::cout<<"nfqqq"<<i<<"_ringsOnly: "<<fqqq_rings_only[i]<<std::endl;
+}
+
+//Requires a file from each calibration stage
+CalibrationSnapshot::CalibrationSnapshot(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch,
+										 const std::string& frontbackmatch, const std::string& energyfile) :
+	kernel_isa(CalibrationKernel::GetBestISA()), valid_flag(false)
+{
+	ChannelMap cmap(channelfile);
+	ZeroCalMap zmap(zerofile);
+	ParameterMap bmap(backmatch), udmap(updownmatch), fbmap(frontbackmatch), emap(energyfile);
+	Fill(cmap, zmap, bmap, udmap, fbmap, emap);
+}
+
+//Requires a bundle with every calibration stage set
+CalibrationSnapshot::CalibrationSnapshot(const CalibrationBundle& bundle) :
+	kernel_isa(CalibrationKernel::GetBestISA()), valid_flag(false)
+{
+	bundle.Print();
+	int nchannels = bundle.GetNChannels();
+	ChannelMap cmap(bundle.GetChannelTable(), nchannels, bundle.GetName());
+	ZeroCalMap zmap(bundle.GetOffsets(), nchannels);
+	ParameterMap bmap(bundle.GetParameters(CalibrationStage::BackGains), nchannels), udmap(bundle.GetParameters(CalibrationStage::UpDownGains), nchannels);
+	ParameterMap fbmap(bundle.GetParameters(CalibrationStage::FrontBackGains), nchannels), emap(bundle.GetParameters(CalibrationStage::Energy), nchannels);
+	Fill(cmap, zmap, bmap, udmap, fbmap, emap);
+}
+
+CalibrationSnapshot::~CalibrationSnapshot() {}
+
+void CalibrationSnapshot::Fill(ChannelMap& cmap, ZeroCalMap& zmap, ParameterMap& bmap, ParameterMap& udmap, ParameterMap& fbmap, ParameterMap& emap)
+{
+	if(!cmap.IsValid() || !zmap.IsValid() || !bmap.IsValid() || !udmap.IsValid() || !fbmap.IsValid() || !emap.IsValid())
+	{
+		std::cerr<<"Bad maps at CalibrationSnapshot::Fill()!"<<std::endl;
+		return;
+	}
+
+	int nchannels = DetectorGeometry::nchannels;
+	calibrations.assign(nchannels, ChannelCalibration());
+	channels.assign(nchannels, ChannelData());
+	for(int gchan=0; gchan<nchannels; gchan++)
+	{
+		const ChannelData* data = cmap.GetChannelData(gchan);
+		if(data != nullptr)
+			channels[gchan] = *data;
+
+		ChannelCalibration& calibration = calibrations[gchan];
+		auto offset = zmap.FindOffset(gchan);
+		if(offset != zmap.End())
+		{
+			calibration.offset = offset->second;
+			calibration.flags |= ChannelCalibration::HasOffset;
+		}
+		auto back = bmap.FindParameters(gchan);
+		if(back != bmap.End())
+		{
+			calibration.back = back->second;
+			calibration.flags |= ChannelCalibration::HasBack;
+		}
+		auto updown = udmap.FindParameters(gchan);
+		if(updown != udmap.End())
+		{
+			calibration.updown = updown->second;
+			calibration.flags |= ChannelCalibration::HasUpDown;
+		}
+		auto frontback = fbmap.FindParameters(gchan);
+		if(frontback != fbmap.End())
+		{
+			calibration.frontback = frontback->second;
+			calibration.flags |= ChannelCalibration::HasFrontBack;
+		}
+		auto energy = emap.FindParameters(gchan);
+		if(energy != emap.End())
+		{
+			calibration.energy = energy->second;
+			calibration.flags |= ChannelCalibration::HasEnergy;
+		}
+	}
+
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	linear_gains.assign(nchannels, nan);
+	linear_offsets.assign(nchannels, nan);
+	for(int gchan=0; gchan<nchannels; gchan++)
+	{
+		const ChannelCalibration& cal = calibrations[gchan];
+		const CalParams* gains = nullptr;
+		if(channels[gchan].IsBackLike() && cal.Has(back_mask))
+			gains = &cal.back;
+		else if(channels[gchan].detectorComponent == DetectorComponent::Ring && cal.Has(ring_mask))
+			gains = &cal.frontback;
+		if(gains == nullptr)
+			continue;
+		linear_gains[gchan] = cal.energy.slope*gains->slope;
+		linear_offsets[gchan] = cal.energy.slope*(gains->intercept - gains->slope*cal.offset) + cal.energy.intercept;
+	}
+	valid_flag = true;
+}
+
+//Hits are copied into small blocks on the stack to give the kernel contiguous arrays
+int CalibrationSnapshot::CalibrateHits(const RawHit* hits, int nhits, double* energies) const
+{
+	const int block_size = 256;
+	int gchans[block_size];
+	double adcs[block_size];
+	int ncalibrated = 0;
+	for(int start=0; start<nhits; start+=block_size)
+	{
+		int n = (nhits - start) < block_size ? (nhits - start) : block_size;
+		for(int i=0; i<n; i++)
+		{
+			gchans[i] = hits[start+i].gchan;
+			adcs[i] = hits[start+i].adc;
+		}
+		ncalibrated += CalibrateHits(gchans, adcs, n, energies + start);
+	}
+	return ncalibrated;
+}
+
+int CalibrationSnapshot::CalibrateHits(const int* gchans, const double* adcs, int nhits, double* energies) const
+{
+	CalibrationKernel::Calibrate(kernel_isa, linear_gains.data(), linear_offsets.data(), linear_gains.size(), gchans, adcs, nhits, energies);
+	int ncalibrated = 0;
+	for(int i=0; i<nhits; i++)
+		if(!std::isnan(energies[i]))
+			ncalibrated++;
+	return ncalibrated;
+}
+
+/*
+	Where the fun happens. We want to convert to a condensed format consisting of assiciated information
+	(front & back data) that makes up a particle hit. To this end: first look for a good back hit, then search
+	for a front (either QQQ ring or SX3 up-down pair as appropriate) and write to a CalibratedEvent.
+
+	NOTE: As currently implemented a front is NOT required to make a good hit. This is due primarily to the
+	poor SX3 front efficiency
+*/
+void CalibrationSnapshot::CalibrateEvent(const AnasenEvent& event, CalibratedEvent& calevent, MatchCounters* counters) const
+{
+	calevent.barrel1.clear();
+	calevent.barrel2.clear();
+	calevent.fqqq.clear();
+	calevent.bqqq.clear();
+
+	//Gathered in the order the detectors are read back below
+	thread_local EventHits event_hits;
+	event_hits.Clear();
+	for(int j=0; j<DetectorGeometry::nsx3_per_barrel; j++)
+	{
+		event_hits.Add(event.barrel1[j].backs);
+		event_hits.Add(event.barrel2[j].backs);
+	}
+	for(int j=0; j<DetectorGeometry::nqqq_per_end; j++)
+	{
+		event_hits.Add(event.fqqq[j].wedges);
+		event_hits.Add(event.fqqq[j].rings);
+		event_hits.Add(event.bqqq[j].wedges);
+		event_hits.Add(event.bqqq[j].rings);
+	}
+	event_hits.energies.resize(event_hits.gchans.size());
+	CalibrateHits(event_hits.gchans.data(), event_hits.adcs.data(), event_hits.gchans.size(), event_hits.energies.data());
+
+	const double* energies = event_hits.energies.data();
+	for(int j=0; j<DetectorGeometry::nsx3_per_barrel; j++)
+	{
+		CalibrateSX3(event.barrel1[j], j, energies, calevent.barrel1);
+		energies += event.barrel1[j].backs.size();
+		CalibrateSX3(event.barrel2[j], j, energies, calevent.barrel2);
+		energies += event.barrel2[j].backs.size();
+	}
+
+	for(int j=0; j<DetectorGeometry::nqqq_per_end; j++)
+	{
+		CalibrateQQQ(event.fqqq[j], j, true, energies, energies + event.fqqq[j].wedges.size(), calevent.fqqq, counters);
+		energies += event.fqqq[j].wedges.size() + event.fqqq[j].rings.size();
+		CalibrateQQQ(event.bqqq[j], j, false, energies, energies + event.bqqq[j].wedges.size(), calevent.bqqq, counters);
+		energies += event.bqqq[j].wedges.size() + event.bqqq[j].rings.size();
+	}
+}
+
+//Energies of the backs are from CalibrateHits (NaN for backs without a calibration); the fronts are matched to the gain-matched back
+void CalibrationSnapshot::CalibrateSX3(const SX3Data& data, int index, const double* back_energies, std::vector<CalibratedSX3Hit>& hits) const
+{
+	static const uint8_t up_mask = ChannelCalibration::HasOffset | ChannelCalibration::HasUpDown | ChannelCalibration::HasFrontBack;
+
+	CalibratedSX3Hit sx3hit;
+	double cal_back, cal_up_energy, cal_down_energy, cal_sum;
+	for(size_t i=0; i<data.backs.size(); i++)
+	{
+		if(std::isnan(back_energies[i]))
+			continue;
+		const SiliconHit& backhit = data.backs[i];
+		const ChannelCalibration* back = GetCalibration(backhit.global_chan);
+
+		sx3hit = CalibratedSX3Hit();
+		cal_back = back->back.slope*(backhit.energy - back->offset) + back->back.intercept;
+		sx3hit.back_energy = back_energies[i];
+		sx3hit.back_gchan = backhit.global_chan;
+		sx3hit.detector_index = index;
+		for(auto& fuphit : data.fronts_up)
+		{
+			for(auto& fdownhit : data.fronts_down)
+			{
+				if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+					continue;
+				const ChannelCalibration* up = GetCalibration(fuphit.global_chan);
+				const ChannelCalibration* down = GetCalibration(fdownhit.global_chan);
+				if(up == nullptr || down == nullptr || !up->Has(up_mask) || !down->Has(ChannelCalibration::HasOffset))
+					continue;
+
+				cal_up_energy = cal_back - up->updown.slope*(fuphit.energy - up->offset) - up->updown.intercept*cal_back;
+				cal_down_energy = fdownhit.energy - down->offset;
+				cal_sum = up->frontback.slope*(cal_down_energy+cal_up_energy) + up->frontback.intercept;
+				if(cal_sum/cal_back > match_window_high || cal_sum/cal_back < match_window_low)
+					continue;
+
+				sx3hit.frontup_energy_adc = cal_up_energy;
+				sx3hit.frontdown_energy_adc = cal_down_energy;
+				sx3hit.frontup_gchan = fuphit.global_chan;
+				sx3hit.frontdown_gchan = fdownhit.global_chan;
+				break;
+			}
+			//One hit is kept per upstream front, as in the original implementation
+			hits.push_back(sx3hit);
+		}
+	}
+}
+
+//Energies of the wedges and rings are from CalibrateHits, NaN for channels without a calibration
+void CalibrationSnapshot::CalibrateQQQ(const QQQData& data, int index, bool forward, const double* wedge_energies, const double* ring_energies,
+									   std::vector<CalibratedQQQHit>& hits, MatchCounters* counters) const
+{
+
+	if(forward && counters != nullptr && data.wedges.size() == 0 && data.rings.size() != 0)
+		counters->fqqq_rings_only[index]++;
+
+	CalibratedQQQHit qqqhit;
+	double ring_energy;
+	for(size_t i=0; i<data.wedges.size(); i++)
+	{
+		if(std::isnan(wedge_energies[i]))
+			continue;
+
+		qqqhit = CalibratedQQQHit();
+		qqqhit.wedge_energy = wedge_energies[i];
+		qqqhit.wedge_gchan = data.wedges[i].global_chan;
+		qqqhit.detector_index = index;
+		if(forward && qqqhit.wedge_energy < fqqq_wedge_threshold)
+			continue;
+		if(counters != nullptr)
+			(forward ? counters->fqqq_wedges : counters->bqqq_wedges)[index]++;
+
+		for(size_t k=0; k<data.rings.size(); k++)
+		{
+			ring_energy = ring_energies[k];
+			if(std::isnan(ring_energy))
+				continue;
+			if(ring_energy/qqqhit.wedge_energy > match_window_high || ring_energy/qqqhit.wedge_energy < match_window_low)
+				continue;
+
+			if(counters != nullptr)
+				(forward ? counters->fqqq_matched : counters->bqqq_matched)[index]++;
+			qqqhit.ring_energy = ring_energy;
+			qqqhit.ring_gchan = data.rings[k].global_chan;
+			break;
+		}
+		hits.push_back(qqqhit);
+
+		if(forward && counters != nullptr && qqqhit.ring_gchan == -1)
+		{
+			if(data.rings.size() == 0)
+				counters->fqqq_no_rings[index]++;
+			else if(data.rings.size() == 1)
+				counters->fqqq_one_ring[index]++;
+			else
+				counters->fqqq_many_rings[index]++;
+		}
+	}
+}
@@ -6,18 +6,49 @@
 
 	Key method is FindChannel. This returns an iterator, which can be checked against the end of the map for validity.
 	If the iterator is equal to the end, the key does not link to a member of the map.
-	
+
+	The strings of the map file ("BARREL1A", "A", "FRONT", "UP") are converted once when the map is loaded into small enums
+	and integers, so that stages compare channel data without any string work; the name tables (GetTypeName, etc.) are
+	only used for printing. The detector index used by the AnasenEvent arrays is stored with each channel as well.
+
+	The reverse direction (channel data -> global channel) is served by an index built when the map is loaded, keyed on the
+	packed (type, id, component, direction, channel) tuple. FindPartnerStrip and FindReferenceChannel give direct access to
+	the most common reverse lookups. All reverse lookups return -1 if no such channel exists.
+
+	When built with make, the channel map file given by CHANNELMAP is compiled into constexpr tables (CompiledChannelMap.h,
+	generated by tools/ChannelTableGenerator.cpp). If the file passed at runtime has the same checksum as the compiled one,
+	the compiled tables are used directly and the file is not parsed; otherwise the file is parsed as usual. GetChannelData
+	is a flat array lookup in either case, and is meant for hot loops. A map can also be made from a flat table owned elsewhere
+	(i.e. a CalibrationBundle), which is then used in place.
+
 	Written by Gordon McCann Nov 2021
 */
-
 #include "ChannelMap.h"
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#ifdef ANASEN_COMPILED_MAP
+#include "CompiledChannelMap.h"
+#endif
 
 ChannelMap::ChannelMap(const std::string& filename) :
-	valid_flag(false), name(filename)
+	compiled_table(nullptr), table_size(0), valid_flag(false), compiled_flag(false), name(filename)
 {
-	FillMap(filename);
+	if(!FillCompiledMap(filename))
+		FillMap(filename);
+}
+
+ChannelMap::ChannelMap(const ChannelData* table, int size, const std::string& source) :
+	compiled_table(nullptr), table_size(0), valid_flag(false), compiled_flag(false), name(source)
+{
+	if(table == nullptr || size <= 0)
+	{
+		std::cerr<<"Bad channel table from "<<source<<" at ChannelMap::ChannelMap!"<<std::endl;
+		return;
+	}
+	UseTable(table, size);
 }
 
 ChannelMap::~ChannelMap() {}
@@ -33,99 +64,276 @@ void ChannelMap::FillMap(const std::string& filename)
 	}
 
 	ChannelData data;
-	int gchan;
+	std::string type, id, component, direction;
+	int gchan, channel;
 	while(input>>gchan)
 	{
-		input>>data.detectorType>>data.detectorID>>data.detectorComponent>>data.detectorDirection>>data.channel;
+		input>>type>>id>>component>>direction>>channel;
+		data.channel = channel;
+		if(!ParseChannel(type, id, component, direction, data))
+		{
+			std::cerr<<"Bad channel data for global channel "<<gchan<<" at ChannelMap::FillMap! Skipping."<<std::endl;
+			continue;
+		}
 		cmap[gchan] = data;
 	}
 
+	BuildTable();
+	BuildIndex();
 	valid_flag = true;
 }
 
-int ChannelMap::ConvertSX3Name2Index(const std::string& detectorType, const std::string& detectorID)
+/*
+	Uses the compiled tables if the file is the one they were generated from. Returns false (and leaves the map empty) if
+	the file differs or no tables were compiled in, in which case the file must be parsed.
+*/
+bool ChannelMap::FillCompiledMap(const std::string& filename)
 {
-	if(detectorType == "BARREL1A" || detectorType == "BARREL2A")
+#ifdef ANASEN_COMPILED_MAP
+	uint64_t checksum = ComputeChecksum(filename);
+	if(checksum == 0)
+		return false;
+	else if(checksum != CompiledChannelMap::checksum)
 	{
-		if(detectorID == "A")
-		{
-			return 0;
-		}
-		else if(detectorID == "B")
-		{
-			return 1;
-		}
-		else if(detectorID == "C")
-		{
-			return 2;
-		}
-		else if(detectorID == "D")
-		{
-			return 3;
-		}
-		else if(detectorID == "E")
-		{
-			return 4;
-		}
-		else if(detectorID == "F")
-		{
-			return 5;
-		}
-	} 
-	else if(detectorType == "BARREL1B" || detectorType == "BARREL2B")
+		std::cout<<"Channel map "<<filename<<" differs from the compiled map ("<<CompiledChannelMap::source<<"), reading it from the file."<<std::endl;
+		return false;
+	}
+
+	UseTable(CompiledChannelMap::channels, CompiledChannelMap::nchannels);
+	compiled_flag = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+//Uses a flat table owned elsewhere (compiled in, or from a bundle) as the map
+void ChannelMap::UseTable(const ChannelData* table, int size)
+{
+	compiled_table = table;
+	table_size = size;
+	for(int i=0; i<table_size; i++)
 	{
-		if(detectorID == "A")
-		{
-			return 6;
-		}
-		else if(detectorID == "B")
-		{
-			return 7;
-		}
-		else if(detectorID == "C")
-		{
-			return 8;
-		}
-		else if(detectorID == "D")
-		{
-			return 9;
-		}
-		else if(detectorID == "E")
-		{
-			return 10;
-		}
-		else if(detectorID == "F")
-		{
-			return 11;
-		}
+		if(compiled_table[i].detectorType != DetectorType::None)
+			cmap[i] = compiled_table[i];
+	}
+
+	BuildIndex();
+	valid_flag = true;
+}
+
+void ChannelMap::BuildTable()
+{
+	table_size = 0;
+	for(auto& channel : cmap)
+		table_size = std::max(table_size, channel.first + 1);
+
+	table_storage.assign(table_size, ChannelData());
+	for(auto& channel : cmap)
+	{
+		if(channel.first >= 0)
+			table_storage[channel.first] = channel.second;
 	}
-	
-	std::cerr<<"Invalid detectorType "<<detectorType<<" or detectorID "<<detectorID<<" at ChannelMap::ConvertSX3Name2Index! Returning -1."<<std::endl;
-	return -1;
 }
 
-int ChannelMap::ConvertQQQName2Index(const std::string& detectorID)
+/*
+	64-bit FNV-1a hash of the file contents. Returns 0 if the file cannot be read.
+*/
+uint64_t ChannelMap::ComputeChecksum(const std::string& filename)
 {
-	if(detectorID == "0")
+	std::ifstream input(filename, std::ios::binary);
+	if(!input.is_open())
 		return 0;
-	else if (detectorID == "1")
-		return 1;
-	else if (detectorID == "2")
-		return 2;
-	else if (detectorID == "3")
-		return 3;
-
-	std::cerr<<"Invalid detectorID "<<detectorID<<" at ChannelMap::CovnertQQQName2Index! Returning -1."<<std::endl;
+
+	uint64_t hash = 14695981039346656037ULL;
+	std::istreambuf_iterator<char> iter(input), end;
+	for(; iter != end; ++iter)
+	{
+		hash ^= (unsigned char) *iter;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+	Converts the strings of one line of the map file. Returns false if any of them are not recognized.
+*/
+bool ChannelMap::ParseChannel(const std::string& type, const std::string& id, const std::string& component, const std::string& direction, ChannelData& data)
+{
+	if(type == "FQQQ")
+		data.detectorType = DetectorType::FQQQ;
+	else if(type == "BQQQ")
+		data.detectorType = DetectorType::BQQQ;
+	else if(type == "BARREL1A")
+		data.detectorType = DetectorType::Barrel1A;
+	else if(type == "BARREL1B")
+		data.detectorType = DetectorType::Barrel1B;
+	else if(type == "BARREL2A")
+		data.detectorType = DetectorType::Barrel2A;
+	else if(type == "BARREL2B")
+		data.detectorType = DetectorType::Barrel2B;
+	else
+		return false;
+
+	if(component == "RING")
+		data.detectorComponent = DetectorComponent::Ring;
+	else if(component == "WEDGE")
+		data.detectorComponent = DetectorComponent::Wedge;
+	else if(component == "FRONT")
+		data.detectorComponent = DetectorComponent::Front;
+	else if(component == "BACK")
+		data.detectorComponent = DetectorComponent::Back;
+	else
+		return false;
+
+	if(direction == "UP")
+		data.detectorDirection = DetectorDirection::Up;
+	else if(direction == "DOWN")
+		data.detectorDirection = DetectorDirection::Down;
+	else
+		data.detectorDirection = DetectorDirection::None;
+
+	if(id.size() != 1)
+		return false;
+	if(data.IsQQQ() && id[0] >= '0' && id[0] <= '3')
+	{
+		data.detectorID = id[0] - '0';
+		data.detectorIndex = data.detectorID;
+	}
+	else if(data.IsSX3() && id[0] >= 'A' && id[0] <= 'F')
+	{
+		data.detectorID = id[0] - 'A';
+		data.detectorIndex = ConvertSX3Index(data.detectorType, data.detectorID);
+	}
+	else
+		return false;
+
+	return true;
+}
+
+//SX3s in the A half of a barrel take indices 0-5, those in the B half 6-11
+int ChannelMap::ConvertSX3Index(DetectorType type, int id)
+{
+	if(id < 0 || id > 5)
+	{
+		std::cerr<<"Invalid detectorID "<<id<<" at ChannelMap::ConvertSX3Index! Returning -1."<<std::endl;
+		return -1;
+	}
+
+	if(type == DetectorType::Barrel1A || type == DetectorType::Barrel2A)
+		return id;
+	else if(type == DetectorType::Barrel1B || type == DetectorType::Barrel2B)
+		return id + 6;
+
+	std::cerr<<"Invalid detectorType "<<GetTypeName(type)<<" at ChannelMap::ConvertSX3Index! Returning -1."<<std::endl;
 	return -1;
 }
 
-int ChannelMap::InverseFindChannel(const ChannelData& data)
+const char* ChannelMap::GetTypeName(DetectorType type)
+{
+	switch(type)
+	{
+		case DetectorType::FQQQ: return "FQQQ";
+		case DetectorType::BQQQ: return "BQQQ";
+		case DetectorType::Barrel1A: return "BARREL1A";
+		case DetectorType::Barrel1B: return "BARREL1B";
+		case DetectorType::Barrel2A: return "BARREL2A";
+		case DetectorType::Barrel2B: return "BARREL2B";
+		case DetectorType::None: return "None";
+	}
+	return "None";
+}
+
+std::string ChannelMap::GetIDName(DetectorType type, int id)
+{
+	if(type == DetectorType::FQQQ || type == DetectorType::BQQQ)
+		return std::to_string(id);
+	else if(type == DetectorType::None)
+		return "None";
+	else
+		return std::string(1, (char)('A' + id));
+}
+
+const char* ChannelMap::GetComponentName(DetectorComponent component)
+{
+	switch(component)
+	{
+		case DetectorComponent::Ring: return "RING";
+		case DetectorComponent::Wedge: return "WEDGE";
+		case DetectorComponent::Front: return "FRONT";
+		case DetectorComponent::Back: return "BACK";
+		case DetectorComponent::None: return "None";
+	}
+	return "None";
+}
+
+const char* ChannelMap::GetDirectionName(DetectorDirection direction)
+{
+	switch(direction)
+	{
+		case DetectorDirection::Up: return "UP";
+		case DetectorDirection::Down: return "DOWN";
+		case DetectorDirection::None: return "NONE";
+	}
+	return "NONE";
+}
+
+void ChannelMap::BuildIndex()
 {
+	for(auto& channel : cmap)
+		reverse_map[MakeKey(channel.second)] = channel.first;
+
+	ChannelData partner;
 	for(auto& channel : cmap)
 	{
-		ChannelData& this_data = channel.second;
-		if(this_data == data)
-			return channel.first;
+		if(channel.second.detectorComponent != DetectorComponent::Front || channel.second.channel < 0 || channel.second.channel >= DetectorGeometry::nsx3_fronts)
+			continue;
+
+		partner = channel.second;
+		partner.channel = DetectorGeometry::updown_list[channel.second.channel];
+		if(channel.second.detectorDirection == DetectorDirection::Up)
+			partner.detectorDirection = DetectorDirection::Down;
+		else if(channel.second.detectorDirection == DetectorDirection::Down)
+			partner.detectorDirection = DetectorDirection::Up;
+		else
+			continue;
+
+		int partner_gchan = InverseFindChannel(partner);
+		if(partner_gchan != -1)
+			partner_map[channel.first] = partner_gchan;
 	}
-	return -1;
+}
+
+//Packs the fields 8 bits each, with the channel in the lowest 16 bits
+uint64_t ChannelMap::MakeKey(const ChannelData& data) const
+{
+	return ((uint64_t) data.detectorType << 40) | ((uint64_t)(uint8_t) data.detectorID << 32) | ((uint64_t) data.detectorComponent << 24) |
+			((uint64_t) data.detectorDirection << 16) | (uint64_t)(uint16_t) data.channel;
+}
+
+int ChannelMap::InverseFindChannel(const ChannelData& data) const
+{
+	auto iter = reverse_map.find(MakeKey(data));
+	if(iter == reverse_map.end())
+		return -1;
+	return iter->second;
+}
+
+int ChannelMap::FindPartnerStrip(int gchan) const
+{
+	auto iter = partner_map.find(gchan);
+	if(iter == partner_map.end())
+		return -1;
+	return iter->second;
+}
+
+int ChannelMap::FindReferenceChannel(int gchan, int reference) const
+{
+	auto channel = cmap.find(gchan);
+	if(channel == cmap.end())
+		return -1;
+
+	ChannelData data = channel->second;
+	data.channel = reference;
+	return InverseFindChannel(data);
 }
@@ -0,0 +1,161 @@
+/*
+	Checkpoint
+	Saved position of a long job writing an output tree (organize-data, apply-calibrations), so that a job which dies partway
+	through can be resumed instead of started over. A checkpoint is a set of named integer values (entry position, number of
+	events written, counters; chosen by the job) and optionally the state of one ROOT object, such as a random generator.
+
+	The checkpoint is kept in the UserInfo of the output tree, and is written along with the tree header by TTree::AutoSave
+	(see EventSink::SaveCheckpoint), so the entries on disk and the checkpoint describing them always agree. A job which
+	finishes always saves a last checkpoint marked complete, even without intermediate checkpoints. Read tells a job, before it
+	opens its output, whether the output is missing (or unusable), complete, or partial and can be resumed from the checkpoint.
+	A tree without any checkpoint (i.e. flushed by ROOT's own AutoSave before the job died) is missing, and is started over.
+	Jobs keep GetInputKey of their input files in the checkpoint as "inputs", and do not resume (or skip) an output which was
+	made from other inputs.
+	RNTuple outputs have nowhere to keep a checkpoint, but are only readable once committed, so they count as complete if they
+	can be opened.
+*/
+#include "Checkpoint.h"
+#include "EventIO.h"
+#include "CalibrationBundle.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TList.h>
+#include <TNamed.h>
+
+static const char* record_name = "Checkpoint";
+static const char* state_name = "CheckpointState";
+
+Checkpoint::Checkpoint() :
+	state(nullptr)
+{
+}
+
+Checkpoint::~Checkpoint()
+{
+	delete state;
+}
+
+long long Checkpoint::Get(const std::string& key, long long default_value) const
+{
+	auto iter = values.find(key);
+	return iter == values.end() ? default_value : iter->second;
+}
+
+void Checkpoint::SetState(const TObject* object)
+{
+	delete state;
+	state = object == nullptr ? nullptr : object->Clone(state_name);
+}
+
+void Checkpoint::Clear()
+{
+	values.clear();
+	SetState(nullptr);
+}
+
+//The values are kept as the title of a TNamed, key=value separated by spaces
+std::string Checkpoint::Encode() const
+{
+	std::stringstream record;
+	for(auto& value : values)
+		record<<value.first<<"="<<value.second<<" ";
+	return record.str();
+}
+
+void Checkpoint::Decode(const std::string& record)
+{
+	values.clear();
+	std::stringstream recordstream(record);
+	std::string item;
+	size_t split;
+	while(recordstream>>item)
+	{
+		split = item.find('=');
+		if(split == std::string::npos)
+			continue;
+		values[item.substr(0, split)] = std::stoll(item.substr(split+1));
+	}
+}
+
+//Replaces any checkpoint already in the tree. Written to disk by the next AutoSave or Write of the tree.
+void Checkpoint::Store(TTree* tree) const
+{
+	TList* info = tree->GetUserInfo();
+	const char* names[] = {record_name, state_name};
+	for(auto& name : names)
+	{
+		TObject* old = info->FindObject(name);
+		if(old != nullptr)
+		{
+			info->Remove(old);
+			delete old;
+		}
+	}
+	info->Add(new TNamed(record_name, Encode().c_str()));
+	if(state != nullptr)
+		info->Add(state->Clone(state_name));
+}
+
+//Returns false if the tree has no checkpoint
+bool Checkpoint::Load(TTree* tree)
+{
+	Clear();
+	TList* info = tree->GetUserInfo();
+	TObject* record = info->FindObject(record_name);
+	if(record == nullptr)
+		return false;
+	Decode(record->GetTitle());
+	SetState(info->FindObject(state_name));
+	return true;
+}
+
+/*
+	Checks the output of a job before it is opened. A file which does not exist, cannot be opened, or does not have the tree
+	(i.e. the job died before the first AutoSave) or a checkpoint is missing, and the job should start over. On a partial
+	output, checkpoint holds the last checkpoint saved.
+*/
+CheckpointStatus Checkpoint::Read(const std::string& filename, const std::string& treename, Checkpoint& checkpoint)
+{
+	checkpoint.Clear();
+	if(!std::ifstream(filename))
+		return CheckpointStatus::Missing;
+	if(EventIO::DetectFormat(filename, treename) != "ttree")
+		return EventIO::GetEntries(filename, treename) >= 0 ? CheckpointStatus::Complete : CheckpointStatus::Missing;
+
+	TFile* file = TFile::Open(filename.c_str(), "READ");
+	if(file == nullptr || !file->IsOpen())
+	{
+		delete file;
+		return CheckpointStatus::Missing;
+	}
+
+	CheckpointStatus status = CheckpointStatus::Missing;
+	TTree* tree = dynamic_cast<TTree*>(file->Get(treename.c_str()));
+	if(tree != nullptr && checkpoint.Load(tree))
+		status = checkpoint.IsComplete() ? CheckpointStatus::Complete : CheckpointStatus::Partial;
+	file->Close();
+	delete file;
+	return status;
+}
+
+/*
+	Identifies the input files of a job: a checksum of their names, sizes, and modification times. Data files are too large
+	to hash by content at every start of a job, and a file which was rewritten has a new modification time.
+*/
+long long Checkpoint::GetInputKey(const std::vector<std::string>& filenames)
+{
+	std::string keydata;
+	struct stat info;
+	for(auto& filename : filenames)
+	{
+		keydata += filename + '\0';
+		if(stat(filename.c_str(), &info) == 0)
+			keydata += std::to_string((long long) info.st_size) + " " + std::to_string((long long) info.st_mtime);
+		keydata += '\0';
+	}
+	return (long long) CalibrationBundle::ComputeChecksum(keydata.data(), keydata.size());
+}
@@ -0,0 +1,167 @@
+/*
+	CompressionBenchmark
+	Class which measures how the output settings perform on our own data. A sample of AnasenEvents is read into memory from
+	the given data files, and then written to a temporary file and read back in full once per setting:
+		Run: every output profile (see OutputPolicy), in the configured data format
+		RunFormats: every data format available in this build (see EventIO), with the configured output profile
+	For each the file size (also relative to the first one), write throughput, and full-scan read throughput are reported.
+	The temporary files are written to (and removed from) the given directory, so it should be on the disk the data lives on.
+*/
+#include "CompressionBenchmark.h"
+#include "EventIO.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+
+CompressionBenchmark::CompressionBenchmark() {}
+
+CompressionBenchmark::~CompressionBenchmark() {}
+
+void CompressionBenchmark::Run(const std::vector<std::string>& inputnames, const std::string& workdir, long nevents)
+{
+	if(!ReadSample(inputnames, nevents))
+		return;
+
+	std::cout<<"Benchmarking "<<OutputPolicy::GetProfiles().size()<<" output profiles with "<<sample.size()<<" events..."<<std::endl;
+	std::vector<CompressionResult> results;
+	OutputPolicy policy = output_policy;
+	for(auto& profile : OutputPolicy::GetProfiles())
+	{
+		std::string filename = workdir + "compression_benchmark_" + profile.name + ".root";
+		policy.SetProfile(profile);
+		results.push_back(TestOutput(policy, profile.name, filename));
+		std::remove(filename.c_str());
+	}
+
+	PrintResults(results);
+}
+
+void CompressionBenchmark::RunFormats(const std::vector<std::string>& inputnames, const std::string& workdir, long nevents)
+{
+	if(!ReadSample(inputnames, nevents))
+		return;
+
+	std::cout<<"Benchmarking data formats using output profile "<<output_policy.GetProfile().name<<" with "<<sample.size()<<" events..."<<std::endl;
+	std::vector<CompressionResult> results;
+	OutputPolicy policy = output_policy;
+	for(auto& format : {"ttree", "rntuple"})
+	{
+		if(!EventIO::IsFormatAvailable(format))
+		{
+			std::cout<<"Data format "<<format<<" is not available in this build, skipping."<<std::endl;
+			continue;
+		}
+		std::string filename = workdir + "format_benchmark_" + format + ".root";
+		policy.SetDataFormat(format);
+		results.push_back(TestOutput(policy, format, filename));
+		std::remove(filename.c_str());
+	}
+
+	PrintResults(results);
+}
+
+bool CompressionBenchmark::ReadSample(const std::vector<std::string>& inputnames, long nevents)
+{
+	if(inputnames.size() == 0)
+	{
+		std::cerr<<"No input data files at CompressionBenchmark::ReadSample()! Exiting."<<std::endl;
+		return false;
+	}
+
+	EventSource<AnasenEvent>* source = MakeEventSource<AnasenEvent>(inputnames, "EventTree", "event", io_policy);
+	if(source == nullptr || !source->IsValid())
+	{
+		std::cerr<<"Unable to read input data at CompressionBenchmark::ReadSample()! Exiting."<<std::endl;
+		delete source;
+		return false;
+	}
+
+	long nentries = source->GetEntries();
+	if(nevents <= 0 || nevents > nentries)
+		nevents = nentries;
+
+	sample.clear();
+	sample.reserve(nevents);
+	for(long i=0; i<nevents; i++)
+		sample.push_back(*(source->GetEntry(i)));
+
+	source->Report();
+	delete source;
+
+	if(sample.size() == 0)
+	{
+		std::cerr<<"No events in the input data at CompressionBenchmark::ReadSample()! Exiting."<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+CompressionResult CompressionBenchmark::TestOutput(const OutputPolicy& policy, const std::string& label, const std::string& filename)
+{
+	CompressionResult result;
+	result.label = label;
+
+	auto start = std::chrono::steady_clock::now();
+	EventSink<AnasenEvent>* sink = MakeEventSink<AnasenEvent>(filename, "EventTree", "event", policy);
+	if(sink == nullptr || !sink->IsValid())
+	{
+		std::cerr<<"Unable to create benchmark file "<<filename<<" at CompressionBenchmark::TestOutput()! Skipping."<<std::endl;
+		delete sink;
+		return result;
+	}
+	AnasenEvent* event = sink->GetObject();
+	for(auto& sample_event : sample)
+	{
+		*event = sample_event;
+		sink->Fill();
+	}
+	sink->Close();
+	delete sink;
+	result.write_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	struct stat info;
+	if(stat(filename.c_str(), &info) == 0)
+		result.file_size = info.st_size;
+
+	start = std::chrono::steady_clock::now();
+	EventSource<AnasenEvent>* source = MakeEventSource<AnasenEvent>({filename}, "EventTree", "event", io_policy);
+	if(source == nullptr || !source->IsValid())
+	{
+		std::cerr<<"Unable to read benchmark file "<<filename<<" at CompressionBenchmark::TestOutput()! Skipping."<<std::endl;
+		delete source;
+		result.read_time = 0.0;
+		return result;
+	}
+	long long nentries = source->GetEntries();
+	for(long long i=0; i<nentries; i++)
+		source->GetEntry(i);
+	result.read_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	source->Report();
+	delete source;
+
+	return result;
+}
+
+void CompressionBenchmark::PrintResults(const std::vector<CompressionResult>& results)
+{
+	double mb = 1024.0*1024.0;
+	double reference = results.size() > 0 ? results[0].file_size : 0;
+	std::cout<<std::left<<std::setw(20)<<"Setting"<<std::right<<std::setw(12)<<"Size (MB)"<<std::setw(12)<<"Rel. size";
+	std::cout<<std::setw(16)<<"Write (MB/s)"<<std::setw(18)<<"Write (evts/s)"<<std::setw(16)<<"Read (MB/s)"<<std::setw(18)<<"Read (evts/s)"<<std::endl;
+	for(auto& result : results)
+	{
+		if(result.file_size == 0 || result.write_time == 0.0 || result.read_time == 0.0)
+		{
+			std::cout<<std::left<<std::setw(20)<<result.label<<" failed"<<std::endl;
+			continue;
+		}
+		std::cout<<std::left<<std::setw(20)<<result.label<<std::right<<std::fixed<<std::setprecision(2);
+		std::cout<<std::setw(12)<<result.file_size/mb<<std::setw(12)<<(reference > 0 ? result.file_size/reference : 0.0);
+		std::cout<<std::setw(16)<<result.file_size/mb/result.write_time<<std::setw(18)<<std::setprecision(0)<<sample.size()/result.write_time;
+		std::cout<<std::setprecision(2)<<std::setw(16)<<result.file_size/mb/result.read_time<<std::setw(18)<<std::setprecision(0)<<sample.size()/result.read_time;
+		std::cout<<std::endl;
+	}
+	std::cout<<std::defaultfloat<<std::setprecision(6);
+}
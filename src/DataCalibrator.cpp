@@ -1,416 +1,277 @@
 /*
 	DataCalibrator
 	Class which applies all of the calibration results to a data set, performs front-back hit assignment (kind of)
-	and saves to a condensed data format (CalibratedEvent) for further analysis. This essentially a single function
-	with some class-global parameter maps.
+	and saves to a condensed data format (CalibratedEvent) for further analysis. The calibration itself is done by a
+	CalibrationSnapshot (see libanasencal), which is either read from the text file of each stage, or taken from a single
+	CalibrationBundle, which guarantees that the calibrations belong together. A CalibrationDatabase instead gives each input
+	run the snapshot of its run range; consecutive runs with the same snapshot are chained together.
 
 	Written by Gordon McCann Nov 2021
 */
 #include "DataCalibrator.h"
+#include "CalibrationBundle.h"
 #include "DataStructs.h"
+#include "EventIO.h"
+#include "AsyncTreeWriter.h"
+#include "FileProcessor.h"
+#include "Checkpoint.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
+#include "ProgressReporter.h"
 #include <iostream>
+#include <algorithm>
 
-#include <TFile.h>
-#include <TTree.h>
-
-//Requires a file from each calibration stage
+//Requires a file from each calibration stage, used for every run
 DataCalibrator::DataCalibrator(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch,
 								const std::string& frontbackmatch, const std::string& energyfile) :
-	channel_map(channelfile), zero_map(zerofile), back_map(backmatch), updown_map(updownmatch), frontback_map(frontbackmatch), energy_map(energyfile)
+	database(new CalibrationDatabase()), resume_flag(false)
+{
+	database->Add(INT_MIN, INT_MAX, new CalibrationSnapshot(channelfile, zerofile, backmatch, updownmatch, frontbackmatch, energyfile), "calibration files");
+}
+
+//Requires a bundle with every calibration stage set, used for every run
+DataCalibrator::DataCalibrator(const std::string& bundlefile) :
+	database(new CalibrationDatabase()), resume_flag(false)
+{
+	database->Add(INT_MIN, INT_MAX, new CalibrationSnapshot(CalibrationBundle(bundlefile)), bundlefile);
+}
+
+//Each run is calibrated with the calibration set of its run range
+DataCalibrator::DataCalibrator(CalibrationDatabase* db) :
+	database(db), resume_flag(false)
+{
+}
+
+DataCalibrator::~DataCalibrator()
 {
+	delete database;
 }
 
-DataCalibrator::~DataCalibrator() {}
+//The match statistics are kept in a checkpoint as <counter><detector>, so that a resumed job reports the same totals
+static const std::vector<std::pair<std::string, long (MatchCounters::*)[4]>>& GetCounterFields()
+{
+	static const std::vector<std::pair<std::string, long (MatchCounters::*)[4]>> fields = {
+		{"fqqq_wedges", &MatchCounters::fqqq_wedges}, {"fqqq_matched", &MatchCounters::fqqq_matched},
+		{"fqqq_no_rings", &MatchCounters::fqqq_no_rings}, {"fqqq_one_ring", &MatchCounters::fqqq_one_ring},
+		{"fqqq_many_rings", &MatchCounters::fqqq_many_rings}, {"fqqq_rings_only", &MatchCounters::fqqq_rings_only},
+		{"bqqq_wedges", &MatchCounters::bqqq_wedges}, {"bqqq_matched", &MatchCounters::bqqq_matched}
+	};
+	return fields;
+}
+
+static void SaveCounters(const MatchCounters& counters, Checkpoint& checkpoint)
+{
+	for(auto& field : GetCounterFields())
+		for(int i=0; i<4; i++)
+			checkpoint.Set(field.first + std::to_string(i), (counters.*field.second)[i]);
+}
+
+static void LoadCounters(MatchCounters& counters, const Checkpoint& checkpoint)
+{
+	for(auto& field : GetCounterFields())
+		for(int i=0; i<4; i++)
+			(counters.*field.second)[i] = checkpoint.Get(field.first + std::to_string(i));
+}
 
 /*
-	Main loop. Takes in an input data fle, and an output data file. These should both be ROOT formated, where input data should be of AnasenEvent
-	type, and the output will be saved as CalibratedEvent data.
+	Main loop. Takes in a list of input data files, and an output data file. These should both be ROOT formated, where input data should be of AnasenEvent
+	type, and the output will be saved as CalibratedEvent data. The input files are chained in order into a single output tree. Each run of files which
+	share a calibration set is read as one source, so the snapshot only changes between sources, never within the event loop.
+	With resume set, a complete output is skipped and a partial one continues from its last checkpoint (see Checkpoint).
+	Returns false if the output could not be made.
 */
-void DataCalibrator::Run(const std::string& inputname, const std::string& outputname)
+bool DataCalibrator::Run(const std::vector<std::string>& inputnames, const std::string& outputname)
 {
-	if(!channel_map.IsValid() || !zero_map.IsValid() || !back_map.IsValid() || !updown_map.IsValid() || !frontback_map.IsValid() || !energy_map.IsValid())
+	ANASEN_TRACE_SCOPE("DataCalibrator/Run");
+	if(!database->IsValid())
 	{
 		std::cerr<<"Bad maps at DataCalibrator::Run()! Exiting."<<std::endl;
-		return;
+		return false;
 	}	
 
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	if(!input->IsOpen())
+	if(inputnames.size() == 0)
 	{
-		std::cerr<<"Unable to open input file "<<inputname<<" at DataCalibrator::Run()! Exiting."<<std::endl;
-		return;
+		std::cerr<<"No input files given to DataCalibrator::Run()! Exiting."<<std::endl;
+		return false;
 	}
-	TTree* intree = (TTree*) input->Get("EventTree");
 
-	AnasenEvent* event = new AnasenEvent();
-	intree->SetBranchAddress("event", &event);
-
-	TFile* output = TFile::Open(outputname.c_str(), "RECREATE");
-	if(!output->IsOpen())
+	Checkpoint checkpoint;
+	CheckpointStatus status = CheckpointStatus::Missing;
+	long long input_key = Checkpoint::GetInputKey(inputnames);
+	if(resume_flag)
+		status = Checkpoint::Read(outputname, "CalTree", checkpoint);
+	if(status == CheckpointStatus::Complete && checkpoint.Has("inputs") && checkpoint.Get("inputs") != input_key)
 	{
-		std::cerr<<"Unable to open output file "<<outputname<<" at DataCalibrator::Run()! Exiting."<<std::endl;
-		return;
+		std::cerr<<"Output "<<outputname<<" was made from other inputs at DataCalibrator::Run()! Starting over."<<std::endl;
+		status = CheckpointStatus::Missing;
+	}
+	if(status == CheckpointStatus::Complete)
+	{
+		std::cout<<"Output "<<outputname<<" is complete, skipping."<<std::endl;
+		return true;
 	}
-	TTree* outtree = new TTree("CalTree", "CalTree");
-
-	CalibratedEvent calevent, blank_event;
-	outtree->Branch("event", &calevent);
-
-	long nentries = intree->GetEntries();
 
-	long count=0, flush_count=0, flush_val = 0.01*nentries;
+	std::vector<std::vector<std::string>> segment_files;
+	std::vector<const CalibrationSnapshot*> segment_snapshots;
+	for(auto& inputname : inputnames)
+	{
+		int run = FileProcessor::GetRunNumber(inputname, INT_MIN);
+		const CalibrationSnapshot* snapshot = database->Find(run);
+		if(snapshot == nullptr)
+		{
+			std::cerr<<"No calibration set covers run "<<run<<" ("<<inputname<<") at DataCalibrator::Run()! Skipping."<<std::endl;
+			continue;
+		}
+		if(segment_snapshots.empty() || segment_snapshots.back() != snapshot)
+		{
+			segment_files.emplace_back();
+			segment_snapshots.push_back(snapshot);
+		}
+		segment_files.back().push_back(inputname);
+	}
 
-	CalibratedSX3Hit sx3hit, blank_sx3;
-	CalibratedQQQHit qqqhit, blank_qqq;
-	double cal_back, cal_up_energy, cal_down_energy, cal_sum;
-	int nbqqq_ws=0, nbqqq_ws_matched=0;
-	int nbqqq0_ws=0, nbqqq0_ws_matched=0;
-	int nbqqq1_ws=0, nbqqq1_ws_matched=0;
-	int nbqqq2_ws=0, nbqqq2_ws_matched=0;
-	int nbqqq3_ws=0, nbqqq3_ws_matched=0;
-	int nfqqq_ws=0, nfqqq_ws_matched=0;
-	int nfqqq0_ws=0, nfqqq0_ws_noRings=0, nfqqq0_ws_manyRings=0, nfqqq0_ws_oneRing=0, nfqqq0_ws_matched=0;
-	int nfqqq1_ws=0, nfqqq1_ws_noRings=0, nfqqq1_ws_manyRings=0, nfqqq1_ws_oneRing=0, nfqqq1_ws_matched=0;
-	int nfqqq2_ws=0, nfqqq2_ws_noRings=0, nfqqq2_ws_manyRings=0, nfqqq2_ws_oneRing=0, nfqqq2_ws_matched=0;
-	int nfqqq3_ws=0, nfqqq3_ws_noRings=0, nfqqq3_ws_manyRings=0, nfqqq3_ws_oneRing=0, nfqqq3_ws_matched=0;
-	int nfqqq0_ringsOnly=0;
-	int nfqqq1_ringsOnly=0;
-	int nfqqq2_ringsOnly=0;
-	int nfqqq3_ringsOnly=0;
-	for(long i=0; i<nentries; i++)
+	//Quick-look mode only calibrates a sample of the clusters of the input
+	std::vector<EventSource<AnasenEvent>*> sources;
+	std::vector<std::vector<EntryRange>> segment_ranges;
+	long nentries = 0;
+	for(auto& files : segment_files)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
+		EventSource<AnasenEvent>* source = MakeEventSource<AnasenEvent>(files, "EventTree", "event", io_policy);
+		if(source == nullptr || !source->IsValid())
 		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count<<"%"<<std::flush;
+			std::cerr<<"Unable to open input data at DataCalibrator::Run()! Exiting."<<std::endl;
+			delete source;
+			for(auto& other : sources)
+				delete other;
+			return false;
 		}
+		sources.push_back(source);
+		segment_ranges.push_back({EntryRange{0, source->GetEntries()}});
+		if(io_policy.IsQuickLook())
+			segment_ranges.back() = io_policy.SelectClusters(source->GetClusters());
+		nentries += IOPolicy::CountEntries(segment_ranges.back());
+	}
+	if(sources.size() == 0)
+	{
+		std::cerr<<"No input files have a calibration set at DataCalibrator::Run()! Exiting."<<std::endl;
+		return false;
+	}
+	AnasenEvent* event;
 
-		calevent = blank_event;
+	if(status == CheckpointStatus::Partial && (checkpoint.Get("inputs") != input_key || checkpoint.Get("nentries") != nentries ||
+												checkpoint.Get("nsegments") != (long long) sources.size() ||
+												checkpoint.Get("segment") >= (long long) sources.size() ||
+												checkpoint.Get("range") >= (long long) segment_ranges[checkpoint.Get("segment")].size()))
+	{
+		std::cerr<<"Checkpoint of "<<outputname<<" does not match the input at DataCalibrator::Run()! Starting over."<<std::endl;
+		status = CheckpointStatus::Missing;
+	}
 
-		/*
-			Where the fun happens. We want to convert to a condensed format consisting of assiciated information
-			(front & back data) that makes up a particle hit. To this end: first look for a good back hit, then search
-			for a front (either QQQ ring or SX3 up-down pair as appropriate) and write to a CalibratedEvent. Looks scarier
-			than it is
+	EventSink<CalibratedEvent>* sink = MakeEventSink<CalibratedEvent>(outputname, "CalTree", "event", output_policy,
+																		status == CheckpointStatus::Partial ? &checkpoint : nullptr);
+	if(status == CheckpointStatus::Partial && (sink == nullptr || !sink->IsValid()))
+	{
+		std::cerr<<"Unable to resume "<<outputname<<" at DataCalibrator::Run()! Starting over."<<std::endl;
+		delete sink;
+		status = CheckpointStatus::Missing;
+		sink = MakeEventSink<CalibratedEvent>(outputname, "CalTree", "event", output_policy);
+	}
+	if(sink == nullptr || !sink->IsValid())
+	{
+		std::cerr<<"Unable to open output file "<<outputname<<" at DataCalibrator::Run()! Exiting."<<std::endl;
+		for(auto& source : sources)
+			delete source;
+		delete sink;
+		return false;
+	}
+	if(io_policy.IsQuickLook())
+		sink->SetTitle("CalTree "+io_policy.GetQuickLookNote());
 
-			NOTE: As currently implemented a front is NOT required to make a good hit. This is due primarily to the 
-			poor SX3 front efficiency
-		*/
+	CalibratedEvent calevent;
+	AsyncTreeWriter<CalibratedEvent> writer(sink, output_policy.GetWriteQueueSize());
 
-		for(int j=0; j<12; j++)
-		{
-			for(auto& backhit : event->barrel1[j].backs)
-			{
-				sx3hit = blank_sx3;
-				auto backoffset = zero_map.FindOffset(backhit.global_chan);
-				auto backgains = back_map.FindParameters(backhit.global_chan);
-				auto backcal = energy_map.FindParameters(backhit.global_chan);
-				if(backgains == back_map.End() || backcal == energy_map.End() || backoffset == zero_map.End())
-					continue;
-				sx3hit.back_energy = backcal->second.slope*(backgains->second.slope*(backhit.energy - backoffset->second) + backgains->second.intercept) + backcal->second.intercept;
-				sx3hit.back_gchan = backhit.global_chan;
-				sx3hit.detector_index = j;				 
-				for(auto& fuphit : event->barrel1[j].fronts_up)
-				{
-					for(auto& fdownhit : event->barrel1[j].fronts_down)
-					{
-						if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							continue;
-						auto upgains = updown_map.FindParameters(fuphit.global_chan);
-						if(upgains == updown_map.End())
-							continue;
-						auto fupzero_offset = zero_map.FindOffset(fuphit.global_chan);
-						auto fdownzero_offset = zero_map.FindOffset(fdownhit.global_chan);
-						if(fupzero_offset == zero_map.End() || fdownzero_offset == zero_map.End())
-							continue;
-						auto frontbackgains = frontback_map.FindParameters(fuphit.global_chan);
-						if(frontbackgains == frontback_map.End())
-							continue;
-		
-						cal_back = backgains->second.slope*(backhit.energy - backoffset->second) + backgains->second.intercept;
-						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-						cal_sum = frontbackgains->second.slope*(cal_down_energy+cal_up_energy) + frontbackgains->second.intercept;
-						if(cal_sum/cal_back > 1.2 || cal_sum/cal_back < 0.8)
-						{
-							continue;
-						}
-						else
-						{
-							sx3hit.frontup_energy_adc = cal_up_energy;
-							sx3hit.frontdown_energy_adc = cal_down_energy;
-							sx3hit.frontup_gchan = fuphit.global_chan;
-							sx3hit.frontdown_gchan = fdownhit.global_chan;
-							break;
-						}
-					}
-					/* This should not have been here
-					if(sx3hit.frontdown_gchan != -1 && sx3hit.frontup_gchan !=  -1)
-					{
-						break;
-					}
-					*/
-					calevent.barrel1.push_back(sx3hit);
-				}
-			}
+	long long nread=0, checkpoint_entries = output_policy.GetCheckpointEntries();
 
-			for(auto& backhit : event->barrel2[j].backs)
-			{
-				sx3hit = blank_sx3;
-				auto backoffset = zero_map.FindOffset(backhit.global_chan);
-				auto backgains = back_map.FindParameters(backhit.global_chan);
-				auto backcal = energy_map.FindParameters(backhit.global_chan);
-				if(backgains == back_map.End() || backcal == energy_map.End() || backoffset == zero_map.End())
-					continue;
-				sx3hit.back_energy = backcal->second.slope*(backgains->second.slope*(backhit.energy - backoffset->second) + backgains->second.intercept) + backcal->second.intercept;
-				sx3hit.back_gchan = backhit.global_chan;
-				sx3hit.detector_index = j;				 
-				for(auto& fuphit : event->barrel2[j].fronts_up)
-				{
-					for(auto& fdownhit : event->barrel2[j].fronts_down)
-					{
-						if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							continue;
-						auto upgains = updown_map.FindParameters(fuphit.global_chan);
-						if(upgains == updown_map.End())
-							continue;
-						auto fupzero_offset = zero_map.FindOffset(fuphit.global_chan);
-						auto fdownzero_offset = zero_map.FindOffset(fdownhit.global_chan);
-						if(fupzero_offset == zero_map.End() || fdownzero_offset == zero_map.End())
-							continue;
-						auto frontbackgains = frontback_map.FindParameters(fuphit.global_chan);
-						if(frontbackgains == frontback_map.End())
-							continue;
-		
-						cal_back = backgains->second.slope*(backhit.energy - backoffset->second) + backgains->second.intercept;
-						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-						cal_sum = frontbackgains->second.slope*(cal_down_energy+cal_up_energy) + frontbackgains->second.intercept;
-						if(cal_sum/cal_back > 1.2 || cal_sum/cal_back < 0.8)
-						{
-							continue;
-						}
-						else
-						{
-							sx3hit.frontup_energy_adc = cal_up_energy;
-							sx3hit.frontdown_energy_adc = cal_down_energy;
-							sx3hit.frontup_gchan = fuphit.global_chan;
-							sx3hit.frontdown_gchan = fdownhit.global_chan;
-							break;
-						}
-					}
+	MatchCounters counters;
+	size_t first_segment = 0, first_range = 0;
+	long long first_entry = 0;
+	if(status == CheckpointStatus::Partial)
+	{
+		first_segment = checkpoint.Get("segment");
+		first_range = checkpoint.Get("range");
+		first_entry = checkpoint.Get("entry");
+		nread = checkpoint.Get("read");
+		LoadCounters(counters, checkpoint);
+		std::cout<<"Resuming "<<outputname<<" from its checkpoint at "<<nread<<" entries read."<<std::endl;
+	}
 
-					/* This should not have been there
-					if(sx3hit.frontdown_gchan != -1 && sx3hit.frontup_gchan !=  -1)
-					{
-						break;
-					}
-					*/
-					calevent.barrel2.push_back(sx3hit); //This should be here....
-				}
-			}
-		}
+	//Everything pushed so far is filled before the checkpoint is saved, so the checkpoint matches the entries on disk
+	auto save_checkpoint = [&](size_t segment, size_t range, long entry, bool complete)
+	{
+		ANASEN_TRACE_SCOPE("DataCalibrator/checkpoint");
+		writer.Drain();
+		checkpoint.Clear();
+		checkpoint.Set("inputs", input_key);
+		checkpoint.Set("nentries", nentries);
+		checkpoint.Set("nsegments", sources.size());
+		checkpoint.Set("segment", segment);
+		checkpoint.Set("range", range);
+		checkpoint.Set("entry", entry);
+		checkpoint.Set("read", nread);
+		SaveCounters(counters, checkpoint);
+		if(complete)
+			checkpoint.SetComplete();
+		sink->SaveCheckpoint(checkpoint);
+	};
 
-		for(int j=0; j<4; j++)
+	ProgressReporter progress("Calibrating", nentries, nread);
+	for(size_t s=0; s<sources.size(); s++)
+	{
+		if(s < first_segment)
 		{
-			/*
-			if(event->fqqq[j].wedges.size() != 0)
-				std::cout<<"looking over fqqq"<<j<<std::endl;
-			*/
-			if(event->fqqq[j].wedges.size() == 0 && event->fqqq[j].rings.size() != 0)
-			{
-				switch(j)
-				{
-					case 0: nfqqq0_ringsOnly++; break;
-					case 1: nfqqq1_ringsOnly++; break;
-					case 2: nfqqq2_ringsOnly++; break;
-					case 3: nfqqq3_ringsOnly++; break;
-				}
-			} 
-			for(auto& wedgehit : event->fqqq[j].wedges)
+			delete sources[s];
+			continue;
+		}
+		const CalibrationSnapshot& snapshot = *segment_snapshots[s];
+		if(sources.size() > 1)
+			std::cout<<"\rCalibrating "<<segment_files[s].size()<<" file(s) with "<<database->GetSource(&snapshot)<<std::endl;
+		for(size_t r=(s == first_segment ? first_range : 0); r<segment_ranges[s].size(); r++)
+		{
+			const EntryRange& range = segment_ranges[s][r];
+			for(long i=(s == first_segment && r == first_range ? std::max(range.first, first_entry) : range.first); i<range.last; i++)
 			{
-				qqqhit = blank_qqq;
-				auto backoffset = zero_map.FindOffset(wedgehit.global_chan);
-				auto backgains = back_map.FindParameters(wedgehit.global_chan);
-				auto backcal = energy_map.FindParameters(wedgehit.global_chan);
-				if(backgains == back_map.End() || backcal == energy_map.End() || backoffset == zero_map.End())
-					continue;
-				
-				qqqhit.wedge_energy = backcal->second.slope*(backgains->second.slope*(wedgehit.energy - backoffset->second) + backgains->second.intercept) + backcal->second.intercept;
-				qqqhit.wedge_gchan = wedgehit.global_chan;
-				qqqhit.detector_index = j;
-				if(qqqhit.wedge_energy < 2.8)
-					continue;
-				nfqqq_ws++;
-				switch(j)
-				{
-					case 0: nfqqq0_ws++; break;
-					case 1: nfqqq1_ws++; break;
-					case 2: nfqqq2_ws++; break;
-					case 3: nfqqq3_ws++; break;
-				}
-				/*
-				if(j==1)
-				{
-					std::cout<<"attempting to match fqqq"<<j<<" wedge with energy "<<qqqhit.wedge_energy<<" time "<<wedgehit.time<<" and gchan "<<qqqhit.wedge_gchan<<std::endl;
-					std::cout<<"number of candidates "<<event->fqqq[j].rings.size()<<std::endl;
-				}
-				*/
-				for(auto& ringhit : event->fqqq[j].rings)
 				{
-					auto frontoffset = zero_map.FindOffset(ringhit.global_chan);
-					auto frontgains = frontback_map.FindParameters(ringhit.global_chan);
-					auto frontcal = energy_map.FindParameters(ringhit.global_chan);
-					if(frontoffset == zero_map.End() || frontgains == frontback_map.End() || frontcal == energy_map.End())
-						continue;
-					cal_up_energy = frontcal->second.slope*(frontgains->second.slope*(ringhit.energy - frontoffset->second) + frontgains->second.intercept) + frontcal->second.intercept;
-					//if(j == 1)std::cout<<"ring candidate energy "<<cal_up_energy<<" time "<<ringhit.time<<" gchan "<<ringhit.global_chan<<std::endl;
-					if(cal_up_energy/qqqhit.wedge_energy > 1.2 || cal_up_energy/qqqhit.wedge_energy < 0.8)
-						continue;
-					else
-					{
-						//if(j==1)std::cout<<"matched!"<<std::endl;
-						nfqqq_ws_matched++;
-						switch(j)
-						{
-							case 0: nfqqq0_ws_matched++; break;
-							case 1: nfqqq1_ws_matched++; break;
-							case 2: nfqqq2_ws_matched++; break;
-							case 3: nfqqq3_ws_matched++; break;
-						}
-						qqqhit.ring_energy = cal_up_energy;
-						qqqhit.ring_gchan = ringhit.global_chan;
-						break;
-					} 
+					ANASEN_TRACE_ACCUMULATE("DataCalibrator/read entry");
+					event = sources[s]->GetEntry(i);
 				}
-				calevent.fqqq.push_back(qqqhit);
-				if(qqqhit.ring_gchan == -1)
-				{
-					switch(j)
-					{
-						case 0:
-						{
-							if(event->fqqq[j].rings.size() == 0)
-								nfqqq0_ws_noRings++;
-							else if(event->fqqq[j].rings.size() == 1)
-								nfqqq0_ws_oneRing++;
-							else if(event->fqqq[j].rings.size() > 1)
-								nfqqq0_ws_manyRings++;
-							break;
-						}
-						case 1:
-						{
-							if(event->fqqq[j].rings.size() == 0)
-								nfqqq1_ws_noRings++;
-							else if(event->fqqq[j].rings.size() == 1)
-								nfqqq1_ws_oneRing++;
-							else if(event->fqqq[j].rings.size() > 1)
-								nfqqq1_ws_manyRings++;
-							break;
-						}
-						case 2:
-						{
-							if(event->fqqq[j].rings.size() == 0)
-								nfqqq2_ws_noRings++;
-							else if(event->fqqq[j].rings.size() == 1)
-								nfqqq2_ws_oneRing++;
-							else if(event->fqqq[j].rings.size() > 1)
-								nfqqq2_ws_manyRings++;
-							break;
-						}
-						case 3:
-						{
-							if(event->fqqq[j].rings.size() == 0)
-								nfqqq3_ws_noRings++;
-							else if(event->fqqq[j].rings.size() == 1)
-								nfqqq3_ws_oneRing++;
-							else if(event->fqqq[j].rings.size() > 1)
-								nfqqq3_ws_manyRings++;
-							break;
-						}
-					}
-				}
-			}
+				progress.Add(1);
 
-			for(auto& wedgehit : event->bqqq[j].wedges)
-			{
-				qqqhit = blank_qqq;
-				auto backoffset = zero_map.FindOffset(wedgehit.global_chan);
-				auto backgains = back_map.FindParameters(wedgehit.global_chan);
-				auto backcal = energy_map.FindParameters(wedgehit.global_chan);
-				if(backgains == back_map.End() || backcal == energy_map.End() || backoffset == zero_map.End())
-					continue;
-				nbqqq_ws++;
-				switch(j)
 				{
-					case 0: nbqqq0_ws++; break;
-					case 1: nbqqq1_ws++; break;
-					case 2: nbqqq2_ws++; break;
-					case 3: nbqqq3_ws++; break;
+					ANASEN_TRACE_ACCUMULATE("DataCalibrator/calibrate event");
+					ANASEN_PERF_REGION("DataCalibrator/CalibrateEvent");
+					snapshot.CalibrateEvent(*event, calevent, &counters);
+					ANASEN_PERF_HITS(calevent.bqqq.size() + calevent.fqqq.size() + calevent.barrel1.size() + calevent.barrel2.size());
 				}
-				qqqhit.wedge_energy = backcal->second.slope*(backgains->second.slope*(wedgehit.energy - backoffset->second) + backgains->second.intercept) + backcal->second.intercept;
-				qqqhit.wedge_gchan = wedgehit.global_chan;
-				qqqhit.detector_index = j;
-				for(auto& ringhit : event->bqqq[j].rings)
-				{
-					auto frontoffset = zero_map.FindOffset(ringhit.global_chan);
-					auto frontgains = frontback_map.FindParameters(ringhit.global_chan);
-					auto frontcal = energy_map.FindParameters(ringhit.global_chan);
-					if(frontoffset == zero_map.End() || frontgains == frontback_map.End() || frontcal == energy_map.End())
-						continue;
-					cal_up_energy = frontcal->second.slope*(frontgains->second.slope*(ringhit.energy - frontoffset->second) + frontgains->second.intercept) + frontcal->second.intercept;
-					if(cal_up_energy/qqqhit.wedge_energy > 1.2 || cal_up_energy/qqqhit.wedge_energy < 0.8)
-						continue;
-					else
-					{
-						nbqqq_ws_matched++;
-						switch(j)
-						{
-							case 0: nbqqq0_ws_matched++; break;
-							case 1: nbqqq1_ws_matched++; break;
-							case 2: nbqqq2_ws_matched++; break;
-							case 3: nbqqq3_ws_matched++; break;
-						}
-						qqqhit.ring_energy = cal_up_energy;
-						qqqhit.ring_gchan = ringhit.global_chan;
-						break;
-					} 
-				}
-				calevent.bqqq.push_back(qqqhit);
+				if(calevent.bqqq.size() + calevent.fqqq.size() + calevent.barrel1.size() + calevent.barrel2.size() > 0)
+					writer.Push(calevent);
+				nread++;
+				if(checkpoint_entries > 0 && nread % checkpoint_entries == 0)
+					save_checkpoint(s, r, i+1, false);
 			}
 		}
-
-		if(calevent.bqqq.size() + calevent.fqqq.size() + calevent.barrel1.size() + calevent.barrel2.size() > 0)
-			outtree->Fill();
-
+		sources[s]->Report();
+		delete sources[s];
 	}
-	std::cout<<std::endl;
+	progress.Finish();
 
-	std::cout<<"nbqqq_ws: "<<nbqqq_ws<<" matched: "<<nbqqq_ws_matched<<std::endl;
-	std::cout<<"nbqqq0_ws: "<<nbqqq0_ws<<" matched: "<<nbqqq0_ws_matched<<std::endl;
-	std::cout<<"nbqqq1_ws: "<<nbqqq1_ws<<" matched: "<<nbqqq1_ws_matched<<std::endl;
-	std::cout<<"nbqqq2_ws: "<<nbqqq2_ws<<" matched: "<<nbqqq2_ws_matched<<std::endl;
-	std::cout<<"nbqqq3_ws: "<<nbqqq3_ws<<" matched: "<<nbqqq3_ws_matched<<std::endl;
-	std::cout<<"nfqqq_ws: "<<nfqqq_ws<<" matched: "<<nfqqq_ws_matched<<std::endl;
-	std::cout<<"nfqqq0_ws: "<<nfqqq0_ws<<" matched: "<<nfqqq0_ws_matched<<" no rings present: "<<nfqqq0_ws_noRings;
-	std::cout<<" many rings present: "<<nfqqq0_ws_manyRings<<" one ring present: "<<nfqqq0_ws_oneRing<<std::endl;
-	std::cout<<"nfqqq1_ws: "<<nfqqq1_ws<<" matched: "<<nfqqq1_ws_matched<<" no rings present: "<<nfqqq1_ws_noRings;
-	std::cout<<" many rings present: "<<nfqqq1_ws_manyRings<<" one ring present: "<<nfqqq1_ws_oneRing<<std::endl;
-	std::cout<<"nfqqq2_ws: "<<nfqqq2_ws<<" matched: "<<nfqqq2_ws_matched<<" no rings present: "<<nfqqq2_ws_noRings;
-	std::cout<<" many rings present: "<<nfqqq2_ws_manyRings<<" one ring present: "<<nfqqq2_ws_oneRing<<std::endl;
-	std::cout<<"nfqqq3_ws: "<<nfqqq3_ws<<" matched: "<<nfqqq3_ws_matched<<" no rings present: "<<nfqqq3_ws_noRings;
-	std::cout<<" many rings present: "<<nfqqq3_ws_manyRings<<" one ring present: "<<nfqqq3_ws_oneRing<<std::endl;
-	std::cout<<"nfqqq0_ringsOnly: "<<nfqqq0_ringsOnly<<std::endl;
-	std::cout<<"nfqqq1_ringsOnly: "<<nfqqq1_ringsOnly<<std::endl;
-	std::cout<<"nfqqq2_ringsOnly: "<<nfqqq2_ringsOnly<<std::endl;
-	std::cout<<"nfqqq3_ringsOnly: "<<nfqqq3_ringsOnly<<std::endl;
+	counters.Print();
 
-	input->Close();
-	output->cd();
-	outtree->Write(outtree->GetName(), TObject::kOverwrite);
-	output->Close();
-	delete event;
+	ANASEN_TRACE_SCOPE("DataCalibrator/write");
+	writer.Finish();
+	writer.Report();
+	//Always saved, so that --resume can tell a finished output from one cut short
+	save_checkpoint(sources.size(), 0, 0, true);
+	sink->Close();
+	delete sink;
+	return true;
 }
@@ -13,9 +13,17 @@
 #include <iostream>
 #include "ChannelMap.h"
 #include "DataStructs.h"
+#include "EventIO.h"
+#include "AsyncTreeWriter.h"
+#include "FiredIndex.h"
+#include "Checkpoint.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
+#include "ProgressReporter.h"
+#include <algorithm>
 
 DataOrganizer::DataOrganizer(const std::string& channelfile) :
-	cmap(channelfile), generator(new TRandom3())
+	cmap(channelfile), generator(new TRandom3()), resume_flag(false)
 {
 	generator->SetSeed(0);
 }
@@ -25,77 +33,118 @@ DataOrganizer::~DataOrganizer()
 	delete generator;
 }
 
+//The detector indices of the channel map must fit the AnasenEvent arrays
+static_assert(sizeof(AnasenEvent::barrel1)/sizeof(AnasenEvent::barrel1[0]) == DetectorGeometry::nsx3_per_barrel, "AnasenEvent barrel1 does not match DetectorGeometry");
+static_assert(sizeof(AnasenEvent::barrel2)/sizeof(AnasenEvent::barrel2[0]) == DetectorGeometry::nsx3_per_barrel, "AnasenEvent barrel2 does not match DetectorGeometry");
+static_assert(sizeof(AnasenEvent::fqqq)/sizeof(AnasenEvent::fqqq[0]) == DetectorGeometry::nqqq_per_end, "AnasenEvent fqqq does not match DetectorGeometry");
+static_assert(sizeof(AnasenEvent::bqqq)/sizeof(AnasenEvent::bqqq[0]) == DetectorGeometry::nqqq_per_end, "AnasenEvent bqqq does not match DetectorGeometry");
+
 /*
 	Method which actually fills the AnasenEvent. The event is passed by reference.
+	Called for every channel of every entry, so the channel data is taken from the flat table (GetChannelData).
 */
 void DataOrganizer::FillEvent(AnasenEvent& event, int gchan, int energy, int time)
 {
 	if(energy == -1.0)
 		return;
 	SiliconHit hit;
-	auto channel = cmap.FindChannel(gchan);
-	if(channel == cmap.End())
+	const ChannelData* channel = cmap.GetChannelData(gchan);
+	if(channel == nullptr)
 	{
 		std::cerr<<"Bad global channel "<<gchan<<" at DataOrganizer::FillEvent(). Skipping hit."<<std::endl;
 		return;
 	}
+	ANASEN_PERF_HIT();
 	hit.global_chan = gchan;
-	hit.local_chan = channel->second.channel;
+	hit.local_chan = channel->channel;
 	hit.energy = ConvertInt2Double(energy);
 	hit.time = ConvertInt2Double(time);
 
-	if(channel->second.detectorType == "BARREL1A" || channel->second.detectorType == "BARREL1B")
+	int detIndex = channel->detectorIndex;
+	if(channel->detectorType == DetectorType::Barrel1A || channel->detectorType == DetectorType::Barrel1B)
 	{
-		int detIndex = cmap.ConvertSX3Name2Index(channel->second.detectorType, channel->second.detectorID);
-		if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "UP")
+		if(channel->detectorComponent == DetectorComponent::Front && channel->detectorDirection == DetectorDirection::Up)
 			event.barrel1[detIndex].fronts_up.push_back(hit);
-		else if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "DOWN")
+		else if(channel->detectorComponent == DetectorComponent::Front && channel->detectorDirection == DetectorDirection::Down)
 			event.barrel1[detIndex].fronts_down.push_back(hit);
-		else if(channel->second.detectorComponent == "BACK")
+		else if(channel->detectorComponent == DetectorComponent::Back)
 			event.barrel1[detIndex].backs.push_back(hit);
 	}
-	else if(channel->second.detectorType == "BARREL2A" || channel->second.detectorType == "BARREL2B")
+	else if(channel->detectorType == DetectorType::Barrel2A || channel->detectorType == DetectorType::Barrel2B)
 	{
-		int detIndex = cmap.ConvertSX3Name2Index(channel->second.detectorType, channel->second.detectorID);
-		if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "UP")
+		if(channel->detectorComponent == DetectorComponent::Front && channel->detectorDirection == DetectorDirection::Up)
 			event.barrel2[detIndex].fronts_up.push_back(hit);
-		else if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "DOWN")
+		else if(channel->detectorComponent == DetectorComponent::Front && channel->detectorDirection == DetectorDirection::Down)
 			event.barrel2[detIndex].fronts_down.push_back(hit);
-		else if(channel->second.detectorComponent == "BACK")
+		else if(channel->detectorComponent == DetectorComponent::Back)
 			event.barrel2[detIndex].backs.push_back(hit);
 	}
-	else if(channel->second.detectorType == "FQQQ")
+	else if(channel->detectorType == DetectorType::FQQQ)
 	{
-		int detIndex = cmap.ConvertQQQName2Index(channel->second.detectorID);
-		if(channel->second.detectorComponent == "RING")
+		if(channel->detectorComponent == DetectorComponent::Ring)
 			event.fqqq[detIndex].rings.push_back(hit);
-		else if(channel->second.detectorComponent == "WEDGE")
+		else if(channel->detectorComponent == DetectorComponent::Wedge)
 			event.fqqq[detIndex].wedges.push_back(hit);
 	}
-	else if(channel->second.detectorType == "BQQQ")
+	else if(channel->detectorType == DetectorType::BQQQ)
 	{
-		int detIndex = cmap.ConvertQQQName2Index(channel->second.detectorID);
-		if(channel->second.detectorComponent == "RING")
+		if(channel->detectorComponent == DetectorComponent::Ring)
 			event.bqqq[detIndex].rings.push_back(hit);
-		else if(channel->second.detectorComponent == "WEDGE")
+		else if(channel->detectorComponent == DetectorComponent::Wedge)
 			event.bqqq[detIndex].wedges.push_back(hit);
 	}
 }
 
+//The generator is part of the state of a job, as the smearing of every later hit depends on it
+void DataOrganizer::RestoreGenerator(const Checkpoint& checkpoint)
+{
+	delete generator;
+	generator = (TRandom3*) checkpoint.GetState()->Clone();
+}
+
 /*
-	Main loop function. Takes in an input file name and an outputfile name
+	Main loop function. Takes in an input file name and an outputfile name. Returns false if the output could not be made.
+	With resume set, a complete output is skipped and a partial one continues from its last checkpoint (see Checkpoint), with
+	the generator, progress, and fired index restored, so the result matches an uninterrupted run.
 */
-void DataOrganizer::Run(const std::string& inputname, const std::string& outputname)
+bool DataOrganizer::Run(const std::string& inputname, const std::string& outputname)
 {
+	ANASEN_TRACE_SCOPE("DataOrganizer/Run");
 	if(!cmap.IsValid())
 	{
 		std::cerr<<"Bad channel map at DataOrganizer::Run()! Exiting."<<std::endl;
-		return;
+		return false;
 	}
+	if(cmap.IsCompiled())
+		std::cout<<"Using the compiled channel map."<<std::endl;
 
+	Checkpoint checkpoint;
+	CheckpointStatus status = CheckpointStatus::Missing;
+	long long input_key = Checkpoint::GetInputKey({inputname});
+	if(resume_flag)
+		status = Checkpoint::Read(outputname, "EventTree", checkpoint);
+	if(status == CheckpointStatus::Complete && checkpoint.Has("inputs") && checkpoint.Get("inputs") != input_key)
+	{
+		std::cerr<<"Output "<<outputname<<" was made from another input at DataOrganizer::Run()! Starting over."<<std::endl;
+		status = CheckpointStatus::Missing;
+	}
+	if(status == CheckpointStatus::Complete)
+	{
+		if(checkpoint.GetState() != nullptr)
+			RestoreGenerator(checkpoint);
+		std::cout<<"Output "<<outputname<<" is complete, skipping."<<std::endl;
+		return true;
+	}
 
 	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	TTree* intree = (TTree*) input->Get("DataTree");
+	TTree* intree = (input == nullptr || !input->IsOpen()) ? nullptr : dynamic_cast<TTree*>(input->Get("DataTree"));
+	if(intree == nullptr)
+	{
+		std::cerr<<"Unable to read DataTree from input "<<inputname<<" at DataOrganizer::Run()! Exiting."<<std::endl;
+		delete input;
+		return false;
+	}
+	io_policy.ConfigureTree(intree);
 
 	int mb1_energy[9][32];
 	int mb2_energy[9][32];
@@ -107,56 +156,148 @@ void DataOrganizer::Run(const std::string& inputname, const std::string& outputn
 	intree->SetBranchAddress("mb2_energy", &mb2_energy);
 	intree->SetBranchAddress("mb2_time", &mb2_time);
 
-	TFile* output = TFile::Open(outputname.c_str(), "RECREATE");
-	TTree* outtree = new TTree("EventTree", "EventTree");
+	//Quick-look mode only converts a sample of the clusters of the raw tree
+	std::vector<EntryRange> ranges = {EntryRange{0, intree->GetEntries()}};
+	if(io_policy.IsQuickLook())
+		ranges = io_policy.SelectClusters(IOPolicy::GetClusters(intree));
+	long nentries = IOPolicy::CountEntries(ranges);
 
-	AnasenEvent event, blank;
-	int gchan, mb2_gchan_offset = 9*32;
+	if(status == CheckpointStatus::Partial && (checkpoint.Get("inputs") != input_key || checkpoint.Get("nentries") != nentries ||
+												checkpoint.Get("range") >= (long long) ranges.size() || checkpoint.GetState() == nullptr))
+	{
+		std::cerr<<"Checkpoint of "<<outputname<<" does not match the input at DataOrganizer::Run()! Starting over."<<std::endl;
+		status = CheckpointStatus::Missing;
+	}
 
-	outtree->Branch("event", &event);
+	EventSink<AnasenEvent>* sink = MakeEventSink<AnasenEvent>(outputname, "EventTree", "event", output_policy,
+																status == CheckpointStatus::Partial ? &checkpoint : nullptr);
+	if(status == CheckpointStatus::Partial && (sink == nullptr || !sink->IsValid()))
+	{
+		std::cerr<<"Unable to resume "<<outputname<<" at DataOrganizer::Run()! Starting over."<<std::endl;
+		delete sink;
+		status = CheckpointStatus::Missing;
+		sink = MakeEventSink<AnasenEvent>(outputname, "EventTree", "event", output_policy);
+	}
+	if(sink == nullptr || !sink->IsValid())
+	{
+		std::cerr<<"Unable to create output "<<outputname<<" at DataOrganizer::Run()! Exiting."<<std::endl;
+		delete sink;
+		input->Close();
+		return false;
+	}
+	if(io_policy.IsQuickLook())
+		sink->SetTitle("EventTree "+io_policy.GetQuickLookNote());
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val=0.01*nentries;
+	AnasenEvent event, blank;
+	int gchan, mb2_gchan_offset = 9*32;
 
-	std::cout<<"Orgainizing data into detector structures... Total number of entries: "<<nentries<<std::endl;
+	AsyncTreeWriter<AnasenEvent> writer(sink, output_policy.GetWriteQueueSize());
+	FiredIndex index;
+	bool write_index = output_policy.GetWriteFiredIndex();
+	std::string index_name = FiredIndex::GetIndexName(outputname);
+	long long checkpoint_entries = output_policy.GetCheckpointEntries();
 
-	for(int i=0; i<nentries; i++)
+	long nwritten=0;
+	size_t first_range = 0;
+	long long first_entry = 0;
+	if(status == CheckpointStatus::Partial)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
+		first_range = checkpoint.Get("range");
+		first_entry = checkpoint.Get("entry");
+		nwritten = checkpoint.Get("entries");
+		RestoreGenerator(checkpoint);
+		//The index is saved just before each checkpoint, so it may hold entries past it, but never fewer
+		if(write_index)
 		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data formated: "<<0.01*flush_count*100.0<<"%"<<std::flush;
+			index = FiredIndex(index_name);
+			if(index.IsValid() && index.GetNEntries() >= nwritten)
+				index.Truncate(nwritten);
+			else
+			{
+				std::cerr<<"Unable to resume fired index "<<index_name<<" at DataOrganizer::Run()! It will not be written."<<std::endl;
+				write_index = false;
+			}
 		}
+		std::cout<<"Resuming "<<outputname<<" from its checkpoint at "<<nwritten<<" entries."<<std::endl;
+	}
+
+	//Everything pushed so far is filled before the checkpoint is saved, so the checkpoint matches the entries on disk
+	auto save_checkpoint = [&](size_t range, long entry, bool complete)
+	{
+		ANASEN_TRACE_SCOPE("DataOrganizer/checkpoint");
+		writer.Drain();
+		checkpoint.Clear();
+		checkpoint.Set("inputs", input_key);
+		checkpoint.Set("nentries", nentries);
+		checkpoint.Set("range", range);
+		checkpoint.Set("entry", entry);
+		checkpoint.SetState(generator);
+		if(complete)
+			checkpoint.SetComplete();
+		else if(write_index)
+			index.Write(index_name, false);
+		sink->SaveCheckpoint(checkpoint);
+	};
 
-		event = blank;
+	std::cout<<"Orgainizing data into detector structures... Total number of entries: "<<nentries<<std::endl;
+	ProgressReporter progress("Organizing", nentries, nwritten);
 
-		for(int j=0; j<9; j++)
+	for(size_t r=first_range; r<ranges.size(); r++)
+	{
+		const EntryRange& range = ranges[r];
+		for(long i=(r == first_range ? std::max(range.first, first_entry) : range.first); i<range.last; i++)
 		{
-			for(int k=0; k<32; k++)
 			{
-				gchan = j*32 + k;
-				FillEvent(event, gchan, mb1_energy[j][k], mb1_time[j][k]);
+				ANASEN_TRACE_ACCUMULATE("DataOrganizer/read entry");
+				intree->GetEntry(i);
 			}
-		}
+			progress.Add(1);
 
-		for(int j=0; j<8; j++)
-		{
-			for(int k=0; k<32; k++)
 			{
-				gchan = mb2_gchan_offset + j*32 + k;
-				FillEvent(event, gchan, mb2_energy[j][k], mb2_time[j][k]);
+				ANASEN_TRACE_ACCUMULATE("DataOrganizer/build event");
+				ANASEN_PERF_REGION("DataOrganizer/FillEvent");
+				event = blank;
+
+				for(int j=0; j<9; j++)
+				{
+					for(int k=0; k<32; k++)
+					{
+						gchan = j*32 + k;
+						FillEvent(event, gchan, mb1_energy[j][k], mb1_time[j][k]);
+					}
+				}
+
+				for(int j=0; j<8; j++)
+				{
+					for(int k=0; k<32; k++)
+					{
+						gchan = mb2_gchan_offset + j*32 + k;
+						FillEvent(event, gchan, mb2_energy[j][k], mb2_time[j][k]);
+					}
+				}
+
+				event.fired = FiredIndex::ComputeMask(event);
 			}
+			if(write_index)
+				index.Add(nwritten, event.fired);
+			writer.Push(event);
+			nwritten++;
+			if(checkpoint_entries > 0 && nwritten % checkpoint_entries == 0)
+				save_checkpoint(r, i+1, false);
 		}
-
-		outtree->Fill();
 	}
-	std::cout<<std::endl;
+	progress.Finish();
 
+	ANASEN_TRACE_SCOPE("DataOrganizer/write");
+	writer.Finish();
+	writer.Report();
+	if(write_index)
+		index.Write(index_name);
+	//The final checkpoint marks the output complete, and keeps the generator for the next run of a resumed job
+	save_checkpoint(ranges.size(), 0, true);
+	io_policy.Report(intree);
 	input->Close();
-	output->cd();
-	outtree->Write(outtree->GetName(), TObject::kOverwrite);
-	output->Close();
-}
\ No newline at end of file
+	sink->Close();
+	delete sink;
+	return true;
+}
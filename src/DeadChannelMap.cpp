@@ -20,8 +20,7 @@ void GenerateDeadChannelMap(const std::string& zoffset, const std::string& backm
 		return;
 	}
 
-	const int nchannels = 544;
-	const int updown_list[8] = {1, 0, 3, 2, 5, 4, 7, 6}; //matches index -> index of up/down pair for SX3 fronts
+	const int nchannels = DetectorGeometry::nchannels;
 
 	std::ofstream output(deadname);
 
@@ -45,27 +44,24 @@ void GenerateDeadChannelMap(const std::string& zoffset, const std::string& backm
 			continue;
 		}
 
-		if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "UP" &&
+		if(channel->second.detectorComponent == DetectorComponent::Front && channel->second.detectorDirection == DetectorDirection::Up &&
 			zero != zmap.End() && updowns != updownmap.End() && frontbacks != frontbackmap.End())
 		{
 			dead_flags[i] = false;
-			ChannelData downdata;
-			downdata = channel->second;
-			downdata.channel = updown_list[channel->second.channel];
-			downdata.detectorDirection = "DOWN";
-			int down_gchan = cmap.InverseFindChannel(downdata);
+			int down_gchan = cmap.FindPartnerStrip(i);
 			if(down_gchan == -1)
 			{
-				std::cerr<<"Blergh"<<std::endl;
+				std::cerr<<"No downstream partner for channel "<<i<<" at GenerateDeadChannelMap!"<<std::endl;
+				continue;
 			}
 			dead_flags[down_gchan] = false;
 		}
-		else if((channel->second.detectorComponent == "BACK" || channel->second.detectorComponent == "WEDGE") && zero != zmap.End() 
+		else if((channel->second.detectorComponent == DetectorComponent::Back || channel->second.detectorComponent == DetectorComponent::Wedge) && zero != zmap.End() 
 				&& backs != backmap.End() && energy != energymap.End())
 		{
 			dead_flags[i] = false;
 		}
-		else if(channel->second.detectorComponent == "RING" && zero != zmap.End() && frontbacks != frontbackmap.End() && energy != energymap.End())
+		else if(channel->second.detectorComponent == DetectorComponent::Ring && zero != zmap.End() && frontbacks != frontbackmap.End() && energy != energymap.End())
 		{
 			dead_flags[i] = false;
 		}
@@ -76,8 +72,8 @@ void GenerateDeadChannelMap(const std::string& zoffset, const std::string& backm
 		if(dead_flags[i])
 		{
 			auto channel = cmap.FindChannel(i);
-			output<<i<<" "<<channel->second.detectorType<<" "<<channel->second.detectorID<<" "<<channel->second.detectorComponent<<" ";
-			output<<channel->second.detectorDirection<<" "<<channel->second.channel<<std::endl;
+			output<<i<<" "<<ChannelMap::GetTypeName(channel->second.detectorType)<<" "<<ChannelMap::GetIDName(channel->second.detectorType, channel->second.detectorID)<<" ";
+			output<<ChannelMap::GetComponentName(channel->second.detectorComponent)<<" "<<ChannelMap::GetDirectionName(channel->second.detectorDirection)<<" "<<channel->second.channel<<std::endl;
 		}
 	}
 	output.close();
@@ -0,0 +1,344 @@
+/*
+	DriftScanner
+	Run-by-run gain drift monitor. One set of calibrations is applied to a whole range of runs, but the ASIC gains drift over
+	an experiment; the drift scan shows by how much, and in which channels. Each run is filled into its own compact spectra of
+	calibrated energy (one per back, wedge, and ring channel, covering only the reference peaks), using the CalibrationSnapshot
+	of the current calibrations. Runs are processed in parallel, one per thread (see FileProcessor::FillFiles), and every run
+	is reduced to its centroid shifts as soon as it is done, so memory does not grow with the number of runs. With histogram
+	banks on, the spectra of each run are kept (see HistogramBank) and a rescan only reads runs which are new or changed.
+
+	The centroid of each reference peak is found with an iterated windowed mean: the mean of the spectrum within DriftWindow of
+	the current estimate, recentred until it converges. The shift of a channel in a run is the average relative shift of its
+	peaks, centroid/reference - 1, so a perfectly calibrated channel sits at zero. A channel is flagged if its shift exceeds
+	DriftTolerance in any run.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		DriftPeaks: reference peak energies in MeV, separated by spaces or commas (default the alpha source lines)
+		DriftWindow: half width in MeV of the window used for each centroid (default 0.1)
+		DriftBinWidth: bin width in MeV of the spectra (default 0.005)
+		DriftMinCounts: counts needed within the window for a centroid (default 50)
+		DriftTolerance: relative centroid shift above which a channel is flagged (default 0.005)
+		DriftScanOutput: text file for the time series of shifts (default drift_scan.txt)
+		DriftScanPlots: ROOT file for a graph of the shifts of each channel against run number (default none)
+*/
+#include "DriftScanner.h"
+#include "CalibrationBundle.h"
+#include "FileProcessor.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <TFile.h>
+#include <TH1.h>
+#include <TGraph.h>
+
+DriftSettings::DriftSettings(const RunOptions& options)
+{
+	std::string peak_list = options.GetString("DriftPeaks", "");
+	if(!peak_list.empty())
+	{
+		std::replace(peak_list.begin(), peak_list.end(), ',', ' ');
+		std::stringstream peakstream(peak_list);
+		double energy;
+		peaks.clear();
+		while(peakstream>>energy)
+			peaks.push_back(energy);
+		std::sort(peaks.begin(), peaks.end());
+	}
+	window = options.GetDouble("DriftWindow", window);
+	bin_width = options.GetDouble("DriftBinWidth", bin_width);
+	min_counts = options.GetDouble("DriftMinCounts", min_counts);
+	tolerance = options.GetDouble("DriftTolerance", tolerance);
+	outputname = options.GetString("DriftScanOutput", outputname);
+	plotname = options.GetString("DriftScanPlots", plotname);
+}
+
+void DriftSettings::Print() const
+{
+	std::cout<<"Drift scan reference peaks (MeV):";
+	for(auto& energy : peaks)
+		std::cout<<" "<<energy;
+	std::cout<<std::endl;
+	std::cout<<"Drift scan window: "<<window<<" MeV Bin width: "<<bin_width<<" MeV Min. counts: "<<min_counts<<" Tolerance: "<<tolerance*100.0<<"%"<<std::endl;
+}
+
+//Requires a file from each calibration stage
+DriftScanner::DriftScanner(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch,
+							const std::string& frontbackmatch, const std::string& energyfile) :
+	snapshot(channelfile, zerofile, backmatch, updownmatch, frontbackmatch, energyfile), nthreads(1), nbins(0), minx(0.0), maxx(0.0)
+{
+	//The spectra are calibrated energies, so the banks belong to this exact set of calibrations
+	bank_key = "files";
+	for(auto& filename : {zerofile, backmatch, updownmatch, frontbackmatch, energyfile})
+		bank_key += ":" + std::to_string(ChannelMap::ComputeChecksum(filename));
+}
+
+//Requires a bundle with every calibration stage set
+DriftScanner::DriftScanner(const std::string& bundlefile) :
+	snapshot(CalibrationBundle(bundlefile)), nthreads(1), nbins(0), minx(0.0), maxx(0.0)
+{
+	bank_key = "bundle:" + std::to_string(ChannelMap::ComputeChecksum(bundlefile));
+}
+
+DriftScanner::~DriftScanner() {}
+
+void DriftScanner::FillHistogram(THashTable* table, int gchan, double value)
+{
+	std::string name = "channel_"+std::to_string(gchan);
+	TH1* histo = (TH1*) table->FindObject(name.c_str());
+	if(histo == nullptr)
+	{
+		histo = new TH1F(name.c_str(), name.c_str(), nbins, minx, maxx);
+		table->Add(histo);
+	}
+	histo->Fill(value);
+}
+
+/*
+	Backs, wedges, and rings are calibrated in one batch per event; SX3 fronts (and any channel without a full calibration)
+	come back as NaN and are skipped. The buffers are kept per thread so that no event allocates.
+*/
+void DriftScanner::FillSpectra(AnasenEvent* event, THashTable* table)
+{
+	thread_local std::vector<RawHit> hits;
+	thread_local std::vector<double> energies;
+	hits.clear();
+	auto add_hits = [](const std::vector<SiliconHit>& silicon)
+	{
+		RawHit raw;
+		for(auto& hit : silicon)
+		{
+			raw.gchan = hit.global_chan;
+			raw.adc = hit.energy;
+			hits.push_back(raw);
+		}
+	};
+	for(int j=0; j<12; j++)
+	{
+		add_hits(event->barrel1[j].backs);
+		add_hits(event->barrel2[j].backs);
+	}
+	for(int j=0; j<4; j++)
+	{
+		add_hits(event->fqqq[j].rings);
+		add_hits(event->fqqq[j].wedges);
+		add_hits(event->bqqq[j].rings);
+		add_hits(event->bqqq[j].wedges);
+	}
+	if(hits.empty())
+		return;
+
+	energies.resize(hits.size());
+	snapshot.CalibrateHits(hits.data(), hits.size(), energies.data());
+	for(size_t i=0; i<hits.size(); i++)
+	{
+		if(!std::isnan(energies[i]) && energies[i] >= minx && energies[i] < maxx)
+			FillHistogram(table, hits[i].gchan, energies[i]);
+	}
+}
+
+/*
+	Iterated windowed mean around the reference energy. Returns NaN if the window ever holds fewer than DriftMinCounts,
+	or the estimate does not settle.
+*/
+double DriftScanner::GetCentroid(TH1* histo, double reference)
+{
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	double centroid = reference;
+	for(int iter=0; iter<20; iter++)
+	{
+		int first = histo->FindFixBin(centroid - settings.window);
+		int last = histo->FindFixBin(centroid + settings.window);
+		double sum = 0.0, weighted = 0.0, content;
+		for(int bin=std::max(first, 1); bin<=std::min(last, histo->GetNbinsX()); bin++)
+		{
+			content = histo->GetBinContent(bin);
+			sum += content;
+			weighted += content*histo->GetBinCenter(bin);
+		}
+		if(sum < settings.min_counts)
+			return nan;
+
+		double next = weighted/sum;
+		if(std::fabs(next - centroid) < 0.01*settings.bin_width)
+			return next;
+		centroid = next;
+	}
+	return nan;
+}
+
+//Average relative shift of the reference peaks of every channel in one run, NaN where no peak had a centroid
+std::vector<double> DriftScanner::GetShifts(THashTable* table)
+{
+	std::vector<double> shifts(snapshot.GetNChannels(), std::numeric_limits<double>::quiet_NaN());
+	for(int i=0; i<snapshot.GetNChannels(); i++)
+	{
+		TH1* histo = (TH1*) table->FindObject(("channel_"+std::to_string(i)).c_str());
+		if(histo == nullptr)
+			continue;
+
+		double total = 0.0;
+		int npeaks = 0;
+		for(auto& reference : settings.peaks)
+		{
+			double centroid = GetCentroid(histo, reference);
+			if(std::isnan(centroid))
+				continue;
+			total += centroid/reference - 1.0;
+			npeaks++;
+		}
+		if(npeaks > 0)
+			shifts[i] = total/npeaks;
+	}
+	return shifts;
+}
+
+/*
+	Main loop. Takes in a list of input data files, one per run, which should be in run order. The results are written to the
+	files given by the settings. Returns false if the scan could not be run or its results could not be written.
+*/
+bool DriftScanner::Run(const std::vector<std::string>& inputnames)
+{
+	if(!snapshot.IsValid())
+	{
+		std::cerr<<"Bad maps at DriftScanner::Run()! Exiting."<<std::endl;
+		return false;
+	}
+	if(settings.peaks.empty() || settings.window <= 0.0 || settings.bin_width <= 0.0)
+	{
+		std::cerr<<"Bad drift scan settings at DriftScanner::Run()! Exiting."<<std::endl;
+		return false;
+	}
+
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
+	if(!processor.IsValid())
+	{
+		std::cerr<<"No input datafiles given to DriftScanner::Run()! Exiting."<<std::endl;
+		return false;
+	}
+
+	//Spectra only cover the reference peaks, with room for the window to move
+	minx = settings.peaks.front() - 2.0*settings.window;
+	maxx = settings.peaks.back() + 2.0*settings.window;
+	nbins = std::ceil((maxx - minx)/settings.bin_width);
+	maxx = minx + nbins*settings.bin_width;
+
+	std::ostringstream key;
+	key<<bank_key<<":"<<minx<<":"<<nbins<<":"<<settings.bin_width;
+	HistogramBank bank(bank_settings, "drift-scan", key.str(), snapshot.GetNChannels());
+
+	const std::vector<std::string>& files = processor.GetFiles();
+	std::vector<std::vector<double>> shifts(files.size());
+	std::vector<int> runs(files.size());
+	for(size_t i=0; i<files.size(); i++)
+		runs[i] = FileProcessor::GetRunNumber(files[i], i);
+
+	bool success = processor.FillFiles([this](AnasenEvent* event, THashTable* table)
+	{
+		FillSpectra(event, table);
+	},
+	[this, &shifts](size_t index, THashTable* table)
+	{
+		shifts[index] = GetShifts(table);
+		table->Delete();
+		delete table;
+	}, bank);
+	if(!success)
+		std::cerr<<"Unable to read all of the input data at DriftScanner::Run()! Runs which could not be read are left out."<<std::endl;
+
+	if(!WriteResults(runs, shifts))
+		return false;
+	return success;
+}
+
+/*
+	The text output holds one line per run and channel with a centroid: run, global channel, relative shift. Flagged channels
+	are listed at the end as comment lines (and to the terminal), with their largest shift and the run it was seen in.
+	Returns false if an output file could not be written.
+*/
+bool DriftScanner::WriteResults(const std::vector<int>& runs, const std::vector<std::vector<double>>& shifts)
+{
+	std::ofstream output(settings.outputname);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open output file "<<settings.outputname<<" at DriftScanner::WriteResults()! Exiting."<<std::endl;
+		return false;
+	}
+	io_policy.WriteQuickLookNote(output);
+	output<<"# Relative centroid shift (centroid/reference - 1) of each channel, per run"<<std::endl;
+	output<<"# run\tgchan\tshift"<<std::endl;
+
+	int nchannels = snapshot.GetNChannels();
+	std::vector<double> max_shift(nchannels, 0.0);
+	std::vector<int> max_run(nchannels, -1), nexceeded(nchannels, 0);
+	std::vector<TGraph*> graphs(nchannels, nullptr);
+	for(size_t r=0; r<runs.size(); r++)
+	{
+		for(int i=0; i<(int)shifts[r].size(); i++)
+		{
+			double shift = shifts[r][i];
+			if(std::isnan(shift))
+				continue;
+			output<<runs[r]<<"\t"<<i<<"\t"<<shift<<std::endl;
+
+			if(std::fabs(shift) > settings.tolerance)
+				nexceeded[i]++;
+			if(max_run[i] == -1 || std::fabs(shift) > std::fabs(max_shift[i]))
+			{
+				max_shift[i] = shift;
+				max_run[i] = runs[r];
+			}
+			if(!settings.plotname.empty())
+			{
+				if(graphs[i] == nullptr)
+				{
+					graphs[i] = new TGraph();
+					std::string name = "channel_"+std::to_string(i)+"_drift";
+					graphs[i]->SetName(name.c_str());
+					graphs[i]->SetTitle((name+";run;relative shift").c_str());
+				}
+				graphs[i]->SetPoint(graphs[i]->GetN(), runs[r], shift);
+			}
+		}
+	}
+
+	int nflagged = 0;
+	for(int i=0; i<nchannels; i++)
+	{
+		if(nexceeded[i] == 0)
+			continue;
+		if(nflagged == 0)
+			output<<"# Flagged channels (gchan, runs over tolerance, largest shift, run of largest shift):"<<std::endl;
+		output<<"# "<<i<<"\t"<<nexceeded[i]<<"\t"<<max_shift[i]<<"\t"<<max_run[i]<<std::endl;
+		std::cout<<"Channel "<<i<<" drifted beyond "<<settings.tolerance*100.0<<"% in "<<nexceeded[i]<<" run(s), largest shift "<<max_shift[i]*100.0
+				<<"% in run "<<max_run[i]<<std::endl;
+		nflagged++;
+	}
+	output.close();
+	std::cout<<"Drift scan of "<<runs.size()<<" run(s) written to "<<settings.outputname<<"; "<<nflagged<<" channel(s) flagged."<<std::endl;
+
+	if(settings.plotname.empty())
+		return true;
+	TFile* plotfile = TFile::Open(settings.plotname.c_str(), "RECREATE");
+	if(plotfile == nullptr || !plotfile->IsOpen())
+	{
+		std::cerr<<"Unable to create drift plot file "<<settings.plotname<<" at DriftScanner::WriteResults()!"<<std::endl;
+		for(auto& graph : graphs)
+			delete graph;
+		delete plotfile;
+		return false;
+	}
+	for(auto& graph : graphs)
+	{
+		if(graph == nullptr)
+			continue;
+		graph->Write();
+		delete graph;
+	}
+	io_policy.WriteQuickLookNote(plotfile);
+	plotfile->Close();
+	delete plotfile;
+	return true;
+}
@@ -8,7 +8,9 @@
 
 #include "EnergyCalibrator.h"
 #include <TFile.h>
-#include <TTree.h>
+#include "FileProcessor.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
 #include <TGraph.h>
 #include <TH1.h>
 #include <TF1.h>
@@ -27,8 +29,21 @@ bool SortEnergyData(const double i, const double j)
 	of maximum peak height. These may need adjusted for each experiment.
 */
 EnergyCalibrator::EnergyCalibrator(const std::string& channelfile, const std::string& zerofile, const std::string& backmatch, const std::string& updownmatch, const std::string& frontbackmatch) :
-	cmap(channelfile), zmap(zerofile), bmap(backmatch), udmap(updownmatch), fbmap(frontbackmatch), sigma(1.0), threshold(0.4)
+	cmap(channelfile), zmap(zerofile), bmap(backmatch), udmap(updownmatch), fbmap(frontbackmatch), nthreads(1), sigma(1.0), threshold(0.4)
 {
+	//The spectra are made with the zero offsets and the back and front-back gains
+	bank_key = "files:" + std::to_string(ChannelMap::ComputeChecksum(zerofile)) + ":" + std::to_string(ChannelMap::ComputeChecksum(backmatch)) + ":" +
+				std::to_string(ChannelMap::ComputeChecksum(frontbackmatch));
+}
+
+//Takes the channel map, zero offsets, and gain-matching from a calibration bundle. The energy stage of the bundle is not used.
+EnergyCalibrator::EnergyCalibrator(const std::string& bundlefile) :
+	bundle(bundlefile), cmap(bundle.GetChannelTable(), bundle.GetNChannels(), bundlefile), zmap(bundle.GetOffsets(), bundle.GetNChannels()),
+	bmap(bundle.GetParameters(CalibrationStage::BackGains), bundle.GetNChannels()), udmap(bundle.GetParameters(CalibrationStage::UpDownGains), bundle.GetNChannels()),
+	fbmap(bundle.GetParameters(CalibrationStage::FrontBackGains), bundle.GetNChannels()), nthreads(1), sigma(1.0), threshold(0.4)
+{
+	bundle.Print();
+	bank_key = "bundle:" + std::to_string(ChannelMap::ComputeChecksum(bundlefile));
 }
 
 EnergyCalibrator::~EnergyCalibrator() {}
@@ -36,6 +51,8 @@ EnergyCalibrator::~EnergyCalibrator() {}
 //Wrapper on histogram creation, storage, and filling.
 void EnergyCalibrator::FillHistogram(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value)
 {
+	ANASEN_TRACE_ACCUMULATE("EnergyCalibrator/fill histogram");
+	ANASEN_PERF_HIT();
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
 	if(histo == nullptr)
 	{
@@ -56,6 +73,7 @@ void EnergyCalibrator::FillHistogram(THashTable* table, const std::string& name,
 */
 GraphData EnergyCalibrator::GetPoints(THashTable* table, int gchan, const std::string& name)
 {
+	ANASEN_TRACE_SCOPE("EnergyCalibrator/find peaks");
 	GraphData data;
 
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
@@ -91,6 +109,7 @@ GraphData EnergyCalibrator::GetPoints(THashTable* table, int gchan, const std::s
 */
 CalParams EnergyCalibrator::CalibrateEnergy(THashTable* table, const std::string& name, const GraphData& data) 
 {
+	ANASEN_TRACE_SCOPE("EnergyCalibrator/fit");
 	CalParams parameters;
 	std::string linename = name+"_fit";
 	TGraph* graph = new TGraph(data.xvals.size(), &(data.xvals[0]), &(data.yvals[0]));
@@ -107,139 +126,254 @@ CalParams EnergyCalibrator::CalibrateEnergy(THashTable* table, const std::string
 }
 
 /*
-	Main loop. Takes in input data file, which should contain source calibration data, and two output files: one which is 
-	a ROOT file for storing graphs, and a text file for storing calibraton parameters.
+	Generate a calibration spectrum for each channel, excluding SX3 fronts (only used for positional data)
 */
-void EnergyCalibrator::Run(const std::string& inputname, const std::string& plotname, const std::string& outputname) 
+void EnergyCalibrator::FillEnergySpectra(AnasenEvent* event, THashTable* histo_table)
+{
+	ANASEN_PERF_REGION("EnergyCalibrator/fill spectra");
+	std::string name;
+	double cal_energy;
+	for(int j=0; j<12; j++)
+	{
+		for(auto& hit : event->barrel1[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+
+		for(auto& hit : event->barrel2[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+	}
+
+	for(int j=0; j<4; j++)
+	{
+		for(auto& hit : event->fqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = fbmap.FindParameters(hit.global_chan);
+			if(gains == fbmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+		for(auto& hit : event->fqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+		for(auto& hit : event->bqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = fbmap.FindParameters(hit.global_chan);
+			if(gains == fbmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+		for(auto& hit : event->bqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End())
+				continue;
+			cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
+			FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
+		}
+	}
+}
+
+//Calibrated spectrum of each channel, used to check the results of the energy calibration
+void EnergyCalibrator::FillEnergyTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& energymap)
 {
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	if(!input->IsOpen())
+	std::string name;
+	double cal_energy;
+	for(int j=0; j<12; j++)
 	{
-		std::cerr<<"Unable to open input datafile "<<inputname<<"! Quitting."<<std::endl;
-		return;
+		for(auto& hit : event->barrel1[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
+
+		for(auto& hit : event->barrel2[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
 	}
-	TTree* intree = (TTree*) input->Get("EventTree");
 
-	AnasenEvent* event = new AnasenEvent();
+	for(int j=0; j<4; j++)
+	{
+		for(auto& hit : event->fqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = fbmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == fbmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
+		for(auto& hit : event->fqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
+		for(auto& hit : event->bqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = fbmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == fbmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
+		for(auto& hit : event->bqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto gains = bmap.FindParameters(hit.global_chan);
+			auto ecal = energymap.FindParameters(hit.global_chan);
+			if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
+				continue;
+			cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
+			FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
+		}
+	}
+}
 
-	intree->SetBranchAddress("event", &event);
+/*
+	Main loop. Takes in a list of input data files, which should contain source calibration data, and two output files: one which is 
+	a ROOT file for storing graphs, and a text file for storing calibraton parameters. Returns false if any input could not be read
+	or an output could not be written.
+*/
+bool EnergyCalibrator::Run(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname) 
+{
+	ANASEN_TRACE_SCOPE("EnergyCalibrator/Run");
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
+	if(!processor.IsValid())
+	{
+		std::cerr<<"No input datafiles given to EnergyCalibrator::Run()! Quitting."<<std::endl;
+		return false;
+	}
 
 	TFile* graphoutput = TFile::Open(plotname.c_str(), "RECREATE");
-	if(!graphoutput->IsOpen())
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
 	{
-		input->Close();
 		std::cerr<<"Unable to create output graph file "<<plotname<<"! Quitting."<<std::endl;
-		return;
+		return false;
 	}
 
 	THashTable* histo_table = new THashTable();
 	THashTable* graph_table = new THashTable();
 
+	HistogramBank bank(bank_settings, "energy", bank_key, nchannels);
+	ParameterMap previous(bank.IsEnabled() ? outputname : "");
+
 	std::ofstream output(outputname);
 	if(!output.is_open())
 	{
-		input->Close();
 		graphoutput->Close();
 		std::cerr<<"Unable to open output file "<<outputname<<". Quitting."<<std::endl;
-		return;
+		return false;
 	}
+	io_policy.WriteQuickLookNote(output);
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val = 0.01*nentries;
-
-	std::string name;
-	double cal_energy;
-	for(int i=0; i<nentries; i++)
+	//Each source spectrum needs enough counts in every alpha peak; SX3 fronts are not calibrated here
+	SpectrumMonitor monitor(early_stop, processor.GetNSlots(), nchannels);
+	for(int i=0; i<nchannels; i++)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
+		const ChannelData* channel = cmap.GetChannelData(i);
+		if(channel != nullptr && (channel->detectorComponent == DetectorComponent::Back || channel->detectorComponent == DetectorComponent::Wedge ||
+									channel->detectorComponent == DetectorComponent::Ring))
+			monitor.SetPeaks(i, energyValues.size());
+	}
 
-		/*
-			Generate a calibration spectrum for each channel, excluding SX3 fronts (only used for positional data)
-		*/
-		for(int j=0; j<12; j++)
+	std::vector<THashTable*> slot_tables;
+	bool success;
+	if(bank.IsEnabled())
+	{
+		success = processor.Fill([this](AnasenEvent* event, THashTable* table)
 		{
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-		}
-
-		for(int j=0; j<4; j++)
+			FillEnergySpectra(event, table);
+		}, histo_table, bank);
+	}
+	else
+	{
+		slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+		monitor.Attach(processor, slot_tables);
+		success = processor.Process([this, &slot_tables](AnasenEvent* event, int slot)
 		{
-			for(auto& hit : event->fqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = fbmap.FindParameters(hit.global_chan);
-				if(gains == fbmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-			for(auto& hit : event->bqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = fbmap.FindParameters(hit.global_chan);
-				if(gains == fbmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End())
-					continue;
-				cal_energy = gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept;
-				FillHistogram(histo_table, name, name, 925,600.0,8000.0, cal_energy);
-			}
-		}
+			FillEnergySpectra(event, slot_tables[slot]);
+		});
+		monitor.Finish(slot_tables);
+		FileProcessor::MergeTables(histo_table, slot_tables);
+	}
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at EnergyCalibrator::Run()! Quitting."<<std::endl;
+		return false;
 	}
-	std::cout<<std::endl;
 
 	//Generate graphs, obtain fit parameters
 	GraphData data;
 	CalParams parameters;
+	std::string name;
+	int nkept = 0;
 	for(int i=0; i<nchannels; i++)
 	{
 		name = "channel_"+std::to_string(i);
+		//Channels whose spectrum has barely changed since the last fit keep their previous calibration
+		auto previous_parameters = previous.FindParameters(i);
+		if(!bank.NeedsRefit(i, HistogramBank::GetCounts(histo_table, name)) && previous_parameters != previous.End())
+		{
+			output<<i<<"\t"<<previous_parameters->second.intercept<<"\t"<<previous_parameters->second.slope<<std::endl;
+			nkept++;
+			continue;
+		}
 		data = GetPoints(histo_table, i, name);
 
 		if(data.xvals.size() ==  0)
@@ -251,6 +385,11 @@ void EnergyCalibrator::Run(const std::string& inputname, const std::string& plot
 		output<<i<<"\t"<<parameters.intercept<<"\t"<<parameters.slope<<std::endl;
 	}
 	output.close();
+	if(bank.IsEnabled())
+	{
+		bank.SaveFitCounts();
+		std::cout<<"Kept the previous calibration of "<<nkept<<" channel(s) with unchanged statistics."<<std::endl;
+	}
 
 	/*
 		Testing
@@ -258,106 +397,37 @@ void EnergyCalibrator::Run(const std::string& inputname, const std::string& plot
 	ParameterMap energymap(outputname);
 	if(!energymap.IsValid())
 	{
+		graphoutput->Close();
 		std::cerr<<"Energy calibration map is not valid at EnergyCalibrator::Run()!"<<std::endl;
+		return false;
 	}
 
 	std::cout<<"Generating energy calibration test plots..."<<std::endl;
-	count=0;
-	flush_count=0;
-	for(int i=0; i<nentries; i++)
+	processor.SetStopCheck(nullptr, 0);
+	if(processor.WasStopped())
+		processor.SetMaxEntries(processor.GetReadEntries()); //test plots from as much data as the fits
+	//With histogram banks only the runs which were just read are used, so that the cost follows the new data
+	FileProcessor new_runs(processor.GetFilledFiles(), "EventTree", io_policy, nthreads);
+	FileProcessor& test_processor = bank.IsEnabled() ? new_runs : processor;
+	if(test_processor.IsValid())
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
+		slot_tables = FileProcessor::MakeTables(test_processor.GetNSlots());
+		success = test_processor.Process([this, &slot_tables, &energymap](AnasenEvent* event, int slot)
 		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
-
-		for(int j=0; j<12; j++)
-		{
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			for(auto& hit : event->fqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = fbmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == fbmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-			for(auto& hit : event->bqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = fbmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == fbmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan)+"_calibrated";
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto gains = bmap.FindParameters(hit.global_chan);
-				auto ecal = energymap.FindParameters(hit.global_chan);
-				if(gains == bmap.End() || zero_offset == zmap.End() || ecal == energymap.End())
-					continue;
-				cal_energy = ecal->second.slope*(gains->second.slope*(hit.energy - zero_offset->second) + gains->second.intercept) + ecal->second.intercept;
-				FillHistogram(histo_table, name, name, 1000.0,0.0,10.0, cal_energy);
-			}
-		}
+			FillEnergyTestPlots(event, slot_tables[slot], energymap);
+		});
+		FileProcessor::MergeTables(histo_table, slot_tables);
 	}
-	std::cout<<std::endl;
-
-	input->Close();
+	else
+		std::cout<<"No new runs were read, skipping the test plots."<<std::endl;
 
+	ANASEN_TRACE_SCOPE("EnergyCalibrator/write");
 	graphoutput->cd();
 	histo_table->Write();
 	graph_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	delete event;
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at EnergyCalibrator::Run()!"<<std::endl;
+	return success;
 }
-
@@ -0,0 +1,91 @@
+/*
+	EventIO
+	Backend abstraction for reading and writing event data (AnasenEvent, CalibratedEvent). Stages read through an EventSource
+	and write through an EventSink, so that the on-disk format can be chosen in one place:
+		ttree: a TTree with a single branch holding the event object (the standard format)
+		rntuple: ROOT's columnar RNTuple format. Only available when built with RNTuple support (make RNTUPLE=1), which
+		requires ROOT 6.34 or newer.
+
+	Sources detect the format of their files on their own, so every stage can read data written in either format. The format
+	written is set by the DataFormat setting of OutputPolicy. Both are templated on the event type, and created through
+	MakeEventSource and MakeEventSink. In either format the tree/ntuple name and the field name match the existing files
+	(EventTree or CalTree, event). GetEntries reads the number of entries of one file from its header, for loops which need the
+	total before any source is made (see FileProcessor).
+*/
+#include "EventIO.h"
+#include <TKey.h>
+
+namespace EventIO
+{
+	/*
+		Looks up the class of the named object in the file. Anything which cannot be identified is treated as a TTree, so that
+		the usual TTree error messages are given for missing files or trees.
+	*/
+	std::string DetectFormat(const std::string& filename, const std::string& name)
+	{
+		std::string format = "ttree";
+		TFile* file = TFile::Open(filename.c_str(), "READ");
+		if(file == nullptr || !file->IsOpen())
+		{
+			delete file;
+			return format;
+		}
+
+		TKey* key = file->GetKey(name.c_str());
+		if(key != nullptr && std::string(key->GetClassName()).find("RNTuple") != std::string::npos)
+			format = "rntuple";
+		file->Close();
+		delete file;
+		return format;
+	}
+
+	/*
+		Returns -1 if the file or the tree cannot be read; the source made for the file later reports the error.
+	*/
+	long long GetEntries(const std::string& filename, const std::string& name)
+	{
+		long long entries = -1;
+		TFile* file = TFile::Open(filename.c_str(), "READ");
+		if(file == nullptr || !file->IsOpen())
+		{
+			delete file;
+			return entries;
+		}
+
+		TKey* key = file->GetKey(name.c_str());
+		if(key != nullptr && std::string(key->GetClassName()).find("RNTuple") != std::string::npos)
+		{
+			file->Close();
+			delete file;
+#ifdef ANASEN_RNTUPLE
+			try
+			{
+				entries = RNTupleAPI::RNTupleReader::Open(name, filename)->GetNEntries();
+			}
+			catch(std::exception& e)
+			{
+				entries = -1;
+			}
+#endif
+			return entries;
+		}
+
+		TTree* tree = dynamic_cast<TTree*>(file->Get(name.c_str()));
+		if(tree != nullptr)
+			entries = tree->GetEntries();
+		file->Close();
+		delete file;
+		return entries;
+	}
+
+	bool IsFormatAvailable(const std::string& format)
+	{
+		if(format == "ttree")
+			return true;
+#ifdef ANASEN_RNTUPLE
+		else if(format == "rntuple")
+			return true;
+#endif
+		return false;
+	}
+}
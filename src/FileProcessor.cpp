@@ -0,0 +1,430 @@
+/*
+	FileProcessor
+	Class which runs the event loop over a list of AnasenEvent data files. Files are handed out to a pool of worker threads,
+	each identified by a slot number. The function passed to Process is called for every event along with the slot of the
+	thread which read it, so that each thread fills its own histograms or data; the per-slot results are then combined by the
+	caller (see MergeTables). With a single thread (or a single file) everything runs on the calling thread. Fill instead keeps
+	one table of histograms per file, so that the spectra of each run can be kept in a HistogramBank; FillFiles hands each of
+	those tables to the caller as soon as its file is done, for run-by-run results (see DriftScanner).
+
+	Inputs can be a single file, a list file (.txt or .list, one data file per line), or a run range given as runs:<start>-<stop>
+	(or simply runs, which uses StartRun and StopRun) which is expanded using the organized data directory. See ResolveInputFiles.
+
+	SetSelection restricts the loop to the events of one FiredGroup. Files with a matching fired index (see FiredIndex) only read
+	the listed entries; otherwise every entry is read and the events whose fired mask lacks the group are skipped. Events
+	without a fired mask (data organized before it existed) are never skipped.
+
+	SetStopCheck installs a function which each thread calls after every interval entries it reads; once it returns true
+	every thread stops and Process returns early (see SpectrumMonitor). SetMaxEntries stops the loop after a fixed number of
+	entries have been read, so that a later pass can be limited to what an early-stopped pass used. Progress over every file is
+	given by a ProgressReporter.
+*/
+#include "FileProcessor.h"
+#include "EventIO.h"
+#include "FiredIndex.h"
+#include "StageTracer.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cctype>
+#include <TROOT.h>
+#include <TH1.h>
+
+static const long progress_batch = 256; //entries a thread reads before adding them to the progress
+
+FileProcessor::FileProcessor(const std::vector<std::string>& files, const std::string& treename, const IOPolicy& policy, int nthreads) :
+	file_list(files), tree_name(treename), io_policy(policy), nslots(1), selection(0), check_interval(0), max_entries(0), total_entries(-1),
+	progress(nullptr), read_entries(0), stopped(false)
+{
+	if(nthreads > 1 && file_list.size() > 1)
+		nslots = std::min(nthreads, (int) file_list.size());
+	if(nslots > 1)
+		ROOT::EnableThreadSafety();
+	//Histograms are created while input files are open; they must not be owned by (and deleted with) those files
+	static std::once_flag detach_flag;
+	std::call_once(detach_flag, []() { TH1::AddDirectory(false); });
+}
+
+FileProcessor::~FileProcessor() {}
+
+/*
+	Expands an input specification into a list of files. Run ranges skip runs which do not exist, as in organize-data, unless
+	must_exist is false (for files which are yet to be made, see Pipeline).
+*/
+std::vector<std::string> FileProcessor::ResolveInputFiles(const std::string& spec, const std::string& rundir, int runMin, int runMax, bool must_exist)
+{
+	std::vector<std::string> files;
+	std::string filename;
+	if(spec == "runs" || spec.compare(0, 5, "runs:") == 0)
+	{
+		int start = runMin, stop = runMax;
+		if(spec != "runs")
+		{
+			size_t dash = spec.find('-', 5);
+			try
+			{
+				start = std::stoi(spec.substr(5, dash-5));
+				stop = (dash == std::string::npos) ? start : std::stoi(spec.substr(dash+1));
+			}
+			catch(std::exception& e)
+			{
+				std::cerr<<"Bad run range "<<spec<<" at FileProcessor::ResolveInputFiles! Use runs:<start>-<stop>."<<std::endl;
+				return files;
+			}
+		}
+
+		for(int i=start; i<=stop; i++)
+		{
+			filename = rundir + "run-" + std::to_string(i) + ".root";
+			if(!must_exist || std::ifstream(filename))
+				files.push_back(filename);
+		}
+	}
+	else if((spec.size() > 4 && spec.compare(spec.size()-4, 4, ".txt") == 0) || (spec.size() > 5 && spec.compare(spec.size()-5, 5, ".list") == 0))
+	{
+		std::ifstream list(spec);
+		if(!list.is_open())
+		{
+			std::cerr<<"Unable to open input file list "<<spec<<" at FileProcessor::ResolveInputFiles!"<<std::endl;
+			return files;
+		}
+		while(list>>filename)
+		{
+			if(filename[0] != '#')
+				files.push_back(filename);
+		}
+	}
+	else
+		files.push_back(spec);
+
+	if(files.size() == 0)
+		std::cerr<<"No input files found for "<<spec<<" at FileProcessor::ResolveInputFiles!"<<std::endl;
+
+	return files;
+}
+
+//Run number from a run-<N>.root file name, or fallback if the name has no run number
+int FileProcessor::GetRunNumber(const std::string& filename, int fallback)
+{
+	size_t start = filename.rfind("run-");
+	if(start == std::string::npos)
+		return fallback;
+	start += 4;
+	size_t stop = start;
+	while(stop < filename.size() && std::isdigit(filename[stop]))
+		stop++;
+	if(stop == start)
+		return fallback;
+	return std::stoi(filename.substr(start, stop-start));
+}
+
+std::vector<THashTable*> FileProcessor::MakeTables(int n)
+{
+	std::vector<THashTable*> tables;
+	for(int i=0; i<n; i++)
+		tables.push_back(new THashTable());
+	return tables;
+}
+
+/*
+	Moves the contents of each table into result. Histograms which already exist in result (by name) are added together;
+	the tables themselves are deleted.
+*/
+void FileProcessor::MergeTables(THashTable* result, std::vector<THashTable*>& tables)
+{
+	ANASEN_TRACE_SCOPE("FileProcessor/merge");
+	for(auto& table : tables)
+		MergeInto(result, table);
+	tables.clear();
+}
+
+/*
+	Parallel version for many tables (i.e. one per run), like hadd -j: in each round the second half of the tables is merged
+	into the first half, one pair per thread, until a single table is left to merge into result. Requires ROOT thread safety,
+	which is on whenever the processor has more than one slot.
+*/
+void FileProcessor::MergeTables(THashTable* result, std::vector<THashTable*>& tables, int nthreads)
+{
+	while(nthreads > 1 && tables.size() > 1)
+	{
+		size_t half = (tables.size() + 1)/2;
+		std::atomic<size_t> next(half);
+		auto worker = [&tables, &next, half]()
+		{
+			size_t index;
+			while((index = next++) < tables.size())
+				MergeInto(tables[index-half], tables[index]);
+		};
+		std::vector<std::thread> threads;
+		for(size_t i=0; i<std::min((size_t) nthreads, tables.size()-half); i++)
+			threads.emplace_back(worker);
+		for(auto& thread : threads)
+			thread.join();
+		tables.resize(half);
+	}
+	MergeTables(result, tables);
+}
+
+void FileProcessor::MergeInto(THashTable* result, THashTable* table)
+{
+	TIter next(table);
+	TObject* object;
+	while((object = next()))
+	{
+		TH1* existing = (TH1*) result->FindObject(object->GetName());
+		TH1* histo = dynamic_cast<TH1*>(object);
+		if(existing == nullptr)
+			result->Add(object);
+		else if(histo != nullptr)
+		{
+			existing->Add(histo);
+			delete histo;
+		}
+		else
+			std::cerr<<"Cannot merge non-histogram object "<<object->GetName()<<" at FileProcessor::MergeTables! Dropping."<<std::endl;
+	}
+	table->Clear();
+	delete table;
+}
+
+long FileProcessor::CountEntries()
+{
+	long total = 0;
+	long long entries;
+	for(auto& filename : file_list)
+	{
+		entries = EventIO::GetEntries(filename, tree_name);
+		if(entries > 0)
+			total += entries;
+	}
+	return total;
+}
+
+/*
+	Main loop. Returns false if any of the files could not be read.
+*/
+bool FileProcessor::Process(const EventFunction& func)
+{
+	if(total_entries < 0)
+		total_entries = CountEntries();
+	read_entries = 0;
+	stopped = false;
+
+	std::cout<<"Processing "<<file_list.size()<<" file(s) with "<<total_entries<<" total entries using "<<nslots<<" thread(s)..."<<std::endl;
+
+	ProgressReporter reporter("Processing", total_entries, 0, &print_mutex);
+	progress = &reporter;
+	bool success = RunFiles([this, &func](size_t index, int slot)
+	{
+		return ProcessFile(file_list[index], func, slot);
+	});
+	reporter.Finish();
+	progress = nullptr;
+	if(stopped)
+		std::cout<<"Stopped early after reading "<<read_entries<<" of "<<total_entries<<" entries."<<std::endl;
+
+	return success;
+}
+
+/*
+	Fills a table of histograms for each file, and merges them all into result. Files with an up to date histogram bank are
+	loaded from the bank instead of being read, and every file which is read is saved to the bank (see HistogramBank). Banks
+	are not used in quick-look mode. The files which were read are given by GetFilledFiles. Returns false if any of the files
+	could not be read.
+*/
+bool FileProcessor::Fill(const FillFunction& func, THashTable* result, const HistogramBank& bank)
+{
+	std::vector<THashTable*> file_tables(file_list.size(), nullptr);
+	bool success = FillFiles(func, [&file_tables](size_t index, THashTable* table) { file_tables[index] = table; }, bank);
+
+	file_tables.erase(std::remove(file_tables.begin(), file_tables.end(), nullptr), file_tables.end());
+	MergeTables(result, file_tables, nslots);
+
+	return success;
+}
+
+/*
+	Same as Fill, but instead of merging, the table of each file is handed to done (on the thread which filled it) along with
+	the index of the file, as soon as the file is finished. done takes ownership of the table. Files which could not be read
+	are never passed to done.
+*/
+bool FileProcessor::FillFiles(const FillFunction& func, const TableFunction& done, const HistogramBank& bank)
+{
+	bool use_bank = bank.IsEnabled() && !io_policy.IsQuickLook();
+	if(bank.IsEnabled() && !use_bank)
+		std::cout<<"Histogram banks are not used in quick-look mode."<<std::endl;
+
+	if(total_entries < 0)
+		total_entries = CountEntries();
+	read_entries = 0;
+	stopped = false;
+	filled_files.clear();
+
+	std::cout<<"Filling histograms from "<<file_list.size()<<" file(s) with "<<total_entries<<" total entries using "<<nslots<<" thread(s)..."<<std::endl;
+
+	ProgressReporter reporter("Filling", total_entries, 0, &print_mutex);
+	progress = &reporter;
+
+	bool success = RunFiles([this, &func, &done, &bank, use_bank](size_t index, int slot)
+	{
+		const std::string& filename = file_list[index];
+		long nentries = 0;
+		THashTable* table = use_bank ? bank.Load(filename, nentries) : nullptr;
+		if(table != nullptr)
+		{
+			progress->Skip(nentries);
+			std::lock_guard<std::mutex> guard(print_mutex);
+			std::cout<<std::endl<<"Loaded histogram bank of "<<filename<<" ("<<nentries<<" entries)."<<std::endl;
+		}
+		else
+		{
+			table = new THashTable();
+			if(!ProcessFile(filename, [&func, table](AnasenEvent* event, int) { func(event, table); }, slot, &nentries))
+			{
+				delete table;
+				return false;
+			}
+			if(use_bank && !stopped)
+				bank.Save(filename, table, nentries);
+			std::lock_guard<std::mutex> guard(print_mutex);
+			filled_files.push_back(filename);
+		}
+		done(index, table);
+		return true;
+	});
+	reporter.Finish();
+	progress = nullptr;
+
+	if(use_bank)
+		std::cout<<"Read "<<filled_files.size()<<" of "<<file_list.size()<<" file(s); the rest were loaded from histogram banks."<<std::endl;
+
+	return success;
+}
+
+/*
+	Hands the files out to the pool of threads, calling work for each. Returns false if work failed for any of the files.
+*/
+bool FileProcessor::RunFiles(const std::function<bool(size_t index, int slot)>& work)
+{
+	std::atomic<size_t> next_file(0);
+	std::atomic<bool> success(true);
+	auto worker = [this, &work, &next_file, &success](int slot)
+	{
+		size_t index;
+		while(!stopped && (index = next_file++) < file_list.size())
+		{
+			if(!work(index, slot))
+				success = false;
+		}
+	};
+
+	if(nslots == 1)
+		worker(0);
+	else
+	{
+		std::vector<std::thread> threads;
+		for(int i=0; i<nslots; i++)
+			threads.emplace_back(worker, i);
+		for(auto& thread : threads)
+			thread.join();
+	}
+	return success;
+}
+
+bool FileProcessor::ProcessFile(const std::string& filename, const EventFunction& func, int slot, long* file_entries)
+{
+	ANASEN_TRACE_SCOPE("FileProcessor/file");
+	EventSource<AnasenEvent>* source = MakeEventSource<AnasenEvent>({filename}, tree_name, "event", io_policy);
+	if(source == nullptr || !source->IsValid())
+	{
+		std::lock_guard<std::mutex> guard(print_mutex);
+		std::cerr<<"Unable to read input datafile "<<filename<<" at FileProcessor::ProcessFile()! Skipping."<<std::endl;
+		delete source;
+		return false;
+	}
+
+	long nentries = source->GetEntries();
+	if(file_entries != nullptr)
+		*file_entries = nentries;
+
+	//A fired index is only trusted if it was made from this exact file
+	const std::vector<long long>* selected = nullptr;
+	FiredIndex index(selection != 0 ? FiredIndex::GetIndexName(filename) : "");
+	if(selection != 0 && index.IsValid())
+	{
+		if(index.GetNEntries() == nentries)
+			selected = index.GetEntries(selection);
+		else
+		{
+			std::lock_guard<std::mutex> guard(print_mutex);
+			std::cerr<<"Fired index of "<<filename<<" does not match the file at FileProcessor::ProcessFile()! Filtering on the fired mask."<<std::endl;
+		}
+	}
+
+	//Quick-look mode only reads a sample of the clusters; the index entries are cut down to the same clusters
+	std::vector<EntryRange> ranges = {EntryRange{0, nentries}};
+	if(io_policy.IsQuickLook())
+		ranges = io_policy.SelectClusters(source->GetClusters());
+
+	long since_check = 0, nread = 0, pending = 0, k, last;
+	AnasenEvent* event;
+	for(auto& range : ranges)
+	{
+		if(selected == nullptr)
+		{
+			k = range.first;
+			last = range.last;
+		}
+		else
+		{
+			k = std::lower_bound(selected->begin(), selected->end(), range.first) - selected->begin();
+			last = std::lower_bound(selected->begin(), selected->end(), range.last) - selected->begin();
+		}
+		for(; k<last && !stopped; k++)
+		{
+			{
+				ANASEN_TRACE_ACCUMULATE("FileProcessor/read entry");
+				event = source->GetEntry(selected == nullptr ? k : (*selected)[k]);
+			}
+			if(selected != nullptr || selection == 0 || !(event->fired & FiredGroup::Set) || (event->fired & selection))
+			{
+				ANASEN_TRACE_ACCUMULATE("FileProcessor/process event");
+				func(event, slot);
+			}
+			nread++;
+
+			if(++read_entries >= max_entries && max_entries > 0)
+				stopped = true;
+			if(stop_check && ++since_check >= check_interval)
+			{
+				since_check = 0;
+				if(stop_check(slot))
+					stopped = true;
+			}
+
+			//Threads hand their progress over in batches, so that they do not all contend on the reporter
+			if(++pending == progress_batch)
+			{
+				progress->Add(pending);
+				pending = 0;
+			}
+		}
+	}
+	progress->Add(pending);
+	if(!stopped)
+		progress->Skip(nentries - nread); //entries skipped by the index or the quick-look sample
+
+	{
+		std::lock_guard<std::mutex> guard(print_mutex);
+		std::cout<<std::endl<<"Finished file "<<filename<<". ";
+		if(selected != nullptr)
+			std::cout<<"Read "<<nread<<" of "<<nentries<<" entries with "<<FiredIndex::GetGroupName(selection)<<" (fired index). ";
+		else if(io_policy.IsQuickLook())
+			std::cout<<"Read "<<nread<<" of "<<nentries<<" entries (quick-look). ";
+		source->Report();
+	}
+	delete source;
+	return true;
+}
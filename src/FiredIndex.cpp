@@ -0,0 +1,202 @@
+/*
+	FiredIndex
+	Per-group entry lists of an organized data file. For every FiredGroup bit (see DataStructs.h) the index holds the sorted
+	list of entries whose fired mask has that bit, so that a stage which only needs one group can read just those entries
+	instead of the whole file (see FileProcessor::SetSelection).
+
+	The index is written by organize-data (when the FiredIndex setting is on) to a sidecar file next to the data file,
+	<datafile>.fired, so that it works the same for TTree and RNTuple data. File layout (native byte order):
+		FiredIndexHeader: magic, version, number of groups, total number of entries in the data file
+		per group: number of entries (int64), followed by that many entry numbers (int64)
+	An index whose total number of entries does not match the data file is stale and should not be used.
+*/
+#include "FiredIndex.h"
+#include "DetectorGeometry.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+static const char index_magic[8] = {'A', 'N', 'F', 'I', 'R', 'E', 'D', 'X'};
+
+//An empty index, to be filled with Add
+FiredIndex::FiredIndex() :
+	nentries(0), valid_flag(true)
+{
+}
+
+//Loads an index from file. A missing file is not an error (the index is optional), it simply leaves the index invalid.
+FiredIndex::FiredIndex(const std::string& filename) :
+	nentries(0), valid_flag(false)
+{
+	std::ifstream input(filename, std::ios::binary);
+	if(!input.is_open())
+		return;
+
+	FiredIndexHeader header;
+	if(!input.read((char*) &header, sizeof(header)) || std::memcmp(header.magic, index_magic, sizeof(index_magic)) != 0)
+	{
+		std::cerr<<filename<<" is not a fired index at FiredIndex::FiredIndex()! Ignoring."<<std::endl;
+		return;
+	}
+	if(header.version != index_version || header.ngroups != ngroups)
+	{
+		std::cerr<<"Fired index "<<filename<<" has version "<<header.version<<" with "<<header.ngroups<<" groups, expected version "<<index_version;
+		std::cerr<<" with "<<ngroups<<" groups at FiredIndex::FiredIndex()! Ignoring."<<std::endl;
+		return;
+	}
+
+	int64_t size;
+	for(int i=0; i<ngroups; i++)
+	{
+		if(!input.read((char*) &size, sizeof(size)) || size < 0 || size > header.nentries)
+		{
+			std::cerr<<"Fired index "<<filename<<" is truncated at FiredIndex::FiredIndex()! Ignoring."<<std::endl;
+			return;
+		}
+		entry_lists[i].resize(size);
+		if(size > 0 && !input.read((char*) entry_lists[i].data(), size*sizeof(long long)))
+		{
+			std::cerr<<"Fired index "<<filename<<" is truncated at FiredIndex::FiredIndex()! Ignoring."<<std::endl;
+			return;
+		}
+	}
+
+	nentries = header.nentries;
+	valid_flag = true;
+}
+
+FiredIndex::~FiredIndex() {}
+
+//Entries must be added in increasing order
+void FiredIndex::Add(long long entry, unsigned int mask)
+{
+	for(int i=0; i<ngroups; i++)
+	{
+		if(mask & (1u<<i))
+			entry_lists[i].push_back(entry);
+	}
+	if(entry >= nentries)
+		nentries = entry + 1;
+}
+
+//Drops every entry from n on, i.e. the entries written after the checkpoint an output is resumed from
+void FiredIndex::Truncate(long long n)
+{
+	for(int i=0; i<ngroups; i++)
+		entry_lists[i].erase(std::lower_bound(entry_lists[i].begin(), entry_lists[i].end(), n), entry_lists[i].end());
+	if(nentries > n)
+		nentries = n;
+}
+
+bool FiredIndex::Write(const std::string& filename, bool verbose) const
+{
+	std::ofstream output(filename, std::ios::binary);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open "<<filename<<" at FiredIndex::Write()! Exiting."<<std::endl;
+		return false;
+	}
+
+	FiredIndexHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, index_magic, sizeof(index_magic));
+	header.version = index_version;
+	header.ngroups = ngroups;
+	header.nentries = nentries;
+	output.write((const char*) &header, sizeof(header));
+
+	int64_t size;
+	for(int i=0; i<ngroups; i++)
+	{
+		size = entry_lists[i].size();
+		output.write((const char*) &size, sizeof(size));
+		output.write((const char*) entry_lists[i].data(), size*sizeof(long long));
+	}
+	output.close();
+
+	if(!verbose)
+		return true;
+	std::cout<<"Wrote fired index "<<filename<<std::endl;
+	for(int i=0; i<ngroups; i++)
+		std::cout<<"\t"<<GetGroupName(1u<<i)<<": "<<entry_lists[i].size()<<" of "<<nentries<<" entries"<<std::endl;
+	return true;
+}
+
+const std::vector<long long>* FiredIndex::GetEntries(unsigned int group) const
+{
+	int index = GetGroupIndex(group);
+	if(index < 0)
+		return nullptr;
+	return &entry_lists[index];
+}
+
+/*
+	Called for every organized event, after the event is filled. Front and back bits of a barrel are set if any SX3 of that
+	barrel has the component; SX3UpDownBack requires all three in the same SX3.
+*/
+unsigned int FiredIndex::ComputeMask(const AnasenEvent& event)
+{
+	unsigned int mask = FiredGroup::Set;
+	for(int i=0; i<DetectorGeometry::nsx3_per_barrel; i++)
+	{
+		const SX3Data& b1 = event.barrel1[i];
+		const SX3Data& b2 = event.barrel2[i];
+		if(!b1.fronts_up.empty())
+			mask |= FiredGroup::Barrel1Up;
+		if(!b1.fronts_down.empty())
+			mask |= FiredGroup::Barrel1Down;
+		if(!b1.backs.empty())
+			mask |= FiredGroup::Barrel1Back;
+		if(!b2.fronts_up.empty())
+			mask |= FiredGroup::Barrel2Up;
+		if(!b2.fronts_down.empty())
+			mask |= FiredGroup::Barrel2Down;
+		if(!b2.backs.empty())
+			mask |= FiredGroup::Barrel2Back;
+		if((!b1.fronts_up.empty() && !b1.fronts_down.empty() && !b1.backs.empty()) ||
+		   (!b2.fronts_up.empty() && !b2.fronts_down.empty() && !b2.backs.empty()))
+			mask |= FiredGroup::SX3UpDownBack;
+	}
+	for(int i=0; i<DetectorGeometry::nqqq_per_end; i++)
+	{
+		if(!event.fqqq[i].rings.empty())
+			mask |= FiredGroup::FQQQRing;
+		if(!event.fqqq[i].wedges.empty())
+			mask |= FiredGroup::FQQQWedge;
+		if(!event.bqqq[i].rings.empty())
+			mask |= FiredGroup::BQQQRing;
+		if(!event.bqqq[i].wedges.empty())
+			mask |= FiredGroup::BQQQWedge;
+	}
+	return mask;
+}
+
+const char* FiredIndex::GetGroupName(unsigned int group)
+{
+	switch(group)
+	{
+		case FiredGroup::Barrel1Up: return "barrel1 upstream fronts";
+		case FiredGroup::Barrel1Down: return "barrel1 downstream fronts";
+		case FiredGroup::Barrel1Back: return "barrel1 backs";
+		case FiredGroup::Barrel2Up: return "barrel2 upstream fronts";
+		case FiredGroup::Barrel2Down: return "barrel2 downstream fronts";
+		case FiredGroup::Barrel2Back: return "barrel2 backs";
+		case FiredGroup::FQQQRing: return "FQQQ rings";
+		case FiredGroup::FQQQWedge: return "FQQQ wedges";
+		case FiredGroup::BQQQRing: return "BQQQ rings";
+		case FiredGroup::BQQQWedge: return "BQQQ wedges";
+		case FiredGroup::SX3UpDownBack: return "SX3 up-down-back";
+	}
+	return "unknown group";
+}
+
+int FiredIndex::GetGroupIndex(unsigned int group)
+{
+	for(int i=0; i<ngroups; i++)
+	{
+		if(group == (1u<<i))
+			return i;
+	}
+	return -1;
+}
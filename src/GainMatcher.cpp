@@ -13,7 +13,9 @@
 #include <TH2.h>
 #include <TGraph.h>
 #include <TF1.h>
-#include <TTree.h>
+#include "FileProcessor.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
 #include <fstream>
 #include <iostream>
 
@@ -24,7 +26,7 @@ bool SortGainData(const double i, const double j)
 }
 
 GainMatcher::GainMatcher(const std::string& channelfile, const std::string& zerofile) :
-	cmap(channelfile), zmap(zerofile)
+	cmap(channelfile), zmap(zerofile), nthreads(1)
 {
 }
 
@@ -33,6 +35,8 @@ GainMatcher::~GainMatcher() {}
 //Wrappers around histogram creation, storage, and filling
 void GainMatcher::MyFill(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value)
 {
+	ANASEN_TRACE_ACCUMULATE("GainMatcher/fill histogram");
+	ANASEN_PERF_HIT();
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
 	if(histo == nullptr)
 	{
@@ -49,6 +53,8 @@ void GainMatcher::MyFill(THashTable* table, const std::string& name, const std::
 void GainMatcher::MyFill(THashTable* table, const std::string& name, const std::string& title, int binsx, double minx, double maxx, double valuex,
 																								int binsy, double miny, double maxy, double valuey)
 {
+	ANASEN_TRACE_ACCUMULATE("GainMatcher/fill histogram");
+	ANASEN_PERF_HIT();
 	TH2* histo = (TH2*) table->FindObject(name.c_str());
 	if(histo == nullptr)
 	{
@@ -68,6 +74,7 @@ void GainMatcher::MyFill(THashTable* table, const std::string& name, const std::
 */
 GraphData GainMatcher::GetPoints(THashTable* table, const std::string& name)
 {
+	ANASEN_TRACE_SCOPE("GainMatcher/find peaks");
 	GraphData data;
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
 	if(histo == nullptr)
@@ -108,6 +115,7 @@ GraphData GainMatcher::GetPoints(THashTable* table, const std::string& name)
 //Wrapper around graph creation from std::vector data and fitting. Returns fit parameters.
 CalParams GainMatcher::MakeGraph(THashTable* table, int gchan, const GraphData& data)
 {
+	ANASEN_TRACE_SCOPE("GainMatcher/fit");
 	std::string name = "channel_"+std::to_string(gchan)+"_graph";
 	TGraph* graph = new TGraph(data.xvals.size(), &(data.xvals[0]), &(data.yvals[0]));
 	TF1* func = new TF1("linear","pol1",0,16384);
@@ -122,124 +130,672 @@ CalParams GainMatcher::MakeGraph(THashTable* table, int gchan, const GraphData&
 	return params;
 }
 
+//Energy spectrum of each back (SX3 back, QQQ wedge) for MatchBacks
+void GainMatcher::FillBackSpectra(AnasenEvent* event, THashTable* histo_table)
+{
+	ANASEN_PERF_REGION("GainMatcher/fill spectra");
+	std::string name;
+	/*
+		For each back (SX3 back, QQQ wedge), generate the energy spectrum from which
+		peaks will be extracted
+	*/
+	for(int j=0; j<12; j++)
+	{
+		for(auto& hit : event->barrel1[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+		}
+		for(auto& hit : event->barrel2[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+		}
+	}
+
+	for(int j=0; j<4; j++)
+	{
+		for(auto& hit : event->fqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+		}
+		for(auto& hit : event->bqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+		}
+	}
+}
+
+//Before and after plots of each detector for MatchBacks
+void GainMatcher::FillBackTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap)
+{
+	std::string before_name, after_name;
+	for(int j=0; j<12; j++)
+	{
+		before_name = "detector_barrel1_"+std::to_string(j)+"_before";
+		after_name = "detector_barrel1_"+std::to_string(j)+"_after";
+		for(auto& hit : event->barrel1[j].backs)
+		{
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto backgains = backmap.FindParameters(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+			if(backgains == backmap.End())
+				continue;
+			MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
+		}
+		before_name = "detector_barrel2_"+std::to_string(j)+"_before";
+		after_name = "detector_barrel2_"+std::to_string(j)+"_after";
+		for(auto& hit : event->barrel2[j].backs)
+		{
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto backgains = backmap.FindParameters(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+			if(backgains == backmap.End())
+				continue;
+			MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
+		}
+	}
+
+	for(int j=0; j<4; j++)
+	{
+		before_name = "detector_fqqq_"+std::to_string(j)+"_before";
+		after_name = "detector_fqqq_"+std::to_string(j)+"_after";
+		for(auto& hit : event->fqqq[j].wedges)
+		{
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto backgains = backmap.FindParameters(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+			if(backgains == backmap.End())
+				continue;
+			MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
+		}
+		before_name = "detector_bqqq_"+std::to_string(j)+"_before";
+		after_name = "detector_bqqq_"+std::to_string(j)+"_after";
+		for(auto& hit : event->bqqq[j].wedges)
+		{
+			auto zero_offset = zmap.FindOffset(hit.global_chan);
+			auto backgains = backmap.FindParameters(hit.global_chan);
+			if(zero_offset == zmap.End())
+				continue;
+			MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
+			if(backgains == backmap.End())
+				continue;
+			MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
+		}
+	}
+}
+
+//Up-down correlation points of each SX3 front for MatchSX3UpDown
+void GainMatcher::FillUpDownData(AnasenEvent* event, std::vector<GraphData>& gain_data, ParameterMap& backmap)
+{
+	double cal_back, up_rel_energy, down_rel_energy;
+	/*
+		Need to associate several chunks of data. A back and an upstream and downstream hit must all be gathered
+		together. Iterating over the arrays, toss away combinations that do not meet anti-noise conditions.
+		Note that there is no front-back hit assignment; rely on robust fitting to eliminate choices of back-fronts
+		that don't actually come from the same hit.
+	*/
+	for(int j=0; j<12; j++)
+	{
+		if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel1[j].backs)
+			{
+				if(backhit.energy < 1000.0)
+					continue;
+				for(auto& fuphit : event->barrel1[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel1[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+						{
+							continue;
+						}
+
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
+						down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
+						if(up_rel_energy > 1.3 || down_rel_energy > 1.3 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0
+							|| (up_rel_energy+down_rel_energy) < 0.5 || (up_rel_energy + down_rel_energy)>1.5)
+							continue;
+						gain_data[fuphit.global_chan].xvals.push_back(up_rel_energy);
+						gain_data[fuphit.global_chan].yvals.push_back(down_rel_energy);
+					}
+				}
+			}
+		}
+
+		if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel2[j].backs)
+			{
+				if(backhit.energy < 1000.0)
+					continue;
+				for(auto& fuphit : event->barrel2[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel2[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+						{
+							continue;
+						}
+
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
+						down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
+						if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0
+							|| (up_rel_energy+down_rel_energy) < 0.5 || (up_rel_energy + down_rel_energy)>1.5)
+							continue;
+						gain_data[fuphit.global_chan].xvals.push_back(up_rel_energy);
+						gain_data[fuphit.global_chan].yvals.push_back(down_rel_energy);
+					}
+				}
+			}
+		}
+	}
+}
+
+//Before and after plots of each SX3 front pair for MatchSX3UpDown
+void GainMatcher::FillUpDownTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap, ParameterMap& updownmap)
+{
+	double cal_back, up_rel_energy, down_rel_energy;
+	std::string before_name, after_name;
+	for(int j=0; j<12; j++)
+	{
+		if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel1[j].backs)
+			{
+				if(backhit.energy < 1000.0)
+					continue;
+				for(auto& fuphit : event->barrel1[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel1[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+						{
+							continue;
+						}
+
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
+						down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
+						if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0)
+							continue;
+						before_name = "detector_barrel1_"+std::to_string(j)+"_before_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
+						MyFill(histo_table, before_name, ";Up;Down", 1000.0, 0.0, 1.0, up_rel_energy, 1000.0, 0.0, 1.0, down_rel_energy);
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						after_name = "detector_barrel1_"+std::to_string(j)+"_after_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
+						MyFill(histo_table, after_name, ";Up;Down", 1000.0, 0.0, 1.0, 1.0 - upgains->second.slope*up_rel_energy-upgains->second.intercept, 1000.0, 0.0, 1.0, down_rel_energy);
+					}
+				}
+			}
+		}
+
+		if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel2[j].backs)
+			{
+				if(backhit.energy < 1000.0)
+					continue;
+				for(auto& fuphit : event->barrel2[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel2[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+						{
+							continue;
+						}
+
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
+						down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
+						if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0)
+							continue;
+						before_name = "detector_barrel2_"+std::to_string(j)+"_before_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
+						MyFill(histo_table, before_name, ";Up;Down", 1000.0, 0.0, 1.0, up_rel_energy, 1000.0, 0.0, 1.0, down_rel_energy);
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						after_name = "detector_barrel2_"+std::to_string(j)+"_after_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
+						MyFill(histo_table, after_name, ";Up;Down", 1000.0, 0.0, 1.0, upgains->second.slope*up_rel_energy+upgains->second.intercept, 1000.0, 0.0, 1.0, down_rel_energy);
+					}
+				}
+			}
+		}
+	}
+}
+
+//Front-back correlation points of each SX3 front and QQQ ring for MatchFrontBack
+void GainMatcher::FillFrontBackData(AnasenEvent* event, std::vector<GraphData>& gain_data, ParameterMap& backmap, ParameterMap& updownmap)
+{
+	double cal_back, cal_up_energy, cal_down_energy;
+	/*
+		Loop over all front-back combinations, using anti-noise conditions to reject. Note that again we do not
+		make a front-back hit assignment. All valid (non-noise) combinations are made and robust fitting is used
+		to reject any mismatched data.
+	*/
+	for(int j=0; j<12; j++)
+	{
+		if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel1[j].backs)
+			{
+				for(auto& fuphit : event->barrel1[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel1[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+							continue;
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
+						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
+						if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
+							continue;
+						gain_data[fuphit.global_chan].xvals.push_back(cal_up_energy+cal_down_energy);
+						gain_data[fuphit.global_chan].yvals.push_back(cal_back);
+					}
+				}
+			}
+		}
+
+		if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel2[j].backs)
+			{
+				for(auto& fuphit : event->barrel2[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel2[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+							continue;
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
+						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
+						if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
+							continue;
+						gain_data[fuphit.global_chan].xvals.push_back(cal_up_energy+cal_down_energy);
+						gain_data[fuphit.global_chan].yvals.push_back(cal_back);
+					}
+				}
+			}
+		}
+	}
+
+	for(int j=0; j<4; j++)
+	{
+		if(event->fqqq[j].rings.size() > 0 && event->fqqq[j].wedges.size() > 0)
+		{
+			for(auto& wedgehit : event->fqqq[j].wedges)
+			{
+				for(auto& ringhit : event->fqqq[j].rings)
+				{
+					auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
+					if(wedgegains == backmap.End())
+						continue;
+					auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
+					auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
+					if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
+						continue;
+
+					cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
+					cal_up_energy = ringhit.energy - ringzero_offset->second;
+					if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
+						continue;
+					gain_data[ringhit.global_chan].xvals.push_back(cal_up_energy);
+					gain_data[ringhit.global_chan].yvals.push_back(cal_back);
+				}
+			}
+		}
+		if(event->bqqq[j].rings.size() > 0 && event->bqqq[j].wedges.size() > 0)
+		{
+			for(auto& wedgehit : event->bqqq[j].wedges)
+			{
+				for(auto& ringhit : event->bqqq[j].rings)
+				{
+					auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
+					if(wedgegains == backmap.End())
+						continue;
+					auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
+					auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
+					if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
+						continue;
+
+					cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
+					cal_up_energy = ringhit.energy - ringzero_offset->second;
+					if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
+						continue;
+					gain_data[ringhit.global_chan].xvals.push_back(cal_up_energy);
+					gain_data[ringhit.global_chan].yvals.push_back(cal_back);
+				}
+			}
+		}
+	}
+}
+
+//Before and after plots of each front for MatchFrontBack
+void GainMatcher::FillFrontBackTestPlots(AnasenEvent* event, THashTable* histo_table, ParameterMap& backmap, ParameterMap& updownmap, ParameterMap& frontbackmap)
+{
+	double cal_back, cal_up_energy, cal_down_energy;
+	std::string before_name, after_name;
+	for(int j=0; j<12; j++)
+	{
+		if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel1[j].backs)
+			{
+				for(auto& fuphit : event->barrel1[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel1[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+							continue;
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
+						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
+						if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
+							continue;
+						before_name = "channel_"+std::to_string(fuphit.global_chan)+"_before";
+						MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy+cal_down_energy,1024,0,16384,cal_back);
+						auto frontbackgains = frontbackmap.FindParameters(fuphit.global_chan);
+						if(frontbackgains == frontbackmap.End())
+							continue;
+						after_name = "channel_"+std::to_string(fuphit.global_chan)+"_after";
+						MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*(cal_up_energy+cal_down_energy)+frontbackgains->second.intercept,1024,0,16384,cal_back);
+					}
+				}
+			}
+		}
+
+		if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
+		{
+			for(auto& backhit : event->barrel2[j].backs)
+			{
+				for(auto& fuphit : event->barrel2[j].fronts_up)
+				{
+					for(auto& fdownhit : event->barrel2[j].fronts_down)
+					{
+						if(fuphit.local_chan != DetectorGeometry::updown_list[fdownhit.local_chan])
+							continue;
+						auto backgains = backmap.FindParameters(backhit.global_chan);
+						if(backgains == backmap.End())
+							continue;
+						auto upgains = updownmap.FindParameters(fuphit.global_chan);
+						if(upgains == updownmap.End())
+							continue;
+						auto backzero_offset = zmap.FindOffset(backhit.global_chan);
+						auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
+						auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
+						if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
+							continue;
+	
+						cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
+						cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
+						cal_down_energy = fdownhit.energy - fdownzero_offset->second;
+						if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
+							continue;
+						before_name = "channel_"+std::to_string(fuphit.global_chan)+"_before";
+						MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy+cal_down_energy,1024,0,16384,cal_back);
+						auto frontbackgains = frontbackmap.FindParameters(fuphit.global_chan);
+						if(frontbackgains == frontbackmap.End())
+							continue;
+						after_name = "channel_"+std::to_string(fuphit.global_chan)+"_after";
+						MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*(cal_up_energy+cal_down_energy)+frontbackgains->second.intercept,1024,0,16384,cal_back);
+					}
+				}
+			}
+		}
+	}
+
+	for(int j=0; j<4; j++)
+	{
+		if(event->fqqq[j].rings.size() > 0 && event->fqqq[j].wedges.size() > 0)
+		{
+			for(auto& wedgehit : event->fqqq[j].wedges)
+			{
+				for(auto& ringhit : event->fqqq[j].rings)
+				{
+					auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
+					if(wedgegains == backmap.End())
+						continue;
+					auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
+					auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
+					if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
+						continue;
+
+					cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
+					cal_up_energy = ringhit.energy - ringzero_offset->second;
+					if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
+						continue;
+					before_name = "channel_"+std::to_string(ringhit.global_chan)+"_before";
+					MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy,1024,0,16384,cal_back);
+					auto frontbackgains = frontbackmap.FindParameters(ringhit.global_chan);
+					if(frontbackgains == frontbackmap.End())
+						continue;
+					after_name = "channel_"+std::to_string(ringhit.global_chan)+"_after";
+					MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*cal_up_energy+frontbackgains->second.intercept,1024,0,16384,cal_back);
+				}
+			}
+		}
+		if(event->bqqq[j].rings.size() > 0 && event->bqqq[j].wedges.size() > 0)
+		{
+			for(auto& wedgehit : event->bqqq[j].wedges)
+			{
+				for(auto& ringhit : event->bqqq[j].rings)
+				{
+					auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
+					if(wedgegains == backmap.End())
+						continue;
+					auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
+					auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
+					if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
+						continue;
+
+					cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
+					cal_up_energy = ringhit.energy - ringzero_offset->second;
+					if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
+						continue;
+					before_name = "channel_"+std::to_string(ringhit.global_chan)+"_before";
+					MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy,1024,0,16384,cal_back);
+					auto frontbackgains = frontbackmap.FindParameters(ringhit.global_chan);
+					if(frontbackgains == frontbackmap.End())
+						continue;
+					after_name = "channel_"+std::to_string(ringhit.global_chan)+"_after";
+					MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*cal_up_energy+frontbackgains->second.intercept,1024,0,16384,cal_back);
+				}
+			}
+		}
+	}
+}
+
+//Appends the per-slot point lists of each channel together
+void GainMatcher::MergeGainData(std::vector<GraphData>& gain_data, std::vector<std::vector<GraphData>>& slot_data)
+{
+	for(auto& data : slot_data)
+	{
+		for(int i=0; i<max_chan; i++)
+		{
+			gain_data[i].xvals.insert(gain_data[i].xvals.end(), data[i].xvals.begin(), data[i].xvals.end());
+			gain_data[i].yvals.insert(gain_data[i].yvals.end(), data[i].yvals.begin(), data[i].yvals.end());
+		}
+	}
+	slot_data.clear();
+}
+
 /*
-	Main loop for gain-matching all of the backs within each detector. Takes in an input data file, which should contain source calibration
+	Main loop for gain-matching all of the backs within each detector. Takes in a list of input data files, which should contain source calibration
 	data, and two output files: a ROOT file which will contain all of the graphs and histograms, and a text file which will contain all of the
 	calibration parameters. Additionally, takes in a detector channel number for both SX3s and QQQs; this channel number indicates which back channel
 	will be the "fixed" channel to which all other backs are matched. Trial and error is best for chosing this.
 */
-void GainMatcher::MatchBacks(const std::string& inputname, const std::string& graphname, const std::string& outputname, int sx3match, int qqqmatch)
+bool GainMatcher::MatchBacks(const std::vector<std::string>& inputnames, const std::string& graphname, const std::string& outputname, int sx3match, int qqqmatch)
 {
+	ANASEN_TRACE_SCOPE("GainMatcher/MatchBacks");
 	if(!cmap.IsValid() || !zmap.IsValid())
 	{
 		std::cerr<<"Bad map files at GainMatcher::Run! Exiting."<<std::endl;
-		return;
+		return false;
 	}
 
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	TTree* intree = (TTree*) input->Get("EventTree");
-
-	AnasenEvent* event = new AnasenEvent();
-
-	intree->SetBranchAddress("event", &event);
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
 
 	TFile* graphoutput = TFile::Open(graphname.c_str(), "RECREATE");
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
+	{
+		std::cerr<<"Unable to create output graph file "<<graphname<<" at GainMatcher::MatchBacks()! Exiting."<<std::endl;
+		return false;
+	}
 
 	THashTable* graph_table = new THashTable();
 	THashTable* histo_table = new THashTable();
 
 	std::ofstream output(outputname);
+	if(!output.is_open())
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to open output file "<<outputname<<" at GainMatcher::MatchBacks()! Exiting."<<std::endl;
+		return false;
+	}
+	io_policy.WriteQuickLookNote(output);
 
 	std::vector<GraphData> gain_data;
 	std::vector<int> match_channel; //List of channels which are to be matched against
 	gain_data.resize(max_chan);
 	match_channel.resize(max_chan);
 
-	ChannelData match;
+	int reference;
 	//Create a quick lookup of global channel to match against
 	for(int i=0; i<max_chan; i++)
 	{
 		auto channel = cmap.FindChannel(i);
-		if(channel->second.detectorComponent == "FRONT" || channel->second.detectorComponent == "RING")
+		if(channel->second.detectorComponent == DetectorComponent::Front || channel->second.detectorComponent == DetectorComponent::Ring)
 			continue;
 
-		match = channel->second;
-		if(match.detectorComponent == "BACK")
-			match.channel = sx3match;
-		else if (match.detectorComponent == "WEDGE")
-			match.channel = qqqmatch;
+		reference = -1;
+		if(channel->second.detectorComponent == DetectorComponent::Back)
+			reference = sx3match;
+		else if (channel->second.detectorComponent == DetectorComponent::Wedge)
+			reference = qqqmatch;
 		else
 			std::cerr<<"weird channel at GainMatcher::MatchBacks()"<<std::endl;
 
-		match_channel[i] = cmap.InverseFindChannel(match);
+		match_channel[i] = cmap.FindReferenceChannel(i, reference);
 		if(match_channel[i] == -1)
-			std::cerr<<"Found a zero to match against for GainMatcher::MatchBacks() gchan: "<<i<<" trying to match to detector channel: "<<match.channel<<std::endl;
+			std::cerr<<"Found a zero to match against for GainMatcher::MatchBacks() gchan: "<<i<<" trying to match to detector channel: "<<reference<<std::endl;
 	}
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val=nentries*0.01;
-
-	std::string name;
-	for(int i=0; i<nentries; i++)
+	std::vector<THashTable*> slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	bool success = processor.Process([this, &slot_tables](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
-
-		/*
-			For each back (SX3 back, QQQ wedge), generate the energy spectrum from which
-			peaks will be extracted
-		*/
-		for(int j=0; j<12; j++)
-		{
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-			}
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, name.c_str(), name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-			}
-		}
+		FillBackSpectra(event, slot_tables[slot]);
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at GainMatcher::MatchBacks()! Exiting."<<std::endl;
+		return false;
 	}
 
+	std::string name;
 	//Find the peaks from the energy spectra and store in an array.
 	for(int i=0; i<max_chan; i++)
 	{
-		if(cmap.FindChannel(i)->second.detectorComponent == "FRONT" || cmap.FindChannel(i)->second.detectorComponent == "RING")
+		if(cmap.FindChannel(i)->second.detectorComponent == DetectorComponent::Front || cmap.FindChannel(i)->second.detectorComponent == DetectorComponent::Ring)
 			continue;
 		name = "channel_"+std::to_string(i);
 		gain_data[i] = GetPoints(histo_table, name);
@@ -266,6 +822,7 @@ void GainMatcher::MatchBacks(const std::string& inputname, const std::string& gr
 		}
 		output<<i<<"\t"<<params.intercept<<"\t"<<params.slope<<std::endl;
 	}
+	output.close();
 
 	/*
 		Test the results
@@ -273,95 +830,28 @@ void GainMatcher::MatchBacks(const std::string& inputname, const std::string& gr
 	ParameterMap backmap(outputname);
 	if(!backmap.IsValid())
 	{
+		graphoutput->Close();
 		std::cerr<<"Unable to load back-gain-matching data in GainMatcher::MatchBacks()!"<<std::endl;
+		return false;
 	}
 
-	count=0;
-	flush_count=0;
 	std::cout<<"Generating test plots for back channel gain-matching..."<<std::endl;
-
-	std::string before_name, after_name;
-	for(int i=0; i<nentries; i++)
+	slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	success = processor.Process([this, &slot_tables, &backmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
+		FillBackTestPlots(event, slot_tables[slot], backmap);
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
 
-		for(int j=0; j<12; j++)
-		{
-			before_name = "detector_barrel1_"+std::to_string(j)+"_before";
-			after_name = "detector_barrel1_"+std::to_string(j)+"_after";
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto backgains = backmap.FindParameters(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-				if(backgains == backmap.End())
-					continue;
-				MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
-			}
-			before_name = "detector_barrel2_"+std::to_string(j)+"_before";
-			after_name = "detector_barrel2_"+std::to_string(j)+"_after";
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto backgains = backmap.FindParameters(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-				if(backgains == backmap.End())
-					continue;
-				MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			before_name = "detector_fqqq_"+std::to_string(j)+"_before";
-			after_name = "detector_fqqq_"+std::to_string(j)+"_after";
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto backgains = backmap.FindParameters(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-				if(backgains == backmap.End())
-					continue;
-				MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
-			}
-			before_name = "detector_bqqq_"+std::to_string(j)+"_before";
-			after_name = "detector_bqqq_"+std::to_string(j)+"_after";
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				auto zero_offset = zmap.FindOffset(hit.global_chan);
-				auto backgains = backmap.FindParameters(hit.global_chan);
-				if(zero_offset == zmap.End())
-					continue;
-				MyFill(histo_table, before_name.c_str(), before_name.c_str(), 875, 1000.0, 8000.0, hit.energy - zero_offset->second);
-				if(backgains == backmap.End())
-					continue;
-				MyFill(histo_table, after_name.c_str(), after_name.c_str(), 875, 1000.0, 8000.0, backgains->second.slope*(hit.energy - zero_offset->second)+backgains->second.intercept);
-			}
-		}
-	}
-	std::cout<<std::endl;
-
-
-	input->Close();
+	ANASEN_TRACE_SCOPE("GainMatcher/write");
 	graphoutput->cd();
 	histo_table->Write();
 	graph_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	output.close();
-	delete event;
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at GainMatcher::MatchBacks()!"<<std::endl;
+	return success;
 }
 
 /*
@@ -374,139 +864,60 @@ void GainMatcher::MatchBacks(const std::string& inputname, const std::string& gr
 	and the other is a text file for storing calibration parameters. It also takes in the name of a file containg results from MatchBack, as all
 	back channels need to be gain-matched prior to this analysis.
 */
-void GainMatcher::MatchSX3UpDown(const std::string& inputname, const std::string& graphname, const std::string& outputname, const std::string& backmatchname)
+bool GainMatcher::MatchSX3UpDown(const std::vector<std::string>& inputnames, const std::string& graphname, const std::string& outputname, const std::string& backmatchname)
 {
+	ANASEN_TRACE_SCOPE("GainMatcher/MatchSX3UpDown");
 	if(!cmap.IsValid() || !zmap.IsValid())
 	{
 		std::cerr<<"Bad map files at GainMatcher::Run! Exiting."<<std::endl;
-		return;
+		return false;
 	}
 
 	ParameterMap backmap(backmatchname);
 	if(!backmap.IsValid())
 	{
 		std::cerr<<"Back back-only gain-matching map at GainMatcher::MatchSX3UpDown(). Exiting."<<std::endl;
-		return;
+		return false;
 	}
 
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	TTree* intree = (TTree*) input->Get("EventTree");
-
-	AnasenEvent* event = new AnasenEvent();
-
-	intree->SetBranchAddress("event", &event);
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
+	//Both passes only use SX3s with an upstream front, a downstream front, and a back
+	processor.SetSelection(FiredGroup::SX3UpDownBack);
 
 	TFile* graphoutput = TFile::Open(graphname.c_str(), "RECREATE");
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
+	{
+		std::cerr<<"Unable to create output graph file "<<graphname<<" at GainMatcher::MatchSX3UpDown()! Exiting."<<std::endl;
+		return false;
+	}
 
 	THashTable* graph_table = new THashTable();
 	THashTable* histo_table = new THashTable();
 
 	std::ofstream output(outputname);
+	if(!output.is_open())
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to open output file "<<outputname<<" at GainMatcher::MatchSX3UpDown()! Exiting."<<std::endl;
+		return false;
+	}
+	io_policy.WriteQuickLookNote(output);
 
 	std::vector<GraphData> gain_data;
 	gain_data.resize(max_chan);
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val=nentries*0.01;
-
-
-	std::string name;
-	double cal_back, up_rel_energy, down_rel_energy;
-	for(int i=0; i<nentries; i++)
+	std::vector<std::vector<GraphData>> slot_data(processor.GetNSlots(), std::vector<GraphData>(max_chan));
+	bool success = processor.Process([this, &slot_data, &backmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
-
-		/*
-			Need to associate several chunks of data. A back and an upstream and downstream hit must all be gathered
-			together. Iterating over the arrays, toss away combinations that do not meet anti-noise conditions.
-			Note that there is no front-back hit assignment; rely on robust fitting to eliminate choices of back-fronts
-			that don't actually come from the same hit.
-		*/
-		for(int j=0; j<12; j++)
-		{
-			if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel1[j].backs)
-				{
-					if(backhit.energy < 1000.0)
-						continue;
-					for(auto& fuphit : event->barrel1[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel1[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							{
-								continue;
-							}
-
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
-							down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
-							if(up_rel_energy > 1.3 || down_rel_energy > 1.3 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0
-								|| (up_rel_energy+down_rel_energy) < 0.5 || (up_rel_energy + down_rel_energy)>1.5)
-								continue;
-							gain_data[fuphit.global_chan].xvals.push_back(up_rel_energy);
-							gain_data[fuphit.global_chan].yvals.push_back(down_rel_energy);
-						}
-					}
-				}
-			}
-
-			if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel2[j].backs)
-				{
-					if(backhit.energy < 1000.0)
-						continue;
-					for(auto& fuphit : event->barrel2[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel2[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							{
-								continue;
-							}
-
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
-							down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
-							if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0
-								|| (up_rel_energy+down_rel_energy) < 0.5 || (up_rel_energy + down_rel_energy)>1.5)
-								continue;
-							gain_data[fuphit.global_chan].xvals.push_back(up_rel_energy);
-							gain_data[fuphit.global_chan].yvals.push_back(down_rel_energy);
-						}
-					}
-				}
-			}
-		}
+		FillUpDownData(event, slot_data[slot], backmap);
+	});
+	MergeGainData(gain_data, slot_data);
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at GainMatcher::MatchSX3UpDown()! Exiting."<<std::endl;
+		return false;
 	}
-	std::cout<<std::endl;
 
 	CalParams params;
 	//Fit the data and write the parameters
@@ -526,132 +937,43 @@ void GainMatcher::MatchSX3UpDown(const std::string& inputname, const std::string
 	ParameterMap updownmap(outputname);
 	if(!updownmap.IsValid())
 	{
+		graphoutput->Close();
 		std::cerr<<"Unable to open up-down gain-matching map at GainMatcher::MatchSX3UpDown()!"<<std::endl;
+		return false;
 	}
 
 	std::cout<<"Generating test plots for up-down gain-matching..."<<std::endl;
-	count=0;
-	flush_count=0;
-	std::string before_name, after_name;
-	for(int i=0; i<nentries; i++)
+	std::vector<THashTable*> slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	success = processor.Process([this, &slot_tables, &backmap, &updownmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
+		FillUpDownTestPlots(event, slot_tables[slot], backmap, updownmap);
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
 
-		for(int j=0; j<12; j++)
-		{
-			if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel1[j].backs)
-				{
-					if(backhit.energy < 1000.0)
-						continue;
-					for(auto& fuphit : event->barrel1[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel1[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							{
-								continue;
-							}
-
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
-							down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
-							if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0)
-								continue;
-							before_name = "detector_barrel1_"+std::to_string(j)+"_before_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
-							MyFill(histo_table, before_name, ";Up;Down", 1000.0, 0.0, 1.0, up_rel_energy, 1000.0, 0.0, 1.0, down_rel_energy);
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							after_name = "detector_barrel1_"+std::to_string(j)+"_after_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
-							MyFill(histo_table, after_name, ";Up;Down", 1000.0, 0.0, 1.0, 1.0 - upgains->second.slope*up_rel_energy-upgains->second.intercept, 1000.0, 0.0, 1.0, down_rel_energy);
-						}
-					}
-				}
-			}
-
-			if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel2[j].backs)
-				{
-					if(backhit.energy < 1000.0)
-						continue;
-					for(auto& fuphit : event->barrel2[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel2[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-							{
-								continue;
-							}
-
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							up_rel_energy = (fuphit.energy - fupzero_offset->second)/(cal_back);
-							down_rel_energy = (fdownhit.energy - fdownzero_offset->second)/cal_back;
-							if(up_rel_energy > 1.5 || down_rel_energy > 1.5 || cal_back < 0 || up_rel_energy < 0 || down_rel_energy < 0)
-								continue;
-							before_name = "detector_barrel2_"+std::to_string(j)+"_before_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
-							MyFill(histo_table, before_name, ";Up;Down", 1000.0, 0.0, 1.0, up_rel_energy, 1000.0, 0.0, 1.0, down_rel_energy);
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							after_name = "detector_barrel2_"+std::to_string(j)+"_after_channels_"+std::to_string(fuphit.local_chan)+"_"+std::to_string(fdownhit.local_chan);
-							MyFill(histo_table, after_name, ";Up;Down", 1000.0, 0.0, 1.0, upgains->second.slope*up_rel_energy+upgains->second.intercept, 1000.0, 0.0, 1.0, down_rel_energy);
-						}
-					}
-				}
-			}
-		}
-	}
-	std::cout<<std::endl;
-
-
-	input->Close();
+	ANASEN_TRACE_SCOPE("GainMatcher/write");
 	graphoutput->cd();
 	graph_table->Write();
 	histo_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	delete event;
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at GainMatcher::MatchSX3UpDown()!"<<std::endl;
+	return success;
 }
 
 /*
 	Method which gain-matches front channels to back channels. After matching backs to each other, and then correcting for SX3 up-down effects, can
-	now gain-match all front signals to all back signals (front: SX3 sum of up-down, QQQ ring). Takes an input data file, which should be a decently
+	now gain-match all front signals to all back signals (front: SX3 sum of up-down, QQQ ring). Takes a list of input data files, which should be a decently
 	large run to cover as much of the dynamic range as possible and two outputs: a ROOT file for graph storage and a text file for calibration
 	results. Also requires a file contaning the results of MatchBack and MatchSX3UpDown as they are necessary to perform this step.
 */
-void GainMatcher::MatchFrontBack(const std::string& inputname, const std::string& graphname, const std::string& outputname, const std::string& backmatchname, const std::string& updownmatchname)
+bool GainMatcher::MatchFrontBack(const std::vector<std::string>& inputnames, const std::string& graphname, const std::string& outputname, const std::string& backmatchname, const std::string& updownmatchname)
 {
+	ANASEN_TRACE_SCOPE("GainMatcher/MatchFrontBack");
 	if(!cmap.IsValid() || !zmap.IsValid())
 	{
 		std::cerr<<"Bad map files at GainMatcher::Run! Exiting."<<std::endl;
-		return;
+		return false;
 	}
 
 	ParameterMap backmap(backmatchname);
@@ -659,168 +981,45 @@ void GainMatcher::MatchFrontBack(const std::string& inputname, const std::string
 	if(!backmap.IsValid() || !updownmap.IsValid())
 	{
 		std::cerr<<"Bad back and up-down gain-matching files at GainMatcher::MatchFrontBack(). Exiting."<<std::endl;
-		return;
+		return false;
 	}
 
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	TTree* intree = (TTree*) input->Get("EventTree");
-
-	AnasenEvent* event = new AnasenEvent();
-
-	intree->SetBranchAddress("event", &event);
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
 
 	TFile* graphoutput = TFile::Open(graphname.c_str(), "RECREATE");
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
+	{
+		std::cerr<<"Unable to create output graph file "<<graphname<<" at GainMatcher::MatchFrontBack()! Exiting."<<std::endl;
+		return false;
+	}
 
 	THashTable* graph_table = new THashTable();
 	THashTable* histo_table = new THashTable();
 
 	std::ofstream output(outputname);
+	if(!output.is_open())
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to open output file "<<outputname<<" at GainMatcher::MatchFrontBack()! Exiting."<<std::endl;
+		return false;
+	}
+	io_policy.WriteQuickLookNote(output);
 
 	std::vector<GraphData> gain_data;
 	gain_data.resize(max_chan);
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val=nentries*0.01;
-
-	double cal_back, cal_up_energy, cal_down_energy;
-	for(int i=0; i<nentries; i++)
+	std::vector<std::vector<GraphData>> slot_data(processor.GetNSlots(), std::vector<GraphData>(max_chan));
+	bool success = processor.Process([this, &slot_data, &backmap, &updownmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
-
-		/*
-			Loop over all front-back combinations, using anti-noise conditions to reject. Note that again we do not
-			make a front-back hit assignment. All valid (non-noise) combinations are made and robust fitting is used
-			to reject any mismatched data.
-		*/
-		for(int j=0; j<12; j++)
-		{
-			if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel1[j].backs)
-				{
-					for(auto& fuphit : event->barrel1[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel1[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-								continue;
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-							cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-							if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
-								continue;
-							gain_data[fuphit.global_chan].xvals.push_back(cal_up_energy+cal_down_energy);
-							gain_data[fuphit.global_chan].yvals.push_back(cal_back);
-						}
-					}
-				}
-			}
-
-			if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel2[j].backs)
-				{
-					for(auto& fuphit : event->barrel2[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel2[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-								continue;
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-							cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-							if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
-								continue;
-							gain_data[fuphit.global_chan].xvals.push_back(cal_up_energy+cal_down_energy);
-							gain_data[fuphit.global_chan].yvals.push_back(cal_back);
-						}
-					}
-				}
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			if(event->fqqq[j].rings.size() > 0 && event->fqqq[j].wedges.size() > 0)
-			{
-				for(auto& wedgehit : event->fqqq[j].wedges)
-				{
-					for(auto& ringhit : event->fqqq[j].rings)
-					{
-						auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
-						if(wedgegains == backmap.End())
-							continue;
-						auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
-						auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
-						if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
-							continue;
-	
-						cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
-						cal_up_energy = ringhit.energy - ringzero_offset->second;
-						if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
-							continue;
-						gain_data[ringhit.global_chan].xvals.push_back(cal_up_energy);
-						gain_data[ringhit.global_chan].yvals.push_back(cal_back);
-					}
-				}
-			}
-			if(event->bqqq[j].rings.size() > 0 && event->bqqq[j].wedges.size() > 0)
-			{
-				for(auto& wedgehit : event->bqqq[j].wedges)
-				{
-					for(auto& ringhit : event->bqqq[j].rings)
-					{
-						auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
-						if(wedgegains == backmap.End())
-							continue;
-						auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
-						auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
-						if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
-							continue;
-	
-						cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
-						cal_up_energy = ringhit.energy - ringzero_offset->second;
-						if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
-							continue;
-						gain_data[ringhit.global_chan].xvals.push_back(cal_up_energy);
-						gain_data[ringhit.global_chan].yvals.push_back(cal_back);
-					}
-				}
-			}
-		}
+		FillFrontBackData(event, slot_data[slot], backmap, updownmap);
+	});
+	MergeGainData(gain_data, slot_data);
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at GainMatcher::MatchFrontBack()! Exiting."<<std::endl;
+		return false;
 	}
-	std::cout<<std::endl;
 
 	//Generate graphs, obtain and write fit data
 	CalParams params;
@@ -839,171 +1038,26 @@ void GainMatcher::MatchFrontBack(const std::string& inputname, const std::string
 	ParameterMap frontbackmap(outputname);
 	if(!frontbackmap.IsValid())
 	{
+		graphoutput->Close();
 		std::cerr<<"Unable to open front-back gain-matching map at GainMatcher::MatchFrontBack()!"<<std::endl;
+		return false;
 	}
 
-	count=0;
-	flush_count=0;
-	std::string before_name, after_name;
 	std::cout<<"Generating front-back gain-matching test plots..."<<std::endl;
-	for(int i=0; i<nentries; i++)
+	std::vector<THashTable*> slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	success = processor.Process([this, &slot_tables, &backmap, &updownmap, &frontbackmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			count=0;
-			flush_count++;
-			std::cout<<"\rPercent of data processed: "<<flush_count*0.01*100.0<<"%"<<std::flush;
-		}
-
-		for(int j=0; j<12; j++)
-		{
-			if(event->barrel1[j].fronts_up.size() > 0 && event->barrel1[j].fronts_down.size() > 0 && event->barrel1[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel1[j].backs)
-				{
-					for(auto& fuphit : event->barrel1[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel1[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-								continue;
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-							cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-							if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
-								continue;
-							before_name = "channel_"+std::to_string(fuphit.global_chan)+"_before";
-							MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy+cal_down_energy,1024,0,16384,cal_back);
-							auto frontbackgains = frontbackmap.FindParameters(fuphit.global_chan);
-							if(frontbackgains == frontbackmap.End())
-								continue;
-							after_name = "channel_"+std::to_string(fuphit.global_chan)+"_after";
-							MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*(cal_up_energy+cal_down_energy)+frontbackgains->second.intercept,1024,0,16384,cal_back);
-						}
-					}
-				}
-			}
-
-			if(event->barrel2[j].fronts_up.size() > 0 && event->barrel2[j].fronts_down.size() > 0 && event->barrel2[j].backs.size() > 0)
-			{
-				for(auto& backhit : event->barrel2[j].backs)
-				{
-					for(auto& fuphit : event->barrel2[j].fronts_up)
-					{
-						for(auto& fdownhit : event->barrel2[j].fronts_down)
-						{
-							if(fuphit.local_chan != updown_list[fdownhit.local_chan])
-								continue;
-							auto backgains = backmap.FindParameters(backhit.global_chan);
-							if(backgains == backmap.End())
-								continue;
-							auto upgains = updownmap.FindParameters(fuphit.global_chan);
-							if(upgains == updownmap.End())
-								continue;
-							auto backzero_offset = zmap.FindOffset(backhit.global_chan);
-							auto fupzero_offset = zmap.FindOffset(fuphit.global_chan);
-							auto fdownzero_offset = zmap.FindOffset(fdownhit.global_chan);
-							if(backzero_offset == zmap.End() || fupzero_offset == zmap.End() || fdownzero_offset == zmap.End())
-								continue;
-		
-							cal_back = backgains->second.slope*(backhit.energy - backzero_offset->second) + backgains->second.intercept;
-							cal_up_energy = cal_back - upgains->second.slope*(fuphit.energy - fupzero_offset->second) - upgains->second.intercept*cal_back;
-							cal_down_energy = fdownhit.energy - fdownzero_offset->second;
-							if(cal_back < 100 || cal_up_energy < 100 || cal_down_energy < 100 || (cal_up_energy+cal_down_energy)/cal_back > 1.2 || (cal_up_energy+cal_down_energy)/cal_back < 0.8)
-								continue;
-							before_name = "channel_"+std::to_string(fuphit.global_chan)+"_before";
-							MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy+cal_down_energy,1024,0,16384,cal_back);
-							auto frontbackgains = frontbackmap.FindParameters(fuphit.global_chan);
-							if(frontbackgains == frontbackmap.End())
-								continue;
-							after_name = "channel_"+std::to_string(fuphit.global_chan)+"_after";
-							MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*(cal_up_energy+cal_down_energy)+frontbackgains->second.intercept,1024,0,16384,cal_back);
-						}
-					}
-				}
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			if(event->fqqq[j].rings.size() > 0 && event->fqqq[j].wedges.size() > 0)
-			{
-				for(auto& wedgehit : event->fqqq[j].wedges)
-				{
-					for(auto& ringhit : event->fqqq[j].rings)
-					{
-						auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
-						if(wedgegains == backmap.End())
-							continue;
-						auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
-						auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
-						if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
-							continue;
-	
-						cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
-						cal_up_energy = ringhit.energy - ringzero_offset->second;
-						if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
-							continue;
-						before_name = "channel_"+std::to_string(ringhit.global_chan)+"_before";
-						MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy,1024,0,16384,cal_back);
-						auto frontbackgains = frontbackmap.FindParameters(ringhit.global_chan);
-						if(frontbackgains == frontbackmap.End())
-							continue;
-						after_name = "channel_"+std::to_string(ringhit.global_chan)+"_after";
-						MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*cal_up_energy+frontbackgains->second.intercept,1024,0,16384,cal_back);
-					}
-				}
-			}
-			if(event->bqqq[j].rings.size() > 0 && event->bqqq[j].wedges.size() > 0)
-			{
-				for(auto& wedgehit : event->bqqq[j].wedges)
-				{
-					for(auto& ringhit : event->bqqq[j].rings)
-					{
-						auto wedgegains = backmap.FindParameters(wedgehit.global_chan);
-						if(wedgegains == backmap.End())
-							continue;
-						auto wedgezero_offset = zmap.FindOffset(wedgehit.global_chan);
-						auto ringzero_offset = zmap.FindOffset(ringhit.global_chan);
-						if(wedgezero_offset == zmap.End() || ringzero_offset == zmap.End())
-							continue;
-	
-						cal_back = wedgegains->second.slope*(wedgehit.energy - wedgezero_offset->second) + wedgegains->second.intercept;
-						cal_up_energy = ringhit.energy - ringzero_offset->second;
-						if(cal_back < 0 || cal_up_energy < 0 || cal_up_energy/cal_back > 1.2 || cal_up_energy/cal_back < 0.8)
-							continue;
-						before_name = "channel_"+std::to_string(ringhit.global_chan)+"_before";
-						MyFill(histo_table, before_name,";Front;Back",1024,0.0,16384,cal_up_energy,1024,0,16384,cal_back);
-						auto frontbackgains = frontbackmap.FindParameters(ringhit.global_chan);
-						if(frontbackgains == frontbackmap.End())
-							continue;
-						after_name = "channel_"+std::to_string(ringhit.global_chan)+"_after";
-						MyFill(histo_table, after_name, ";Front;Back",1024,0,16384,frontbackgains->second.slope*cal_up_energy+frontbackgains->second.intercept,1024,0,16384,cal_back);
-					}
-				}
-			}
-		}
-	}
-	std::cout<<std::endl;
+		FillFrontBackTestPlots(event, slot_tables[slot], backmap, updownmap, frontbackmap);
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
 
-	input->Close();
+	ANASEN_TRACE_SCOPE("GainMatcher/write");
 	graphoutput->cd();
 	graph_table->Write();
 	histo_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	delete event;
-}
\ No newline at end of file
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at GainMatcher::MatchFrontBack()!"<<std::endl;
+	return success;
+}
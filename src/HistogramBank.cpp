@@ -0,0 +1,198 @@
+/*
+	HistogramBank
+	Persisted spectra of a calibration stage, one bank per input run, so that a calibration can be redone as new runs arrive
+	without refilling the runs which were already seen. Each bank is a ROOT file holding the histograms the stage filled from
+	that run, along with the stage key (which changes whenever the inputs to the spectra, such as the maps they are made with,
+	change) and a stamp of the run file (size and modification time). A bank is only used if both still match.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		HistogramBankDirectory: directory the banks are kept in, one subdirectory per stage (default none disables the banks)
+		RefitThreshold: relative change in the counts of a channel's spectrum which triggers a refit (default 0.1)
+
+	FileProcessor::Fill loads the bank of every run which has one and only fills (and saves) the rest. The bank also keeps
+	the counts of each channel at its last fit, so that stages can keep the previous result of a channel whose statistics
+	have not changed meaningfully (NeedsRefit) and save the updated counts once done (SaveFitCounts).
+*/
+#include "HistogramBank.h"
+#include "StageTracer.h"
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <sys/stat.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TList.h>
+#include <TNamed.h>
+#include <TH1.h>
+
+BankSettings::BankSettings(const RunOptions& options)
+{
+	directory = options.GetString("HistogramBankDirectory", directory);
+	if(!directory.empty() && directory.back() != '/')
+		directory += '/';
+	refit_threshold = options.GetDouble("RefitThreshold", refit_threshold);
+}
+
+void BankSettings::Print() const
+{
+	if(IsEnabled())
+		std::cout<<"Histogram banks: "<<directory<<" (refit when a channel's counts change by "<<refit_threshold*100.0<<"%)"<<std::endl;
+}
+
+/*
+	The counts of the last fit are kept in <directory><stage>.counts, one channel per line.
+*/
+HistogramBank::HistogramBank(const BankSettings& s, const std::string& stage, const std::string& key, int nchannels) :
+	settings(s), stage_name(stage), stage_key(key), fit_counts(nchannels, 0.0)
+{
+	if(!IsEnabled())
+		return;
+
+	bank_dir = settings.directory + stage_name + "/";
+	mkdir(settings.directory.c_str(), 0755);
+	mkdir(bank_dir.c_str(), 0755);
+
+	std::ifstream input(settings.directory + stage_name + ".counts");
+	int gchan;
+	double counts;
+	std::string key_line;
+	//Counts made with a different key belong to different spectra
+	if(std::getline(input, key_line) && key_line == stage_key)
+	{
+		while(input>>gchan>>counts)
+		{
+			if(gchan >= 0 && gchan < nchannels)
+				fit_counts[gchan] = counts;
+		}
+	}
+}
+
+HistogramBank::~HistogramBank() {}
+
+std::string HistogramBank::GetBankName(const std::string& inputfile) const
+{
+	size_t slash = inputfile.find_last_of('/');
+	std::string base = (slash == std::string::npos) ? inputfile : inputfile.substr(slash+1);
+	return bank_dir + base;
+}
+
+std::string HistogramBank::GetStamp(const std::string& inputfile)
+{
+	struct stat info;
+	if(stat(inputfile.c_str(), &info) != 0)
+		return "";
+	return inputfile + " " + std::to_string((long long) info.st_size) + " " + std::to_string((long long) info.st_mtime);
+}
+
+THashTable* HistogramBank::Load(const std::string& inputfile, long& nentries) const
+{
+	ANASEN_TRACE_SCOPE("HistogramBank/load");
+	if(!IsEnabled())
+		return nullptr;
+
+	std::string bankname = GetBankName(inputfile);
+	struct stat info;
+	if(stat(bankname.c_str(), &info) != 0)
+		return nullptr;
+
+	TFile* file = TFile::Open(bankname.c_str(), "READ");
+	if(file == nullptr || !file->IsOpen())
+	{
+		delete file;
+		return nullptr;
+	}
+
+	TNamed* key = (TNamed*) file->Get("BankKey");
+	TNamed* source = (TNamed*) file->Get("BankSource");
+	TNamed* entries = (TNamed*) file->Get("BankEntries");
+	if(key == nullptr || source == nullptr || entries == nullptr || stage_key != key->GetTitle() || GetStamp(inputfile) != source->GetTitle())
+	{
+		file->Close();
+		delete file;
+		return nullptr;
+	}
+	nentries = std::stol(entries->GetTitle());
+
+	//Histograms are detached from the file, so they outlive it
+	THashTable* table = new THashTable();
+	TIter next(file->GetListOfKeys());
+	TKey* object_key;
+	while((object_key = (TKey*) next()))
+	{
+		TH1* histo = dynamic_cast<TH1*>(object_key->ReadObj());
+		if(histo != nullptr)
+		{
+			histo->SetDirectory(nullptr);
+			table->Add(histo);
+		}
+	}
+	file->Close();
+	delete file;
+	return table;
+}
+
+bool HistogramBank::Save(const std::string& inputfile, THashTable* table, long nentries) const
+{
+	ANASEN_TRACE_SCOPE("HistogramBank/save");
+	if(!IsEnabled())
+		return false;
+
+	std::string bankname = GetBankName(inputfile);
+	TFile* file = TFile::Open(bankname.c_str(), "RECREATE");
+	if(file == nullptr || !file->IsOpen())
+	{
+		std::cerr<<"Unable to create histogram bank "<<bankname<<" at HistogramBank::Save()!"<<std::endl;
+		delete file;
+		return false;
+	}
+	table->Write();
+	TNamed key("BankKey", stage_key.c_str());
+	TNamed source("BankSource", GetStamp(inputfile).c_str());
+	TNamed entries("BankEntries", std::to_string(nentries).c_str());
+	key.Write();
+	source.Write();
+	entries.Write();
+	file->Close();
+	delete file;
+	return true;
+}
+
+/*
+	A channel needs a refit if it was never fit, or its counts have changed by more than the threshold since the last fit. The
+	counts of a refit channel are stored, so that small changes add up over several batches until they trigger a refit.
+*/
+bool HistogramBank::NeedsRefit(int gchan, double counts)
+{
+	if(!IsEnabled() || gchan < 0 || gchan >= (int) fit_counts.size())
+		return true;
+	double previous = fit_counts[gchan];
+	if(previous > 0.0 && std::fabs(counts - previous) <= settings.refit_threshold*previous)
+		return false;
+	fit_counts[gchan] = counts;
+	return true;
+}
+
+bool HistogramBank::SaveFitCounts() const
+{
+	if(!IsEnabled())
+		return false;
+	std::ofstream output(settings.directory + stage_name + ".counts");
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to save fit counts of "<<stage_name<<" at HistogramBank::SaveFitCounts()!"<<std::endl;
+		return false;
+	}
+	output<<stage_key<<std::endl;
+	for(size_t i=0; i<fit_counts.size(); i++)
+	{
+		if(fit_counts[i] > 0.0)
+			output<<i<<"\t"<<fit_counts[i]<<std::endl;
+	}
+	return true;
+}
+
+double HistogramBank::GetCounts(THashTable* table, const std::string& name)
+{
+	TH1* histo = (TH1*) table->FindObject(name.c_str());
+	return histo == nullptr ? 0.0 : histo->Integral();
+}
@@ -0,0 +1,215 @@
+/*
+	IOPolicy
+	Class which holds the settings used when reading ROOT trees, so that every stage reads its input the same way. Settings
+	are taken from the optional entries of the input file (see RunOptions):
+		TreeCacheSize: size of the TTreeCache in MB (0 disables the cache)
+		TreeCacheBranches: all (cache every branch up front) or learn (learn the used branches from the first entries)
+		TreeCacheLearnEntries: number of entries used to learn the branches when TreeCacheBranches is learn
+		AsyncPrefetch: 1 to enable asynchronous prefetching of the cache blocks
+		ImplicitMTThreads: number of threads ROOT may use to decompress baskets (0 disables, -1 uses all cores)
+		QuickLookFraction: fraction of every input read by each stage, for quick-look calibrations (default 1 reads everything)
+	Unlike the other settings, the defaults do not read the way the stages used to: a 64 MB TTreeCache over every branch is
+	on by default. TreeCacheSize: 0 turns it off and reads the trees without a cache, as before.
+
+	Key methods are ConfigureTree, which should be called on every input tree before the event loop, and Report, which
+	should be called when the loop is finished (before closing the file). EnableGlobal must be called once before any
+	files are opened.
+
+	Quick-look mode samples whole storage clusters (GetClusters), so that the data which is skipped is never read from disk.
+	SelectClusters takes evenly spaced clusters over each input, which spreads the sample over every run and over the length of
+	each run, and always gives the same entries for the same files. The sample cannot be finer than a cluster, and at least
+	one cluster of every input is read. Everything produced from a sample should be marked with WriteQuickLookNote.
+*/
+#include "IOPolicy.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <TROOT.h>
+#include <TDirectory.h>
+#include <TNamed.h>
+#include <TEnv.h>
+#include <TTree.h>
+#include <TTreePerfStats.h>
+
+//Defaults: 64 MB cache over all branches, no prefetching, no implicit multithreading
+IOPolicy::IOPolicy() :
+	cache_size(64*1024*1024), learn_branches(false), learn_entries(10), async_prefetch(false), imt_threads(0),
+	quicklook_fraction(1.0)
+{
+}
+
+IOPolicy::IOPolicy(const RunOptions& options) :
+	IOPolicy()
+{
+	cache_size = options.GetLong("TreeCacheSize", cache_size/(1024*1024))*1024*1024;
+	learn_branches = (options.GetString("TreeCacheBranches", "all") == "learn");
+	learn_entries = options.GetInt("TreeCacheLearnEntries", learn_entries);
+	async_prefetch = options.GetBool("AsyncPrefetch", async_prefetch);
+	imt_threads = options.GetInt("ImplicitMTThreads", imt_threads);
+	quicklook_fraction = options.GetDouble("QuickLookFraction", quicklook_fraction);
+	if(quicklook_fraction <= 0.0 || quicklook_fraction > 1.0)
+	{
+		std::cerr<<"QuickLookFraction must be in (0, 1] at IOPolicy::IOPolicy()! Reading everything."<<std::endl;
+		quicklook_fraction = 1.0;
+	}
+}
+
+IOPolicy::~IOPolicy() {}
+
+/*
+	Process wide settings. Asynchronous prefetching is read by TFile when a file is opened, and implicit multithreading
+	must be enabled before any trees are read for basket decompression to be parallelized.
+*/
+void IOPolicy::EnableGlobal() const
+{
+	gEnv->SetValue("TFile.AsyncPrefetching", async_prefetch ? 1 : 0);
+	if(imt_threads < 0)
+		ROOT::EnableImplicitMT();
+	else if(imt_threads > 0)
+		ROOT::EnableImplicitMT(imt_threads);
+}
+
+void IOPolicy::ConfigureTree(TTree* tree) const
+{
+	if(tree == nullptr)
+	{
+		std::cerr<<"Null tree passed to IOPolicy::ConfigureTree! Skipping."<<std::endl;
+		return;
+	}
+
+	tree->SetCacheSize(cache_size);
+	if(cache_size > 0)
+	{
+		if(learn_branches)
+			tree->SetCacheLearnEntries(learn_entries);
+		else
+		{
+			tree->AddBranchToCache("*", true);
+			tree->StopCacheLearningPhase();
+		}
+	}
+
+	//A chain only has a current tree (which the statistics need) once an entry has been loaded
+	tree->LoadTree(0);
+	//Owned by the tree from here on; removed and deleted in Report
+	new TTreePerfStats("iopolicy_stats", tree);
+}
+
+/*
+	Reports and returns the I/O statistics collected since ConfigureTree. Must be called before the input file is closed.
+*/
+IOStats IOPolicy::Report(TTree* tree) const
+{
+	IOStats stats;
+	if(tree == nullptr)
+		return stats;
+
+	TTreePerfStats* perf = dynamic_cast<TTreePerfStats*>(tree->GetPerfStats());
+	if(perf == nullptr)
+	{
+		std::cerr<<"Tree "<<tree->GetName()<<" was not configured at IOPolicy::Report! No statistics available."<<std::endl;
+		return stats;
+	}
+	perf->Finish();
+	stats.bytes_read = perf->GetBytesRead();
+	stats.read_calls = perf->GetReadCalls();
+	stats.unzip_time = perf->GetUnzipTime();
+	tree->SetPerfStats(nullptr);
+	delete perf;
+
+	std::cout<<"I/O summary for "<<tree->GetName()<<": "<<stats.bytes_read/(1024.0*1024.0)<<" MB read in "<<stats.read_calls<<" read calls, ";
+	std::cout<<stats.unzip_time<<" s spent decompressing"<<std::endl;
+	return stats;
+}
+
+void IOPolicy::Print() const
+{
+	std::cout<<"Tree cache size: "<<cache_size/(1024*1024)<<" MB";
+	if(cache_size > 0)
+		std::cout<<(learn_branches ? " (learning branches over "+std::to_string(learn_entries)+" entries)" : " (all branches)");
+	std::cout<<" Async prefetch: "<<(async_prefetch ? "on" : "off");
+	std::cout<<" Implicit MT threads: "<<(imt_threads < 0 ? std::string("all") : std::to_string(imt_threads))<<std::endl;
+	if(IsQuickLook())
+		std::cout<<"Quick-look mode: reading "<<quicklook_fraction*100.0<<"% of the clusters of every input. Results are PRELIMINARY."<<std::endl;
+}
+
+/*
+	Cluster i is taken whenever the running total i*fraction passes an integer, which gives evenly spaced clusters.
+*/
+std::vector<EntryRange> IOPolicy::SelectClusters(const std::vector<EntryRange>& clusters) const
+{
+	if(!IsQuickLook())
+		return clusters;
+
+	std::vector<EntryRange> selected;
+	for(size_t i=0; i<clusters.size(); i++)
+	{
+		if(std::floor((i+1)*quicklook_fraction) > std::floor(i*quicklook_fraction))
+			selected.push_back(clusters[i]);
+	}
+	if(selected.size() == 0 && clusters.size() > 0)
+		selected.push_back(clusters[clusters.size()/2]);
+	return selected;
+}
+
+std::string IOPolicy::GetQuickLookNote() const
+{
+	std::stringstream note;
+	note<<"PRELIMINARY quick-look result from "<<quicklook_fraction*100.0<<"% of the data (QuickLookFraction "<<quicklook_fraction<<")";
+	return note.str();
+}
+
+//Text outputs get a leading comment line, which the map readers skip
+void IOPolicy::WriteQuickLookNote(std::ostream& output) const
+{
+	if(IsQuickLook())
+		output<<"# "<<GetQuickLookNote()<<std::endl;
+}
+
+//ROOT outputs get a TNamed called QuickLook holding the note
+void IOPolicy::WriteQuickLookNote(TDirectory* directory) const
+{
+	if(!IsQuickLook() || directory == nullptr)
+		return;
+	directory->cd();
+	TNamed note("QuickLook", GetQuickLookNote().c_str());
+	note.Write();
+}
+
+/*
+	Storage clusters of a tree or chain, in global entry numbers. A chain is walked one tree at a time, so this moves the
+	current tree of the chain.
+*/
+std::vector<EntryRange> IOPolicy::GetClusters(TTree* tree)
+{
+	std::vector<EntryRange> clusters;
+	if(tree == nullptr)
+		return clusters;
+
+	long long entry = 0, nentries = tree->GetEntries();
+	while(entry < nentries)
+	{
+		long long local = tree->LoadTree(entry);
+		TTree* current = tree->GetTree();
+		if(local < 0 || current == nullptr)
+			break;
+		long long offset = entry - local;
+		long long current_entries = current->GetEntries();
+		TTree::TClusterIterator iter = current->GetClusterIterator(0);
+		long long start;
+		while((start = iter()) < current_entries)
+			clusters.push_back(EntryRange{offset + start, offset + std::min(iter.GetNextEntry(), current_entries)});
+		entry = offset + current_entries;
+	}
+	tree->LoadTree(0);
+	return clusters;
+}
+
+long long IOPolicy::CountEntries(const std::vector<EntryRange>& ranges)
+{
+	long long total = 0;
+	for(auto& range : ranges)
+		total += range.last - range.first;
+	return total;
+}
@@ -18,10 +18,15 @@ MapChecker::MapChecker(const std::string& channelfile) :
 MapChecker::~MapChecker() {}
 
 
-void MapChecker::CheckZOffset(const std::string& filename)
+bool MapChecker::CheckZOffset(const std::string& filename)
 {
 	std::cout<<"Loading map "<<filename<<"..."<<std::endl;
 	ZeroCalMap zmap(filename);
+	if(!zmap.IsValid())
+	{
+		std::cerr<<"Unable to load map "<<filename<<" at MapChecker::CheckZOffset()! Exiting."<<std::endl;
+		return false;
+	}
 
 	//Counters
 	int frontups=0, frontdowns=0, backs=0, rings=0, wedges=0;
@@ -36,18 +41,18 @@ void MapChecker::CheckZOffset(const std::string& filename)
 		if(offset == zmap.End())
 		{
 			missing_channels.push_back(i);
-			if(channel->second.detectorComponent == "FRONT")
+			if(channel->second.detectorComponent == DetectorComponent::Front)
 			{
-				if(channel->second.detectorDirection == "DOWN")
+				if(channel->second.detectorDirection == DetectorDirection::Down)
 					frontdowns++;
-				else if(channel->second.detectorDirection == "UP")
+				else if(channel->second.detectorDirection == DetectorDirection::Up)
 					frontups++;
 			}
-			else if(channel->second.detectorComponent == "BACK")
+			else if(channel->second.detectorComponent == DetectorComponent::Back)
 				backs++;
-			else if(channel->second.detectorComponent == "RING")
+			else if(channel->second.detectorComponent == DetectorComponent::Ring)
 				rings++;
-			else if(channel->second.detectorComponent == "WEDGE")
+			else if(channel->second.detectorComponent == DetectorComponent::Wedge)
 				wedges++;
 		}
 	}
@@ -63,13 +68,18 @@ void MapChecker::CheckZOffset(const std::string& filename)
 	{
 		std::cout<<i<<std::endl;
 	}
-
+	return true;
 }
 
-void MapChecker::CheckBackGainMatch(const std::string& filename)
+bool MapChecker::CheckBackGainMatch(const std::string& filename)
 {
 	std::cout<<"Loading map "<<filename<<"..."<<std::endl;
 	ParameterMap pmap(filename);
+	if(!pmap.IsValid())
+	{
+		std::cerr<<"Unable to load map "<<filename<<" at MapChecker::CheckBackGainMatch()! Exiting."<<std::endl;
+		return false;
+	}
 
 	//Counters
 	int backs=0, wedges=0;
@@ -83,12 +93,12 @@ void MapChecker::CheckBackGainMatch(const std::string& filename)
 		auto offset = pmap.FindParameters(i);
 		if(offset == pmap.End())
 		{
-			if(channel->second.detectorComponent == "BACK")
+			if(channel->second.detectorComponent == DetectorComponent::Back)
 			{
 				backs++;
 				missing_channels.push_back(i);
 			}
-			else if(channel->second.detectorComponent == "WEDGE")
+			else if(channel->second.detectorComponent == DetectorComponent::Wedge)
 			{
 				wedges++;
 				missing_channels.push_back(i);
@@ -104,13 +114,18 @@ void MapChecker::CheckBackGainMatch(const std::string& filename)
 	{
 		std::cout<<i<<std::endl;
 	}
-
+	return true;
 }
 
-void MapChecker::CheckUpDownGainMatch(const std::string& filename)
+bool MapChecker::CheckUpDownGainMatch(const std::string& filename)
 {
 	std::cout<<"Loading map "<<filename<<"..."<<std::endl;
 	ParameterMap pmap(filename);
+	if(!pmap.IsValid())
+	{
+		std::cerr<<"Unable to load map "<<filename<<" at MapChecker::CheckUpDownGainMatch()! Exiting."<<std::endl;
+		return false;
+	}
 
 	//Counters
 	int frontups=0;
@@ -124,7 +139,7 @@ void MapChecker::CheckUpDownGainMatch(const std::string& filename)
 		auto offset = pmap.FindParameters(i);
 		if(offset == pmap.End())
 		{
-			if(channel->second.detectorComponent == "FRONT" && channel->second.detectorDirection == "UP")
+			if(channel->second.detectorComponent == DetectorComponent::Front && channel->second.detectorDirection == DetectorDirection::Up)
 			{
 				frontups++;
 				missing_channels.push_back(i);
@@ -138,13 +153,18 @@ void MapChecker::CheckUpDownGainMatch(const std::string& filename)
 	{
 		std::cout<<i<<std::endl;
 	}
-
+	return true;
 }
 
-void MapChecker::CheckFrontBackGainMatch(const std::string& filename)
+bool MapChecker::CheckFrontBackGainMatch(const std::string& filename)
 {
 	std::cout<<"Loading map "<<filename<<"..."<<std::endl;
 	ParameterMap pmap(filename);
+	if(!pmap.IsValid())
+	{
+		std::cerr<<"Unable to load map "<<filename<<" at MapChecker::CheckFrontBackGainMatch()! Exiting."<<std::endl;
+		return false;
+	}
 
 	//Counters
 	int frontups=0, rings=0;
@@ -158,15 +178,15 @@ void MapChecker::CheckFrontBackGainMatch(const std::string& filename)
 		auto offset = pmap.FindParameters(i);
 		if(offset == pmap.End())
 		{
-			if(channel->second.detectorComponent == "FRONT")
+			if(channel->second.detectorComponent == DetectorComponent::Front)
 			{
-				if(channel->second.detectorDirection == "UP")
+				if(channel->second.detectorDirection == DetectorDirection::Up)
 				{
 					frontups++;
 					missing_channels.push_back(i);
 				}
 			}
-			else if(channel->second.detectorComponent == "RING")
+			else if(channel->second.detectorComponent == DetectorComponent::Ring)
 			{
 				rings++;
 				missing_channels.push_back(i);
@@ -182,5 +202,5 @@ void MapChecker::CheckFrontBackGainMatch(const std::string& filename)
 	{
 		std::cout<<i<<std::endl;
 	}
-
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,222 @@
+/*
+	OutputPolicy
+	Class which holds the settings used when writing ROOT trees, so that every stage which produces a data file writes it
+	the same way. Settings are taken from the optional entries of the input file (see RunOptions):
+		DataFormat: format of the output data files (ttree or rntuple, see EventIO)
+		OutputProfile: named set of compression and basket settings (default, fast, zstd, archival, analysis; see GetProfiles)
+		CompressionAlgorithm: overrides the profile algorithm (none, zlib, lzma, lz4, zstd)
+		CompressionLevel: overrides the profile compression level (1-9; with the default profile and no algorithm, ROOT's
+		default algorithm is used at this level)
+		BasketSizeKB: overrides the profile basket size of every branch
+		AutoFlushMB: overrides the profile amount of data buffered before the baskets are flushed to the file
+		AsyncWriteQueue: number of events which may be queued for the output writer thread (0 fills the tree in the event loop)
+		FiredIndex: if 1, organize-data also writes the per-group entry lists of each run next to the data file (see FiredIndex)
+		CheckpointEntries: number of entries between checkpoints of organize-data and apply-calibrations outputs, which let an
+		interrupted job be resumed (see Checkpoint; 0 only saves the final one, which marks the output complete)
+
+	Key methods are ConfigureFile, which should be called right after the output file is opened, and ConfigureTree, which
+	should be called once all of the branches of the output tree exist (both are handled by the EventIO sinks). The queue size is handed to an AsyncTreeWriter
+	through GetWriteQueueSize.
+*/
+#include "OutputPolicy.h"
+#include "EventIO.h"
+#include <iostream>
+#include <Compression.h>
+#include <TFile.h>
+#include <TTree.h>
+
+//Defaults: ROOT defaults for everything, trees are filled in the event loop
+OutputPolicy::OutputPolicy() :
+	data_format("ttree"), write_queue(0), fired_index(false), checkpoint_entries(0)
+{
+	FindProfile("default", profile);
+}
+
+OutputPolicy::OutputPolicy(const RunOptions& options) :
+	OutputPolicy()
+{
+	data_format = options.GetString("DataFormat", data_format);
+	if(!EventIO::IsFormatAvailable(data_format))
+	{
+		std::cerr<<"Data format "<<data_format<<" is not available in this build at OutputPolicy::OutputPolicy()! Using ttree."<<std::endl;
+		data_format = "ttree";
+	}
+
+	std::string name = options.GetString("OutputProfile", profile.name);
+	if(!FindProfile(name, profile))
+	{
+		std::cerr<<"Unknown output profile "<<name<<" at OutputPolicy::OutputPolicy()! Using default."<<std::endl;
+		FindProfile("default", profile);
+	}
+
+	bool custom = false;
+	if(options.HasOption("CompressionAlgorithm"))
+	{
+		int algorithm = ConvertAlgorithmName(options.GetString("CompressionAlgorithm", ""));
+		if(algorithm == -1)
+			std::cerr<<"Unknown compression algorithm at OutputPolicy::OutputPolicy()! Using the profile algorithm."<<std::endl;
+		else
+		{
+			profile.algorithm = algorithm;
+			custom = true;
+		}
+	}
+	if(options.HasOption("CompressionLevel"))
+	{
+		profile.level = options.GetInt("CompressionLevel", profile.level);
+		custom = true;
+	}
+	if(options.HasOption("BasketSizeKB"))
+	{
+		profile.basket_size = options.GetInt("BasketSizeKB", 0)*1024;
+		custom = true;
+	}
+	if(options.HasOption("AutoFlushMB"))
+	{
+		profile.autoflush = options.GetLong("AutoFlushMB", 0)*1024*1024;
+		custom = true;
+	}
+
+	//An algorithm chosen on top of the default profile needs a level as well
+	if(profile.algorithm > 0 && profile.level < 0)
+		profile.level = 5;
+	if(custom)
+		profile.name += "+custom";
+
+	write_queue = options.GetInt("AsyncWriteQueue", write_queue);
+	if(write_queue < 0)
+		write_queue = 0;
+
+	fired_index = options.GetBool("FiredIndex", fired_index);
+
+	checkpoint_entries = options.GetLong("CheckpointEntries", checkpoint_entries);
+	if(checkpoint_entries > 0 && !EventIO::IsFormatResumable(data_format))
+	{
+		std::cerr<<"Data format "<<data_format<<" cannot be resumed at OutputPolicy::OutputPolicy()! Checkpoints are off."<<std::endl;
+		checkpoint_entries = 0;
+	}
+	else if(checkpoint_entries < 0)
+		checkpoint_entries = 0;
+}
+
+OutputPolicy::~OutputPolicy() {}
+
+/*
+	The named profiles.
+		default: whatever the installed ROOT uses
+		fast: LZ4 at a low level, for when writing speed matters most (i.e. organizing data during an experiment)
+		zstd: ZSTD at a medium level, good compression at a small write cost
+		archival: LZMA at a high level, smallest files but slow to write
+		analysis: LZ4 with large baskets and clusters, for files which are read many times
+*/
+const std::vector<OutputProfile>& OutputPolicy::GetProfiles()
+{
+	static const std::vector<OutputProfile> profiles = {
+		{"default", -1, -1, -1, 0},
+		{"fast", ROOT::RCompressionSetting::EAlgorithm::kLZ4, 1, 64*1024, 0},
+		{"zstd", ROOT::RCompressionSetting::EAlgorithm::kZSTD, 5, -1, 0},
+		{"archival", ROOT::RCompressionSetting::EAlgorithm::kLZMA, 8, -1, 0},
+		{"analysis", ROOT::RCompressionSetting::EAlgorithm::kLZ4, 4, 1024*1024, 100LL*1024*1024}
+	};
+	return profiles;
+}
+
+bool OutputPolicy::FindProfile(const std::string& name, OutputProfile& prof)
+{
+	for(auto& entry : GetProfiles())
+	{
+		if(entry.name == name)
+		{
+			prof = entry;
+			return true;
+		}
+	}
+	return false;
+}
+
+//Returns -1 if the ROOT default should be kept. A level without an algorithm is applied with the ROOT default algorithm.
+int OutputPolicy::GetCompressionSettings() const
+{
+	if(profile.algorithm < 0 && profile.level < 0)
+		return -1;
+	else if(profile.algorithm < 0)
+		return ROOT::CompressionSettings(ROOT::RCompressionSetting::EAlgorithm::kUseGlobal, profile.level);
+	else if(profile.algorithm == 0)
+		return 0;
+	else
+		return ROOT::CompressionSettings((ROOT::RCompressionSetting::EAlgorithm::EValues) profile.algorithm, profile.level);
+}
+
+void OutputPolicy::ConfigureFile(TFile* file) const
+{
+	int settings = GetCompressionSettings();
+	if(file == nullptr || settings < 0)
+		return;
+
+	file->SetCompressionSettings(settings);
+}
+
+void OutputPolicy::ConfigureTree(TTree* tree) const
+{
+	if(tree == nullptr)
+		return;
+
+	if(profile.basket_size > 0)
+		tree->SetBasketSize("*", profile.basket_size);
+	if(profile.autoflush > 0)
+		tree->SetAutoFlush(-profile.autoflush); //negative values are in bytes
+}
+
+void OutputPolicy::Print() const
+{
+	std::cout<<"Output format: "<<data_format<<" Output profile: "<<profile.name<<" (compression: ";
+	if(profile.algorithm < 0 && profile.level < 0)
+		std::cout<<"ROOT default";
+	else if(profile.algorithm < 0)
+		std::cout<<"ROOT default algorithm level "<<profile.level;
+	else
+		std::cout<<ConvertAlgorithm2Name(profile.algorithm)<<" level "<<profile.level;
+	if(profile.basket_size > 0)
+		std::cout<<", baskets: "<<profile.basket_size/1024<<" kB";
+	if(profile.autoflush > 0)
+		std::cout<<", autoflush: "<<profile.autoflush/(1024*1024)<<" MB";
+	std::cout<<")";
+	std::cout<<" Output writer queue: ";
+	if(write_queue > 0)
+		std::cout<<write_queue<<" events"<<std::endl;
+	else
+		std::cout<<"off"<<std::endl;
+	if(fired_index)
+		std::cout<<"Writing fired indices of organized data"<<std::endl;
+	if(checkpoint_entries > 0)
+		std::cout<<"Saving a checkpoint of the output every "<<checkpoint_entries<<" entries"<<std::endl;
+}
+
+int OutputPolicy::ConvertAlgorithmName(const std::string& name)
+{
+	if(name == "none")
+		return 0;
+	else if(name == "zlib")
+		return ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+	else if(name == "lzma")
+		return ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+	else if(name == "lz4")
+		return ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+	else if(name == "zstd")
+		return ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+	else
+		return -1;
+}
+
+std::string OutputPolicy::ConvertAlgorithm2Name(int algorithm)
+{
+	switch(algorithm)
+	{
+		case 0: return "none";
+		case ROOT::RCompressionSetting::EAlgorithm::kZLIB: return "zlib";
+		case ROOT::RCompressionSetting::EAlgorithm::kLZMA: return "lzma";
+		case ROOT::RCompressionSetting::EAlgorithm::kLZ4: return "lz4";
+		case ROOT::RCompressionSetting::EAlgorithm::kZSTD: return "zstd";
+	}
+	return "unknown";
+}
@@ -10,6 +10,8 @@
 */
 #include "ParameterMap.h"
 #include <fstream>
+#include <limits>
+#include <cmath>
 
 ParameterMap::ParameterMap(const std::string& filename) :
 	valid_flag(false)
@@ -17,6 +19,24 @@ ParameterMap::ParameterMap(const std::string& filename) :
 	FillMap(filename);
 }
 
+ParameterMap::ParameterMap(const double* params, int size) :
+	valid_flag(false)
+{
+	if(params == nullptr)
+		return;
+
+	CalParams entry;
+	for(int gchan=0; gchan<size; gchan++)
+	{
+		if(std::isnan(params[2*gchan]))
+			continue;
+		entry.intercept = params[2*gchan];
+		entry.slope = params[2*gchan+1];
+		map[gchan] = entry;
+	}
+	valid_flag = true;
+}
+
 ParameterMap::~ParameterMap() {}
 
 void ParameterMap::FillMap(const std::string& filename)
@@ -30,8 +50,16 @@ void ParameterMap::FillMap(const std::string& filename)
 
 	int gchan;
 	CalParams params;
-	while(input>>gchan)
+	//Lines starting with # are comments (i.e. the note on a quick-look result)
+	while(input>>std::ws && input.peek() != EOF)
 	{
+		if(input.peek() == '#')
+		{
+			input.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			continue;
+		}
+		if(!(input>>gchan))
+			break;
 		input>>params.intercept>>params.slope;
 		map[gchan] = params;
 	}
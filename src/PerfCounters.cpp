@@ -0,0 +1,291 @@
+/*
+	PerfCounters
+	Hardware performance counters (Linux perf_event_open) around the hot loops, to see what the per-event and per-hit work
+	costs at the instruction level: instructions, cycles, cache misses and branch misses. Regions are placed by macros:
+		ANASEN_PERF_REGION(name): counts from here to the end of the scope as one event of the region. Regions are placed
+		around the work done for a single event (building an AnasenEvent, filling the spectra of an event, calibrating an
+		event), so that the counts divide into a cost per event.
+		ANASEN_PERF_HIT(): counts one hit in the innermost region open on the thread (i.e. one FillEvent or histogram fill).
+		ANASEN_PERF_HITS(n): counts n hits in the innermost region open on the thread.
+	Names are string literals of the form Stage/region.
+
+	The macros expand to nothing unless built with counters (make PERF=1, which defines ANASEN_PERF). With counters, each
+	thread opens its own group of the four counters the first time it enters a region, counting user space only, and every
+	region reads the group at entry and exit (two system calls per event, so counts include a small fixed overhead, and wall
+	times are slower than a normal build). If the counters cannot be opened (i.e. perf_event_paranoid is too strict, or in a
+	container without access to the PMU), a warning is printed once and the regions only count events and hits. If the
+	kernel had to multiplex the counters, the counts are partial and the summary says so.
+
+	WriteSummary writes one line per region, summed over threads, as tab-separated columns (see the header line of the
+	file); PrintSummary gives the same per event and per hit. Both must only be called once every counted thread has finished.
+*/
+#include "PerfCounters.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <cstring>
+
+#ifdef ANASEN_PERF
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounters::PerfCounters() :
+	warned(false)
+{
+}
+
+PerfCounters& PerfCounters::Get()
+{
+	static PerfCounters counters;
+	return counters;
+}
+
+const char* PerfCounters::GetCounterName(int index)
+{
+	static const char* names[ncounters] = {"instructions", "cycles", "cache_misses", "branch_misses"};
+	return names[index];
+}
+
+/*
+	The counters of a thread are closed when it exits (the thread_local holder goes away), but the totals are kept by the
+	tracker for the summary.
+*/
+PerfCounters::ThreadCounters& PerfCounters::GetThread()
+{
+	struct Holder
+	{
+		std::shared_ptr<ThreadCounters> counters;
+		~Holder()
+		{
+			if(counters)
+				counters->Close();
+		}
+	};
+	thread_local Holder holder;
+	if(!holder.counters)
+	{
+		holder.counters = std::make_shared<ThreadCounters>();
+		std::lock_guard<std::mutex> guard(thread_mutex);
+		threads.push_back(holder.counters);
+	}
+	return *holder.counters;
+}
+
+void PerfCounters::Warn()
+{
+	std::lock_guard<std::mutex> guard(thread_mutex);
+	if(warned)
+		return;
+	warned = true;
+	std::cerr<<"Unable to open the hardware performance counters at PerfCounters::Warn()! Only events and hits will be counted. ";
+	std::cerr<<"Check /proc/sys/kernel/perf_event_paranoid (2 or less is needed)."<<std::endl;
+}
+
+void PerfCounters::AddHits(long long n)
+{
+	ThreadCounters& thread = Get().GetThread();
+	if(thread.current != nullptr)
+		thread.current->hits += n;
+}
+
+PerfCounters::ThreadCounters::~ThreadCounters()
+{
+	Close();
+}
+
+//One group led by the instruction counter, so that all four are read at once and cover the same span
+bool PerfCounters::ThreadCounters::Open()
+{
+	opened = true;
+#ifdef ANASEN_PERF
+	static const uint64_t configs[ncounters] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES,
+												PERF_COUNT_HW_BRANCH_MISSES};
+	for(int i=0; i<ncounters; i++)
+	{
+		struct perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = configs[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+		if(fds[i] < 0)
+		{
+			Close();
+			return false;
+		}
+	}
+	available = true;
+#endif
+	return available;
+}
+
+void PerfCounters::ThreadCounters::Close()
+{
+#ifdef ANASEN_PERF
+	for(int i=ncounters-1; i>=0; i--)
+	{
+		if(fds[i] >= 0)
+			close(fds[i]);
+		fds[i] = -1;
+	}
+#endif
+	available = false;
+}
+
+bool PerfCounters::ThreadCounters::Read(Counts& counts)
+{
+#ifdef ANASEN_PERF
+	struct
+	{
+		uint64_t nr;
+		uint64_t time_enabled;
+		uint64_t time_running;
+		uint64_t values[ncounters];
+	} data;
+	if(read(fds[0], &data, sizeof(data)) != (ssize_t) sizeof(data) || data.nr != ncounters)
+		return false;
+	if(data.time_running < data.time_enabled)
+		multiplexed = true;
+	for(int i=0; i<ncounters; i++)
+		counts.values[i] = data.values[i];
+	return true;
+#else
+	return false;
+#endif
+}
+
+PerfCounters::RegionTotal* PerfCounters::ThreadCounters::Find(const char* name)
+{
+	for(auto& total : totals)
+		if(total.name == name)
+			return &total;
+	totals.emplace_back();
+	totals.back().name = name;
+	return &totals.back();
+}
+
+PerfCounters::Region::Region(const char* name) :
+	thread(&Get().GetThread()), outer(nullptr), hits(0), counting(false)
+{
+	if(!thread->opened && !thread->Open())
+		Get().Warn();
+	total = thread->Find(name);
+	outer = thread->current;
+	thread->current = this;
+	counting = thread->available && thread->Read(start);
+}
+
+PerfCounters::Region::~Region()
+{
+	Counts stop;
+	if(counting && thread->Read(stop))
+	{
+		for(int i=0; i<ncounters; i++)
+			total->counts.values[i] += stop.values[i] - start.values[i];
+	}
+	total->events++;
+	total->hits += hits;
+	thread->current = outer;
+}
+
+//Sums the regions of every thread by name
+std::map<std::string, PerfCounters::RegionTotal> PerfCounters::Merge(bool& multiplexed) const
+{
+	std::map<std::string, RegionTotal> merged;
+	multiplexed = false;
+	for(auto& thread : threads)
+	{
+		multiplexed |= thread->multiplexed;
+		for(auto& total : thread->totals)
+		{
+			RegionTotal& entry = merged[total.name];
+			entry.events += total.events;
+			entry.hits += total.hits;
+			for(int i=0; i<ncounters; i++)
+				entry.counts.values[i] += total.counts.values[i];
+		}
+	}
+	return merged;
+}
+
+/*
+	Columns: region, events, hits, then the total of each counter, then each counter per event and per hit. Lines starting
+	with # are comments; regions counted on a thread without counters (see Warn) are missing those counts.
+*/
+bool PerfCounters::WriteSummary(const std::string& filename) const
+{
+	bool multiplexed;
+	std::map<std::string, RegionTotal> merged = Merge(multiplexed);
+
+	std::ofstream output(filename);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open performance counter summary "<<filename<<" at PerfCounters::WriteSummary()!"<<std::endl;
+		return false;
+	}
+	if(warned)
+		output<<"#hardware counters unavailable, only events and hits were counted"<<std::endl;
+	if(multiplexed)
+		output<<"#counters were multiplexed by the kernel, counts are partial"<<std::endl;
+	output<<"#region\tevents\thits";
+	for(int i=0; i<ncounters; i++)
+		output<<"\t"<<GetCounterName(i);
+	for(int i=0; i<ncounters; i++)
+		output<<"\t"<<GetCounterName(i)<<"_per_event\t"<<GetCounterName(i)<<"_per_hit";
+	output<<std::endl;
+
+	for(auto& item : merged)
+	{
+		const RegionTotal& entry = item.second;
+		output<<item.first<<"\t"<<entry.events<<"\t"<<entry.hits;
+		for(int i=0; i<ncounters; i++)
+			output<<"\t"<<entry.counts.values[i];
+		for(int i=0; i<ncounters; i++)
+		{
+			output<<"\t"<<(entry.events > 0 ? ((double) entry.counts.values[i])/entry.events : 0.0);
+			output<<"\t"<<(entry.hits > 0 ? ((double) entry.counts.values[i])/entry.hits : 0.0);
+		}
+		output<<std::endl;
+	}
+	std::cout<<"Wrote hardware counter summary of "<<merged.size()<<" region(s) to "<<filename<<std::endl;
+	return true;
+}
+
+void PerfCounters::PrintSummary() const
+{
+	bool multiplexed;
+	std::map<std::string, RegionTotal> merged = Merge(multiplexed);
+
+	std::cout<<"----------------Hardware Counters------------------"<<std::endl;
+	if(merged.empty())
+	{
+		std::cout<<"No regions were counted."<<std::endl;
+		return;
+	}
+	std::cout<<std::left<<std::setw(34)<<"Region"<<std::right<<std::setw(12)<<"Events"<<std::setw(10)<<"Hits/evt"
+			 <<std::setw(12)<<"Instr/evt"<<std::setw(12)<<"Instr/hit"<<std::setw(8)<<"IPC"<<std::setw(12)<<"CacheM/evt"
+			 <<std::setw(12)<<"BranchM/evt"<<std::endl;
+	std::cout<<std::fixed<<std::setprecision(2);
+	for(auto& item : merged)
+	{
+		const RegionTotal& entry = item.second;
+		double events = entry.events > 0 ? entry.events : 1.0;
+		double hits = entry.hits > 0 ? entry.hits : 1.0;
+		std::cout<<std::left<<std::setw(34)<<item.first<<std::right<<std::setw(12)<<entry.events<<std::setw(10)<<entry.hits/events
+				 <<std::setw(12)<<entry.counts.values[0]/events<<std::setw(12)<<entry.counts.values[0]/hits
+				 <<std::setw(8)<<(entry.counts.values[1] > 0 ? ((double) entry.counts.values[0])/entry.counts.values[1] : 0.0)
+				 <<std::setw(12)<<entry.counts.values[2]/events<<std::setw(12)<<entry.counts.values[3]/events<<std::endl;
+	}
+	std::cout<<std::defaultfloat;
+	if(warned)
+		std::cout<<"Hardware counters were unavailable, only events and hits were counted."<<std::endl;
+	if(multiplexed)
+		std::cout<<"The counters were multiplexed by the kernel, so the counts are partial."<<std::endl;
+	std::cout<<"---------------------------------------------------"<<std::endl;
+}
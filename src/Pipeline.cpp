@@ -0,0 +1,319 @@
+/*
+	Pipeline
+	Runs a set of stages as a DAG, skipping the stages whose outputs are current. Each stage lists the files it reads, the files
+	it writes, and a string of the parameters it depends on (see RunOptions::GetSettings). The edges of the graph are found by
+	matching the inputs of each stage to the outputs of the others, so a stage only waits on the stages which write what it reads.
+
+	When a stage is ready (every stage it depends on has finished), its key is computed from its name, its parameters, and its
+	inputs: text files are hashed by content (so a rerun of an upstream stage which gives the same result does not invalidate
+	anything downstream), and ROOT data files by name, size and modification time. If the key matches the key recorded in the
+	state file from the last successful run, and every output exists, the stage is current and is not run. Otherwise it is run,
+	and it succeeds if its function returns true and every output was written. Stages downstream of a failure are not run.
+
+	Up to njobs stages run at once; independent branches (the organize shards of each run, the check stages) can run side by
+	side. Stages running at the same time must not share state, and each may use threads of its own. The state file is rewritten
+	after every stage which succeeds, so an interrupted pipeline resumes where it stopped.
+*/
+#include "Pipeline.h"
+#include "ChannelMap.h"
+#include "CalibrationBundle.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <sys/stat.h>
+#include <TROOT.h>
+
+Pipeline::Pipeline(const std::string& statefile) :
+	state_name(statefile)
+{
+}
+
+Pipeline::~Pipeline() {}
+
+void Pipeline::AddStage(const std::string& name, const std::vector<std::string>& inputs, const std::vector<std::string>& outputs,
+						const std::string& parameters, const StageFunction& func)
+{
+	Stage stage;
+	stage.name = name;
+	stage.inputs = inputs;
+	stage.outputs = outputs;
+	stage.parameters = parameters;
+	stage.func = func;
+	for(auto& output : outputs)
+		producers.emplace(output, stages.size());
+	stages.push_back(stage);
+}
+
+/*
+	ROOT files are too large to read just to hash, so they are stamped by size and modification time; everything else by the
+	checksum of its content. A missing file has an empty stamp.
+*/
+std::string Pipeline::GetFileStamp(const std::string& filename)
+{
+	struct stat info;
+	if(stat(filename.c_str(), &info) != 0)
+		return "";
+	if(filename.size() > 5 && filename.compare(filename.size()-5, 5, ".root") == 0)
+		return std::to_string((long long) info.st_size) + " " + std::to_string((long long) info.st_mtime);
+	return std::to_string(ChannelMap::ComputeChecksum(filename));
+}
+
+/*
+	Finds the dependencies of every stage, and checks that the graph is complete and has no cycles: every input must either
+	exist already or be written by another stage, and no file may be written by two stages.
+*/
+bool Pipeline::Build()
+{
+	bool valid = true;
+	for(size_t i=0; i<stages.size(); i++)
+	{
+		Stage& stage = stages[i];
+		stage.dependencies.clear();
+		for(auto& output : stage.outputs)
+		{
+			if(producers[output] != (int) i)
+			{
+				std::cerr<<"File "<<output<<" is written by both "<<stages[producers[output]].name<<" and "<<stage.name<<" at Pipeline::Build()!"<<std::endl;
+				valid = false;
+			}
+		}
+		for(auto& input : stage.inputs)
+		{
+			auto producer = producers.find(input);
+			if(producer != producers.end() && producer->second != (int) i)
+			{
+				if(std::find(stage.dependencies.begin(), stage.dependencies.end(), producer->second) == stage.dependencies.end())
+					stage.dependencies.push_back(producer->second);
+			}
+			else if(producer == producers.end() && !std::ifstream(input))
+			{
+				std::cerr<<"Input "<<input<<" of stage "<<stage.name<<" does not exist and is not made by any stage at Pipeline::Build()!"<<std::endl;
+				valid = false;
+			}
+		}
+	}
+	if(!valid)
+		return false;
+
+	//Kahn's algorithm: if not every stage can be ordered, there is a cycle
+	std::vector<int> nwaiting(stages.size());
+	std::vector<int> ready;
+	for(size_t i=0; i<stages.size(); i++)
+	{
+		nwaiting[i] = stages[i].dependencies.size();
+		if(nwaiting[i] == 0)
+			ready.push_back(i);
+	}
+	size_t nordered = 0;
+	while(!ready.empty())
+	{
+		int index = ready.back();
+		ready.pop_back();
+		nordered++;
+		for(size_t i=0; i<stages.size(); i++)
+		{
+			for(auto& dependency : stages[i].dependencies)
+				if(dependency == index && --nwaiting[i] == 0)
+					ready.push_back(i);
+		}
+	}
+	if(nordered != stages.size())
+	{
+		std::cerr<<"The stages of the pipeline have a cycle at Pipeline::Build()!"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+//Each part ends with a null, so that ("ab","c") and ("a","bc") differ
+uint64_t Pipeline::ComputeKey(const Stage& stage) const
+{
+	const char separator = '\0';
+	std::string keydata = stage.name + separator + stage.parameters + separator;
+	for(auto& input : stage.inputs)
+		keydata += input + separator + GetFileStamp(input) + separator;
+	for(auto& output : stage.outputs)
+		keydata += output + separator;
+	return CalibrationBundle::ComputeChecksum(keydata.data(), keydata.size());
+}
+
+bool Pipeline::IsCurrent(const Stage& stage) const
+{
+	auto previous = state.find(stage.name);
+	if(previous == state.end() || previous->second != stage.key)
+		return false;
+	for(auto& output : stage.outputs)
+		if(!std::ifstream(output))
+			return false;
+	return true;
+}
+
+/*
+	Called on the thread of the stage. An output only counts as written if it was modified after the stage started, so that a
+	stage which gives up early does not pass on the outputs of an earlier run.
+*/
+void Pipeline::RunStage(int index)
+{
+	Stage& stage = stages[index];
+	stage.key = ComputeKey(stage);
+	{
+		std::lock_guard<std::mutex> guard(state_mutex);
+		if(IsCurrent(stage))
+		{
+			std::cout<<"Stage "<<stage.name<<" is current, skipping."<<std::endl;
+			stage.status = StageStatus::Current;
+			stage_finished.notify_all();
+			return;
+		}
+		std::cout<<"Running stage "<<stage.name<<"..."<<std::endl;
+	}
+
+	std::time_t start_time = std::time(nullptr);
+	auto start = std::chrono::steady_clock::now();
+	bool success = stage.func();
+	struct stat info;
+	for(auto& output : stage.outputs)
+	{
+		if(stat(output.c_str(), &info) != 0 || info.st_mtime < start_time)
+		{
+			std::cerr<<"Stage "<<stage.name<<" did not write "<<output<<" at Pipeline::RunStage()!"<<std::endl;
+			success = false;
+		}
+	}
+	double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> guard(state_mutex);
+	if(success)
+	{
+		std::cout<<"Stage "<<stage.name<<" finished in "<<time<<" s."<<std::endl;
+		state[stage.name] = stage.key;
+		SaveState();
+		stage.status = StageStatus::Done;
+	}
+	else
+	{
+		std::cerr<<"Stage "<<stage.name<<" failed after "<<time<<" s at Pipeline::RunStage()!"<<std::endl;
+		state.erase(stage.name);
+		SaveState();
+		stage.status = StageStatus::Failed;
+	}
+	stage_finished.notify_all();
+}
+
+/*
+	Main loop. Starts every stage whose dependencies have finished, up to njobs at a time, until every stage has either finished
+	or been blocked by a failure. Returns false if any stage failed (or was blocked).
+*/
+bool Pipeline::Run(int njobs)
+{
+	if(!Build())
+	{
+		std::cerr<<"Unable to build the pipeline at Pipeline::Run()! Exiting."<<std::endl;
+		return false;
+	}
+	LoadState();
+	if(njobs < 1)
+		njobs = 1;
+	if(njobs > 1)
+		ROOT::EnableThreadSafety();
+	std::cout<<"Running a pipeline of "<<stages.size()<<" stage(s) with up to "<<njobs<<" at once..."<<std::endl;
+
+	std::vector<std::thread> threads;
+	std::unique_lock<std::mutex> lock(state_mutex);
+	int nrunning, nfailed;
+	while(true)
+	{
+		nrunning = 0;
+		nfailed = 0;
+		bool pending = false;
+		for(auto& stage : stages)
+		{
+			if(stage.status == StageStatus::Running)
+				nrunning++;
+		}
+		for(size_t i=0; i<stages.size(); i++)
+		{
+			Stage& stage = stages[i];
+			if(stage.status == StageStatus::Failed)
+				nfailed++;
+			if(stage.status != StageStatus::Pending)
+				continue;
+
+			bool ready = true;
+			std::string failed_dependency;
+			for(auto& dependency : stage.dependencies)
+			{
+				StageStatus status = stages[dependency].status;
+				if(status == StageStatus::Failed)
+					failed_dependency = stages[dependency].name;
+				else if(status != StageStatus::Current && status != StageStatus::Done)
+					ready = false;
+			}
+
+			if(!failed_dependency.empty())
+			{
+				std::cerr<<"Not running stage "<<stage.name<<", it depends on the failed stage "<<failed_dependency<<"."<<std::endl;
+				stage.status = StageStatus::Failed;
+				nfailed++;
+			}
+			else if(ready && nrunning < njobs)
+			{
+				stage.status = StageStatus::Running;
+				nrunning++;
+				threads.emplace_back(&Pipeline::RunStage, this, i);
+			}
+			else
+				pending = true;
+		}
+		if(!pending && nrunning == 0)
+			break;
+		stage_finished.wait(lock);
+	}
+	lock.unlock();
+	for(auto& thread : threads)
+		thread.join();
+
+	int nrun = 0, ncurrent = 0;
+	for(auto& stage : stages)
+	{
+		if(stage.status == StageStatus::Done)
+			nrun++;
+		else if(stage.status == StageStatus::Current)
+			ncurrent++;
+	}
+	std::cout<<"Pipeline finished: "<<nrun<<" stage(s) run, "<<ncurrent<<" current, "<<nfailed<<" failed or blocked."<<std::endl;
+	return nfailed == 0;
+}
+
+//Each line of the state file is a stage name and the key of its last successful run
+void Pipeline::LoadState()
+{
+	state.clear();
+	std::ifstream input(state_name);
+	std::string line, name;
+	uint64_t key;
+	while(std::getline(input, line))
+	{
+		std::stringstream linestream(line);
+		if(linestream>>name>>key)
+			state[name] = key;
+	}
+}
+
+void Pipeline::SaveState()
+{
+	std::map<std::string, uint64_t> sorted(state.begin(), state.end());
+	std::ofstream output(state_name);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to write pipeline state file "<<state_name<<" at Pipeline::SaveState()!"<<std::endl;
+		return;
+	}
+	for(auto& entry : sorted)
+		output<<entry.first<<"\t"<<entry.second<<std::endl;
+}
@@ -0,0 +1,144 @@
+/*
+	ProgressReporter
+	Progress and throughput of an event loop, shared by every stage so that they all report the same way: the fraction of the
+	entries done, the event rate, the rate data is read from ROOT files, and the time left. Settings are taken from the optional
+	entries of the input file (see RunOptions):
+		ProgressMode: terminal (default; one line, rewritten in place), log (one line of key=value pairs per report, for batch
+		logs), or off
+		ProgressInterval: seconds between reports (default 1 in terminal mode, 30 in log mode)
+	The settings are shared by every reporter, and must be given once through Configure before any loop starts.
+
+	Add is called from the event loop, on any number of threads, with the number of entries handled since the last call. It is
+	a relaxed atomic add and a compare, and only every few hundred entries (see stride) does it read the clock; the thread which
+	finds a report due prints it, while the others carry on. Threads which share a reporter may still batch their updates to
+	avoid contending on it (see FileProcessor). Skip counts entries which were accounted for without being read (i.e. loaded
+	from a histogram bank), which count towards the progress but not towards the event rate. Finish prints the final totals.
+
+	The read rate is taken from the bytes read by every ROOT file of the process (TFile::GetFileBytesRead), so stages which run
+	side by side (see Pipeline) each report the combined rate, and RNTuple inputs are not counted. Log lines start with
+	"progress" and always give the same keys:
+		progress stage=<label> state=<running|done> entries=<n> total=<n> percent=<p> elapsed_s=<t> events_per_s=<r>
+			mb_per_s=<r> eta_s=<t>
+*/
+#include "ProgressReporter.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <TFile.h>
+
+ProgressSettings ProgressReporter::settings;
+
+ProgressSettings::ProgressSettings(const RunOptions& options)
+{
+	std::string name = options.GetString("ProgressMode", "terminal");
+	if(name == "log")
+		mode = ProgressMode::Log;
+	else if(name == "off")
+		mode = ProgressMode::Off;
+	else if(name != "terminal")
+		std::cerr<<"Unknown ProgressMode "<<name<<" at ProgressSettings::ProgressSettings()! Using terminal."<<std::endl;
+	interval = options.GetDouble("ProgressInterval", mode == ProgressMode::Log ? 30.0 : 1.0);
+	if(interval < 0.0)
+		interval = 0.0;
+}
+
+void ProgressSettings::Print() const
+{
+	if(mode == ProgressMode::Log)
+		std::cout<<"Progress: log lines every "<<interval<<" s"<<std::endl;
+	else if(mode == ProgressMode::Off)
+		std::cout<<"Progress: off"<<std::endl;
+}
+
+/*
+	The clock is read about every thousandth of the loop, but at least every 1024 entries and at most every entry. done is the
+	number of entries already handled before the loop starts (i.e. a resumed job), which are not counted in the rates.
+*/
+ProgressReporter::ProgressReporter(const std::string& label, long long total, long long d, std::mutex* lock) :
+	stage_label(label), total_entries(total), start_done(d), start_bytes(TFile::GetFileBytesRead()),
+	stride(std::max(1LL, std::min(1024LL, total/1000))), start_time(Clock::now()), done(d), skipped(0), next_check(d + stride),
+	next_report((long long)(settings.interval*1.0e9)), print_lock(lock == nullptr ? &own_lock : lock), finished(false)
+{
+}
+
+ProgressReporter::~ProgressReporter() {}
+
+void ProgressReporter::Configure(const ProgressSettings& progress_settings)
+{
+	settings = progress_settings;
+}
+
+//Only the thread which moves next_report on prints, so a report is never given twice
+void ProgressReporter::Check(long long now)
+{
+	next_check.store(now + stride, std::memory_order_relaxed);
+	if(settings.mode == ProgressMode::Off)
+		return;
+	long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time).count();
+	long long due = next_report.load(std::memory_order_relaxed);
+	if(elapsed < due || !next_report.compare_exchange_strong(due, elapsed + (long long)(settings.interval*1.0e9)))
+		return;
+	std::lock_guard<std::mutex> guard(*print_lock);
+	Print(now, false);
+}
+
+//Must be called once every thread using the reporter is done
+void ProgressReporter::Finish()
+{
+	if(finished)
+		return;
+	finished = true;
+	if(settings.mode == ProgressMode::Off)
+		return;
+	std::lock_guard<std::mutex> guard(*print_lock);
+	Print(done.load(), true);
+}
+
+std::string ProgressReporter::FormatTime(double seconds)
+{
+	long long s = (long long)(seconds + 0.5);
+	std::stringstream time;
+	time<<s/3600<<":"<<std::setfill('0')<<std::setw(2)<<(s/60)%60<<":"<<std::setw(2)<<s%60;
+	return time.str();
+}
+
+void ProgressReporter::Print(long long now, bool final)
+{
+	double elapsed = std::chrono::duration<double>(Clock::now() - start_time).count();
+	double percent = total_entries > 0 ? std::min(100.0, now*100.0/total_entries) : 100.0;
+	double events_per_s = 0.0, mb_per_s = 0.0, eta = 0.0;
+	if(elapsed > 0.0)
+	{
+		events_per_s = (now - start_done - skipped.load(std::memory_order_relaxed))/elapsed;
+		mb_per_s = (TFile::GetFileBytesRead() - start_bytes)*1.0e-6/elapsed;
+		double progress_rate = (now - start_done)/elapsed;
+		if(progress_rate > 0.0 && !final)
+			eta = std::max(0LL, total_entries - now)/progress_rate;
+	}
+
+	std::stringstream line;
+	line<<std::fixed;
+	if(settings.mode == ProgressMode::Log)
+	{
+		line<<"progress stage="<<stage_label<<" state="<<(final ? "done" : "running")<<" entries="<<now<<" total="<<total_entries
+			<<std::setprecision(1)<<" percent="<<percent<<std::setprecision(3)<<" elapsed_s="<<elapsed
+			<<std::setprecision(1)<<" events_per_s="<<events_per_s<<std::setprecision(3)<<" mb_per_s="<<mb_per_s
+			<<std::setprecision(1)<<" eta_s="<<eta;
+		std::cout<<line.str()<<std::endl;
+		return;
+	}
+
+	line<<"\r"<<stage_label<<": "<<std::setprecision(1)<<percent<<"% ("<<now<<"/"<<total_entries<<")  ";
+	line<<std::setprecision(2)<<events_per_s*1.0e-3<<" kevt/s  "<<mb_per_s<<" MB/s  ";
+	if(final)
+		line<<"in "<<FormatTime(elapsed);
+	else
+		line<<"ETA "<<FormatTime(eta);
+	line<<"    "; //covers the end of a longer line before
+	std::cout<<line.str();
+	if(final)
+		std::cout<<std::endl;
+	else
+		std::cout<<std::flush;
+}
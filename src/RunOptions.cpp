@@ -0,0 +1,119 @@
+/*
+	RunOptions
+	Wrapper around std::unordered_map which gives access to the optional settings of a run. Optional settings are given
+	in the input file after all of the required entries, one per line, using the same "Key: value" format as the rest of
+	the file (i.e. TreeCacheSize: 100). Lines starting with # are ignored.
+
+	Key methods are the Get functions. If a setting was not given in the input file, the passed default is returned, so
+	every optional setting must have a sensible default, which reproduces the standard behavior wherever it can (the read
+	cache of IOPolicy is on by default).
+*/
+#include "RunOptions.h"
+#include <sstream>
+#include <iostream>
+
+RunOptions::RunOptions() {}
+
+RunOptions::~RunOptions() {}
+
+/*
+	Reads the remainder of an input file. The stream should already be positioned after the required entries.
+*/
+void RunOptions::FillMap(std::istream& input)
+{
+	std::string line, key, value;
+	while(std::getline(input, line))
+	{
+		std::stringstream linestream(line);
+		if(!(linestream>>key) || key[0] == '#')
+			continue;
+		if(key.back() == ':')
+			key.pop_back();
+
+		std::getline(linestream>>std::ws, value);
+		while(!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r'))
+			value.pop_back();
+		if(value.empty())
+		{
+			std::cerr<<"Optional setting "<<key<<" has no value at RunOptions::FillMap! Skipping."<<std::endl;
+			continue;
+		}
+		map[key] = value;
+	}
+}
+
+std::string RunOptions::GetString(const std::string& key, const std::string& default_value) const
+{
+	auto iter = map.find(key);
+	if(iter == map.end())
+		return default_value;
+	return iter->second;
+}
+
+long RunOptions::GetLong(const std::string& key, long default_value) const
+{
+	auto iter = map.find(key);
+	if(iter == map.end())
+		return default_value;
+	try
+	{
+		return std::stol(iter->second);
+	}
+	catch(std::exception& e)
+	{
+		std::cerr<<"Optional setting "<<key<<" has non-integer value "<<iter->second<<" at RunOptions::GetLong! Using default "<<default_value<<"."<<std::endl;
+		return default_value;
+	}
+}
+
+int RunOptions::GetInt(const std::string& key, int default_value) const
+{
+	return (int) GetLong(key, default_value);
+}
+
+double RunOptions::GetDouble(const std::string& key, double default_value) const
+{
+	auto iter = map.find(key);
+	if(iter == map.end())
+		return default_value;
+	try
+	{
+		return std::stod(iter->second);
+	}
+	catch(std::exception& e)
+	{
+		std::cerr<<"Optional setting "<<key<<" has non-numeric value "<<iter->second<<" at RunOptions::GetDouble! Using default "<<default_value<<"."<<std::endl;
+		return default_value;
+	}
+}
+
+bool RunOptions::GetBool(const std::string& key, bool default_value) const
+{
+	auto iter = map.find(key);
+	if(iter == map.end())
+		return default_value;
+	const std::string& value = iter->second;
+	if(value == "1" || value == "true" || value == "on" || value == "yes")
+		return true;
+	else if(value == "0" || value == "false" || value == "off" || value == "no")
+		return false;
+
+	std::cerr<<"Optional setting "<<key<<" has non-boolean value "<<value<<" at RunOptions::GetBool! Using default "<<default_value<<"."<<std::endl;
+	return default_value;
+}
+
+/*
+	The given settings as key=value pairs, in the order given, for hashing the settings a stage depends on (see Pipeline).
+	Settings which were not given are left out (so giving a setting explicitly at its default value still counts as a change).
+*/
+std::string RunOptions::GetSettings(const std::vector<std::string>& keys) const
+{
+	std::string settings;
+	for(auto& key : keys)
+	{
+		auto iter = map.find(key);
+		if(iter != map.end())
+			settings += key + "=" + iter->second + ";";
+	}
+	return settings;
+}
@@ -0,0 +1,211 @@
+/*
+	RunPrefetcher
+	Class which warms the upcoming raw run files into the OS page cache while the current run is being converted, so that
+	the organize-data loop does not alternate between cold disk reads and computation. A background thread hints the kernel
+	(posix_fadvise) and then reads each of the next few files through once. Settings are taken from the optional entries of
+	the input file (see RunOptions):
+		PrefetchRuns: number of runs ahead of the current run to warm (0 disables prefetching)
+		PrefetchMemoryMB: maximum amount of data warmed ahead of the current run at any time
+
+	Key methods are Start, which is given the full list of files before the loop, and BeginRun, which should be called just
+	before each file is processed. BeginRun moves the prefetch window and reports how much of the file was warmed and how
+	much of it is resident in the page cache.
+*/
+#include "RunPrefetcher.h"
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Defaults: prefetching off, at most 1 GB warmed ahead
+RunPrefetcher::RunPrefetcher() :
+	depth(0), memory_cap(1024LL*1024*1024), current(-1), stop_flag(false)
+{
+}
+
+RunPrefetcher::RunPrefetcher(const RunOptions& options) :
+	RunPrefetcher()
+{
+	depth = options.GetInt("PrefetchRuns", depth);
+	memory_cap = options.GetLong("PrefetchMemoryMB", memory_cap/(1024*1024))*1024*1024;
+	if(depth < 0)
+		depth = 0;
+}
+
+RunPrefetcher::~RunPrefetcher()
+{
+	Stop();
+}
+
+void RunPrefetcher::Start(const std::vector<std::string>& files)
+{
+	Stop();
+
+	file_list = files;
+	file_sizes.assign(files.size(), 0);
+	warmed_bytes.assign(files.size(), 0);
+	attempted.assign(files.size(), false);
+	current = -1;
+	stop_flag = false;
+
+	struct stat info;
+	for(unsigned int i=0; i<file_list.size(); i++)
+	{
+		if(stat(file_list[i].c_str(), &info) == 0)
+			file_sizes[i] = info.st_size;
+	}
+
+	if(IsEnabled() && file_list.size() > 1)
+		worker = std::thread(&RunPrefetcher::Worker, this);
+}
+
+/*
+	Moves the prefetch window to the given file and reports on it. The residency is measured before the file is opened, so
+	it reflects what the prefetcher (or an earlier read) left in the page cache.
+*/
+void RunPrefetcher::BeginRun(int index)
+{
+	if(!IsEnabled() || index < 0 || index >= (int) file_list.size())
+		return;
+
+	long long warmed;
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		current = index;
+		warmed = warmed_bytes[index];
+	}
+	cond.notify_all();
+
+	if(index == 0)
+		return; //nothing could be warmed ahead of the first run
+
+	double resident = GetResidentFraction(file_list[index]);
+	std::cout<<"Prefetch: "<<warmed/(1024.0*1024.0)<<" MB of "<<file_sizes[index]/(1024.0*1024.0)<<" MB warmed ahead, ";
+	if(resident < 0.0)
+		std::cout<<"page cache residency unavailable"<<std::endl;
+	else
+		std::cout<<resident*100.0<<"% resident in page cache"<<std::endl;
+}
+
+void RunPrefetcher::Stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		stop_flag = true;
+	}
+	cond.notify_all();
+	if(worker.joinable())
+		worker.join();
+}
+
+void RunPrefetcher::Print() const
+{
+	if(IsEnabled())
+		std::cout<<"Prefetching "<<depth<<" run(s) ahead, at most "<<memory_cap/(1024*1024)<<" MB"<<std::endl;
+	else
+		std::cout<<"Run prefetching: off"<<std::endl;
+}
+
+/*
+	Picks the next file inside the window (current+1 to current+depth) which has not been warmed yet, as long as the data
+	already warmed ahead of the current run plus the new file stays under the memory cap. Sleeps until BeginRun moves the
+	window otherwise.
+*/
+void RunPrefetcher::Worker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!stop_flag)
+	{
+		int next = -1;
+		long long ahead = 0;
+		for(int i=current+1; i<=current+depth && i<(int)file_list.size(); i++)
+		{
+			if(attempted[i])
+				ahead += warmed_bytes[i];
+			else if(next == -1)
+				next = i;
+		}
+
+		if(next == -1 || ahead + file_sizes[next] > memory_cap)
+		{
+			cond.wait(lock);
+			continue;
+		}
+
+		attempted[next] = true;
+		lock.unlock();
+		long long bytes = WarmFile(next);
+		lock.lock();
+		warmed_bytes[next] = bytes;
+	}
+}
+
+/*
+	Reads the file through in large chunks so the kernel populates the page cache. Stops early if the loop has already
+	reached this file (any further reading would only compete with the conversion) or if the prefetcher is stopped.
+*/
+long long RunPrefetcher::WarmFile(int index)
+{
+	int fd = open(file_list[index].c_str(), O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+	std::vector<char> buffer(chunk_size);
+	long long total = 0;
+	ssize_t nread;
+	while((nread = read(fd, buffer.data(), chunk_size)) > 0)
+	{
+		total += nread;
+		std::lock_guard<std::mutex> guard(mutex);
+		if(stop_flag || current >= index)
+			break;
+	}
+	close(fd);
+	return total;
+}
+
+/*
+	Fraction of the pages of a file which are currently in the page cache. Returns -1 if it could not be determined.
+*/
+double RunPrefetcher::GetResidentFraction(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0)
+		return -1.0;
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return -1.0;
+	}
+
+	void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(addr == MAP_FAILED)
+		return -1.0;
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	size_t npages = (info.st_size + page_size - 1)/page_size;
+#ifdef __APPLE__
+	std::vector<char> pages(npages);
+#else
+	std::vector<unsigned char> pages(npages);
+#endif
+	double fraction = -1.0;
+	if(mincore(addr, info.st_size, pages.data()) == 0)
+	{
+		size_t resident = 0;
+		for(auto& page : pages)
+			if(page & 1)
+				resident++;
+		fraction = ((double)resident)/npages;
+	}
+	munmap(addr, info.st_size);
+	return fraction;
+}
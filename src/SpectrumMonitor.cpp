@@ -0,0 +1,167 @@
+/*
+	SpectrumMonitor
+	Statistics-driven early termination of a calibration pass. Each channel which is calibrated is given the number of peaks
+	its spectrum should contain; once every live channel has at least EarlyStopCounts counts per expected peak, there is
+	nothing more to gain from reading data and the pass can stop. A channel is live if it has at least EarlyStopLiveFraction
+	of the median counts of the channels with data, so that dead or nearly dead channels do not hold up the pass.
+
+	Settings are taken from the optional entries of the input file (see RunOptions):
+		EarlyStopCounts: counts needed per expected peak (default 0 disables early termination)
+		EarlyStopInterval: number of entries each thread reads between checks (default 100000)
+		EarlyStopLiveFraction: fraction of the median channel counts below which a channel is not waited on (default 0.05)
+
+	Update is the stop check of a FileProcessor (see SetStopCheck; Attach installs it): it is called on the thread of a slot, reads the
+	channel_<gchan> spectra of that slot's own table, and merges the counts of every slot. Once the pass is over, Finish takes
+	the final counts of every slot and reports the channels which did not reach their target.
+*/
+#include "SpectrumMonitor.h"
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <TH1.h>
+
+EarlyStopSettings::EarlyStopSettings(const RunOptions& options)
+{
+	counts_per_peak = options.GetDouble("EarlyStopCounts", counts_per_peak);
+	check_interval = options.GetLong("EarlyStopInterval", check_interval);
+	if(check_interval < 1)
+		check_interval = 1;
+	live_fraction = options.GetDouble("EarlyStopLiveFraction", live_fraction);
+}
+
+void EarlyStopSettings::Print() const
+{
+	if(IsEnabled())
+		std::cout<<"Early termination: "<<counts_per_peak<<" counts per peak, checked every "<<check_interval<<" entries per thread"<<std::endl;
+}
+
+SpectrumMonitor::SpectrumMonitor(const EarlyStopSettings& s, int nslots, int nchannels) :
+	settings(s), slot_counts(nslots, std::vector<double>(nchannels, 0.0)), totals(nchannels, 0.0), targets(nchannels, 0.0),
+	done_flag(false)
+{
+}
+
+SpectrumMonitor::~SpectrumMonitor() {}
+
+void SpectrumMonitor::SetPeaks(int gchan, int npeaks)
+{
+	if(gchan < 0 || gchan >= (int) targets.size())
+		return;
+	targets[gchan] = npeaks*settings.counts_per_peak;
+}
+
+//Must be called with the mutex held
+double SpectrumMonitor::GetLiveThreshold() const
+{
+	std::vector<double> counts;
+	for(size_t i=0; i<targets.size(); i++)
+	{
+		if(targets[i] > 0.0 && totals[i] > 0.0)
+			counts.push_back(totals[i]);
+	}
+	if(counts.size() == 0)
+		return -1.0;
+	std::nth_element(counts.begin(), counts.begin() + counts.size()/2, counts.end());
+	return settings.live_fraction*counts[counts.size()/2];
+}
+
+/*
+	Only the table of the calling slot is read, which is safe as only that slot's thread fills it. The counts of the other
+	slots are those of their last update, so the totals can only lag behind the data.
+*/
+bool SpectrumMonitor::Update(int slot, THashTable* table)
+{
+	if(!settings.IsEnabled() || slot < 0 || slot >= (int) slot_counts.size())
+		return false;
+
+	std::vector<double> counts(targets.size(), 0.0);
+	std::string name;
+	for(size_t i=0; i<targets.size(); i++)
+	{
+		if(targets[i] <= 0.0)
+			continue;
+		name = "channel_"+std::to_string(i);
+		TH1* histo = (TH1*) table->FindObject(name.c_str());
+		if(histo != nullptr)
+			counts[i] = histo->Integral();
+	}
+
+	std::lock_guard<std::mutex> guard(mutex);
+	slot_counts[slot].swap(counts);
+	std::fill(totals.begin(), totals.end(), 0.0);
+	for(auto& row : slot_counts)
+		for(size_t i=0; i<totals.size(); i++)
+			totals[i] += row[i];
+	if(done_flag)
+		return true;
+
+	double live = GetLiveThreshold();
+	if(live < 0.0)
+		return false;
+	for(size_t i=0; i<targets.size(); i++)
+	{
+		if(targets[i] > 0.0 && totals[i] >= live && totals[i] < targets[i])
+			return false;
+	}
+	done_flag = true;
+	return true;
+}
+
+//Does nothing if early termination is disabled. The tables must outlive the pass.
+void SpectrumMonitor::Attach(FileProcessor& processor, const std::vector<THashTable*>& slot_tables)
+{
+	if(!settings.IsEnabled())
+		return;
+	processor.SetStopCheck([this, &slot_tables](int slot)
+	{
+		return Update(slot, slot_tables[slot]);
+	}, settings.check_interval);
+}
+
+//Called after the pass, before the slot tables are merged
+void SpectrumMonitor::Finish(const std::vector<THashTable*>& slot_tables)
+{
+	if(!settings.IsEnabled())
+		return;
+	for(size_t i=0; i<slot_tables.size(); i++)
+		Update(i, slot_tables[i]);
+	Report();
+}
+
+void SpectrumMonitor::Report() const
+{
+	if(!settings.IsEnabled())
+		return;
+
+	std::lock_guard<std::mutex> guard(mutex);
+	double live = GetLiveThreshold();
+	std::vector<int> short_list, dead_list;
+	int nmonitored = 0;
+	for(size_t i=0; i<targets.size(); i++)
+	{
+		if(targets[i] <= 0.0)
+			continue;
+		nmonitored++;
+		if(live < 0.0 || totals[i] < live)
+			dead_list.push_back(i);
+		else if(totals[i] < targets[i])
+			short_list.push_back(i);
+	}
+
+	std::cout<<"Spectrum statistics: "<<nmonitored-(int)(short_list.size()+dead_list.size())<<" of "<<nmonitored<<" channels reached "<<settings.counts_per_peak<<" counts per peak";
+	std::cout<<(done_flag ? " (stopped early)" : "")<<std::endl;
+	if(short_list.size() > 0)
+	{
+		std::cout<<"Channels below target:";
+		for(auto gchan : short_list)
+			std::cout<<" "<<gchan<<"("<<totals[gchan]<<"/"<<targets[gchan]<<")";
+		std::cout<<std::endl;
+	}
+	if(dead_list.size() > 0)
+	{
+		std::cout<<"Channels without enough data to be considered live:";
+		for(auto gchan : dead_list)
+			std::cout<<" "<<gchan<<"("<<totals[gchan]<<")";
+		std::cout<<std::endl;
+	}
+}
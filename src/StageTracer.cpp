@@ -0,0 +1,176 @@
+/*
+	StageTracer
+	Scoped timers for finding where the time of a stage goes. Two kinds of timer are placed in the code through macros:
+		ANASEN_TRACE_SCOPE(name): records a span (start and duration on its thread) for each pass through the scope. Used
+		for the phases of a stage (filling, peak finding, fitting, writing), which run a few thousand times at most.
+		ANASEN_TRACE_ACCUMULATE(name): only adds the time and the number of calls to a per-thread total. Used inside the event
+		loop (reading an entry, filling a histogram), where recording every pass would cost more than the work measured.
+	Names are string literals of the form Stage/phase, and the summary is grouped by the stage part.
+
+	The macros expand to nothing unless built with tracing (make TRACE=1, which defines ANASEN_TRACE), so a normal build pays
+	nothing. With tracing, each thread records into its own buffer (no locking outside of the first record of a thread), and
+	at the end of the program the spans are written as a Chrome trace-event JSON file (open in Perfetto or chrome://tracing)
+	by WriteTrace, and the spans and totals of every name are summed over threads by PrintSummary. Both must only be called
+	once every traced thread has finished.
+*/
+#include "StageTracer.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+StageTracer::StageTracer() :
+	origin(Clock::now())
+{
+}
+
+StageTracer& StageTracer::Get()
+{
+	static StageTracer tracer;
+	return tracer;
+}
+
+//Buffers are owned by the tracer, so they outlive the worker threads which filled them
+StageTracer::ThreadBuffer& StageTracer::GetBuffer()
+{
+	thread_local ThreadBuffer* buffer = nullptr;
+	if(buffer == nullptr)
+	{
+		std::lock_guard<std::mutex> guard(buffer_mutex);
+		buffers.emplace_back(new ThreadBuffer());
+		buffer = buffers.back().get();
+		buffer->thread = buffers.size() - 1;
+	}
+	return *buffer;
+}
+
+void StageTracer::AddSpan(const char* name, const Clock::time_point& start, const Clock::time_point& stop)
+{
+	Span span;
+	span.name = name;
+	span.start = std::chrono::duration_cast<std::chrono::nanoseconds>(start - origin).count();
+	span.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+	GetBuffer().spans.push_back(span);
+}
+
+void StageTracer::AddTotal(const char* name, const Clock::time_point& start, const Clock::time_point& stop)
+{
+	long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+	std::vector<Total>& totals = GetBuffer().totals;
+	for(auto& total : totals)
+	{
+		if(total.name == name)
+		{
+			total.calls++;
+			total.duration += duration;
+			return;
+		}
+	}
+	Total total;
+	total.name = name;
+	total.calls = 1;
+	total.duration = duration;
+	totals.push_back(total);
+}
+
+/*
+	Chrome trace-event format: one complete ("X") event per span, with times in microseconds, and a thread_name metadata
+	event per thread. The totals have no place on a timeline, so they are only given by PrintSummary.
+*/
+bool StageTracer::WriteTrace(const std::string& filename) const
+{
+	std::ofstream output(filename);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open trace file "<<filename<<" at StageTracer::WriteTrace()!"<<std::endl;
+		return false;
+	}
+
+	long long nspans = 0;
+	output<<"{\"traceEvents\":["<<std::endl;
+	output<<std::fixed<<std::setprecision(3);
+	bool first = true;
+	for(auto& buffer : buffers)
+	{
+		output<<(first ? "" : ",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"<<buffer->thread
+			  <<",\"args\":{\"name\":\""<<(buffer->thread == 0 ? "main" : "thread "+std::to_string(buffer->thread))<<"\"}}";
+		first = false;
+		for(auto& span : buffer->spans)
+		{
+			output<<",\n{\"name\":\""<<span.name<<"\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":"<<buffer->thread
+				  <<",\"ts\":"<<span.start*1.0e-3<<",\"dur\":"<<span.duration*1.0e-3<<"}";
+			nspans++;
+		}
+	}
+	output<<std::endl<<"],\"displayTimeUnit\":\"ms\"}"<<std::endl;
+	std::cout<<"Wrote "<<nspans<<" trace spans from "<<buffers.size()<<" thread(s) to "<<filename<<std::endl;
+	return true;
+}
+
+/*
+	One line per name, summed over threads and grouped by stage. Span lines give the wall time of each pass; since passes on
+	different threads overlap, the total of a name run on several threads can exceed the wall time of the stage. Total lines
+	(marked *) are the time summed over every thread.
+*/
+void StageTracer::PrintSummary() const
+{
+	struct Entry
+	{
+		long long calls = 0;
+		long long duration = 0;
+		long long max = 0;
+		bool accumulated = false;
+	};
+	std::map<std::string, Entry> entries;
+	for(auto& buffer : buffers)
+	{
+		for(auto& span : buffer->spans)
+		{
+			Entry& entry = entries[span.name];
+			entry.calls++;
+			entry.duration += span.duration;
+			entry.max = std::max(entry.max, span.duration);
+		}
+		for(auto& total : buffer->totals)
+		{
+			Entry& entry = entries[total.name];
+			entry.calls += total.calls;
+			entry.duration += total.duration;
+			entry.accumulated = true;
+		}
+	}
+
+	std::cout<<"-------------------Stage Timing--------------------"<<std::endl;
+	if(entries.empty())
+	{
+		std::cout<<"Nothing was traced."<<std::endl;
+		return;
+	}
+	std::cout<<std::left<<std::setw(28)<<"Phase"<<std::right<<std::setw(12)<<"Calls"<<std::setw(14)<<"Total (s)"
+			 <<std::setw(14)<<"Mean (us)"<<std::setw(14)<<"Max (ms)"<<std::endl;
+	std::string stage, phase;
+	size_t split;
+	for(auto& item : entries)
+	{
+		split = item.first.find('/');
+		std::string name_stage = split == std::string::npos ? item.first : item.first.substr(0, split);
+		phase = split == std::string::npos ? "" : item.first.substr(split+1);
+		if(name_stage != stage)
+		{
+			stage = name_stage;
+			std::cout<<stage<<std::endl;
+		}
+
+		const Entry& entry = item.second;
+		std::cout<<std::left<<std::setw(28)<<("  "+phase+(entry.accumulated ? " *" : ""))<<std::right<<std::setw(12)<<entry.calls
+				 <<std::fixed<<std::setprecision(3)<<std::setw(14)<<entry.duration*1.0e-9
+				 <<std::setw(14)<<(entry.calls > 0 ? entry.duration*1.0e-3/entry.calls : 0.0);
+		if(entry.accumulated)
+			std::cout<<std::setw(14)<<"-"<<std::endl;
+		else
+			std::cout<<std::setw(14)<<entry.max*1.0e-6<<std::endl;
+	}
+	std::cout<<std::defaultfloat<<"* time summed over every thread"<<std::endl;
+	std::cout<<"---------------------------------------------------"<<std::endl;
+}
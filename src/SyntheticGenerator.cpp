@@ -0,0 +1,421 @@
+/*
+	SyntheticGenerator
+	Writes synthetic raw ANASEN data with a known calibration, so that every stage can be run, benchmarked, and checked without
+	the experiment files. Each channel of the channel map is given a true zero offset (ADC) and a true gain (ADC per MeV), and
+	hits are turned into raw ADC values by adc = offset + gain*charge plus gaussian noise. Two kinds of run are made, in the raw
+	DataTree format of evt2root (mb1/mb2 energy and time arrays, -1 for a channel without a hit):
+		Pulser: every channel fires in every event, with the pulser amplitude stepping through the front (SX3 fronts, QQQ rings)
+		and back (SX3 backs, QQQ wedges) pulser values. The amplitudes are scaled to ADC by FrontPulserADC and BackPulserADC.
+		Alpha: each event has a Poisson number of particles (Multiplicity), each with one of the alpha energies, smeared by the
+		resolution, in a random detector. A QQQ particle fires one wedge and one ring; an SX3 particle fires one back and both
+		ends of one front strip, with the charge shared between the upstream and downstream ends by a random position. Noise hits
+		(a Poisson number per event, NoiseHits) add small signals on random channels.
+	Runs are organized with DataOrganizer like any other raw data, so the organized EventTree follows the same channel map.
+
+	Settings are taken from the optional entries of the input file (see RunOptions), all starting with Synthetic (see the
+	README). The truth is drawn from the seed, so the same settings always give the same calibration.
+
+	WriteTruth writes the true calibration in the format of each stage's output file. For the gain-matching files it needs the
+	reference back and wedge channels used by MatchBacks. Validate compares the outputs of the stages with the truth. It gives
+	the zero offsets, and the energy of each alpha line as calibrated by the full chain of files (see CalibrationSnapshot), for
+	every back, wedge and ring. SX3 fronts have no calibration of their own, so they are not checked.
+*/
+#include "SyntheticGenerator.h"
+#include "CalibrationSnapshot.h"
+#include "ZeroCalMap.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <TFile.h>
+#include <TTree.h>
+
+static const double noise_charge = 0.1; //MeV, sigma of the noise hits
+static const int adc_max = 16383;
+
+//Values separated by spaces or commas
+static std::vector<double> ParseValues(const std::string& text, const std::vector<double>& default_values)
+{
+	std::string spaced = text;
+	std::replace(spaced.begin(), spaced.end(), ',', ' ');
+	std::stringstream stream(spaced);
+	std::vector<double> values;
+	double value;
+	while(stream>>value)
+		values.push_back(value);
+	if(values.empty() || !stream.eof())
+	{
+		if(!text.empty())
+			std::cerr<<"Bad list of values "<<text<<" at SyntheticSettings::SyntheticSettings()! Using the default."<<std::endl;
+		return default_values;
+	}
+	return values;
+}
+
+SyntheticSettings::SyntheticSettings(const RunOptions& options)
+{
+	events = options.GetLong("SyntheticEvents", events);
+	pulser_runs = options.GetInt("SyntheticPulserRuns", pulser_runs);
+	seed = options.GetLong("SyntheticSeed", seed);
+	offset_min = options.GetDouble("SyntheticOffsetMin", offset_min);
+	offset_max = options.GetDouble("SyntheticOffsetMax", offset_max);
+	gain = options.GetDouble("SyntheticGain", gain);
+	gain_spread = options.GetDouble("SyntheticGainSpread", gain_spread);
+	front_pulser_adc = options.GetDouble("SyntheticFrontPulserADC", front_pulser_adc);
+	back_pulser_adc = options.GetDouble("SyntheticBackPulserADC", back_pulser_adc);
+	front_pulses = ParseValues(options.GetString("SyntheticFrontPulses", ""), front_pulses);
+	back_pulses = ParseValues(options.GetString("SyntheticBackPulses", ""), back_pulses);
+	alpha_energies = ParseValues(options.GetString("SyntheticAlphaEnergies", ""), alpha_energies);
+	multiplicity = options.GetDouble("SyntheticMultiplicity", multiplicity);
+	resolution = options.GetDouble("SyntheticResolution", resolution);
+	noise = options.GetDouble("SyntheticNoise", noise);
+	noise_hits = options.GetDouble("SyntheticNoiseHits", noise_hits);
+	truth_prefix = options.GetString("SyntheticTruthPrefix", truth_prefix);
+	if(events < 0)
+		events = 0;
+	if(gain <= 0.0)
+	{
+		std::cerr<<"SyntheticGain must be positive at SyntheticSettings::SyntheticSettings()! Using 900."<<std::endl;
+		gain = 900.0;
+	}
+}
+
+void SyntheticSettings::Print() const
+{
+	std::cout<<"Synthetic data: "<<events<<" events per run, "<<pulser_runs<<" pulser run(s), seed "<<seed<<std::endl;
+	std::cout<<"Synthetic channels: offsets "<<offset_min<<" to "<<offset_max<<" ADC, gain "<<gain<<" ADC/MeV +/- "<<gain_spread*100.0<<"%"<<std::endl;
+	std::cout<<"Synthetic alphas: multiplicity "<<multiplicity<<", resolution "<<resolution<<" MeV, noise "<<noise<<" ADC, "<<noise_hits
+			 <<" noise hits per event"<<std::endl;
+}
+
+SyntheticGenerator::SyntheticGenerator(const std::string& channelfile, const SyntheticSettings& s) :
+	cmap(channelfile), channel_name(channelfile), settings(s), generator(s.seed)
+{
+	MakeTruth();
+}
+
+SyntheticGenerator::~SyntheticGenerator() {}
+
+/*
+	Draws the offset and gain of every channel, and groups the channels by detector for placing particles. Detectors missing
+	a back or a front are never hit.
+*/
+void SyntheticGenerator::MakeTruth()
+{
+	int nchannels = DetectorGeometry::nchannels;
+	offsets.assign(nchannels, 0.0);
+	gains.assign(nchannels, 0.0);
+	channel_detectors.assign(nchannels, -1);
+	if(!cmap.IsValid())
+		return;
+
+	std::map<int, Detector> grouped;
+	for(int gchan=0; gchan<nchannels; gchan++)
+	{
+		const ChannelData* data = cmap.GetChannelData(gchan);
+		if(data == nullptr)
+			continue;
+		channels.push_back(gchan);
+		offsets[gchan] = generator.Uniform(settings.offset_min, settings.offset_max);
+		gains[gchan] = settings.gain*generator.Uniform(1.0 - settings.gain_spread, 1.0 + settings.gain_spread);
+
+		Detector& detector = grouped[((int) data->detectorType)*100 + data->detectorID];
+		detector.sx3 = data->IsSX3();
+		if(data->IsBackLike())
+			detector.backs.push_back(gchan);
+		else if(data->detectorComponent == DetectorComponent::Ring)
+			detector.fronts.push_back(gchan);
+		else if(data->detectorDirection == DetectorDirection::Up)
+		{
+			int partner = cmap.FindPartnerStrip(gchan);
+			if(partner != -1)
+				detector.strips.push_back(Strip{gchan, partner});
+		}
+	}
+
+	for(auto& item : grouped)
+	{
+		Detector& detector = item.second;
+		if(detector.backs.empty() || (detector.sx3 ? detector.strips.empty() : detector.fronts.empty()))
+			continue;
+		for(auto& gchan : detector.backs)
+			channel_detectors[gchan] = detectors.size();
+		for(auto& gchan : detector.fronts)
+			channel_detectors[gchan] = detectors.size();
+		for(auto& strip : detector.strips)
+			channel_detectors[strip.up] = channel_detectors[strip.down] = detectors.size();
+		detectors.push_back(detector);
+	}
+}
+
+//Charges of -1 mark channels without a hit
+static inline void AddCharge(std::vector<double>& charges, int gchan, double charge)
+{
+	charges[gchan] = (charges[gchan] < 0.0 ? 0.0 : charges[gchan]) + charge;
+}
+
+void SyntheticGenerator::AddParticle(std::vector<double>& charges)
+{
+	if(detectors.empty() || settings.alpha_energies.empty())
+		return;
+	const Detector& detector = detectors[generator.Integer(detectors.size())];
+	double energy = settings.alpha_energies[generator.Integer(settings.alpha_energies.size())] + generator.Gaus(0.0, settings.resolution);
+	if(energy <= 0.0)
+		return;
+
+	AddCharge(charges, detector.backs[generator.Integer(detector.backs.size())], energy);
+	if(detector.sx3)
+	{
+		const Strip& strip = detector.strips[generator.Integer(detector.strips.size())];
+		double position = generator.Uniform(0.0, 1.0); //fraction of the charge seen at the upstream end
+		AddCharge(charges, strip.up, energy*position);
+		AddCharge(charges, strip.down, energy*(1.0 - position));
+	}
+	else
+		AddCharge(charges, detector.fronts[generator.Integer(detector.fronts.size())], energy);
+}
+
+/*
+	The ADC value is truncated, as the organizer smears each value within its bin, so the organized data is centered on the
+	true value.
+*/
+int SyntheticGenerator::ToADC(int gchan, double charge)
+{
+	if(charge < 0.0)
+		return -1;
+	double adc = offsets[gchan] + gains[gchan]*charge + generator.Gaus(0.0, settings.noise);
+	return std::max(0, std::min(adc_max, (int) std::floor(adc)));
+}
+
+bool SyntheticGenerator::WriteRun(const std::string& filename, SyntheticRunType type)
+{
+	if(!cmap.IsValid())
+	{
+		std::cerr<<"Bad channel map at SyntheticGenerator::WriteRun()! Exiting."<<std::endl;
+		return false;
+	}
+	if(type == SyntheticRunType::Pulser && (settings.front_pulses.empty() || settings.back_pulses.empty()))
+	{
+		std::cerr<<"No pulser values at SyntheticGenerator::WriteRun()! Exiting."<<std::endl;
+		return false;
+	}
+
+	TFile* output = TFile::Open(filename.c_str(), "RECREATE");
+	if(output == nullptr || !output->IsOpen())
+	{
+		std::cerr<<"Unable to create synthetic run "<<filename<<" at SyntheticGenerator::WriteRun()! Exiting."<<std::endl;
+		delete output;
+		return false;
+	}
+	TTree* tree = new TTree("DataTree", "DataTree");
+
+	int mb1_energy[9][32];
+	int mb2_energy[9][32];
+	int mb1_time[9][32];
+	int mb2_time[9][32];
+	tree->Branch("mb1_energy", mb1_energy, "mb1_energy[9][32]/I");
+	tree->Branch("mb1_time", mb1_time, "mb1_time[9][32]/I");
+	tree->Branch("mb2_energy", mb2_energy, "mb2_energy[9][32]/I");
+	tree->Branch("mb2_time", mb2_time, "mb2_time[9][32]/I");
+
+	int nchannels = DetectorGeometry::nchannels, mb2_gchan_offset = 9*32;
+	std::vector<double> charges(nchannels, -1.0);
+	double front_charge, back_charge;
+	int npulses_front = settings.front_pulses.size(), npulses_back = settings.back_pulses.size();
+	int* energy_slot;
+	int* time_slot;
+	for(long i=0; i<settings.events; i++)
+	{
+		std::fill(charges.begin(), charges.end(), -1.0);
+		if(type == SyntheticRunType::Pulser)
+		{
+			front_charge = settings.front_pulses[i % npulses_front]*settings.front_pulser_adc/settings.gain;
+			back_charge = settings.back_pulses[i % npulses_back]*settings.back_pulser_adc/settings.gain;
+			for(auto& gchan : channels)
+				charges[gchan] = cmap.GetChannelData(gchan)->IsFrontLike() ? front_charge : back_charge;
+		}
+		else
+		{
+			int nparticles = generator.Poisson(settings.multiplicity);
+			for(int j=0; j<nparticles; j++)
+				AddParticle(charges);
+			int nnoise = channels.empty() ? 0 : generator.Poisson(settings.noise_hits);
+			for(int j=0; j<nnoise; j++)
+				AddCharge(charges, channels[generator.Integer(channels.size())], std::abs(generator.Gaus(0.0, noise_charge)));
+		}
+
+		for(int gchan=0; gchan<9*32+9*32; gchan++)
+		{
+			if(gchan < mb2_gchan_offset)
+			{
+				energy_slot = &mb1_energy[gchan/32][gchan%32];
+				time_slot = &mb1_time[gchan/32][gchan%32];
+			}
+			else
+			{
+				energy_slot = &mb2_energy[(gchan-mb2_gchan_offset)/32][gchan%32];
+				time_slot = &mb2_time[(gchan-mb2_gchan_offset)/32][gchan%32];
+			}
+			*energy_slot = gchan < nchannels ? ToADC(gchan, charges[gchan]) : -1;
+			*time_slot = *energy_slot == -1 ? -1 : (int) generator.Gaus(1000.0, 10.0);
+		}
+		tree->Fill();
+	}
+
+	output->cd();
+	tree->Write();
+	output->Close();
+	delete output;
+	std::cout<<"Wrote "<<settings.events<<" synthetic "<<(type == SyntheticRunType::Pulser ? "pulser" : "alpha")<<" events to "<<filename<<std::endl;
+	return true;
+}
+
+std::vector<std::string> SyntheticGenerator::GetTruthFiles() const
+{
+	return {channel_name, settings.truth_prefix+"zoffset.txt", settings.truth_prefix+"backgains.txt", settings.truth_prefix+"updowngains.txt",
+			settings.truth_prefix+"frontbackgains.txt", settings.truth_prefix+"ecal.txt"};
+}
+
+//Gain of the channel a back or wedge is matched to by MatchBacks; 0 if there is none
+double SyntheticGenerator::GetReferenceGain(int gchan, int sx3reference, int qqqreference)
+{
+	const ChannelData* data = cmap.GetChannelData(gchan);
+	if(data == nullptr || !data->IsBackLike())
+		return 0.0;
+	int reference = cmap.FindReferenceChannel(gchan, data->IsSX3() ? sx3reference : qqqreference);
+	return reference == -1 ? 0.0 : gains[reference];
+}
+
+/*
+	The true calibration, following the definitions of each stage (see GainMatcher and CalibrationSnapshot). With g the gain of
+	a channel and g_ref that of the reference back or wedge of its detector:
+		backs, wedges: matched to the reference by g_ref/g, and calibrated to MeV by 1/g_ref
+		SX3 upstream fronts: up-down intercept g_down/g_ref and slope -g_down/g_up, front-back intercept 0 and slope 1
+		QQQ rings: front-back slope g_ref/g (the reference wedge), calibrated to MeV by 1/g_ref
+	Every intercept other than the up-down one is 0.
+*/
+bool SyntheticGenerator::WriteTruth(int sx3reference, int qqqreference)
+{
+	std::vector<std::string> names = GetTruthFiles();
+	std::ofstream zero_output(names[1]), back_output(names[2]), updown_output(names[3]), frontback_output(names[4]), energy_output(names[5]);
+	if(!zero_output.is_open() || !back_output.is_open() || !updown_output.is_open() || !frontback_output.is_open() || !energy_output.is_open())
+	{
+		std::cerr<<"Unable to open the truth files "<<settings.truth_prefix<<"* at SyntheticGenerator::WriteTruth()! Exiting."<<std::endl;
+		return false;
+	}
+	zero_output<<std::setprecision(10);
+	back_output<<std::setprecision(10);
+	updown_output<<std::setprecision(10);
+	frontback_output<<std::setprecision(10);
+	energy_output<<std::setprecision(10);
+
+	double reference_gain;
+	for(auto& gchan : channels)
+	{
+		zero_output<<gchan<<"\t"<<offsets[gchan]<<std::endl;
+		if(channel_detectors[gchan] == -1)
+			continue;
+		const Detector& detector = detectors[channel_detectors[gchan]];
+		reference_gain = GetReferenceGain(detector.backs[0], sx3reference, qqqreference);
+		if(reference_gain == 0.0)
+			continue;
+
+		const ChannelData* data = cmap.GetChannelData(gchan);
+		if(data->IsBackLike())
+		{
+			back_output<<gchan<<"\t"<<0<<"\t"<<reference_gain/gains[gchan]<<std::endl;
+			energy_output<<gchan<<"\t"<<0<<"\t"<<1.0/reference_gain<<std::endl;
+		}
+		else if(data->detectorComponent == DetectorComponent::Ring)
+		{
+			frontback_output<<gchan<<"\t"<<0<<"\t"<<reference_gain/gains[gchan]<<std::endl;
+			energy_output<<gchan<<"\t"<<0<<"\t"<<1.0/reference_gain<<std::endl;
+		}
+		else if(data->detectorDirection == DetectorDirection::Up)
+		{
+			int partner = cmap.FindPartnerStrip(gchan);
+			updown_output<<gchan<<"\t"<<gains[partner]/reference_gain<<"\t"<<-gains[partner]/gains[gchan]<<std::endl;
+			frontback_output<<gchan<<"\t"<<0<<"\t"<<1<<std::endl;
+		}
+	}
+	std::cout<<"Wrote the true calibration to "<<settings.truth_prefix<<"*.txt"<<std::endl;
+	return true;
+}
+
+/*
+	Compares the output of each stage with the truth. Offsets are compared directly. Energies are compared at the true ADC value
+	of each alpha line, calibrated with the folded calibration of the stage files, so a channel is only counted if every stage
+	it needs has calibrated it. Returns false if the stage files cannot be loaded.
+*/
+bool SyntheticGenerator::Validate(const std::vector<std::string>& stagefiles)
+{
+	CalibrationSnapshot snapshot(stagefiles[0], stagefiles[1], stagefiles[2], stagefiles[3], stagefiles[4], stagefiles[5]);
+	ZeroCalMap zmap(stagefiles[1]);
+	if(!cmap.IsValid() || !snapshot.IsValid() || !zmap.IsValid())
+	{
+		std::cerr<<"Unable to load the calibration files at SyntheticGenerator::Validate()! Exiting."<<std::endl;
+		return false;
+	}
+
+	struct Deviation
+	{
+		int nchannels = 0;
+		int ncalibrated = 0;
+		double sum = 0.0;
+		double max = 0.0;
+
+		void Add(double deviation)
+		{
+			sum += std::abs(deviation);
+			max = std::max(max, std::abs(deviation));
+		}
+	};
+	Deviation offset_deviation;
+	std::map<std::string, Deviation> energy_deviations; //keV, by component
+
+	const double* linear_gains = snapshot.GetLinearGains();
+	const double* linear_offsets = snapshot.GetLinearOffsets();
+	double adc;
+	for(auto& gchan : channels)
+	{
+		offset_deviation.nchannels++;
+		auto offset = zmap.FindOffset(gchan);
+		if(offset != zmap.End())
+		{
+			offset_deviation.ncalibrated++;
+			offset_deviation.Add(offset->second - offsets[gchan]);
+		}
+
+		const ChannelData* data = cmap.GetChannelData(gchan);
+		if(data->detectorComponent == DetectorComponent::Front)
+			continue;
+		Deviation& deviation = energy_deviations[std::string(data->IsSX3() ? "SX3 " : "QQQ ") + ChannelMap::GetComponentName(data->detectorComponent)];
+		deviation.nchannels++;
+		if(std::isnan(linear_gains[gchan]) || std::isnan(linear_offsets[gchan]))
+			continue;
+		deviation.ncalibrated++;
+		for(auto& energy : settings.alpha_energies)
+		{
+			adc = offsets[gchan] + gains[gchan]*energy;
+			deviation.Add(1000.0*(linear_gains[gchan]*adc + linear_offsets[gchan] - energy));
+		}
+	}
+
+	std::cout<<"--------------Synthetic Calibration Check------------"<<std::endl;
+	std::cout<<std::fixed<<std::setprecision(3);
+	std::cout<<"Zero offsets: "<<offset_deviation.ncalibrated<<" of "<<offset_deviation.nchannels<<" channels, mean |diff| "
+			 <<(offset_deviation.ncalibrated > 0 ? offset_deviation.sum/offset_deviation.ncalibrated : 0.0)<<" ADC, max "<<offset_deviation.max<<" ADC"<<std::endl;
+	for(auto& item : energy_deviations)
+	{
+		const Deviation& deviation = item.second;
+		int npoints = deviation.ncalibrated*settings.alpha_energies.size();
+		std::cout<<item.first<<" energies: "<<deviation.ncalibrated<<" of "<<deviation.nchannels<<" channels, mean |diff| "
+				 <<(npoints > 0 ? deviation.sum/npoints : 0.0)<<" keV, max "<<deviation.max<<" keV"<<std::endl;
+	}
+	std::cout<<std::defaultfloat;
+	std::cout<<"-----------------------------------------------------"<<std::endl;
+	return true;
+}
@@ -10,6 +10,8 @@
 */
 #include "ZeroCalMap.h"
 #include <fstream>
+#include <limits>
+#include <cmath>
 
 ZeroCalMap::ZeroCalMap(const std::string& filename) :
 	valid_flag(false)
@@ -17,6 +19,20 @@ ZeroCalMap::ZeroCalMap(const std::string& filename) :
 	FillMap(filename);
 }
 
+ZeroCalMap::ZeroCalMap(const double* offsets, int size) :
+	valid_flag(false)
+{
+	if(offsets == nullptr)
+		return;
+
+	for(int gchan=0; gchan<size; gchan++)
+	{
+		if(!std::isnan(offsets[gchan]))
+			zmap[gchan] = offsets[gchan];
+	}
+	valid_flag = true;
+}
+
 ZeroCalMap::~ZeroCalMap() {}
 
 void ZeroCalMap::FillMap(const std::string& filename)
@@ -31,8 +47,16 @@ void ZeroCalMap::FillMap(const std::string& filename)
 	int gchan;
 	double offset;
 
-	while(input>>gchan)
+	//Lines starting with # are comments (i.e. the note on a quick-look result)
+	while(input>>std::ws && input.peek() != EOF)
 	{
+		if(input.peek() == '#')
+		{
+			input.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			continue;
+		}
+		if(!(input>>gchan))
+			break;
 		input>>offset;
 		zmap[gchan] = offset;
 	}
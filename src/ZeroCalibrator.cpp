@@ -8,6 +8,9 @@
 */
 #include "ZeroCalibrator.h"
 #include "ZeroCalMap.h"
+#include "FileProcessor.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -16,7 +19,6 @@
 #include <TF1.h>
 #include <TGraph.h>
 #include <TFile.h>
-#include <TTree.h>
 
 //for use with std::sort
 bool SortZeroData(const double i, const double j) 
@@ -30,7 +32,7 @@ bool SortZeroData(const double i, const double j)
 	These may need to be adjusted on an experiment by experiment basis.
 */
 ZeroCalibrator::ZeroCalibrator(const std::string& channelfile) :
-	sigma(25.0), threshold(0.15), cmap(channelfile)
+	sigma(25.0), threshold(0.15), cmap(channelfile), nthreads(1)
 {
 }
 
@@ -39,6 +41,8 @@ ZeroCalibrator::~ZeroCalibrator() {}
 //Wrappers which make, store, and fill histograms
 void ZeroCalibrator::FillHistogram(THashTable* table, const std::string& name, const std::string& title, int bins, double minx, double maxx, double value)
 {
+	ANASEN_TRACE_ACCUMULATE("ZeroCalibrator/fill histogram");
+	ANASEN_PERF_HIT();
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
 	if(histo == nullptr)
 	{
@@ -55,6 +59,8 @@ void ZeroCalibrator::FillHistogram(THashTable* table, const std::string& name, c
 void ZeroCalibrator::FillHistogram(THashTable* table, const std::string& name, const std::string& title, int binsx, double minx, double maxx, double valuex,
 																										int binsy, double miny, double maxy, double valuey)
 {
+	ANASEN_TRACE_ACCUMULATE("ZeroCalibrator/fill histogram");
+	ANASEN_PERF_HIT();
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
 	if(histo == nullptr)
 	{
@@ -74,6 +80,7 @@ void ZeroCalibrator::FillHistogram(THashTable* table, const std::string& name, c
 */
 GraphData ZeroCalibrator::GetPoints(THashTable* table, int gchan, const std::string& name)
 {
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/find peaks");
 	GraphData data;
 
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
@@ -89,9 +96,9 @@ GraphData ZeroCalibrator::GetPoints(THashTable* table, int gchan, const std::str
 	}
 
 	auto channel = cmap.FindChannel(gchan);
-	if(channel->second.detectorComponent == "RING" || channel->second.detectorComponent ==  "FRONT")
+	if(channel->second.detectorComponent == DetectorComponent::Ring || channel->second.detectorComponent == DetectorComponent::Front)
 		threshold = 0.025;
-	else if(channel->second.detectorComponent == "BACK" || channel->second.detectorComponent == "WEDGE")
+	else if(channel->second.detectorComponent == DetectorComponent::Back || channel->second.detectorComponent == DetectorComponent::Wedge)
 		threshold = 0.15;
 
 	int npeaks = spec.Search(histo, sigma, "nobackground", threshold);
@@ -107,13 +114,13 @@ GraphData ZeroCalibrator::GetPoints(THashTable* table, int gchan, const std::str
 		std::cerr<<"At ZeroCalibrator::GetPoints front/ring channel (gchan="<<gchan<<") does not have "<<nfrontpeaks-1<<" peaks (found "<<npeaks<<"). Returning empty data."<<std::endl;
 		return data;
 	}
-	else if ((channel->second.detectorComponent == "FRONT" || channel->second.detectorComponent == "RING") && npeaks != nfrontpeaks &&
+	else if ((channel->second.detectorComponent == DetectorComponent::Front || channel->second.detectorComponent == DetectorComponent::Ring) && npeaks != nfrontpeaks &&
 			(gchan < 224 || gchan > 287) && (gchan <304 || gchan > 319))
 	{
 		std::cerr<<"At ZeroCalibrator::GetPoints front/ring channel (gchan="<<gchan<<") does not have "<<nfrontpeaks<<" peaks (found "<<npeaks<<"). Returning empty data."<<std::endl;
 		return data;
 	}
-	else if ((channel->second.detectorComponent == "BACK" || channel->second.detectorComponent == "WEDGE") && npeaks != nbackpeaks)
+	else if ((channel->second.detectorComponent == DetectorComponent::Back || channel->second.detectorComponent == DetectorComponent::Wedge) && npeaks != nbackpeaks)
 	{
 		std::cerr<<"At ZeroCalibrator::GetPoints back/wedge channel (gchan="<<gchan<<") does not have "<<nbackpeaks<<" peaks (found "<<npeaks<<"). Returning empty data."<<std::endl;
 		return data;
@@ -129,11 +136,11 @@ GraphData ZeroCalibrator::GetPoints(THashTable* table, int gchan, const std::str
 
 	std::sort(data.xvals.begin(), data.xvals.end(), SortZeroData);
 
-	if((channel->second.detectorComponent == "FRONT" || channel->second.detectorComponent == "RING"))
+	if((channel->second.detectorComponent == DetectorComponent::Front || channel->second.detectorComponent == DetectorComponent::Ring))
 	{
 		data.yvals = frontPulseValues;
 	}
-	else if ((channel->second.detectorComponent == "BACK" || channel->second.detectorComponent == "WEDGE"))
+	else if ((channel->second.detectorComponent == DetectorComponent::Back || channel->second.detectorComponent == DetectorComponent::Wedge))
 	{
 		data.yvals = backPulseValues;
 	}
@@ -143,6 +150,7 @@ GraphData ZeroCalibrator::GetPoints(THashTable* table, int gchan, const std::str
 
 GraphData ZeroCalibrator::GetPointsAlphas(THashTable* table, int gchan, const std::string& name)
 {
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/find peaks");
 	GraphData data;
 
 	TH1* histo = (TH1*) table->FindObject(name.c_str());
@@ -176,6 +184,7 @@ GraphData ZeroCalibrator::GetPointsAlphas(THashTable* table, int gchan, const st
 //Wrapper which generates graphs from vectors, fits, and reports fit parameters
 double ZeroCalibrator::MakeGraph(THashTable* table, const std::string& name, const GraphData& data)
 {
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/fit");
 	TGraph* graph = new TGraph(data.xvals.size(), &(data.xvals[0]), &(data.yvals[0]));
 	graph->SetName(name.c_str());
 
@@ -191,132 +200,214 @@ double ZeroCalibrator::MakeGraph(THashTable* table, const std::string& name, con
 }
 
 /*
-	Main loop, takes in an input file and two output files: one output is a ROOT file for plots, the other a textfile
-	for the calibration results
+	Spectrum of each channel for the zero-offset fits. In the case of zero-offset calibrations, each channel should be
+	calibrated independently.
 */
-void ZeroCalibrator::Run(const std::string& inputname, const std::string& plotname, const std::string& outputname)
+void ZeroCalibrator::FillOffsetSpectra(AnasenEvent* event, THashTable* table)
 {
+	ANASEN_PERF_REGION("ZeroCalibrator/fill spectra");
+	std::string name;
+	for(int j=0; j<12; j++)
+	{
+		for(auto& hit : event->barrel1[j].fronts_up)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->barrel1[j].fronts_down)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->barrel1[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+
+		for(auto& hit : event->barrel2[j].fronts_up)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->barrel2[j].fronts_down)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->barrel2[j].backs)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+	}
 
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	if(!input->IsOpen())
+	for(int j=0; j<4; j++)
 	{
-		std::cerr<<"Unable to open input datafile "<<inputname<<"! Quitting."<<std::endl;
+		for(auto& hit : event->fqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->fqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+
+		for(auto& hit : event->bqqq[j].rings)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+		for(auto& hit : event->bqqq[j].wedges)
+		{
+			name = "channel_"+std::to_string(hit.global_chan);
+			FillHistogram(table, name, name, 3746,1400,16384, hit.energy);
+		}
+	}
+}
+
+//Before and after plots of every channel, used to check the results of a zero-offset map
+void ZeroCalibrator::FillOffsetTestPlot(THashTable* table, ZeroCalMap& zmap, const SiliconHit& hit)
+{
+	static const std::string before_name="before_offset_cal";
+	static const std::string before_title="before_offset_cal;Channel;Energy(arb)";
+	static const std::string after_name="after_offset_cal";
+	static const std::string after_title="after_offset_cal;Channel;Energy(arb)";
+
+	FillHistogram(table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
+	auto offset_data = zmap.FindOffset(hit.global_chan);
+	if(offset_data == zmap.End())
 		return;
+	FillHistogram(table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
+}
+
+void ZeroCalibrator::FillOffsetTestPlots(AnasenEvent* event, THashTable* table, ZeroCalMap& zmap)
+{
+	for(int j=0; j<12; j++)
+	{
+		for(auto& hit : event->barrel1[j].fronts_up)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->barrel1[j].fronts_down)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->barrel1[j].backs)
+			FillOffsetTestPlot(table, zmap, hit);
+
+		for(auto& hit : event->barrel2[j].fronts_up)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->barrel2[j].fronts_down)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->barrel2[j].backs)
+			FillOffsetTestPlot(table, zmap, hit);
 	}
-	TTree* intree = (TTree*) input->Get("EventTree");
 
-	AnasenEvent* event = new AnasenEvent();
+	for(int j=0; j<4; j++)
+	{
+		for(auto& hit : event->fqqq[j].rings)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->fqqq[j].wedges)
+			FillOffsetTestPlot(table, zmap, hit);
+
+		for(auto& hit : event->bqqq[j].rings)
+			FillOffsetTestPlot(table, zmap, hit);
+		for(auto& hit : event->bqqq[j].wedges)
+			FillOffsetTestPlot(table, zmap, hit);
+	}
+}
 
-	intree->SetBranchAddress("event", &event);
+/*
+	Main loop, takes in a list of input files and two output files: one output is a ROOT file for plots, the other a textfile
+	for the calibration results. Returns false if any input could not be read or an output could not be written.
+*/
+bool ZeroCalibrator::Run(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname)
+{
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/Run");
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
+	if(!processor.IsValid())
+	{
+		std::cerr<<"No input datafiles given to ZeroCalibrator::Run()! Quitting."<<std::endl;
+		return false;
+	}
 
 	TFile* graphoutput = TFile::Open(plotname.c_str(), "RECREATE");
-	if(!graphoutput->IsOpen())
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
 	{
-		input->Close();
 		std::cerr<<"Unable to create output graph file "<<plotname<<"! Quitting."<<std::endl;
-		return;
+		return false;
 	}
 
 	THashTable* histo_table = new THashTable();
 	THashTable* graph_table = new THashTable();
 
+	//The spectra are raw ADC values, so the bank key does not depend on any other calibration
+	HistogramBank bank(bank_settings, "zero-offset", "raw", nchannels);
+	ZeroCalMap previous(bank.IsEnabled() ? outputname : "");
+
 	std::ofstream output(outputname);
 	if(!output.is_open())
 	{
-		input->Close();
 		graphoutput->Close();
 		std::cerr<<"Unable to open output file "<<outputname<<". Quitting."<<std::endl;
-		return;
+		return false;
 	}
+	io_policy.WriteQuickLookNote(output);
 
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val = 0.05*nentries;
-
-	std::string name;
-	for(int i=0; i<nentries; i++)
+	//Each pulser spectrum needs enough counts in every pulser peak
+	SpectrumMonitor monitor(early_stop, processor.GetNSlots(), nchannels);
+	for(int i=0; i<nchannels; i++)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*5<<"%"<<std::flush;
-		}
+		const ChannelData* channel = cmap.GetChannelData(i);
+		if(channel == nullptr)
+			continue;
+		else if(channel->detectorComponent == DetectorComponent::Front || channel->detectorComponent == DetectorComponent::Ring)
+			monitor.SetPeaks(i, frontPulseValues.size());
+		else if(channel->detectorComponent == DetectorComponent::Back || channel->detectorComponent == DetectorComponent::Wedge)
+			monitor.SetPeaks(i, backPulseValues.size());
+	}
 
-		/*
-			In the case of zero-offset calibrations, each channel should be calibrated
-			independently.
-		*/
-		for(int j=0; j<12; j++)
+	std::vector<THashTable*> slot_tables;
+	bool success;
+	if(bank.IsEnabled())
+	{
+		success = processor.Fill([this](AnasenEvent* event, THashTable* table)
 		{
-			for(auto& hit : event->barrel1[j].fronts_up)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->barrel1[j].fronts_down)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-
-			for(auto& hit : event->barrel2[j].fronts_up)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->barrel2[j].fronts_down)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-		}
-
-		for(int j=0; j<4; j++)
+			FillOffsetSpectra(event, table);
+		}, histo_table, bank);
+	}
+	else
+	{
+		slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+		monitor.Attach(processor, slot_tables);
+		success = processor.Process([this, &slot_tables](AnasenEvent* event, int slot)
 		{
-			for(auto& hit : event->fqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-
-			for(auto& hit : event->bqqq[j].rings)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
-			}
-		}
+			FillOffsetSpectra(event, slot_tables[slot]);
+		});
+		monitor.Finish(slot_tables);
+		FileProcessor::MergeTables(histo_table, slot_tables);
+	}
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at ZeroCalibrator::Run()! Quitting."<<std::endl;
+		return false;
 	}
 
-	
-
-	int nchannels = 544;
 	GraphData data;
 	double offset;
+	std::string name;
+	int nkept = 0;
 	for(int i=0; i<nchannels; i++)
 	{
 		name = "channel_"+std::to_string(i);
+		//Channels whose spectrum has barely changed since the last fit keep their previous offset
+		auto previous_offset = previous.FindOffset(i);
+		if(!bank.NeedsRefit(i, HistogramBank::GetCounts(histo_table, name)) && previous_offset != previous.End())
+		{
+			output<<i<<"\t"<<previous_offset->second<<std::endl;
+			nkept++;
+			continue;
+		}
 		data = GetPoints(histo_table, i, name);
 
 		if(data.xvals.size() ==  0)
@@ -327,206 +418,120 @@ void ZeroCalibrator::Run(const std::string& inputname, const std::string& plotna
 
 		output<<i<<"\t"<<offset<<std::endl;
 	}
+	output.close();
+	if(bank.IsEnabled())
+	{
+		bank.SaveFitCounts();
+		std::cout<<"Kept the previous offset of "<<nkept<<" channel(s) with unchanged statistics."<<std::endl;
+	}
 
 	ZeroCalMap zmap(outputname);
 	if(!zmap.IsValid())
 	{
+		graphoutput->Close();
 		std::cerr<<"Unable to open a map after creating calibrations in ZeroCalibrator::Run()."<<std::endl;
+		return false;
 	}
 
-	count=0;
-	flush_count=0;
-	std::string before_name="before_offset_cal";
-	std::string before_title="before_offset_cal;Channel;Energy(arb)";
-	std::string after_name="after_offset_cal";
-	std::string after_title="after_offset_cal;Channel;Energy(arb)";
-
 	std::cout<<"Generating zero-offset calibration test plots..."<<std::endl;
-	for(int i=0; i<nentries; i++)
+	processor.SetStopCheck(nullptr, 0);
+	if(processor.WasStopped())
+		processor.SetMaxEntries(processor.GetReadEntries()); //test plots from as much data as the fits
+	//With histogram banks only the runs which were just read are used, so that the cost follows the new data
+	FileProcessor new_runs(processor.GetFilledFiles(), "EventTree", io_policy, nthreads);
+	FileProcessor& test_processor = bank.IsEnabled() ? new_runs : processor;
+	if(test_processor.IsValid())
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*5<<"%"<<std::flush;
-		}
-
-		for(int j=0; j<12; j++)
+		slot_tables = FileProcessor::MakeTables(test_processor.GetNSlots());
+		success = test_processor.Process([this, &slot_tables, &zmap](AnasenEvent* event, int slot)
 		{
-			for(auto& hit : event->barrel1[j].fronts_up)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel1[j].fronts_down)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-
-			for(auto& hit : event->barrel2[j].fronts_up)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel2[j].fronts_down)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			for(auto& hit : event->fqqq[j].rings)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-
-			for(auto& hit : event->bqqq[j].rings)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-		}
+			FillOffsetTestPlots(event, slot_tables[slot], zmap);
+		});
+		FileProcessor::MergeTables(histo_table, slot_tables);
 	}
-	std::cout<<std::endl;
-
-	input->Close();
+	else
+		std::cout<<"No new runs were read, skipping the test plots."<<std::endl;
 
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/write");
 	graphoutput->cd();
 	histo_table->Write();
 	graph_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	delete event;
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at ZeroCalibrator::Run()!"<<std::endl;
+	return success;
 }
 
-//For when things go wrong
-void ZeroCalibrator::RecoverOffsets(const std::string& inputname, const std::string& plotname, const std::string& outputname)
+//For when things go wrong. Returns false if the recovered offsets could not be written.
+bool ZeroCalibrator::RecoverOffsets(const std::vector<std::string>& inputnames, const std::string& plotname, const std::string& outputname)
 {
-	TFile* input = TFile::Open(inputname.c_str(), "READ");
-	if(!input->IsOpen())
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/RecoverOffsets");
+	FileProcessor processor(inputnames, "EventTree", io_policy, nthreads);
+	if(!processor.IsValid())
 	{
-		std::cerr<<"Unable to open input datafile "<<inputname<<"! Quitting."<<std::endl;
-		return;
+		std::cerr<<"No input datafiles given to ZeroCalibrator::RecoverOffsets()! Quitting."<<std::endl;
+		return false;
 	}
-	TTree* intree = (TTree*) input->Get("EventTree");
-
-	AnasenEvent* event = new AnasenEvent();
-
-	intree->SetBranchAddress("event", &event);
 
 	TFile* graphoutput = TFile::Open(plotname.c_str(), "RECREATE");
-	if(!graphoutput->IsOpen())
+	if(graphoutput == nullptr || !graphoutput->IsOpen())
 	{
-		input->Close();
-		std::cerr<<"Unable to create output graph file "<<plotname<<"! Quitting."<<std::endl;
-		return;
+		std::cerr<<"Unable to create output graph file "<<plotname<<" at ZeroCalibrator::RecoverOffsets()! Quitting."<<std::endl;
+		delete graphoutput;
+		return false;
 	}
 
 	THashTable* histo_table = new THashTable();
 	THashTable* graph_table = new THashTable();
 
-	
-
-	int nentries = intree->GetEntries();
-	int count=0, flush_count=0, flush_val = 0.05*nentries;
-
-	std::string name;
-	for(int i=0; i<nentries; i++)
+	//Only the BQQQ rings are used to recover the offsets
+	processor.SetSelection(FiredGroup::BQQQRing);
+	std::vector<THashTable*> slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	bool success = processor.Process([this, &slot_tables](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*5<<"%"<<std::flush;
-		}
-
+		std::string name;
 		for(int j=0; j<4; j++)
 		{
 			for(auto& hit : event->bqqq[j].rings)
 			{
 				auto channel = cmap.FindChannel(hit.global_chan);
-				if(channel->second.detectorID != "2")
+				if(channel->second.detectorID != 2)
 					continue;
 				name = "channel_"+std::to_string(hit.global_chan);
-				FillHistogram(histo_table, name, name, 3746,1400,16384, hit.energy);
+				FillHistogram(slot_tables[slot], name, name, 3746,1400,16384, hit.energy);
 			}
 		}
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
+
+	if(!success)
+	{
+		graphoutput->Close();
+		std::cerr<<"Unable to read all of the input data at ZeroCalibrator::RecoverOffsets()! Quitting."<<std::endl;
+		return false;
 	}
 
+	//The good channels come from the existing zero-offset calibration, which the recovered ones are appended to
 	ZeroCalMap zmap(outputname);
 	if(!zmap.IsValid())
 	{
-		std::cerr<<"Unable to open a map after creating calibrations in ZeroCalibrator::Run()."<<std::endl;
+		graphoutput->Close();
+		std::cerr<<"Unable to open the zero-offset map "<<outputname<<" at ZeroCalibrator::RecoverOffsets()! Quitting."<<std::endl;
+		return false;
 	}
 	std::ofstream output;
 	output.open(outputname, std::ofstream::out | std::ofstream::app);
 	if(!output.is_open())
 	{
-		input->Close();
 		graphoutput->Close();
-		std::cerr<<"Unable to open output file "<<outputname<<". Quitting."<<std::endl;
-		return;
+		std::cerr<<"Unable to open output file "<<outputname<<" at ZeroCalibrator::RecoverOffsets()! Quitting."<<std::endl;
+		return false;
 	}
-	int nchannels = 544;
+	io_policy.WriteQuickLookNote(output);
 	GraphData data;
 	double offset;
+	std::string name;
 	std::vector<double> chipboard5_offs;
 	std::vector<double> chipboard14_offs;
 	for(int i=208; i<224; i++)
@@ -577,124 +582,22 @@ void ZeroCalibrator::RecoverOffsets(const std::string& inputname, const std::str
 		output<<i<<"\t"<<482.949<<std::endl;
 	output.close();
 
-	
-
-	count=0;
-	flush_count=0;
-	std::string before_name="before_offset_cal";
-	std::string before_title="before_offset_cal;Channel;Energy(arb)";
-	std::string after_name="after_offset_cal";
-	std::string after_title="after_offset_cal;Channel;Energy(arb)";
-
 	std::cout<<"Generating zero-offset calibration test plots..."<<std::endl;
-	for(int i=0; i<nentries; i++)
+	processor.SetSelection(0);
+	slot_tables = FileProcessor::MakeTables(processor.GetNSlots());
+	success = processor.Process([this, &slot_tables, &zmap](AnasenEvent* event, int slot)
 	{
-		intree->GetEntry(i);
-		count++;
-		if(count == flush_val)
-		{
-			flush_count++;
-			count=0;
-			std::cout<<"\rPercent of data histogrammed: "<<flush_count*5<<"%"<<std::flush;
-		}
-
-		for(int j=0; j<12; j++)
-		{
-			for(auto& hit : event->barrel1[j].fronts_up)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel1[j].fronts_down)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel1[j].backs)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-
-			for(auto& hit : event->barrel2[j].fronts_up)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel2[j].fronts_down)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->barrel2[j].backs)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-		}
-
-		for(int j=0; j<4; j++)
-		{
-			for(auto& hit : event->fqqq[j].rings)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->fqqq[j].wedges)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-
-			for(auto& hit : event->bqqq[j].rings)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-			for(auto& hit : event->bqqq[j].wedges)
-			{
-				FillHistogram(histo_table, before_name, before_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy);
-				auto offset_data = zmap.FindOffset(hit.global_chan);
-				if(offset_data == zmap.End())
-					continue;
-				FillHistogram(histo_table, after_name, after_title, nchannels, 0, nchannels, hit.global_chan, 16384,1400,16384, hit.energy-offset_data->second);
-			}
-		}
-	}
-	std::cout<<std::endl;
-
-	input->Close();
+		FillOffsetTestPlots(event, slot_tables[slot], zmap);
+	});
+	FileProcessor::MergeTables(histo_table, slot_tables);
 
+	ANASEN_TRACE_SCOPE("ZeroCalibrator/write");
 	graphoutput->cd();
 	histo_table->Write();
 	graph_table->Write();
+	io_policy.WriteQuickLookNote(graphoutput);
 	graphoutput->Close();
-	delete event;
-}
\ No newline at end of file
+	if(!success)
+		std::cerr<<"Unable to read all of the input data for the test plots at ZeroCalibrator::RecoverOffsets()!"<<std::endl;
+	return success;
+}
@@ -8,11 +8,47 @@
 #include "MapChecker.h"
 #include "EnergyCalibrator.h"
 #include "DataCalibrator.h"
+#include "RunOptions.h"
+#include "IOPolicy.h"
+#include "OutputPolicy.h"
+#include "FileProcessor.h"
+#include "RunPrefetcher.h"
+#include "CompressionBenchmark.h"
+#include "CalibrationBundle.h"
+#include "CalibrationSnapshot.h"
+#include "CalibrationDatabase.h"
+#include "SpectrumMonitor.h"
+#include "HistogramBank.h"
+#include "DriftScanner.h"
+#include "Pipeline.h"
+#include "StageTracer.h"
+#include "PerfCounters.h"
+#include "ProgressReporter.h"
+#include "SyntheticGenerator.h"
+#include <chrono>
+#include <sys/resource.h>
 
 
+//Local channels which MatchBacks matches every SX3 back and every QQQ wedge to
+static const int sx3_reference = 3;
+static const int qqq_reference = 1;
+
+//Peak resident memory of the program so far, in MB
+static double GetPeakMemory()
+{
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+#ifdef __APPLE__
+	return usage.ru_maxrss/(1024.0*1024.0); //bytes
+#else
+	return usage.ru_maxrss/1024.0; //kB
+#endif
+}
 
 int main(int argc, char** argv) 
 {
+	auto start_time = std::chrono::steady_clock::now();
 	std::string option = "";
 	if(argc == 2)
 	{
@@ -22,6 +58,7 @@ int main(int argc, char** argv)
 			std::cerr<<"Select an option from the following list to run AnasenCal:"<<std::endl;
 			std::cerr<<"--organize-data : converts data to the AnasenEvent format specified in DataStructs.h"<<std::endl;
 			std::cerr<<"--zero-offset : calibrates the zero offset of each channel using pulser data"<<std::endl;
+			std::cerr<<"--zero-dirty : recovers the zero offsets of channels missing from the pulser data using alpha data"<<std::endl;
 			std::cerr<<"--gain-match : performs all gain-matching steps in a single-shot (not recommended)"<<std::endl;
 			std::cerr<<"--gain-match-backs : performs first step of gain-matching by aligning all back channels within each detector"<<std::endl;
 			std::cerr<<"--gain-match-updown : performs second step of gain-matching by aligning the SX3 front upstream and downstream channels"<<std::endl;
@@ -29,18 +66,34 @@ int main(int argc, char** argv)
 			std::cerr<<"--calibrate-energy : calibrates the energy of each channel using alpha data"<<std::endl;
 			std::cerr<<"--apply-calibrations : applies calibrations to a dataset, generating a new calibrated file"<<std::endl;
 			std::cerr<<"These are listed in the order that they should be used to completely calibrate the silicon in an ANASEN dataset"<<std::endl;
+			std::cerr<<"--benchmark-compression : writes and reads back a sample of the run data with every output profile and reports the performance"<<std::endl;
+			std::cerr<<"--benchmark-formats : writes and reads back a sample of the run data in every available data format (TTree, RNTuple) and reports the performance"<<std::endl;
+			std::cerr<<"--export-calibrations : packs the channel map and every calibration file into the binary bundle given by CalibrationBundle"<<std::endl;
+			std::cerr<<"--import-calibrations : writes the channel map and calibration files back out from the binary bundle given by CalibrationBundle"<<std::endl;
+			std::cerr<<"--benchmark-kernel : measures the speed of the batch calibration kernel with every available instruction set on the current calibrations"<<std::endl;
+			std::cerr<<"--drift-scan : measures the run-by-run drift of reference peak centroids in every channel with the current calibrations"<<std::endl;
+			std::cerr<<"--generate-data : writes and organizes synthetic pulser and alpha runs with a known calibration, and writes the true calibration files"<<std::endl;
+			std::cerr<<"--validate-synthetic : compares the calibration files with the true calibration of the synthetic data"<<std::endl;
+			std::cerr<<"--pipeline : runs every stage from organize-data to apply-calibrations, skipping the stages whose outputs are current"<<std::endl;
 			std::cerr<<"AnasenCal should be run using the following formula:"<<std::endl;
 			std::cerr<<"./bin/anasencal --<option> <input file>"<<std::endl;
+			std::cerr<<"--organize-data and --apply-calibrations also take --resume after the input file, which skips complete outputs and continues partial ones from their last checkpoint (see CheckpointEntries)"<<std::endl;
 			return 0;
 		}
 	}
 
-	if(argc != 3) {
+	bool resume = (argc == 4 && std::string(argv[3]) == "--resume");
+	if(argc != 3 && !resume) {
 		std::cerr<<"Incorrect number of arguments, please specify an operation and an input file."<<std::endl;
-		std::cerr<<"./bin/anasencal --<option> <input file>"<<std::endl;
+		std::cerr<<"./bin/anasencal --<option> <input file> [--resume]"<<std::endl;
 		return 1;
 	} 
 	option = argv[1];
+	if(resume && option != "--organize-data" && option != "--apply-calibrations")
+	{
+		std::cerr<<"Only --organize-data and --apply-calibrations can be resumed."<<std::endl;
+		return 1;
+	}
 	
 	std::ifstream input(argv[2]);
 	if(!input.is_open()) 
@@ -74,11 +127,43 @@ int main(int argc, char** argv)
 	input>>junk>>ecaloutfile;
 	input>>junk>>channelfile;
 	input>>junk>>finaldata;
+	RunOptions options;
+	options.FillMap(input);
 	input.close();
 
+	IOPolicy io_policy(options);
+	io_policy.EnableGlobal();
+	OutputPolicy output_policy(options);
+	int nthreads = options.GetInt("NThreads", 1);
+	EarlyStopSettings early_stop(options);
+	BankSettings bank_settings(options);
+	//Banks hold the spectra of whole runs, so they cannot be mixed with a partial read of the data
+	if(bank_settings.IsEnabled() && (io_policy.IsQuickLook() || early_stop.IsEnabled()))
+	{
+		std::cout<<"Histogram banks are not used with quick-look mode or early termination."<<std::endl;
+		bank_settings.directory.clear();
+	}
+	std::string bundlefile = options.GetString("CalibrationBundle", "");
+	std::string databasefile = options.GetString("CalibrationDatabase", "");
+	std::vector<std::string> stagefiles = {channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile}; //CalibrationStage order
+	std::string tracefile = options.GetString("TraceFile", "etc/StageTrace.json");
+	std::string perffile = options.GetString("PerfCounterFile", "etc/PerfCounters.txt");
+	ProgressSettings progress_settings(options);
+	ProgressReporter::Configure(progress_settings);
+
 	std::cout<<"--------ANASEN Gain Matching and Calibration--------"<<std::endl;
 	std::cout<<"Option passed: "<<option<<std::endl;
 	std::cout<<"-------------------Input Data Used------------------"<<std::endl;
+	io_policy.Print();
+	output_policy.Print();
+	early_stop.Print();
+	bank_settings.Print();
+	progress_settings.Print();
+	if(StageTracer::IsEnabled())
+		std::cout<<"Tracing stage timing to "<<tracefile<<std::endl;
+	if(PerfCounters::IsEnabled())
+		std::cout<<"Counting hardware events of the hot loops to "<<perffile<<std::endl;
+	bool success = true; //false if a stage failed, for the exit status
 	if(option == "--organize-data")
 	{
 		std::cout<<"Raw datadir: "<<rawdata<<std::endl;
@@ -86,17 +171,31 @@ int main(int argc, char** argv)
 		std::cout<<"Run min: "<<runMin<<" Run max: "<<runMax<<std::endl;
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Converting data from raw root format to orgainzed data structures..."<<std::endl;
-		std::string raw_file, organized_file;
-		DataOrganizer organ(channelfile);
+		std::string raw_file;
+		std::vector<std::string> raw_files, organized_files;
 		for(int i=runMin; i<=runMax; i++)
 		{
 			raw_file = rawdata + "run-" + std::to_string(i) + ".root";
 			if(!std::ifstream(raw_file))
 				continue;
-			organized_file = orgainzedata + "run-" + std::to_string(i) + ".root";
-			std::cout<<"Converting file "<<raw_file<<" to file "<<organized_file<<"..."<<std::endl;
-			organ.Run(raw_file, organized_file);
+			raw_files.push_back(raw_file);
+			organized_files.push_back(orgainzedata + "run-" + std::to_string(i) + ".root");
 		}
+		DataOrganizer organ(channelfile);
+		organ.SetIOPolicy(io_policy);
+		organ.SetOutputPolicy(output_policy);
+		organ.SetResume(resume);
+		RunPrefetcher prefetcher(options);
+		prefetcher.Print();
+		prefetcher.Start(raw_files);
+		for(unsigned int i=0; i<raw_files.size(); i++)
+		{
+			std::cout<<"Converting file "<<raw_files[i]<<" to file "<<organized_files[i]<<"..."<<std::endl;
+			prefetcher.BeginRun(i);
+			if(!organ.Run(raw_files[i], organized_files[i]))
+				success = false;
+		}
+		prefetcher.Stop();
 	}
 	else if(option == "--zero-offset")
 	{
@@ -106,21 +205,30 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Calibrating zero-offset in every channel using pulser data..."<<std::endl;
 		ZeroCalibrator zcal(channelfile);
-		zcal.Run(pulserdata, zcaloutrootfile, zcaloutfile);
+		zcal.SetIOPolicy(io_policy);
+		zcal.SetNThreads(nthreads);
+		zcal.SetEarlyStop(early_stop);
+		zcal.SetHistogramBank(bank_settings);
+		success = zcal.Run(FileProcessor::ResolveInputFiles(pulserdata, orgainzedata, runMin, runMax), zcaloutrootfile, zcaloutfile);
 	}
 	else if(option == "--zero-dirty")
 	{
+		std::string zerorecoveryfile = options.GetString("ZeroRecoveryHistogramFile", "etc/dirtyZero.root");
 		std::cout<<"Alpha data file: "<<alphadata<<std::endl;
-		std::cout<<"Zero-Offset Histogram File: "<<zcaloutrootfile<<std::endl;
+		std::cout<<"Zero-Offset Recovery Histogram File: "<<zerorecoveryfile<<std::endl;
 		std::cout<<"Zero-Offset Calibration Output File: "<<zcaloutfile<<std::endl;
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Attempting to recover busted channels in zero offset with alpha data..."<<std::endl;
 		ZeroCalibrator zcal(channelfile);
-		zcal.RecoverOffsets(alphadata, "/data1/gwm17/7BeNov2021/calibration_plots/dirtyZero.root", zcaloutfile);
+		zcal.SetIOPolicy(io_policy);
+		zcal.SetNThreads(nthreads);
+		success = zcal.RecoverOffsets(FileProcessor::ResolveInputFiles(alphadata, orgainzedata, runMin, runMax), zerorecoveryfile, zcaloutfile);
 	}
 	else if(option == "--gain-match")
 	{
 		GainMatcher matcher(channelfile, zcaloutfile);
+		matcher.SetIOPolicy(io_policy);
+		matcher.SetNThreads(nthreads);
 		std::cout<<"Alpha data file: "<<alphadata<<std::endl;
 		std::cout<<"Run data file: "<<rundata<<std::endl;
 		std::cout<<"Back Gain-matching Histogram File: "<<backgains_plots<<std::endl;
@@ -132,11 +240,17 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Gain-matching channels..."<<std::endl;
 		std::cout<<"Starting by gain-matching all back (SX3 backs & QQQ wedges) channels..."<<std::endl;
-		matcher.MatchBacks(alphadata, backgains_plots, backgains, 3, 1);
-		std::cout<<"Finished. Now gain-matching SX3 upstream fronts and downstream fronts..."<<std::endl;
-		matcher.MatchSX3UpDown(alphadata, updowngains_plots, updowngains, backgains);
-		std::cout<<"Finished. Finally, gain-matching all front channels to all back channels..."<<std::endl;
-		matcher.MatchFrontBack(rundata, frontbackgains_plots, frontbackgains, backgains, updowngains);
+		success = matcher.MatchBacks(FileProcessor::ResolveInputFiles(alphadata, orgainzedata, runMin, runMax), backgains_plots, backgains, sx3_reference, qqq_reference);
+		if(success)
+		{
+			std::cout<<"Finished. Now gain-matching SX3 upstream fronts and downstream fronts..."<<std::endl;
+			success = matcher.MatchSX3UpDown(FileProcessor::ResolveInputFiles(alphadata, orgainzedata, runMin, runMax), updowngains_plots, updowngains, backgains);
+		}
+		if(success)
+		{
+			std::cout<<"Finished. Finally, gain-matching all front channels to all back channels..."<<std::endl;
+			success = matcher.MatchFrontBack(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), frontbackgains_plots, frontbackgains, backgains, updowngains);
+		}
 	}
 	else if(option == "--gain-match-backs")
 	{
@@ -146,7 +260,9 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Gain-matching all back (SX3 backs & QQQ wedges) channels..."<<std::endl;
 		GainMatcher matcher(channelfile, zcaloutfile);
-		matcher.MatchBacks(alphadata, backgains_plots, backgains, 3, 1);
+		matcher.SetIOPolicy(io_policy);
+		matcher.SetNThreads(nthreads);
+		success = matcher.MatchBacks(FileProcessor::ResolveInputFiles(alphadata, orgainzedata, runMin, runMax), backgains_plots, backgains, sx3_reference, qqq_reference);
 	}
 	else if(option == "--gain-match-updown")
 	{
@@ -156,7 +272,9 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Gain-matching SX3 upstream fronts and downstream fronts..."<<std::endl;
 		GainMatcher matcher(channelfile, zcaloutfile);
-		matcher.MatchSX3UpDown(rundata, updowngains_plots, updowngains, backgains);
+		matcher.SetIOPolicy(io_policy);
+		matcher.SetNThreads(nthreads);
+		success = matcher.MatchSX3UpDown(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), updowngains_plots, updowngains, backgains);
 	}
 	else if(option == "--gain-match-frontback")
 	{
@@ -166,7 +284,9 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Gain-matching all front channels to all back channels..."<<std::endl;
 		GainMatcher matcher(channelfile, zcaloutfile);
-		matcher.MatchFrontBack(rundata, frontbackgains_plots, frontbackgains, backgains, updowngains);
+		matcher.SetIOPolicy(io_policy);
+		matcher.SetNThreads(nthreads);
+		success = matcher.MatchFrontBack(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), frontbackgains_plots, frontbackgains, backgains, updowngains);
 	}
 	else if(option == "--check-zoffset")
 	{
@@ -174,7 +294,7 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Running check on the given zero-offset map..."<<std::endl;
 		MapChecker checker(channelfile);
-		checker.CheckZOffset(zcaloutfile);
+		success = checker.CheckZOffset(zcaloutfile);
 	}
 	else if(option == "--check-backgains")
 	{
@@ -182,7 +302,7 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Running check on the given backs gain-matching map..."<<std::endl;
 		MapChecker checker(channelfile);
-		checker.CheckBackGainMatch(backgains);
+		success = checker.CheckBackGainMatch(backgains);
 	}
 	else if(option == "--check-updowngains")
 	{
@@ -190,7 +310,7 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Running check on the given SX3 up-down gain-matching map..."<<std::endl;
 		MapChecker checker(channelfile);
-		checker.CheckUpDownGainMatch(updowngains);
+		success = checker.CheckUpDownGainMatch(updowngains);
 	}
 	else if(option == "--check-frontbackgains")
 	{
@@ -198,7 +318,7 @@ int main(int argc, char** argv)
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Running check on the given front-back gain-matching map..."<<std::endl;
 		MapChecker checker(channelfile);
-		checker.CheckFrontBackGainMatch(frontbackgains);
+		success = checker.CheckFrontBackGainMatch(frontbackgains);
 	}
 	else if(option == "--calibrate-energy")
 	{
@@ -207,8 +327,17 @@ int main(int argc, char** argv)
 		std::cout<<"Energy Calibration Output File: "<<ecaloutfile<<std::endl;
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Calibrating the energy of the back channels and QQQ rings..."<<std::endl;
-		EnergyCalibrator ecal(channelfile, zcaloutfile, backgains, updowngains, frontbackgains);
-		ecal.Run(alphadata, ecaloutrootfile, ecaloutfile);
+		EnergyCalibrator* ecal;
+		if(bundlefile != "")
+			ecal = new EnergyCalibrator(bundlefile);
+		else
+			ecal = new EnergyCalibrator(channelfile, zcaloutfile, backgains, updowngains, frontbackgains);
+		ecal->SetIOPolicy(io_policy);
+		ecal->SetNThreads(nthreads);
+		ecal->SetEarlyStop(early_stop);
+		ecal->SetHistogramBank(bank_settings);
+		success = ecal->Run(FileProcessor::ResolveInputFiles(alphadata, orgainzedata, runMin, runMax), ecaloutrootfile, ecaloutfile);
+		delete ecal;
 	}
 	else if(option == "--apply-calibrations")
 	{
@@ -221,8 +350,302 @@ int main(int argc, char** argv)
 		std::cout<<"Calibrated data file: "<<finaldata<<std::endl;
 		std::cout<<"----------------------------------------------------"<<std::endl;
 		std::cout<<"Applying calibration to the data set "<<rundata<<"..."<<std::endl;
-		DataCalibrator dcal(channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile);
-		dcal.Run(rundata, finaldata);
+		DataCalibrator* dcal;
+		if(databasefile != "")
+		{
+			std::cout<<"Calibration database: "<<databasefile<<std::endl;
+			CalibrationDatabase* database = new CalibrationDatabase(databasefile);
+			database->Print();
+			dcal = new DataCalibrator(database);
+		}
+		else if(bundlefile != "")
+			dcal = new DataCalibrator(bundlefile);
+		else
+			dcal = new DataCalibrator(channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile);
+		dcal->SetIOPolicy(io_policy);
+		dcal->SetOutputPolicy(output_policy);
+		dcal->SetResume(resume);
+		success = dcal->Run(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), finaldata);
+		delete dcal;
+	}
+	else if(option == "--benchmark-compression")
+	{
+		std::cout<<"Run data file: "<<rundata<<std::endl;
+		std::cout<<"Benchmark directory: "<<orgainzedata<<std::endl;
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		std::cout<<"Benchmarking output profiles using the data set "<<rundata<<"..."<<std::endl;
+		CompressionBenchmark bench;
+		bench.SetIOPolicy(io_policy);
+		bench.SetOutputPolicy(output_policy);
+		bench.Run(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), orgainzedata, options.GetLong("BenchmarkEvents", 100000));
+	}
+	else if(option == "--benchmark-formats")
+	{
+		std::cout<<"Run data file: "<<rundata<<std::endl;
+		std::cout<<"Benchmark directory: "<<orgainzedata<<std::endl;
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		std::cout<<"Benchmarking data formats using the data set "<<rundata<<"..."<<std::endl;
+		CompressionBenchmark bench;
+		bench.SetIOPolicy(io_policy);
+		bench.SetOutputPolicy(output_policy);
+		bench.RunFormats(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax), orgainzedata, options.GetLong("BenchmarkEvents", 100000));
+	}
+	else if(option == "--export-calibrations" || option == "--import-calibrations")
+	{
+		if(bundlefile == "")
+		{
+			std::cerr<<"No CalibrationBundle given in the input file, unable to "<<(option == "--export-calibrations" ? "export" : "import")<<" calibrations."<<std::endl;
+			success = false;
+		}
+		else
+		{
+			std::cout<<"Channel map file: "<<channelfile<<std::endl;
+			std::cout<<"Zero-Offset Calibration Output File: "<<zcaloutfile<<std::endl;
+			std::cout<<"Back Gain-matching Output File: "<<backgains<<std::endl;
+			std::cout<<"SX3 Upstream-Downstream Gain-matching Output File: "<<updowngains<<std::endl;
+			std::cout<<"Front-Back Gain-matching Output File: "<<frontbackgains<<std::endl;
+			std::cout<<"Energy Calibration Output File: "<<ecaloutfile<<std::endl;
+			std::cout<<"Calibration bundle: "<<bundlefile<<std::endl;
+			std::cout<<"----------------------------------------------------"<<std::endl;
+			if(option == "--export-calibrations")
+			{
+				std::cout<<"Packing the calibration files into "<<bundlefile<<"..."<<std::endl;
+				success = CalibrationBundle::Export(stagefiles, bundlefile);
+			}
+			else
+			{
+				std::cout<<"Writing the calibration files from "<<bundlefile<<"..."<<std::endl;
+				CalibrationBundle bundle(bundlefile);
+				bundle.Print();
+				success = bundle.Import(stagefiles);
+			}
+		}
+	}
+	else if(option == "--benchmark-kernel")
+	{
+		if(bundlefile != "")
+			std::cout<<"Calibration bundle: "<<bundlefile<<std::endl;
+		else
+		{
+			std::cout<<"Zero-Offset Calibration Output File: "<<zcaloutfile<<std::endl;
+			std::cout<<"Back Gain-matching Output File: "<<backgains<<std::endl;
+			std::cout<<"SX3 Upstream-Downstream Gain-matching Output File: "<<updowngains<<std::endl;
+			std::cout<<"Front-Back Gain-matching Output File: "<<frontbackgains<<std::endl;
+			std::cout<<"Energy Calibration Output File: "<<ecaloutfile<<std::endl;
+		}
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		CalibrationSnapshot* snapshot;
+		if(bundlefile != "")
+			snapshot = new CalibrationSnapshot(CalibrationBundle(bundlefile));
+		else
+			snapshot = new CalibrationSnapshot(channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile);
+		if(!snapshot->IsValid())
+		{
+			std::cerr<<"Unable to load the calibrations for the kernel benchmark."<<std::endl;
+			success = false;
+		}
+		else
+			CalibrationKernel::Benchmark(snapshot->GetLinearGains(), snapshot->GetLinearOffsets(), snapshot->GetNChannels(), options.GetLong("BenchmarkHits", 100000000));
+		delete snapshot;
+	}
+	else if(option == "--drift-scan")
+	{
+		DriftSettings drift_settings(options);
+		if(bundlefile != "")
+			std::cout<<"Calibration bundle: "<<bundlefile<<std::endl;
+		else
+		{
+			std::cout<<"Zero-Offset Calibration Output File: "<<zcaloutfile<<std::endl;
+			std::cout<<"Back Gain-matching Output File: "<<backgains<<std::endl;
+			std::cout<<"SX3 Upstream-Downstream Gain-matching Output File: "<<updowngains<<std::endl;
+			std::cout<<"Front-Back Gain-matching Output File: "<<frontbackgains<<std::endl;
+			std::cout<<"Energy Calibration Output File: "<<ecaloutfile<<std::endl;
+		}
+		std::cout<<"Run data file: "<<rundata<<std::endl;
+		std::cout<<"Drift scan output file: "<<drift_settings.outputname<<std::endl;
+		drift_settings.Print();
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		std::cout<<"Scanning the gain drift of every channel run by run..."<<std::endl;
+		DriftScanner* scanner;
+		if(bundlefile != "")
+			scanner = new DriftScanner(bundlefile);
+		else
+			scanner = new DriftScanner(channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile);
+		scanner->SetIOPolicy(io_policy);
+		scanner->SetNThreads(nthreads);
+		scanner->SetSettings(drift_settings);
+		scanner->SetHistogramBank(bank_settings);
+		success = scanner->Run(FileProcessor::ResolveInputFiles(rundata, orgainzedata, runMin, runMax));
+		delete scanner;
+	}
+	else if(option == "--pipeline")
+	{
+		std::string statefile = options.GetString("PipelineState", "etc/PipelineState.txt");
+		int njobs = options.GetInt("PipelineJobs", 1);
+		std::cout<<"Raw datadir: "<<rawdata<<std::endl;
+		std::cout<<"Organized datadir: "<<orgainzedata<<std::endl;
+		std::cout<<"Run min: "<<runMin<<" Run max: "<<runMax<<std::endl;
+		std::cout<<"Pipeline state file: "<<statefile<<std::endl;
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		if(bundlefile != "" || databasefile != "")
+			std::cout<<"The pipeline makes its own calibration files; CalibrationBundle and CalibrationDatabase are not used."<<std::endl;
+
+		//Settings which change the results of each stage; the performance settings (caches, threads, banks) do not
+		std::string quicklook = options.GetSettings({"QuickLookFraction"});
+		std::string output_settings = options.GetSettings({"DataFormat", "OutputProfile", "CompressionAlgorithm", "CompressionLevel", "BasketSizeKB", "AutoFlushMB"});
+		std::string early_settings = options.GetSettings({"EarlyStopCounts", "EarlyStopInterval", "EarlyStopLiveFraction", "RefitThreshold"});
+
+		Pipeline pipeline(statefile);
+		std::string raw_file, organized_file;
+		for(int i=runMin; i<=runMax; i++)
+		{
+			raw_file = rawdata + "run-" + std::to_string(i) + ".root";
+			if(!std::ifstream(raw_file))
+				continue;
+			organized_file = orgainzedata + "run-" + std::to_string(i) + ".root";
+			pipeline.AddStage("organize:run-"+std::to_string(i), {raw_file, channelfile}, {organized_file},
+								quicklook + output_settings + options.GetSettings({"FiredIndex"}), [&, raw_file, organized_file]()
+			{
+				DataOrganizer organ(channelfile);
+				organ.SetIOPolicy(io_policy);
+				organ.SetOutputPolicy(output_policy);
+				return organ.Run(raw_file, organized_file);
+			});
+		}
+
+		//Run ranges may refer to organized files which the pipeline has yet to make
+		auto resolve = [&](const std::string& spec)
+		{
+			std::vector<std::string> files;
+			for(auto& file : FileProcessor::ResolveInputFiles(spec, orgainzedata, runMin, runMax, false))
+				if(pipeline.IsOutput(file) || std::ifstream(file))
+					files.push_back(file);
+			return files;
+		};
+		std::vector<std::string> pulser_files = resolve(pulserdata);
+		std::vector<std::string> alpha_files = resolve(alphadata);
+		std::vector<std::string> run_files = resolve(rundata);
+		auto with = [](std::vector<std::string> files, const std::vector<std::string>& more)
+		{
+			files.insert(files.end(), more.begin(), more.end());
+			return files;
+		};
+
+		pipeline.AddStage("zero-offset", with(pulser_files, {channelfile}), {zcaloutrootfile, zcaloutfile}, quicklook + early_settings, [&]()
+		{
+			ZeroCalibrator zcal(channelfile);
+			zcal.SetIOPolicy(io_policy);
+			zcal.SetNThreads(nthreads);
+			zcal.SetEarlyStop(early_stop);
+			zcal.SetHistogramBank(bank_settings);
+			return zcal.Run(pulser_files, zcaloutrootfile, zcaloutfile);
+		});
+		pipeline.AddStage("gain-match-backs", with(alpha_files, {channelfile, zcaloutfile}), {backgains_plots, backgains}, quicklook, [&]()
+		{
+			GainMatcher matcher(channelfile, zcaloutfile);
+			matcher.SetIOPolicy(io_policy);
+			matcher.SetNThreads(nthreads);
+			return matcher.MatchBacks(alpha_files, backgains_plots, backgains, sx3_reference, qqq_reference);
+		});
+		pipeline.AddStage("gain-match-updown", with(run_files, {channelfile, zcaloutfile, backgains}), {updowngains_plots, updowngains}, quicklook, [&]()
+		{
+			GainMatcher matcher(channelfile, zcaloutfile);
+			matcher.SetIOPolicy(io_policy);
+			matcher.SetNThreads(nthreads);
+			return matcher.MatchSX3UpDown(run_files, updowngains_plots, updowngains, backgains);
+		});
+		pipeline.AddStage("gain-match-frontback", with(run_files, {channelfile, zcaloutfile, backgains, updowngains}), {frontbackgains_plots, frontbackgains},
+							quicklook, [&]()
+		{
+			GainMatcher matcher(channelfile, zcaloutfile);
+			matcher.SetIOPolicy(io_policy);
+			matcher.SetNThreads(nthreads);
+			return matcher.MatchFrontBack(run_files, frontbackgains_plots, frontbackgains, backgains, updowngains);
+		});
+		pipeline.AddStage("calibrate-energy", with(alpha_files, {channelfile, zcaloutfile, backgains, updowngains, frontbackgains}), {ecaloutrootfile, ecaloutfile},
+							quicklook + early_settings, [&]()
+		{
+			EnergyCalibrator ecal(channelfile, zcaloutfile, backgains, updowngains, frontbackgains);
+			ecal.SetIOPolicy(io_policy);
+			ecal.SetNThreads(nthreads);
+			ecal.SetEarlyStop(early_stop);
+			ecal.SetHistogramBank(bank_settings);
+			return ecal.Run(alpha_files, ecaloutrootfile, ecaloutfile);
+		});
+		pipeline.AddStage("apply-calibrations", with(run_files, {channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile}), {finaldata},
+							quicklook + output_settings, [&]()
+		{
+			DataCalibrator dcal(channelfile, zcaloutfile, backgains, updowngains, frontbackgains, ecaloutfile);
+			dcal.SetIOPolicy(io_policy);
+			dcal.SetOutputPolicy(output_policy);
+			return dcal.Run(run_files, finaldata);
+		});
+
+		//The checks only report, and run alongside the rest of the chain
+		pipeline.AddStage("check-zoffset", {channelfile, zcaloutfile}, {}, "", [&]()
+		{
+			return MapChecker(channelfile).CheckZOffset(zcaloutfile);
+		});
+		pipeline.AddStage("check-backgains", {channelfile, backgains}, {}, "", [&]()
+		{
+			return MapChecker(channelfile).CheckBackGainMatch(backgains);
+		});
+		pipeline.AddStage("check-updowngains", {channelfile, updowngains}, {}, "", [&]()
+		{
+			return MapChecker(channelfile).CheckUpDownGainMatch(updowngains);
+		});
+		pipeline.AddStage("check-frontbackgains", {channelfile, frontbackgains}, {}, "", [&]()
+		{
+			return MapChecker(channelfile).CheckFrontBackGainMatch(frontbackgains);
+		});
+
+		success = pipeline.Run(njobs);
+	}
+	else if(option == "--generate-data")
+	{
+		SyntheticSettings synthetic_settings(options);
+		std::cout<<"Raw datadir: "<<rawdata<<std::endl;
+		std::cout<<"Organized datadir: "<<orgainzedata<<std::endl;
+		std::cout<<"Run min: "<<runMin<<" Run max: "<<runMax<<std::endl;
+		synthetic_settings.Print();
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		std::cout<<"Generating synthetic data with a known calibration..."<<std::endl;
+		SyntheticGenerator synthetic(channelfile, synthetic_settings);
+		if(!synthetic.IsValid())
+		{
+			std::cerr<<"Unable to load the channel map for the synthetic data."<<std::endl;
+			success = false;
+		}
+		DataOrganizer organ(channelfile);
+		organ.SetIOPolicy(io_policy);
+		organ.SetOutputPolicy(output_policy);
+		std::string raw_file, organized_file;
+		for(int i=runMin; i<=runMax && success; i++)
+		{
+			raw_file = rawdata + "run-" + std::to_string(i) + ".root";
+			organized_file = orgainzedata + "run-" + std::to_string(i) + ".root";
+			success = synthetic.WriteRun(raw_file, i-runMin < synthetic_settings.pulser_runs ? SyntheticRunType::Pulser : SyntheticRunType::Alpha);
+			if(!success)
+				break;
+			std::cout<<"Converting file "<<raw_file<<" to file "<<organized_file<<"..."<<std::endl;
+			success = organ.Run(raw_file, organized_file);
+		}
+		if(success)
+			success = synthetic.WriteTruth(sx3_reference, qqq_reference);
+	}
+	else if(option == "--validate-synthetic")
+	{
+		SyntheticSettings synthetic_settings(options);
+		std::cout<<"Zero-Offset Calibration Output File: "<<zcaloutfile<<std::endl;
+		std::cout<<"Back Gain-matching Output File: "<<backgains<<std::endl;
+		std::cout<<"SX3 Upstream-Downstream Gain-matching Output File: "<<updowngains<<std::endl;
+		std::cout<<"Front-Back Gain-matching Output File: "<<frontbackgains<<std::endl;
+		std::cout<<"Energy Calibration Output File: "<<ecaloutfile<<std::endl;
+		synthetic_settings.Print();
+		std::cout<<"----------------------------------------------------"<<std::endl;
+		std::cout<<"Comparing the calibrations with the truth of the synthetic data..."<<std::endl;
+		SyntheticGenerator synthetic(channelfile, synthetic_settings);
+		success = synthetic.Validate(stagefiles);
 	}
 	else if(option == "--dead-channels")
 	{
@@ -241,6 +664,7 @@ int main(int argc, char** argv)
 		std::cerr<<"Unrecognized option passed. Select from the following list to run AnasenCal:"<<std::endl;
 		std::cerr<<"--organize-data : converts data to the AnasenEvent format specified in DataStructs.h"<<std::endl;
 		std::cerr<<"--zero-offset : calibrates the zero offset of each channel using pulser data"<<std::endl;
+		std::cerr<<"--zero-dirty : recovers the zero offsets of channels missing from the pulser data using alpha data"<<std::endl;
 		std::cerr<<"--gain-match : performs all gain-matching steps in a single-shot (not recommended)"<<std::endl;
 		std::cerr<<"--gain-match-backs : performs first step of gain-matching by aligning all back channels within each detector"<<std::endl;
 		std::cerr<<"--gain-match-updown : performs second step of gain-matching by aligning the SX3 front upstream and downstream channels"<<std::endl;
@@ -248,9 +672,38 @@ int main(int argc, char** argv)
 		std::cerr<<"--calibrate-energy : calibrates the energy of each channel using alpha data"<<std::endl;
 		std::cerr<<"--apply-calibrations : applies calibrations to a dataset, generating a new calibrated file"<<std::endl;
 		std::cerr<<"These are listed in the order that they should be used to completely calibrate the silicon in an ANASEN dataset"<<std::endl;
+		std::cerr<<"--benchmark-compression : writes and reads back a sample of the run data with every output profile and reports the performance"<<std::endl;
+		std::cerr<<"--benchmark-formats : writes and reads back a sample of the run data in every available data format (TTree, RNTuple) and reports the performance"<<std::endl;
+		std::cerr<<"--export-calibrations : packs the channel map and every calibration file into the binary bundle given by CalibrationBundle"<<std::endl;
+		std::cerr<<"--import-calibrations : writes the channel map and calibration files back out from the binary bundle given by CalibrationBundle"<<std::endl;
+		std::cerr<<"--benchmark-kernel : measures the speed of the batch calibration kernel with every available instruction set on the current calibrations"<<std::endl;
+		std::cerr<<"--drift-scan : measures the run-by-run drift of reference peak centroids in every channel with the current calibrations"<<std::endl;
+		std::cerr<<"--generate-data : writes and organizes synthetic pulser and alpha runs with a known calibration, and writes the true calibration files"<<std::endl;
+		std::cerr<<"--validate-synthetic : compares the calibration files with the true calibration of the synthetic data"<<std::endl;
+		std::cerr<<"--pipeline : runs every stage from organize-data to apply-calibrations, skipping the stages whose outputs are current"<<std::endl;
 		return 1;
 	}
 	
+	if(StageTracer::IsEnabled())
+	{
+		StageTracer::Get().PrintSummary();
+		StageTracer::Get().WriteTrace(tracefile);
+	}
+	if(PerfCounters::IsEnabled())
+	{
+		PerfCounters::Get().PrintSummary();
+		PerfCounters::Get().WriteSummary(perffile);
+	}
+
+	//Read by tools/bench.sh
+	std::cout<<"Wall time: "<<std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count()<<" s Peak memory: "
+			 <<GetPeakMemory()<<" MB"<<std::endl;
+	if(!success)
+	{
+		std::cerr<<"Failed."<<std::endl;
+		std::cout<<"---------------------------------------------------"<<std::endl;
+		return 1;
+	}
 	std::cout<<"Finished."<<std::endl;
 	std::cout<<"---------------------------------------------------"<<std::endl;
 
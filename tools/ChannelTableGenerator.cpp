@@ -0,0 +1,136 @@
+/*
+	ChannelTableGenerator
+	Build-time tool which compiles a channel map file into constexpr tables (CompiledChannelMap.h) used by ChannelMap.
+	It is built and run by the Makefile whenever the channel map file (CHANNELMAP) changes:
+		./bin/channeltablegen <channel map file> <output header>
+	The generated header also checks at compile time that the map fits the detector arrays of AnasenEvent.
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include "ChannelMap.h"
+
+static const char* GetEnumName(DetectorType type)
+{
+	switch(type)
+	{
+		case DetectorType::FQQQ: return "DetectorType::FQQQ";
+		case DetectorType::BQQQ: return "DetectorType::BQQQ";
+		case DetectorType::Barrel1A: return "DetectorType::Barrel1A";
+		case DetectorType::Barrel1B: return "DetectorType::Barrel1B";
+		case DetectorType::Barrel2A: return "DetectorType::Barrel2A";
+		case DetectorType::Barrel2B: return "DetectorType::Barrel2B";
+		case DetectorType::None: return "DetectorType::None";
+	}
+	return "DetectorType::None";
+}
+
+static const char* GetEnumName(DetectorComponent component)
+{
+	switch(component)
+	{
+		case DetectorComponent::Ring: return "DetectorComponent::Ring";
+		case DetectorComponent::Wedge: return "DetectorComponent::Wedge";
+		case DetectorComponent::Front: return "DetectorComponent::Front";
+		case DetectorComponent::Back: return "DetectorComponent::Back";
+		case DetectorComponent::None: return "DetectorComponent::None";
+	}
+	return "DetectorComponent::None";
+}
+
+static const char* GetEnumName(DetectorDirection direction)
+{
+	switch(direction)
+	{
+		case DetectorDirection::Up: return "DetectorDirection::Up";
+		case DetectorDirection::Down: return "DetectorDirection::Down";
+		case DetectorDirection::None: return "DetectorDirection::None";
+	}
+	return "DetectorDirection::None";
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 3)
+	{
+		std::cerr<<"Incorrect number of arguments at ChannelTableGenerator!"<<std::endl;
+		std::cerr<<"./bin/channeltablegen <channel map file> <output header>"<<std::endl;
+		return 1;
+	}
+	std::string mapname = argv[1];
+
+	ChannelMap cmap(mapname);
+	if(!cmap.IsValid())
+	{
+		std::cerr<<"Unable to read channel map "<<mapname<<" at ChannelTableGenerator! Exiting."<<std::endl;
+		return 1;
+	}
+
+	std::ofstream output(argv[2]);
+	if(!output.is_open())
+	{
+		std::cerr<<"Unable to open output header "<<argv[2]<<" at ChannelTableGenerator! Exiting."<<std::endl;
+		return 1;
+	}
+
+	//Number of detectors of each kind, as the largest detector index used
+	int nbarrel1=0, nbarrel2=0, nfqqq=0, nbqqq=0, nmapped=0;
+	for(int i=0; i<DetectorGeometry::nchannels; i++)
+	{
+		const ChannelData* data = cmap.GetChannelData(i);
+		if(data == nullptr)
+			continue;
+		nmapped++;
+		if(data->detectorType == DetectorType::Barrel1A || data->detectorType == DetectorType::Barrel1B)
+			nbarrel1 = std::max(nbarrel1, data->detectorIndex + 1);
+		else if(data->detectorType == DetectorType::Barrel2A || data->detectorType == DetectorType::Barrel2B)
+			nbarrel2 = std::max(nbarrel2, data->detectorIndex + 1);
+		else if(data->detectorType == DetectorType::FQQQ)
+			nfqqq = std::max(nfqqq, data->detectorIndex + 1);
+		else if(data->detectorType == DetectorType::BQQQ)
+			nbqqq = std::max(nbqqq, data->detectorIndex + 1);
+	}
+	if(cmap.GetChannelData(DetectorGeometry::nchannels) != nullptr)
+		std::cerr<<"Channel map "<<mapname<<" has channels beyond "<<DetectorGeometry::nchannels<<" which are not compiled!"<<std::endl;
+
+	output<<"/*"<<std::endl;
+	output<<"\tCompiledChannelMap"<<std::endl;
+	output<<"\tGenerated by ChannelTableGenerator from "<<mapname<<". Do not edit; changes to the map file are picked up by make."<<std::endl;
+	output<<"*/"<<std::endl;
+	output<<"#ifndef COMPILEDCHANNELMAP_H"<<std::endl;
+	output<<"#define COMPILEDCHANNELMAP_H"<<std::endl<<std::endl;
+	output<<"#include \"ChannelMap.h\""<<std::endl;
+	output<<"#include \"DetectorGeometry.h\""<<std::endl<<std::endl;
+	output<<"namespace CompiledChannelMap"<<std::endl<<"{"<<std::endl;
+	output<<"\tconstexpr const char* source = \""<<mapname<<"\";"<<std::endl;
+	output<<"\tconstexpr uint64_t checksum = 0x"<<std::hex<<ChannelMap::ComputeChecksum(mapname)<<std::dec<<"ULL;"<<std::endl;
+	output<<"\tconstexpr int nchannels = "<<DetectorGeometry::nchannels<<";"<<std::endl;
+	output<<"\tconstexpr int nmapped = "<<nmapped<<";"<<std::endl;
+	output<<"\tconstexpr int nbarrel1 = "<<nbarrel1<<";"<<std::endl;
+	output<<"\tconstexpr int nbarrel2 = "<<nbarrel2<<";"<<std::endl;
+	output<<"\tconstexpr int nfqqq = "<<nfqqq<<";"<<std::endl;
+	output<<"\tconstexpr int nbqqq = "<<nbqqq<<";"<<std::endl<<std::endl;
+	output<<"\tconstexpr ChannelData channels[nchannels] = {"<<std::endl;
+	for(int i=0; i<DetectorGeometry::nchannels; i++)
+	{
+		const ChannelData* data = cmap.GetChannelData(i);
+		ChannelData blank;
+		if(data == nullptr)
+			data = &blank;
+		output<<"\t\tChannelData("<<GetEnumName(data->detectorType)<<", "<<(int)data->detectorID<<", "<<GetEnumName(data->detectorComponent)<<", ";
+		output<<GetEnumName(data->detectorDirection)<<", "<<(int)data->detectorIndex<<", "<<data->channel<<")";
+		output<<(i == DetectorGeometry::nchannels-1 ? "" : ",")<<" //"<<i<<std::endl;
+	}
+	output<<"\t};"<<std::endl;
+	output<<"}"<<std::endl<<std::endl;
+	output<<"static_assert(CompiledChannelMap::nbarrel1 <= DetectorGeometry::nsx3_per_barrel, \"Channel map has more barrel 1 SX3s than AnasenEvent\");"<<std::endl;
+	output<<"static_assert(CompiledChannelMap::nbarrel2 <= DetectorGeometry::nsx3_per_barrel, \"Channel map has more barrel 2 SX3s than AnasenEvent\");"<<std::endl;
+	output<<"static_assert(CompiledChannelMap::nfqqq <= DetectorGeometry::nqqq_per_end, \"Channel map has more forward QQQs than AnasenEvent\");"<<std::endl;
+	output<<"static_assert(CompiledChannelMap::nbqqq <= DetectorGeometry::nqqq_per_end, \"Channel map has more backward QQQs than AnasenEvent\");"<<std::endl<<std::endl;
+	output<<"#endif"<<std::endl;
+	output.close();
+
+	std::cout<<"Compiled "<<nmapped<<" channels from "<<mapname<<" into "<<argv[2]<<std::endl;
+	return 0;
+}
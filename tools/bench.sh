@@ -0,0 +1,195 @@
+#!/bin/bash
+#
+#	bench.sh
+#	End-to-end benchmark of the calibration chain on synthetic data (see SyntheticGenerator), run by make bench. For each size
+#	(events per synthetic run) the data is generated once: one pulser run and two alpha runs. Then every stage, from
+#	organize-data to apply-calibrations, is run with each thread count. Each stage records:
+#		wall_s: wall time of the program (from its "Wall time" line)
+#		events_per_s: entries handled by every event loop of the stage (the done lines of ProgressMode log), per second of wall time
+#		peak_rss_mb: peak resident memory of the program
+#		output_mb: size of the files the stage writes
+#	The results are written to results.tsv in the work directory, then compared with the baseline. A stage regresses if it
+#	is slower, uses more memory, or writes more than the baseline by more than the tolerance. Timings are only compared when
+#	the baseline stage takes at least BENCH_MIN_TIME seconds, as shorter ones are mostly noise. The script fails if any stage
+#	failed or regressed. With --baseline, the results replace the baseline instead (make bench-baseline).
+#
+#	Each chain is also checked against the true calibration (--validate-synthetic), and the check is printed with the
+#	results.
+#
+#	Environment (all optional): BENCH_SIZES, BENCH_THREADS, BENCH_TOLERANCE (fractional), BENCH_MIN_TIME (s), BENCH_DIR (work
+#	directory), BENCH_BASELINE (baseline file), ANASENCAL (executable), CHANNELMAP (channel map file)
+#
+
+EXE=${ANASENCAL:-./bin/anasencal}
+SIZES=${BENCH_SIZES:-"20000 100000"}
+THREADS=${BENCH_THREADS:-"1 4"}
+TOLERANCE=${BENCH_TOLERANCE:-0.15}
+MIN_TIME=${BENCH_MIN_TIME:-1.0}
+WORKDIR=${BENCH_DIR:-results/bench}
+BASELINE=${BENCH_BASELINE:-etc/BenchBaseline.tsv}
+CHANNELMAP=${CHANNELMAP:-etc/AnasenChannelMap_fixedOrientation.txt}
+RESULTS=$WORKDIR/results.tsv
+STAGES="organize-data zero-offset gain-match-backs gain-match-updown gain-match-frontback calibrate-energy apply-calibrations"
+
+MAKE_BASELINE=0
+if [ "$1" == "--baseline" ]; then
+	MAKE_BASELINE=1
+elif [ -n "$1" ]; then
+	echo "Usage: tools/bench.sh [--baseline]"
+	exit 1
+fi
+
+if [ ! -x "$EXE" ]; then
+	echo "Unable to find the executable $EXE, run make first."
+	exit 1
+fi
+
+#Input file for one size and thread count; the required entries must stay in the order main reads them
+write_input() {
+	local sizedir=$1 rundir=$2 nthreads=$3 nevents=$4
+	cat > "$rundir/input.txt" <<EOF
+RawDataDirectory: $sizedir/raw/
+OrgainizedDataDirectory: $sizedir/organized/
+StartRun: 1 StopRun: 3
+PulserData: runs:1-1
+AlphaData: runs:2-3
+RunData: runs:2-3
+ZeroCalibrationHistogramFile: $rundir/zoffset.root
+ZeroCalibrationFile: $rundir/zoffset.txt
+BackGainMatchingHistogramFile: $rundir/backgains.root
+BackGainMatchingFile: $rundir/backgains.txt
+UpDownGainMatchingHistogramFile: $rundir/updowngains.root
+UpDownGainMatchingFile: $rundir/updowngains.txt
+FrontBackGainMatchingHistogramFile: $rundir/frontbackgains.root
+FrontBackGainMatchingFile: $rundir/frontbackgains.txt
+EnergyCalibrationHistogramFile: $rundir/ecal.root
+EnergyCalibrationFile: $rundir/ecal.txt
+ChannelMap: $CHANNELMAP
+CalibratedDataFile: $rundir/calibrated.root
+NThreads: $nthreads
+ProgressMode: log
+ProgressInterval: 60
+SyntheticEvents: $nevents
+SyntheticPulserRuns: 1
+SyntheticTruthPrefix: $sizedir/truth_
+TraceFile: $rundir/StageTrace.json
+PerfCounterFile: $rundir/PerfCounters.txt
+EOF
+}
+
+stage_outputs() {
+	local sizedir=$1 rundir=$2
+	case $3 in
+		organize-data) echo "$sizedir"/organized/run-*.root ;;
+		zero-offset) echo "$rundir/zoffset.root $rundir/zoffset.txt" ;;
+		gain-match-backs) echo "$rundir/backgains.root $rundir/backgains.txt" ;;
+		gain-match-updown) echo "$rundir/updowngains.root $rundir/updowngains.txt" ;;
+		gain-match-frontback) echo "$rundir/frontbackgains.root $rundir/frontbackgains.txt" ;;
+		calibrate-energy) echo "$rundir/ecal.root $rundir/ecal.txt" ;;
+		apply-calibrations) echo "$rundir/calibrated.root" ;;
+	esac
+}
+
+failed=0
+mkdir -p "$WORKDIR"
+printf "#stage\tsize\tthreads\twall_s\tevents_per_s\tpeak_rss_mb\toutput_mb\n" > "$RESULTS"
+checks=""
+
+for size in $SIZES; do
+	sizedir=$WORKDIR/$size
+	mkdir -p "$sizedir/raw" "$sizedir/organized"
+	first_threads=${THREADS%% *}
+	mkdir -p "$sizedir/t$first_threads"
+	write_input "$sizedir" "$sizedir/t$first_threads" "$first_threads" "$size"
+	echo "Generating synthetic data with $size events per run..."
+	if ! "$EXE" --generate-data "$sizedir/t$first_threads/input.txt" > "$sizedir/generate.log" 2>&1; then
+		echo "Unable to generate the synthetic data, see $sizedir/generate.log"
+		exit 1
+	fi
+
+	for nthreads in $THREADS; do
+		rundir=$sizedir/t$nthreads
+		mkdir -p "$rundir/logs"
+		write_input "$sizedir" "$rundir" "$nthreads" "$size"
+		for stage in $STAGES; do
+			log=$rundir/logs/$stage.log
+			echo "Running $stage with $size events per run and $nthreads thread(s)..."
+			#anasencal exits non-zero when the stage reports an error
+			if ! "$EXE" --$stage "$rundir/input.txt" > "$log" 2>&1; then
+				echo "Stage $stage failed, see $log"
+				printf "%s\t%s\t%s\tFAILED\tFAILED\tFAILED\tFAILED\n" "$stage" "$size" "$nthreads" >> "$RESULTS"
+				failed=1
+				continue
+			fi
+			output_bytes=0
+			for file in $(stage_outputs "$sizedir" "$rundir" "$stage"); do
+				[ -f "$file" ] && output_bytes=$((output_bytes + $(wc -c < "$file")))
+			done
+			awk -v stage="$stage" -v size="$size" -v nthreads="$nthreads" -v output_bytes="$output_bytes" '
+				/^Wall time: / { wall = $3; rss = $7 }
+				$1 == "progress" && / state=done / { for(i=2; i<=NF; i++) if($i ~ /^entries=/) { sub("entries=", "", $i); entries += $i } }
+				END { printf "%s\t%s\t%s\t%.3f\t%.1f\t%.1f\t%.3f\n", stage, size, nthreads, wall, (wall > 0 ? entries/wall : 0), rss, output_bytes/1.0e6 }
+			' "$log" >> "$RESULTS"
+		done
+		"$EXE" --validate-synthetic "$rundir/input.txt" > "$rundir/logs/validate.log" 2>&1
+		checks="$checks\n$size events, $nthreads thread(s):\n$(grep -E "^(Zero offsets|SX3|QQQ)" "$rundir/logs/validate.log")"
+	done
+done
+
+echo "------------------------Benchmark------------------------"
+column -t -s $'\t' "$RESULTS" 2>/dev/null || cat "$RESULTS"
+echo "------------------Synthetic Calibration------------------"
+echo -e "${checks#\\n}"
+echo "---------------------------------------------------------"
+
+if [ $MAKE_BASELINE -eq 1 ]; then
+	if [ $failed -ne 0 ]; then
+		echo "Not storing a baseline from a benchmark with failed stages."
+		exit 1
+	fi
+	cp "$RESULTS" "$BASELINE"
+	echo "Stored the results as the baseline in $BASELINE."
+	exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+	echo "No baseline in $BASELINE to compare with; run make bench-baseline to store one."
+	exit $failed
+fi
+
+echo "Comparing with the baseline in $BASELINE (tolerance $TOLERANCE)..."
+awk -F '\t' -v tolerance="$TOLERANCE" -v min_time="$MIN_TIME" '
+	function check(name, value, base, higher_is_worse) {
+		if(base <= 0)
+			return
+		change = (value - base)/base
+		if((higher_is_worse && change > tolerance) || (!higher_is_worse && -change > tolerance)) {
+			printf "REGRESSION %s size %s threads %s: %s %.3f against %.3f (%+.1f%%)\n", $1, $2, $3, name, value, base, change*100.0
+			regressions++
+		}
+	}
+	/^#/ { next }
+	FNR == NR { wall[$1 FS $2 FS $3] = $4; rate[$1 FS $2 FS $3] = $5; rss[$1 FS $2 FS $3] = $6; output[$1 FS $2 FS $3] = $7; next }
+	{
+		key = $1 FS $2 FS $3
+		if($4 == "FAILED" || !(key in wall))
+			next
+		compared++
+		if(wall[key] >= min_time) {
+			check("wall_s", $4, wall[key], 1)
+			check("events_per_s", $5, rate[key], 0)
+		}
+		check("peak_rss_mb", $6, rss[key], 1)
+		check("output_mb", $7, output[key], 1)
+	}
+	END {
+		printf "Compared %d stage run(s), %d regression(s).\n", compared, regressions
+		exit (regressions > 0)
+	}
+' "$BASELINE" "$RESULTS"
+regressed=$?
+
+if [ $failed -ne 0 ] || [ $regressed -ne 0 ]; then
+	exit 1
+fi
+exit 0